@@ -153,6 +153,15 @@ bool c4db_compact(C4Database* database, C4Error *outError) noexcept {
 }
 
 
+bool c4db_pruneRevTrees(C4Database* database, uint64_t maxBytes, C4PruneProgress *outProgress,
+                        C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        database->pruneRevTrees(maxBytes, *outProgress);
+    });
+}
+
+
 bool c4db_rekey(C4Database* database, const C4EncryptionKey *newKey, C4Error *outError) noexcept {
     return tryCatch(outError, bind(&Database::rekey, database, newKey));
 }
@@ -45,9 +45,10 @@ struct C4DocEnumerator: C4InstanceCounted {
     { }
 
     C4DocEnumerator(C4Database *database,
-                    const C4EnumeratorOptions &options)
+                    const C4EnumeratorOptions &options,
+                    slice startAfterDocID =nullslice)
     :_database(database),
-     _e(database->defaultKeyStore(), allDocOptions(options)),
+     _e(database->defaultKeyStore(), allDocOptions(options, startAfterDocID)),
      _options(options)
     { }
 
@@ -55,10 +56,13 @@ struct C4DocEnumerator: C4InstanceCounted {
         _e.close();
     }
 
-    static RecordEnumerator::Options allDocOptions(const C4EnumeratorOptions &c4options) {
+    static RecordEnumerator::Options allDocOptions(const C4EnumeratorOptions &c4options,
+                                                   slice startAfterDocID =nullslice) {
         RecordEnumerator::Options options;
         options.descending      = (c4options.flags & kC4Descending) != 0;
         options.includeDeleted  = (c4options.flags & kC4IncludeDeleted) != 0;
+        options.onlyConflicts   = (c4options.flags & kC4IncludeNonConflicted) == 0;
+        options.startAfter      = startAfterDocID;
         if ((c4options.flags & kC4IncludeBodies) == 0)
             options.contentOptions = kMetaOnly;
         return options;
@@ -151,6 +155,19 @@ C4DocEnumerator* c4db_enumerateAllDocs(C4Database *database,
 }
 
 
+C4DocEnumerator* c4db_enumerateConflicts(C4Database *database,
+                                         C4String startAfterDocID,
+                                         const C4EnumeratorOptions *c4options,
+                                         C4Error *outError) noexcept
+{
+    return tryCatch<C4DocEnumerator*>(outError, [&]{
+        C4EnumeratorOptions options = c4options ? *c4options : kC4DefaultEnumeratorOptions;
+        options.flags &= ~kC4IncludeNonConflicted;
+        return new C4DocEnumerator(database, options, startAfterDocID);
+    });
+}
+
+
 namespace c4Internal {
     void setEnumFilter(C4DocEnumerator *e, EnumFilter f) {
         e->setFilter(f);
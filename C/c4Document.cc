@@ -326,6 +326,29 @@ static alloc_slice createDocUUID() {
 }
 
 
+// Checks the parameters of a PutRequest.
+static bool checkPutRequest(const C4DocPutRequest *rq, C4Error *outError) {
+    if (rq->docID.buf && !Document::isValidDocID(rq->docID)) {
+        c4error_return(LiteCoreDomain, kC4ErrorBadDocID, C4STR("Invalid docID"), outError);
+        return false;
+    }
+    if (rq->existingRevision || rq->historyCount > 0)
+        if (!checkParam(rq->docID.buf, "Missing docID", outError))
+            return false;
+    if (rq->existingRevision) {
+        if (!checkParam(rq->historyCount > 0, "No history", outError))
+            return false;
+    } else {
+        if (!checkParam(rq->historyCount <= 1, "Too much history", outError))
+            return false;
+        if (!checkParam(rq->historyCount > 0 || !(rq->revFlags & kRevDeleted),
+                        "Can't create a new already-deleted document", outError))
+            return false;
+    }
+    return true;
+}
+
+
 // Is this a PutRequest that doesn't require a Record to exist already?
 static bool isNewDocPutRequest(C4Database *database, const C4DocPutRequest *rq) {
     if (rq->existingRevision)
@@ -356,6 +379,35 @@ static Document* putNewDoc(C4Database *database, const C4DocPutRequest *rq)
 }
 
 
+// Selects the existing parent revision of a Put of a _new_ revision. Returns 0 on success,
+// else a LiteCore error code.
+static int selectParentForPut(Document *idoc,
+                              C4Slice parentRevID,
+                              bool deleting,
+                              bool allowConflict)
+{
+    if (parentRevID.buf) {
+        // Updating an existing revision; make sure it exists and is a leaf:
+        if (!idoc->exists())
+            return kC4ErrorNotFound;
+        else if (!idoc->selectRevision(parentRevID, false))
+            return allowConflict ? kC4ErrorNotFound : kC4ErrorConflict;
+        else if (!allowConflict && !(idoc->selectedRev.flags & kRevLeaf))
+            return kC4ErrorConflict;
+    } else {
+        // No parent revision given:
+        if (deleting) {
+            // Didn't specify a revision to delete: NotFound or a Conflict, depending
+            return ((idoc->flags & kDocExists) ?kC4ErrorConflict :kC4ErrorNotFound);
+        } else if ((idoc->flags & kDocExists) && !(idoc->selectedRev.flags & kDocDeleted)) {
+            // If doc exists, current rev must be a deletion or there will be a conflict:
+            return kC4ErrorConflict;
+        }
+    }
+    return 0;
+}
+
+
 // Finds a document for a Put of a _new_ revision, and selects the existing parent revision.
 // After this succeeds, you can call c4doc_insertRevision and then c4doc_save.
 C4Document* c4doc_getForPut(C4Database *database,
@@ -376,27 +428,7 @@ C4Document* c4doc_getForPut(C4Database *database,
         }
 
         idoc = internal(database->documentFactory().newDocumentInstance(docID));
-        int code = 0;
-
-        if (parentRevID.buf) {
-            // Updating an existing revision; make sure it exists and is a leaf:
-            if (!idoc->exists())
-                code = kC4ErrorNotFound;
-            else if (!idoc->selectRevision(parentRevID, false))
-                code = allowConflict ? kC4ErrorNotFound : kC4ErrorConflict;
-            else if (!allowConflict && !(idoc->selectedRev.flags & kRevLeaf))
-                code = kC4ErrorConflict;
-        } else {
-            // No parent revision given:
-            if (deleting) {
-                // Didn't specify a revision to delete: NotFound or a Conflict, depending
-                code = ((idoc->flags & kDocExists) ?kC4ErrorConflict :kC4ErrorNotFound);
-            } else if ((idoc->flags & kDocExists) && !(idoc->selectedRev.flags & kDocDeleted)) {
-                // If doc exists, current rev must be a deletion or there will be a conflict:
-                code = kC4ErrorConflict;
-            }
-        }
-
+        int code = selectParentForPut(idoc, parentRevID, deleting, allowConflict);
         if (code)
             recordError(LiteCoreDomain, code, outError);
         else
@@ -415,23 +447,8 @@ C4Document* c4doc_put(C4Database *database,
 {
     if (!database->mustBeInTransaction(outError))
         return nullptr;
-    if (rq->docID.buf && !Document::isValidDocID(rq->docID)) {
-        c4error_return(LiteCoreDomain, kC4ErrorBadDocID, C4STR("Invalid docID"), outError);
+    if (!checkPutRequest(rq, outError))
         return nullptr;
-    }
-    if (rq->existingRevision || rq->historyCount > 0)
-        if (!checkParam(rq->docID.buf, "Missing docID", outError))
-            return nullptr;
-    if (rq->existingRevision) {
-        if (!checkParam(rq->historyCount > 0, "No history", outError))
-            return nullptr;
-    } else {
-        if (!checkParam(rq->historyCount <= 1, "Too much history", outError))
-            return nullptr;
-        if (!checkParam(rq->historyCount > 0 || !(rq->revFlags & kRevDeleted),
-                        "Can't create a new already-deleted document", outError))
-            return nullptr;
-    }
 
     int commonAncestorIndex = 0;
     C4Document *doc = nullptr;
@@ -478,6 +495,148 @@ C4Document* c4doc_put(C4Database *database,
 }
 
 
+// Implementation of c4doc_putMany. Errors of individual requests are stored in outErrors, but
+// other exceptions (such as running out of memory) are thrown.
+static size_t putMany(C4Database *database,
+                      const C4DocPutRequest requests[],
+                      size_t count,
+                      C4Error outErrors[])
+{
+    C4Error error = {};
+    if (!database->mustBeInTransaction(&error)) {
+        fill_n(outErrors, count, error);
+        return 0;
+    }
+
+    // Check the requests, and gather the docIDs to read. If a docID appears more than once, the
+    // requests after the first are deferred till the end, since each one has to see the
+    // revision saved by the one before it.
+    vector<C4DocPutRequest> batch, deferred;
+    vector<C4Error*> batchErrors, deferredErrors;
+    vector<Record> records;
+    unordered_set<slice, fleece::sliceHash> docIDs;
+    batch.reserve(count);
+    records.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!checkPutRequest(&requests[i], &outErrors[i]))
+            continue;
+        C4DocPutRequest rq = requests[i];
+        rq.save = true;         // (no docs are returned, so they must be saved; see c4Document.h)
+        if (rq.docID.buf && !docIDs.insert(rq.docID).second) {
+            deferred.push_back(rq);
+            deferredErrors.push_back(&outErrors[i]);
+        } else {
+            batch.push_back(rq);
+            batchErrors.push_back(&outErrors[i]);
+            if (rq.docID.buf)
+                records.emplace_back(rq.docID);
+        }
+    }
+
+    size_t nSaved = 0;
+    auto &factory = database->documentFactory();
+    try {
+        database->defaultKeyStore().readMany(records);
+    } catchError(&error)
+    if (error.code) {
+        for (auto outError : batchErrors)
+            *outError = error;
+        batch.clear();
+    }
+
+    // Insert the existing revisions, and select the parents of the new ones:
+    vector<unique_ptr<Document>> docs;
+    vector<Document*> newRevDocs;
+    vector<const C4DocPutRequest*> newRevRequests;
+    vector<C4Error*> newRevErrors;
+    docs.reserve(batch.size());
+    auto record = records.begin();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const C4DocPutRequest &rq = batch[i];
+        try {
+            unique_ptr<Document> doc;
+            if (rq.docID.buf) {
+                doc.reset(internal(factory.newDocumentInstance(*record++)));
+            } else {
+                Record newRecord(createDocUUID());
+                doc.reset(internal(factory.newDocumentInstance(newRecord)));
+            }
+            database->validateRevisionBody(rq.body);
+
+            int code;
+            if (rq.existingRevision) {
+                code = (doc->putExistingRevision(rq) >= 0) ? 0 : kC4ErrorConflict;
+                if (!code)
+                    ++nSaved;
+            } else {
+                C4Slice parentRevID = (rq.historyCount == 1) ? rq.history[0] : kC4SliceNull;
+                code = selectParentForPut(doc.get(), parentRevID,
+                                          (rq.revFlags & kRevDeleted) != 0, rq.allowConflict);
+                if (!code) {
+                    newRevDocs.push_back(doc.get());
+                    newRevRequests.push_back(&rq);
+                    newRevErrors.push_back(batchErrors[i]);
+                }
+            }
+            if (code)
+                recordError(LiteCoreDomain, code, batchErrors[i]);
+            docs.push_back(move(doc));
+        } catchError(batchErrors[i])
+    }
+
+    // Now generate all the new revIDs at once, and insert the new revisions. (If the factory
+    // can't do that, putNewRevision generates each revID itself.)
+    vector<alloc_slice> revIDs;
+    try {
+        revIDs = factory.generateRevIDs(newRevDocs.data(), newRevRequests.data(),
+                                        newRevDocs.size());
+    } catchExceptions()
+    for (size_t i = 0; i < newRevDocs.size(); ++i) {
+        try {
+            bool ok;
+            if (revIDs.empty())
+                ok = newRevDocs[i]->putNewRevision(*newRevRequests[i]);
+            else
+                ok = newRevDocs[i]->putNewRevision(*newRevRequests[i], revIDs[i]);
+            if (ok)
+                ++nSaved;
+            else
+                recordError(LiteCoreDomain, kC4ErrorConflict, newRevErrors[i]);
+        } catchError(newRevErrors[i])
+    }
+    docs.clear();
+
+    // Finally the deferred requests, which have to be done one at a time:
+    for (size_t i = 0; i < deferred.size(); ++i) {
+        C4Document *doc = c4doc_put(database, &deferred[i], nullptr, deferredErrors[i]);
+        if (doc) {
+            c4doc_free(doc);
+            ++nSaved;
+        }
+    }
+    return nSaved;
+}
+
+
+size_t c4doc_putMany(C4Database *database,
+                     const C4DocPutRequest requests[],
+                     size_t count,
+                     C4Error outErrors[]) noexcept
+{
+    fill_n(outErrors, count, C4Error{});
+    C4Error error;
+    try {
+        return putMany(database, requests, count, outErrors);
+    } catchError(&error)
+    // The batch was cut short, so any request without an error of its own gets this one:
+    for (size_t i = 0; i < count; ++i) {
+        if (!outErrors[i].code)
+            outErrors[i] = error;
+    }
+    return 0;
+}
+
+
 C4Document* c4doc_create(C4Database *db,
                          C4String docID,
                          C4Slice revBody,
@@ -22,6 +22,7 @@
 #include "Database.hh"
 #include "DataFile.hh"
 #include "Query.hh"
+#include "IndexAdvisor.hh"
 #include "Record.hh"
 #include <math.h>
 #include <limits.h>
@@ -33,7 +34,13 @@ using namespace litecore;
 
 
 CBL_CORE_API const C4QueryOptions kC4DefaultQueryOptions = {
-    true
+    true,
+    false,
+    0,
+    0,
+    0,
+    0,
+    false
 };
 
 
@@ -127,6 +134,21 @@ private:
 static C4QueryEnumeratorImpl* internal(C4QueryEnumerator *e) {return (C4QueryEnumeratorImpl*)e;}
 
 
+static Query::Options queryOptions(const C4QueryOptions *c4options, C4Slice encodedParameters) {
+    Query::Options options;
+    options.paramBindings = encodedParameters;
+    if (c4options) {
+        options.paramBindingsAreFleece = c4options->fleeceParameters;
+        options.timeLimitMS = c4options->timeLimitMS;
+        options.stepLimit = c4options->stepLimit;
+        options.parallelism = c4options->parallelism;
+        options.maxRecordingBytes = c4options->maxRecordingBytes;
+        options.spillToDisk = c4options->spillToDisk;
+    }
+    return options;
+}
+
+
 #pragma mark - QUERY:
 
 
@@ -156,13 +178,71 @@ C4QueryEnumerator* c4query_run(C4Query *query,
                                C4Error *outError) noexcept
 {
     return tryCatch<C4QueryEnumerator*>(outError, [&]{
-        Query::Options options;
-        options.paramBindings = encodedParameters;
+        Query::Options options = queryOptions(c4options, encodedParameters);
         return new C4QueryEnumeratorImpl(query, &options);
     });
 }
 
 
+bool c4query_runBatch(C4Query* const queries[],
+                      const C4String encodedParameters[],
+                      size_t count,
+                      const C4QueryOptions *c4options,
+                      C4QueryEnumerator* outEnumerators[],
+                      C4Error *outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        vector<Query*> batch;
+        vector<Query::Options> options;
+        for (size_t i = 0; i < count; ++i) {
+            if (queries[i]->database() != queries[0]->database())
+                error::_throw(error::InvalidParameter,
+                              "Batched queries must be on the same database");
+            batch.push_back(queries[i]->query());
+            options.push_back(queryOptions(c4options, (encodedParameters ? encodedParameters[i]
+                                                                         : kC4SliceNull)));
+        }
+        auto enums = Query::createEnumerators(batch, options,
+                                              (c4options ? c4options->parallelism : 0));
+        vector<unique_ptr<C4QueryEnumeratorImpl>> results;
+        for (size_t i = 0; i < count; ++i)
+            results.emplace_back(new C4QueryEnumeratorImpl(queries[i]->database(),
+                                                           enums[i].release()));
+        for (size_t i = 0; i < count; ++i)
+            outEnumerators[i] = results[i].release();
+    });
+}
+
+
+C4StringResult c4query_profile(C4Query *query,
+                               const C4QueryOptions *c4options,
+                               C4Slice encodedParameters,
+                               C4Error *outError) noexcept
+{
+    return tryCatch<C4StringResult>(outError, [&]{
+        Query::Options options = queryOptions(c4options, encodedParameters);
+        return sliceResult(query->query()->profile(&options));
+    });
+}
+
+
+void c4query_cancel(C4Query *query) noexcept {
+    query->query()->cancel();
+}
+
+
+void c4query_setRecordingMemoryLimit(uint64_t maxBytes) noexcept {
+    Query::setRecordingMemoryLimit(maxBytes);
+}
+
+
+C4QueryRecordingStats c4query_getRecordingStats() noexcept {
+    auto stats = Query::recordingStats();
+    return {stats.bytesInMemory, stats.peakBytesInMemory, stats.largestRecording,
+            stats.bytesSpilled};
+}
+
+
 
 C4StringResult c4query_explain(C4Query *query) noexcept {
     return tryCatch<C4StringResult>(nullptr, [&]{
@@ -278,3 +358,45 @@ C4SliceResult c4db_getIndexes(C4Database* database, C4Error* outError) noexcept
         return sliceResult(database->defaultKeyStore().getIndexes());
     });
 }
+
+
+bool c4db_setIndexAdvisor(C4Database* database,
+                          const C4IndexAdvisorOptions *options,
+                          C4Error* outError) noexcept
+{
+    return tryCatch(outError, [&]{
+        shared_ptr<IndexAdvisor> advisor;
+        if (options) {
+            IndexAdvisor::Options advisorOptions;
+            advisorOptions.autoCreate = options->autoCreate;
+            advisorOptions.maxAutoIndexes = options->maxAutoIndexes;
+            advisorOptions.maxAutoIndexBytes = options->maxAutoIndexBytes;
+            advisorOptions.minRuns = options->minRuns;
+            advisorOptions.minTotalMS = options->minTotalMS;
+            advisor = make_shared<IndexAdvisor>(advisorOptions);
+        }
+        database->defaultKeyStore().setIndexAdvisor(advisor);
+    });
+}
+
+C4SliceResult c4db_getIndexAdvice(C4Database* database, C4Error* outError) noexcept
+{
+    return tryCatch<C4SliceResult>(outError, [&]{
+        vector<IndexAdvisor::Recommendation> recs;
+        auto advisor = database->defaultKeyStore().indexAdvisor();
+        if (advisor)
+            recs = advisor->recommendations();
+        return sliceResult(IndexAdvisor::encodeRecommendations(recs));
+    });
+}
+
+int64_t c4db_createAdvisedIndexes(C4Database* database, C4Error* outError) noexcept
+{
+    if (!database->mustNotBeInTransaction(outError))
+        return -1;
+    int64_t created = -1;
+    tryCatch(outError, [&]{
+        created = database->defaultKeyStore().createAdvisedIndexes();
+    });
+    return created;
+}
@@ -164,6 +164,8 @@ typedef C4_ENUM(int32_t, C4ErrorCode) {
     kC4ErrorDatabaseTooNew,         // Database file format is newer than what I can open
     kC4ErrorBadDocID,               // Invalid document ID
     kC4ErrorCantUpgradeDatabase,    // Database can't be upgraded (might be unsupported dev version)
+    kC4ErrorQueryInterrupted, /*40*/ // Query was cancelled, or exceeded its time/step limit
+    kC4ErrorQueryResultTooLarge,    // Query results exceeded the memory limit
 
     kC4NumErrorCodesPlus1
 };
@@ -196,6 +196,36 @@ extern "C" {
     bool c4db_compact(C4Database* database C4NONNULL, C4Error *outError) C4API;
 
 
+    /** Progress of a rev-tree pruning job, as returned by c4db_pruneRevTrees. */
+    typedef struct {
+        C4SequenceNumber lastSequence;  ///< The job has checked the docs up to this sequence
+        C4SequenceNumber endSequence;   ///< The job will stop after this sequence
+        uint64_t docsChecked;           ///< Number of docs checked by this call
+        uint64_t docsPruned;            ///< Number of those docs that were pruned
+        bool complete;                  ///< True if the job has finished
+    } C4PruneProgress;
+
+    /** Prunes the revision trees of existing documents to the current max depth, and removes
+        the bodies of revisions that are no longer leaves. Normally this only happens when a
+        document is saved, so documents that aren't updated keep all their old revisions, for
+        instance after c4db_setMaxRevTreeDepth lowers the depth. Documents don't get new sequences.
+
+        Each call checks documents in sequence order, in one transaction, until about `maxBytes`
+        of them have been read, then saves its position; the next call resumes from there, even
+        after the database is reopened. To run the job in the background, call this repeatedly
+        on a background thread, sleeping between calls to limit its I/O, until
+        `outProgress->complete` is true. Lowering the max depth restarts the job.
+        @param database  The database. Must not be in a transaction.
+        @param maxBytes  The approximate number of bytes of documents to check, or 0 for a default.
+        @param outProgress  The job's progress is stored here.
+        @param outError  On failure, error info will be stored here.
+        @return  True on success, false on failure. */
+    bool c4db_pruneRevTrees(C4Database* database C4NONNULL,
+                            uint64_t maxBytes,
+                            C4PruneProgress *outProgress C4NONNULL,
+                            C4Error *outError) C4API;
+
+
     /** @} */
     /** \name Transactions
         @{ */
@@ -99,6 +99,23 @@ extern "C" {
                                            const C4EnumeratorOptions *options,
                                            C4Error *outError) C4API;
 
+    /** Creates an enumerator over only the documents that are in conflict, ordered by docID.
+        This uses an index, so it's much faster than enumerating all documents and checking their
+        flags. To page through the results, stop after as many documents as you want, then pass
+        the last docID you got as `startAfterDocID` to get the next page.
+        The kC4IncludeNonConflicted flag in the options is ignored.
+        Caller is responsible for freeing the enumerator when finished with it.
+        @param database  The database.
+        @param startAfterDocID  The enumeration starts after this docID (or before it, if
+                        descending.) Pass kC4SliceNull to start from the beginning.
+        @param options  Enumeration options (NULL for defaults).
+        @param outError  Error will be stored here on failure.
+        @return  A new enumerator, or NULL on failure. */
+    C4DocEnumerator* c4db_enumerateConflicts(C4Database *database C4NONNULL,
+                                             C4String startAfterDocID,
+                                             const C4EnumeratorOptions *options,
+                                             C4Error *outError) C4API;
+
     /** Advances the enumerator to the next document.
         Returns false at the end, or on error; look at the C4Error to determine which occurred,
         and don't forget to free the enumerator. */
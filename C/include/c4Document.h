@@ -93,7 +93,8 @@ extern "C" {
 
     /** Saves changes to a C4Document.
         Must be called within a transaction.
-        The revision history will be pruned to the maximum depth given. */
+        The revision history will be pruned to the maximum depth given.
+        Fails with kC4ErrorConflict if the document has been changed since it was read. */
     bool c4doc_save(C4Document *doc C4NONNULL,
                     uint32_t maxRevTreeDepth,
                     C4Error *outError) C4API;
@@ -280,6 +281,7 @@ extern "C" {
         const C4String *history;     ///< Array of ancestor revision IDs
         size_t historyCount;        ///< Size of history[] array
         bool save;                  ///< Save the document after inserting the revision?
+                                    ///< (c4doc_putMany ignores this and always saves.)
         uint32_t maxRevTreeDepth;   ///< Max depth of revision tree to save (or 0 for default)
         C4RemoteID remoteDBID;      ///< Identifier of remote db this rev's from (or 0 if local)
     } C4DocPutRequest;
@@ -298,6 +300,25 @@ extern "C" {
                           size_t *outCommonAncestorIndex,
                           C4Error *outError) C4API;
 
+    /** Performs a batch of Put operations, which is faster than calling c4doc_put on each:
+        the existing documents are read from the database all at once, and the IDs of the new
+        revisions are generated together. Must be called within a transaction.
+        Every revision is saved, since no documents are returned for the caller to save: the
+        requests' `save` flags are ignored, as if they were all true. A request's failure
+        doesn't prevent the others from being saved.
+        @param database  The database to put the revisions into.
+        @param requests  The Put requests, as for c4doc_put.
+        @param count  The number of requests.
+        @param outErrors  An array of `count` errors; each one is set to the result of its
+                    request, with a `code` of 0 if it succeeded.
+        @return  The number of requests that succeeded. If the batch as a whole fails (e.g. out
+                    of memory), returns 0 and gives every request without an error of its own
+                    that error; some of them may have been saved, so abort the transaction. */
+    size_t c4doc_putMany(C4Database *database C4NONNULL,
+                         const C4DocPutRequest requests[] C4NONNULL,
+                         size_t count,
+                         C4Error outErrors[] C4NONNULL) C4API;
+
     /** Convenience function to create a new document. This just a wrapper around c4doc_put.
         If the document already exists, it will fail with the error kC4ErrorConflict.
         @param db  The database to create the document in
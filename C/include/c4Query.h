@@ -70,6 +70,12 @@ extern "C" {
     /** Options for running queries. */
     typedef struct {
         bool rankFullText;      ///< Should full-text results be ranked by relevance?
+        bool fleeceParameters;  ///< Are `encodedParameters` Fleece instead of JSON?
+        uint32_t timeLimitMS;   ///< Max time the query may run, in milliseconds (0 = no limit)
+        uint64_t stepLimit;     ///< Max number of SQLite VM steps the query may run (0 = no limit)
+        uint32_t parallelism;   ///< Max threads scanning for an aggregate query (0 or 1 = serial)
+        uint64_t maxRecordingBytes; ///< Max bytes of results kept in memory (0 = no limit)
+        bool spillToDisk;       ///< Write results past the memory limit to a temporary file?
     } C4QueryOptions;
 
 
@@ -116,13 +122,81 @@ extern "C" {
         @param encodedParameters  Optional JSON object whose keys correspond to the named
                 parameters in the query expression, and values correspond to the values to
                 bind. Any unbound parameters will be `null`.
-        @param outError  On failure, will be set to the error status.
+                If `options->fleeceParameters` is true, this is instead a Fleece-encoded dict
+                (encoded without shared keys), which is faster since it can be bound directly.
+        @param outError  On failure, will be set to the error status. If the query was cancelled
+                by `c4query_cancel`, or exceeded the `timeLimitMS` or `stepLimit` in the options,
+                the error is kC4ErrorQueryInterrupted.
         @return  An enumerator for reading the rows, or NULL on error. */
     C4QueryEnumerator* c4query_run(C4Query *query C4NONNULL,
                                    const C4QueryOptions *options,
                                    C4String encodedParameters,
                                    C4Error *outError) C4API;
 
+    /** Runs several queries of the same database at once, in a single read transaction, so that
+        their results are consistent with each other; for instance, all the queries that
+        populate one screen of an app. It's also faster than running them one at a time.
+        If `options->parallelism` is greater than 1, up to that many of the queries run
+        concurrently, each on its own connection to the database file.
+        @param queries  The compiled queries to run.
+        @param encodedParameters  The parameters of each query, as for `c4query_run`; or NULL
+                if none of the queries have parameters.
+        @param count  The number of queries.
+        @param options  Query options, as for `c4query_run`, applied to every query.
+        @param outEnumerators  An array of `count` pointers, in which the queries' enumerators
+                are stored, in the same order as `queries`. Each must be freed with
+                `c4queryenum_free`.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure (in which case no enumerators are returned.) */
+    bool c4query_runBatch(C4Query* const queries[] C4NONNULL,
+                          const C4String encodedParameters[],
+                          size_t count,
+                          const C4QueryOptions *options,
+                          C4QueryEnumerator* outEnumerators[] C4NONNULL,
+                          C4Error *outError) C4API;
+
+    /** Runs a query, discarding the results, and returns a report of how it executed, for
+        diagnosing slow queries. The report gives the number of rows and the time taken; the
+        number of SQLite VM steps, full-table-scan steps, sorts and automatic-index rows; the
+        number of loops and rows visited by each loop of the query plan; and the number of calls
+        to, and time spent in, each of LiteCore's SQL functions (including the `fl_each` table
+        and the `geo_radius` R*Tree callback) that the query used.
+        The format of the report is intended for humans and may change.
+        @param query  The compiled query to run.
+        @param options  Query options, as for `c4query_run`.
+        @param encodedParameters  Parameter values, as for `c4query_run`.
+        @param outError  On failure, will be set to the error status.
+        @return  The report, or a null slice on error. */
+    C4StringResult c4query_profile(C4Query *query C4NONNULL,
+                                   const C4QueryOptions *options,
+                                   C4String encodedParameters,
+                                   C4Error *outError) C4API;
+
+    /** Process-wide statistics of the memory used by query results. */
+    typedef struct {
+        uint64_t bytesInMemory;     ///< Bytes of results held in memory by open enumerators
+        uint64_t peakBytesInMemory; ///< Highest value of `bytesInMemory` so far
+        uint64_t largestRecording;  ///< Size of the largest single query result so far
+        uint64_t bytesSpilled;      ///< Total bytes of results written to temporary files
+    } C4QueryRecordingStats;
+
+    /** Sets the maximum number of bytes that the results of all open query enumerators may
+        occupy in memory (0 = no limit, the default.) A query whose results would go past this
+        limit, or past its own `maxRecordingBytes` option, writes the rest of them to a
+        memory-mapped temporary file if its `spillToDisk` option is set, or else fails with
+        kC4ErrorQueryResultTooLarge. The temporary file isn't encrypted, so the results of an
+        encrypted database are never spilled. */
+    void c4query_setRecordingMemoryLimit(uint64_t maxBytes) C4API;
+
+    /** Returns statistics about the memory used by query results. */
+    C4QueryRecordingStats c4query_getRecordingStats(void) C4API;
+
+    /** Aborts any call to `c4query_run` on this query that's in progress on another thread,
+        causing it to fail with kC4ErrorQueryInterrupted. (The query stops within a few
+        thousand SQLite VM steps.) Calls to `c4query_run` made after this returns are not
+        affected. This function is thread-safe, and does not lock the database. */
+    void c4query_cancel(C4Query *query C4NONNULL) C4API;
+
     /** Given a C4FullTextMatch from the enumerator, returns the entire text of the property that
         was matched. (The result depends only on the term's `dataSource` and `property` fields,
         so if you get multiple matches of the same property in the same document, you can skip
@@ -182,7 +256,10 @@ extern "C" {
     typedef C4_ENUM(uint32_t, C4IndexType) {
         kC4ValueIndex,         ///< Regular index of property value
         kC4FullTextIndex,      ///< Full-text index
-        kC4GeoIndex,           ///< Geospatial index of GeoJSON values (NOT YET IMPLEMENTED)
+        kC4GeoIndex,           ///< Geospatial index of GeoJSON values
+        kC4ArrayIndex,         ///< Index of the items of an array property
+        kC4AggregateIndex,     ///< Materialized grouped aggregates (count/sum/avg/min/max)
+        kC4TrigramIndex,       ///< Index of substrings, for LIKE/contains()/regexp_*()
     };
 
 
@@ -218,6 +295,33 @@ extern "C" {
             To provide a custom list of words, use a string containing the words in lowercase
             separated by spaces. */
         const char *stopWords;
+
+        /** A JSON expression, in the same syntax as a query's `WHERE` clause, that limits which
+            documents are indexed. Documents for which it's false (and deleted documents) are
+            left out of the index, making it smaller and cheaper to update. A query can only use
+            such a "partial" index if its own `WHERE` clause contains every term of this one.
+            Only value indexes support this; if NULL, all documents are indexed. */
+        const char *where;
+
+        /** Full-text indexes only: build the index with SQLite's FTS5 engine instead of FTS4.
+            FTS5 indexes are smaller and faster to query, and `rank()` uses its native BM25
+            ranking. Setting this when re-creating an existing FTS4 index migrates it to FTS5.
+            Note that FTS5's search syntax is stricter: words may contain only letters, digits
+            and underscores unless quoted, so a column filter on a property path has to be written
+            as `"contact.address.street": Santa`. */
+        bool useFTS5;
+
+        /** Value indexes only: index expressions that use a Unicode-aware `COLLATE` store the
+            collation's binary sort keys instead of the values. A query whose `ORDER_BY` has the
+            same collated expression then sorts by comparing raw bytes, instead of calling the
+            collator for every comparison. Strings still sort in the same place relative to other
+            types (after numbers, before arrays, dictionaries and JSON null.)
+            Sort keys are available where LiteCore uses ICU (Linux and Android) and on Windows;
+            on Apple platforms creating the index fails with kC4ErrorUnsupported, and a database
+            containing such an index can't be updated there. Sort keys can change between
+            versions of the platform's collator, so when a database is opened after such a
+            change (as after an OS upgrade), its sort-key indexes are rebuilt. */
+        bool unicodeSortKeys;
     } C4IndexOptions;
 
 
@@ -225,7 +329,7 @@ extern "C" {
         The name is used to identify the index for later updating or deletion; if an index with the
         same name already exists, it will be replaced unless it has the exact same expressions.
 
-        Currently two types of indexes are supported:
+        Currently six types of indexes are supported:
 
         * Value indexes speed up queries by making it possible to look up property (or expression)
           values without scanning every document. They're just like regular indexes in SQL or N1QL.
@@ -236,16 +340,41 @@ extern "C" {
           search: a query with a `MATCH` operator will fail to compile unless there is already a
           FTS index for the property/expression being matched. Only a single expression is
           currently allowed, and it must evaluate to a string.
+        * Array indexes index each item of an array property, which speeds up queries of the form
+          `ANY x IN array SATISFIES x = value`. Only a single expression is allowed, and it must
+          be a property.
+        * Geospatial indexes index the bounding box of a GeoJSON value (a geometry, a Feature, or
+          any object with a `bbox`), enabling the query operators
+          `["GEO_WITHIN", indexName, west, south, east, north]` and
+          `["GEO_NEAR", indexName, longitude, latitude, meters]`. A geo index is **required** for
+          these operators. Only a single expression is allowed. Coordinates are indexed with
+          single-precision, so matches within a meter or so of the search boundary may vary.
+        * Aggregate indexes are materialized views that keep grouped aggregates up to date as
+          documents change. The expressions are the grouping keys, plus calls of the aggregate
+          functions `count()`, `sum()`, `avg()`, `min()` or `max()`, e.g.
+          `[[".type"], ["count()"], ["sum()", [".amount"]]]`. An aggregate query (or
+          `DISTINCT` query) whose grouping keys, aggregates and WHERE clause only use those
+          expressions is answered from the index, in time proportional to the number of groups
+          rather than of documents. Sums of floating-point values are maintained incrementally,
+          so they may differ from a full recomputation by rounding error.
+        * Trigram indexes index the three-byte substrings of a string property, which speeds up
+          substring searches: `LIKE` with a literal pattern (even one starting with `%`), and
+          `contains()`, `regexp_contains()` or `regexp_like()` with a literal second argument.
+          Only literal fragments of at least three bytes can use the index, and only in a WHERE
+          clause or a top-level AND in it. Only a single expression is allowed, and it must be a
+          property.
 
         Note: If the value of an expression in some document is missing or an unsupported type,
         that document will just be omitted from the index. It's not an error.
 
+        A value index can be restricted to a subset of documents by setting the `where` option;
+        see C4IndexOptions.
+
         Expressions are defined in JSON, as in a query, and wrapped in a JSON array. For example,
         `[[".name.first"]]` will index on the first-name property. Note the two levels of brackets,
         since an expression is already an array.
 
-        Currently, full-text indexes are limited to a single expression only.
-        Geospatial indexes are not implemented at all yet.
+        Currently, full-text and geospatial indexes are limited to a single expression only.
 
         @param database  The database to index.
         @param name  The name of the index. Any existing index with the same name will be replaced,
@@ -253,7 +382,7 @@ extern "C" {
         @param expressionsJSON  A JSON array of one or more expressions to index. Each expression
                      takes the same form as in a query, which means it's a JSON array as well;
                      don't get mixed up by the nesting!
-        @param indexType  The type of index (value or full-text.)
+        @param indexType  The type of index (value, full-text, geospatial or array.)
         @param indexOptions  Options for the index. If NULL, each option will get a default value.
         @param outError  On failure, will be set to the error status.
         @return  True on success, false on failure. */
@@ -280,6 +409,59 @@ extern "C" {
     C4SliceResult c4db_getIndexes(C4Database* database C4NONNULL,
                                   C4Error* outError) C4API;
 
+
+    /** Options for the index advisor; see `c4db_setIndexAdvisor`. */
+    typedef struct {
+        bool autoCreate;            ///< Let `c4db_createAdvisedIndexes` create indexes
+        unsigned maxAutoIndexes;    ///< Max number of automatically-created indexes
+        uint64_t maxAutoIndexBytes; ///< Max size of an automatic index (0 = no limit); a larger
+                                    ///< one is deleted right after it's created
+        unsigned minRuns;           ///< Runs of a query before its index is created (0 = 3)
+        unsigned minTotalMS;        ///< Total milliseconds of those runs before it's created
+    } C4IndexAdvisorOptions;
+
+    /** Starts or stops the index advisor, which watches the queries run on the database --
+        the properties they filter and sort on, and whether their plans have to scan every
+        document or sort the results -- and recommends value indexes for the most expensive ones.
+        Restarting it clears what it has recorded.
+
+        If `options->autoCreate` is true, `c4db_createAdvisedIndexes` creates the recommended
+        indexes whose queries have met the `minRuns` and `minTotalMS` thresholds. (Running a
+        query never creates an index.) Automatic indexes are named with an "advisor_" prefix,
+        and there are never more than `maxAutoIndexes` of them.
+        @param database  The database.
+        @param options  The advisor's options, or NULL to stop it.
+        @param outError  On failure, will be set to the error status.
+        @return  True on success, false on failure. */
+    bool c4db_setIndexAdvisor(C4Database* database C4NONNULL,
+                              const C4IndexAdvisorOptions *options,
+                              C4Error* outError) C4API;
+
+    /** Returns the index advisor's recommendations, most expensive first, as a Fleece-encoded
+        array of dictionaries with keys:
+        - "name": suggested index name
+        - "expressions": the index expressions, as JSON to pass to `c4db_createIndex`
+        - "runs": number of query runs that would have used the index
+        - "ms": total milliseconds taken by those runs
+        - "fullScan", "tempBTree": whether those queries scanned every document, or sorted the
+          results in a temporary table
+        - "autoCreated": whether the advisor has created the index
+        @param database  The database.
+        @param outError  On failure, will be set to the error status.
+        @return  A Fleece-encoded array (empty if the advisor isn't running), or NULL on failure. */
+    C4SliceResult c4db_getIndexAdvice(C4Database* database C4NONNULL,
+                                      C4Error* outError) C4API;
+
+    /** Creates the indexes the index advisor recommends, if its `autoCreate` option is set.
+        Building an index takes a while on a large database, so call this when the app can
+        afford to wait, such as at launch or when idle, and not while queries are latency-
+        sensitive. Must not be called within a transaction.
+        @param database  The database.
+        @param outError  On failure, will be set to the error status.
+        @return  The number of indexes created, or -1 on failure. */
+    int64_t c4db_createAdvisedIndexes(C4Database* database C4NONNULL,
+                                      C4Error* outError) C4API;
+
     /** @} */
 
 #ifdef __cplusplus
@@ -330,6 +330,88 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database AllDocsInfo", "[Database][C]")
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Conflicts", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+    setupAllDocs();
+    C4Error error;
+    char docID[20];
+
+    // Put every tenth doc in conflict:
+    for (int i = 10; i < 100; i += 10) {
+        sprintf(docID, "doc-%03d", i);
+        createRev(c4str(docID), kRev2ID, kBody);
+        TransactionHelper t(db);
+        C4Slice history[2] = {C4STR("2-cccccc"), kRevID};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.docID = c4str(docID);
+        rq.history = history;
+        rq.historyCount = 2;
+        rq.body = kBody;
+        rq.save = true;
+        auto doc = c4doc_put(db, &rq, nullptr, &error);
+        REQUIRE(doc);
+        CHECK((doc->flags & kDocConflicted) != 0);
+        c4doc_free(doc);
+    }
+
+    // Page through the conflicts, four at a time:
+    C4EnumeratorOptions options = kC4DefaultEnumeratorOptions;
+    options.flags &= ~kC4IncludeBodies;
+    std::string startAfter;
+    int i = 10, pages = 0;
+    for (;;) {
+        auto e = c4db_enumerateConflicts(db, c4str(startAfter.empty() ? nullptr
+                                                                       : startAfter.c_str()),
+                                         &options, &error);
+        REQUIRE(e);
+        int n;
+        for (n = 0; n < 4 && c4enum_next(e, &error); ++n) {
+            C4DocumentInfo info;
+            REQUIRE(c4enum_getDocumentInfo(e, &info));
+            sprintf(docID, "doc-%03d", i);
+            CHECK(info.docID == c4str(docID));
+            CHECK((info.flags & kDocConflicted) != 0);
+            startAfter = std::string((const char*)info.docID.buf, info.docID.size);
+            i += 10;
+        }
+        c4enum_free(e);
+        CHECK(error.code == 0);
+        if (n == 0)
+            break;
+        ++pages;
+    }
+    CHECK(i == 100);
+    CHECK(pages == 3);
+
+    // Descending, starting before a docID:
+    options.flags |= kC4Descending;
+    auto e = c4db_enumerateConflicts(db, C4STR("doc-050"), &options, &error);
+    REQUIRE(e);
+    i = 40;
+    while (c4enum_next(e, &error)) {
+        C4DocumentInfo info;
+        REQUIRE(c4enum_getDocumentInfo(e, &info));
+        sprintf(docID, "doc-%03d", i);
+        CHECK(info.docID == c4str(docID));
+        i -= 10;
+    }
+    c4enum_free(e);
+    CHECK(i == 0);
+
+    // All-docs enumeration without kC4IncludeNonConflicted finds the same docs:
+    options.flags &= ~(kC4Descending | kC4IncludeNonConflicted);
+    e = c4db_enumerateAllDocs(db, &options, &error);
+    REQUIRE(e);
+    int count = 0;
+    while (c4enum_next(e, &error))
+        ++count;
+    c4enum_free(e);
+    CHECK(count == 9);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Changes", "[Database][C]") {
     createNumberedDocs(99);
 
@@ -551,6 +633,75 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Compact", "[Database][C]")
     REQUIRE(c4blob_getSize(store, key3) == -1);
 }
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database PruneRevTrees", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+    static const unsigned kNumDocs = 20, kNumRevs = 10;
+    C4Error error;
+    char docID[20];
+    for (unsigned i = 1; i <= kNumDocs; ++i) {
+        sprintf(docID, "doc-%03u", i);
+        for (unsigned r = 0; r < kNumRevs; ++r)
+            createNewRev(db, c4str(docID), kBody);
+    }
+    C4SequenceNumber lastSeq = c4db_getLastSequence(db);
+
+    auto historyLength = [&](unsigned i) -> unsigned {
+        sprintf(docID, "doc-%03u", i);
+        C4Document *doc = c4doc_get(db, c4str(docID), true, &error);
+        REQUIRE(doc);
+        unsigned n = 1;
+        while (c4doc_selectParentRevision(doc))
+            ++n;
+        c4doc_free(doc);
+        return n;
+    };
+    CHECK(historyLength(1) == kNumRevs);
+
+    // Lowering the max depth doesn't affect existing docs until the job runs:
+    c4db_setMaxRevTreeDepth(db, 4);
+    CHECK(historyLength(1) == kNumRevs);
+
+    // Run part of the job, one doc at a time:
+    C4PruneProgress progress;
+    uint64_t docsChecked = 0, docsPruned = 0;
+    for (int i = 0; i < 5; ++i) {
+        REQUIRE(c4db_pruneRevTrees(db, 1, &progress, &error));
+        CHECK(progress.docsChecked == 1u);
+        CHECK(!progress.complete);
+        CHECK(progress.endSequence == lastSeq);
+        docsChecked += progress.docsChecked;
+        docsPruned += progress.docsPruned;
+    }
+    CHECK(historyLength(1) == 4u);
+    CHECK(historyLength(kNumDocs) == kNumRevs);
+
+    // Reopen the database; the job resumes where it left off:
+    reopenDB();
+    C4SequenceNumber prevSeq = progress.lastSequence;
+    do {
+        REQUIRE(c4db_pruneRevTrees(db, 1000, &progress, &error));
+        CHECK(progress.lastSequence > prevSeq);
+        prevSeq = progress.lastSequence;
+        docsChecked += progress.docsChecked;
+        docsPruned += progress.docsPruned;
+    } while (!progress.complete);
+    CHECK(docsChecked == kNumDocs);
+    CHECK(docsPruned == kNumDocs);
+    CHECK(progress.lastSequence == lastSeq);
+
+    for (unsigned i = 1; i <= kNumDocs; ++i)
+        CHECK(historyLength(i) == 4u);
+    CHECK(c4db_getLastSequence(db) == lastSeq);      // Pruning doesn't create new sequences
+
+    // Running it again starts a new pass, which has nothing left to do:
+    REQUIRE(c4db_pruneRevTrees(db, 0, &progress, &error));
+    CHECK(progress.complete);
+    CHECK(progress.docsChecked == kNumDocs);
+    CHECK(progress.docsPruned == 0u);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database copy", "[Database][C]") {
     C4Slice doc1ID = C4STR("doc001");
     C4Slice doc2ID = C4STR("doc002");
@@ -472,6 +472,83 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document Put", "[Database][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document PutMany", "[Database][C]") {
+    C4Slice kRev1ID = isRevTrees() ? C4STR("1-9a57afaa2e551a0bc470548763a5660a19d579f4")
+                                   : C4STR("1@*");
+    C4Slice kRev2ID = isRevTrees() ? C4STR("2-559298a253c7bfb7edc0ce1dc93c8e8ebf504065")
+                                   : C4STR("2@*");
+    C4Slice kRemoteRevID = isRevTrees() ? C4STR("1-abcd") : C4STR("1@binky");
+    C4Slice kBody2 = C4STR("{\"ok\":\"go\"}");
+
+    C4DocPutRequest rqs[7] = {};
+    // 0: new document
+    rqs[0].docID = C4STR("new");
+    rqs[0].body = kBody;
+    // 1: update of an existing document
+    rqs[1].docID = kDocID;
+    rqs[1].body = kBody2;
+    rqs[1].history = &kRev1ID;
+    rqs[1].historyCount = 1;
+    // 2: same docID as #0, which will have been created by then: conflict
+    rqs[2].docID = C4STR("new");
+    rqs[2].body = kBody2;
+    // 3: existing document without a parent revision: conflict
+    rqs[3].docID = kDocID;
+    rqs[3].body = kBody2;
+    // 4: existing revision from a remote database
+    rqs[4].docID = C4STR("remote");
+    rqs[4].body = kBody;
+    rqs[4].existingRevision = true;
+    rqs[4].history = &kRemoteRevID;
+    rqs[4].historyCount = 1;
+    // 5: invalid request
+    C4Slice history[2] = {kRev2ID, kRev1ID};
+    rqs[5].docID = C4STR("invalid");
+    rqs[5].body = kBody;
+    rqs[5].history = history;
+    rqs[5].historyCount = 2;
+    // 6: new document with a generated docID
+    rqs[6].body = kBody;
+
+    C4Error errors[7];
+    REQUIRE(c4doc_putMany(db, rqs, 7, errors) == 0);
+    for (auto &err : errors)
+        CHECK(err.code == kC4ErrorNotInTransaction);
+
+    {
+        TransactionHelper t(db);
+        createRev(kDocID, kRev1ID, kBody);
+        CHECK(c4doc_putMany(db, rqs, 7, errors) == 4);
+    }
+    CHECK(errors[0].code == 0);
+    CHECK(errors[1].code == 0);
+    CHECK(errors[2].domain == LiteCoreDomain);
+    CHECK(errors[2].code == kC4ErrorConflict);
+    CHECK(errors[3].domain == LiteCoreDomain);
+    CHECK(errors[3].code == kC4ErrorConflict);
+    CHECK(errors[4].code == 0);
+    CHECK(errors[5].domain == LiteCoreDomain);
+    CHECK(errors[5].code == kC4ErrorInvalidParameter);
+    CHECK(errors[6].code == 0);
+    CHECK(c4db_getDocumentCount(db) == 4);
+
+    // The revIDs must be the same ones c4doc_put would have generated:
+    C4Error error;
+    auto doc = c4doc_get(db, C4STR("new"), true, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kRev1ID);
+    c4doc_free(doc);
+    doc = c4doc_get(db, kDocID, true, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kRev2ID);
+    c4doc_free(doc);
+    doc = c4doc_get(db, C4STR("remote"), true, &error);
+    REQUIRE(doc);
+    CHECK(doc->revID == kRemoteRevID);
+    c4doc_free(doc);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document Update", "[Database][C]") {
     C4Log("Begin test");
     C4Error error;
@@ -623,6 +700,142 @@ N_WAY_TEST_CASE_METHOD(C4Test, "Document Conflict", "[Database][C]") {
     c4doc_free(doc);
 }
 
+N_WAY_TEST_CASE_METHOD(C4Test, "Document Conflict Body Stored Separately", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+
+    const C4Slice kBody2 = C4STR("{\"ok\":\"go\"}");
+    const C4Slice kBody3 = C4STR("{\"ubu\":\"roi\"}");
+    const C4Slice kConflictBody = C4STR("{\"from\":\"remote\"}");
+    createRev(kDocID, kRevID, kBody);
+    createRev(kDocID, kRev2ID, kBody2);
+    createRev(kDocID, C4STR("3-aaaaaa"), kBody3);
+
+    C4Error err;
+    {
+        TransactionHelper t(db);
+        C4Slice history[3] = {C4STR("4-dddd"), C4STR("3-ababab"), kRev2ID};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.docID = kDocID;
+        rq.history = history;
+        rq.historyCount = 3;
+        rq.body = kConflictBody;
+        rq.save = true;
+        auto doc = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc);
+        c4doc_free(doc);
+    }
+
+    // Re-read the doc; the conflicting leaf's body is no longer in the rev tree, but is still
+    // loadable:
+    auto doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->revID == C4STR("3-aaaaaa"));
+    CHECK(doc->selectedRev.body == kBody3);
+    REQUIRE(c4doc_selectRevision(doc, C4STR("4-dddd"), false, &err));
+    CHECK(c4doc_hasRevisionBody(doc));
+    REQUIRE(c4doc_loadRevisionBody(doc, &err));
+    CHECK(doc->selectedRev.body == kConflictBody);
+
+    // Resolving the conflict in favor of the remote rev brings its body back inline:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4doc_resolveConflict(doc, C4STR("4-dddd"), C4STR("3-aaaaaa"),
+                                      kC4SliceNull, 0, &err));
+        REQUIRE(c4doc_save(doc, 0, &err));
+    }
+    c4doc_free(doc);
+
+    doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->revID == C4STR("4-dddd"));
+    CHECK(doc->selectedRev.body == kConflictBody);
+    c4doc_free(doc);
+
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4db_purgeDoc(db, kDocID, &err));
+    }
+    CHECK(c4db_getDocumentCount(db) == 0);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4Test, "Document Retained Body Survives Updates", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+
+    // Bodies that differ in only one property, as in a typical conflict:
+    auto makeBody = [](const char *value) -> std::string {
+        std::string body = "{";
+        for (int i = 0; i < 50; ++i)
+            body += "\"property" + std::to_string(i) + "\":\"value " + std::to_string(i) + "\",";
+        return body + "\"changed\":\"" + value + "\"}";
+    };
+    std::string body3 = makeBody("local"), conflictBody = makeBody("remote"), body4 = makeBody("newer");
+    createRev(kDocID, kRevID, kBody);
+    createRev(kDocID, kRev2ID, kBody);
+    createRev(kDocID, C4STR("3-aaaaaa"), c4str(body3.c_str()));
+
+    C4Error err;
+    {
+        TransactionHelper t(db);
+        C4Slice history[3] = {C4STR("4-dddd"), C4STR("3-ababab"), kRev2ID};
+        C4DocPutRequest rq = {};
+        rq.existingRevision = true;
+        rq.docID = kDocID;
+        rq.history = history;
+        rq.historyCount = 3;
+        rq.body = c4str(conflictBody.c_str());
+        rq.save = true;
+        auto doc = c4doc_put(db, &rq, nullptr, &err);
+        REQUIRE(doc);
+        c4doc_free(doc);
+    }
+
+    auto doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->revID == C4STR("3-aaaaaa"));
+    REQUIRE(c4doc_selectRevision(doc, C4STR("4-dddd"), true, &err));
+    CHECK(doc->selectedRev.body == c4str(conflictBody.c_str()));
+    c4doc_free(doc);
+
+    // Read a copy that will be out of date:
+    auto stale = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(stale);
+
+    // Adding a new current revision leaves the conflict's stored body alone:
+    createRev(kDocID, C4STR("4-bbbbbb"), c4str(body4.c_str()));
+    doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->revID == C4STR("4-bbbbbb"));
+    CHECK(doc->selectedRev.body == c4str(body4.c_str()));
+    REQUIRE(c4doc_selectRevision(doc, C4STR("4-dddd"), true, &err));
+    CHECK(doc->selectedRev.body == c4str(conflictBody.c_str()));
+    C4SequenceNumber sequence = doc->sequence;
+    c4doc_free(doc);
+
+    // Saving the stale copy fails, without touching the stored bodies:
+    {
+        TransactionHelper t(db);
+        REQUIRE(c4doc_resolveConflict(stale, C4STR("3-aaaaaa"), C4STR("4-dddd"),
+                                      c4str(body4.c_str()), 0, &err));
+        CHECK(!c4doc_save(stale, 0, &err));
+        CHECK(err.domain == LiteCoreDomain);
+        CHECK(err.code == kC4ErrorConflict);
+    }
+    c4doc_free(stale);
+
+    doc = c4doc_get(db, kDocID, true, &err);
+    REQUIRE(doc);
+    CHECK(doc->sequence == sequence);
+    CHECK(doc->revID == C4STR("4-bbbbbb"));
+    REQUIRE(c4doc_selectRevision(doc, C4STR("4-dddd"), true, &err));
+    CHECK(doc->selectedRev.body == c4str(conflictBody.c_str()));
+    c4doc_free(doc);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4Test, "Document Legacy Properties", "[Database][C]") {
     CHECK(c4doc_isOldMetaProperty(C4STR("_attachments")));
     CHECK(!c4doc_isOldMetaProperty(C4STR("@type")));
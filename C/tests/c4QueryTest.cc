@@ -185,6 +185,49 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query bindings", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query Fleece bindings", "[Query][C]") {
+    compile(json5("['AND', ['=', ['.', 'contact', 'address', 'state'], ['$', 'state']],"
+                          "['>=', ['.', 'name', 'first'], ['$', 'first']]]"));
+    Encoder enc;
+    enc.beginDict();
+    enc.writeKey("state"_sl);
+    enc.writeString("CA"_sl);
+    enc.writeKey("first"_sl);
+    enc.writeString("M"_sl);
+    enc.endDict();
+    alloc_slice params = enc.finish();
+
+    C4QueryOptions options = kC4DefaultQueryOptions;
+    options.fleeceParameters = true;
+    vector<string> docIDs;
+    for (int pass = 0; pass < 2; ++pass) {      // Run twice to make sure rebinding works
+        C4Error error;
+        c4::ref<C4QueryEnumerator> e = c4query_run(query, &options, params, &error);
+        REQUIRE(e);
+        docIDs.clear();
+        while (c4queryenum_next(e, &error))
+            docIDs.push_back(slice(FLValue_AsString(FLArrayIterator_GetValueAt(&e->columns, 0))).asString());
+        CHECK(error.code == 0);
+        CHECK(docIDs == run("{\"state\": \"CA\", \"first\": \"M\"}"));
+    }
+    CHECK(!docIDs.empty());
+
+    // Unknown parameter names are an error:
+    enc.beginDict();
+    enc.writeKey("nope"_sl);
+    enc.writeInt(1);
+    enc.endDict();
+    params = enc.finish();
+    C4Error error;
+    {
+        ExpectingExceptions x;
+        CHECK(c4query_run(query, &options, params, &error) == nullptr);
+    }
+    CHECK(error.domain == LiteCoreDomain);
+    CHECK(error.code == kC4ErrorInvalidQueryParam);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query ANY", "[Query][C]") {
     compile(json5("['ANY', 'like', ['.', 'likes'], ['=', ['?', 'like'], 'climbing']]"));
     CHECK(run() == (vector<string>{"0000017", "0000021", "0000023", "0000045", "0000060"}));
@@ -481,6 +524,57 @@ N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query Aggregate", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query batch", "[Query][C]") {
+    C4Error error;
+    c4::ref<C4Query> q1 = c4query_new(db, c4str(json5("{WHAT: [['count()', ['._id']]]}").c_str()), &error);
+    c4::ref<C4Query> q2 = c4query_new(db, c4str(json5("{WHAT: [['min()', ['.name.last']]]}").c_str()),
+                                      &error);
+    c4::ref<C4Query> q3 = c4query_new(db, c4str(json5("{WHAT: [['._id']], "
+                                                      "WHERE: ['=', ['.contact.address.state'], ['$state']]}").c_str()),
+                                      &error);
+    REQUIRE(q1);
+    REQUIRE(q2);
+    REQUIRE(q3);
+    C4Query* queries[3] = {q1, q2, q3};
+    C4String params[3] = {kC4SliceNull, kC4SliceNull, C4STR("{\"state\": \"CA\"}")};
+
+    for (unsigned parallelism = 0; parallelism <= 2; parallelism += 2) {
+        C4QueryOptions options = kC4DefaultQueryOptions;
+        options.parallelism = parallelism;
+        C4QueryEnumerator* enums[3] = {};
+        REQUIRE(c4query_runBatch(queries, params, 3, &options, enums, &error));
+        c4::ref<C4QueryEnumerator> e1 = enums[0], e2 = enums[1], e3 = enums[2];
+
+        REQUIRE(c4queryenum_next(e1, &error));
+        CHECK(Array::iterator(e1->columns)[0].asInt() == 100);
+        REQUIRE(c4queryenum_next(e2, &error));
+        CHECK(Array::iterator(e2->columns)[0].asstring() == "Aerni");
+        CHECK(c4queryenum_getRowCount(e3, &error) == 8);
+    }
+}
+
+
+N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query step limit", "[Query][C]") {
+    compileSelect(json5("{WHAT: [['count()', ['.a.name.last']]], "
+                         "FROM: [{AS: 'a'}, {AS: 'b', JOIN: 'CROSS'}]}"));
+    C4QueryOptions options = kC4DefaultQueryOptions;
+    options.stepLimit = 1000;
+    C4Error error;
+    {
+        ExpectingExceptions x;
+        CHECK(c4query_run(query, &options, kC4SliceNull, &error) == nullptr);
+    }
+    CHECK(error.domain == LiteCoreDomain);
+    CHECK(error.code == kC4ErrorQueryInterrupted);
+
+    options.stepLimit = 0;
+    c4::ref<C4QueryEnumerator> e = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e);
+    REQUIRE(c4queryenum_next(e, &error));
+    CHECK(Array::iterator(e->columns)[0].asInt() == 100 * 100);
+}
+
+
 N_WAY_TEST_CASE_METHOD(QueryTest, "DB Query Grouped", "[Query][C]") {
     const vector<string> expectedState = {"AL",      "AR",        "AZ",       "CA"};
     const vector<string> expectedMin   = {"Laidlaw", "Okorududu", "Kinatyan", "Bejcek"};
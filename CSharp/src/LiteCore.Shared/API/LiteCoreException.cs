@@ -187,6 +187,16 @@ namespace Couchbase.Lite
         /// </summary>
         CantUpgradeDatabase,
 
+        /// <summary>
+        /// Query was cancelled, or exceeded its time/step limit
+        /// </summary>
+        QueryInterrupted,
+
+        /// <summary>
+        /// Query results exceeded the memory limit
+        /// </summary>
+        QueryResultTooLarge,
+
         /// <summary>
         /// Not an actual error, but serves as the lower bound for network related
         /// errors
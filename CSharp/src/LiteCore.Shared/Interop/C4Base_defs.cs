@@ -91,6 +91,8 @@ namespace LiteCore.Interop
         DatabaseTooNew,
         BadDocID,
         CantUpgradeDatabase,
+        QueryInterrupted,
+        QueryResultTooLarge,
         NumErrorCodesPlus1
     }
 
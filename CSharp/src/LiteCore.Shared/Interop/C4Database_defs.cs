@@ -108,6 +108,30 @@ namespace LiteCore.Interop
         public fixed byte bytes[16];
     }
 
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe partial struct C4PruneProgress
+    {
+        public ulong lastSequence;
+        public ulong endSequence;
+        public ulong docsChecked;
+        public ulong docsPruned;
+        private byte _complete;
+
+        public bool complete
+        {
+            get {
+                return Convert.ToBoolean(_complete);
+            }
+            set {
+                _complete = Convert.ToByte(value);
+            }
+        }
+    }
+
 #if LITECORE_PACKAGED
     internal
 #else
@@ -112,6 +112,10 @@ namespace LiteCore.Interop
         [return: MarshalAs(UnmanagedType.U1)]
         public static extern bool c4db_compact(C4Database* database, C4Error* outError);
 
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        public static extern bool c4db_pruneRevTrees(C4Database* database, ulong maxBytes, C4PruneProgress* outProgress, C4Error* outError);
+
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         [return: MarshalAs(UnmanagedType.U1)]
         public static extern bool c4db_beginTransaction(C4Database* database, C4Error* outError);
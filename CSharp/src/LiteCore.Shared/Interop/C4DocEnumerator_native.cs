@@ -43,6 +43,13 @@ namespace LiteCore.Interop
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern C4DocEnumerator* c4db_enumerateAllDocs(C4Database* database, C4EnumeratorOptions* options, C4Error* outError);
 
+        public static C4DocEnumerator* c4db_enumerateConflicts(C4Database* database, string startAfterDocID, C4EnumeratorOptions* options, C4Error* outError)
+        {
+            using(var startAfterDocID_ = new C4String(startAfterDocID)) {
+                return NativeRaw.c4db_enumerateConflicts(database, startAfterDocID_.AsC4Slice(), options, outError);
+            }
+        }
+
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         [return: MarshalAs(UnmanagedType.U1)]
         public static extern bool c4enum_next(C4DocEnumerator* e, C4Error* outError);
@@ -64,6 +71,9 @@ namespace LiteCore.Interop
 #endif 
     unsafe static partial class NativeRaw
     {
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern C4DocEnumerator* c4db_enumerateConflicts(C4Database* database, C4Slice startAfterDocID, C4EnumeratorOptions* options, C4Error* outError);
+
 
     }
 }
@@ -189,6 +189,11 @@ namespace LiteCore.Interop
         }
 
 
+        public static ulong c4doc_putMany(C4Database* database, C4DocPutRequest* requests, ulong count, C4Error* outErrors)
+        {
+            return NativeRaw.c4doc_putMany(database, requests, (UIntPtr)count, outErrors).ToUInt64();
+        }
+
         public static C4Document* c4doc_create(C4Database* db, string docID, byte[] body, C4RevisionFlags revisionFlags, C4Error* error)
         {
             using(var docID_ = new C4String(docID))
@@ -266,6 +271,9 @@ namespace LiteCore.Interop
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern C4Document* c4doc_put(C4Database* database, C4DocPutRequest* request, UIntPtr* outCommonAncestorIndex, C4Error* outError);
 
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern UIntPtr c4doc_putMany(C4Database* database, C4DocPutRequest* requests, UIntPtr count, C4Error* outErrors);
+
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern C4Document* c4doc_create(C4Database* db, C4Slice docID, C4Slice body, C4RevisionFlags revisionFlags, C4Error* error);
 
@@ -35,6 +35,9 @@ namespace LiteCore.Interop
         ValueIndex,
         FullTextIndex,
         GeoIndex,
+        ArrayIndex,
+        AggregateIndex,
+        TrigramIndex,
     }
 
 #if LITECORE_PACKAGED
@@ -54,6 +57,12 @@ namespace LiteCore.Interop
     unsafe partial struct C4QueryOptions
     {
         private byte _rankFullText;
+        private byte _fleeceParameters;
+        public uint timeLimitMS;
+        public ulong stepLimit;
+        public uint parallelism;
+        public ulong maxRecordingBytes;
+        private byte _spillToDisk;
 
         public bool rankFullText
         {
@@ -64,6 +73,39 @@ namespace LiteCore.Interop
                 _rankFullText = Convert.ToByte(value);
             }
         }
+
+        public bool fleeceParameters
+        {
+            get {
+                return Convert.ToBoolean(_fleeceParameters);
+            }
+            set {
+                _fleeceParameters = Convert.ToByte(value);
+            }
+        }
+
+        public bool spillToDisk
+        {
+            get {
+                return Convert.ToBoolean(_spillToDisk);
+            }
+            set {
+                _spillToDisk = Convert.ToByte(value);
+            }
+        }
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe struct C4QueryRecordingStats
+    {
+        public ulong bytesInMemory;
+        public ulong peakBytesInMemory;
+        public ulong largestRecording;
+        public ulong bytesSpilled;
     }
 
 #if LITECORE_PACKAGED
@@ -77,6 +119,9 @@ namespace LiteCore.Interop
         private byte _ignoreDiacritics;
         private byte _disableStemming;
         private IntPtr _stopWords;
+        private IntPtr _where;
+        private byte _useFTS5;
+        private byte _unicodeSortKeys;
 
         public string language
         {
@@ -119,6 +164,61 @@ namespace LiteCore.Interop
                 Marshal.FreeHGlobal(old);
             }
         }
+
+        public string where
+        {
+            get {
+                return Marshal.PtrToStringAnsi(_where);
+            }
+            set {
+                var old = Interlocked.Exchange(ref _where, Marshal.StringToHGlobalAnsi(value));
+                Marshal.FreeHGlobal(old);
+            }
+        }
+
+        public bool useFTS5
+        {
+            get {
+                return Convert.ToBoolean(_useFTS5);
+            }
+            set {
+                _useFTS5 = Convert.ToByte(value);
+            }
+        }
+
+        public bool unicodeSortKeys
+        {
+            get {
+                return Convert.ToBoolean(_unicodeSortKeys);
+            }
+            set {
+                _unicodeSortKeys = Convert.ToByte(value);
+            }
+        }
+    }
+
+#if LITECORE_PACKAGED
+    internal
+#else
+    public
+#endif
+    unsafe partial struct C4IndexAdvisorOptions
+    {
+        private byte _autoCreate;
+        public uint maxAutoIndexes;
+        public ulong maxAutoIndexBytes;
+        public uint minRuns;
+        public uint minTotalMS;
+
+        public bool autoCreate
+        {
+            get {
+                return Convert.ToBoolean(_autoCreate);
+            }
+            set {
+                _autoCreate = Convert.ToByte(value);
+            }
+        }
     }
 
 #if LITECORE_PACKAGED
@@ -51,6 +51,19 @@ namespace LiteCore.Interop
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern uint c4query_columnCount(C4Query* query);
 
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void c4query_cancel(C4Query* query);
+
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void c4query_setRecordingMemoryLimit(ulong maxBytes);
+
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern C4QueryRecordingStats c4query_getRecordingStats();
+
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        public static extern bool c4query_runBatch(C4Query** queries, C4Slice* encodedParameters, UIntPtr count, C4QueryOptions* options, C4QueryEnumerator** outEnumerators, C4Error* outError);
+
         public static C4QueryEnumerator* c4query_run(C4Query* query, C4QueryOptions* options, string encodedParameters, C4Error* outError)
         {
             using(var encodedParameters_ = new C4String(encodedParameters)) {
@@ -58,6 +71,14 @@ namespace LiteCore.Interop
             }
         }
 
+        public static string c4query_profile(C4Query* query, C4QueryOptions* options, string encodedParameters, C4Error* outError)
+        {
+            using(var encodedParameters_ = new C4String(encodedParameters))
+            using(var retVal = NativeRaw.c4query_profile(query, options, encodedParameters_.AsC4Slice(), outError)) {
+                return ((C4Slice)retVal).CreateString();
+            }
+        }
+
         public static string c4query_fullTextMatched(C4Query* query, C4FullTextMatch* term, C4Error* outError)
         {
             using(var retVal = NativeRaw.c4query_fullTextMatched(query, term, outError)) {
@@ -107,6 +128,19 @@ namespace LiteCore.Interop
             }
         }
 
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        public static extern bool c4db_setIndexAdvisor(C4Database* database, C4IndexAdvisorOptions* options, C4Error* outError);
+
+        public static byte[] c4db_getIndexAdvice(C4Database* database, C4Error* outError)
+        {
+            using(var retVal = NativeRaw.c4db_getIndexAdvice(database, outError)) {
+                return ((C4Slice)retVal).ToArrayFast();
+            }
+        }
+
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern long c4db_createAdvisedIndexes(C4Database* database, C4Error* outError);
 
     }
     
@@ -126,6 +160,9 @@ namespace LiteCore.Interop
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern C4QueryEnumerator* c4query_run(C4Query* query, C4QueryOptions* options, C4Slice encodedParameters, C4Error* outError);
 
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern C4SliceResult c4query_profile(C4Query* query, C4QueryOptions* options, C4Slice encodedParameters, C4Error* outError);
+
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern C4SliceResult c4query_fullTextMatched(C4Query* query, C4FullTextMatch* term, C4Error* outError);
 
@@ -140,6 +177,9 @@ namespace LiteCore.Interop
         [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern C4SliceResult c4db_getIndexes(C4Database* database, C4Error* outError);
 
+        [DllImport(Constants.DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern C4SliceResult c4db_getIndexAdvice(C4Database* database, C4Error* outError);
+
 
     }
 }
@@ -118,7 +118,10 @@ public interface C4Constants {
     interface C4IndexType {
         int kC4ValueIndex = 0; ///< Regular index of property value
         int kC4FullTextIndex = 1; ///< Full-text index
-        int kC4GeoIndex = 2; ///< Geospatial index of GeoJSON values (NOT YET IMPLEMENTED)
+        int kC4GeoIndex = 2; ///< Geospatial index of GeoJSON values
+        int kC4ArrayIndex = 3; ///< Index of the items of an array property
+        int kC4AggregateIndex = 4; ///< Materialized grouped aggregates
+        int kC4TrigramIndex = 5; ///< Index of substrings, for LIKE and contains()
     }
 
     ////////////////////////////////////
@@ -178,8 +181,10 @@ public interface C4Constants {
         int kC4ErrorDatabaseTooNew = 37;        // Database file format is newer than what I can open
         int kC4ErrorBadDocID = 38;              // Invalid document ID
         int kC4ErrorCantUpgradeDatabase = 39;   // Database can't be upgraded (might be unsupported dev version)
+        int kC4ErrorQueryInterrupted = 40;      // Query was cancelled, or exceeded its time/step limit
+        int kC4ErrorQueryResultTooLarge = 41;   // Query results exceeded the memory limit
 
-        int kC4NumErrorCodesPlus1 = 40;         //
+        int kC4NumErrorCodesPlus1 = 42;         //
     }
 
     /**
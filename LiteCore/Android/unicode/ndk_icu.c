@@ -39,7 +39,7 @@ static char icudata_version[ICUDATA_VERSION_MAX_LENGTH + 1];
 
 static void* handle_i18n = NULL;
 static void* handle_common = NULL;
-static void* syms[11];
+static void* syms[13];
 
 /* ICU data filename on Android is like 'icudt49l.dat'.
  *
@@ -156,6 +156,14 @@ static void init_icudata_version() {
     strcpy(func_name, "ucol_strcollIter");
     strcat(func_name, icudata_version);
     syms[10] = dlsym(handle_i18n, func_name);
+
+    strcpy(func_name, "ucol_getSortKey");
+    strcat(func_name, icudata_version);
+    syms[11] = dlsym(handle_i18n, func_name);
+
+    strcpy(func_name, "ucol_getVersion");
+    strcat(func_name, icudata_version);
+    syms[12] = dlsym(handle_i18n, func_name);
 }
 
 UCollator* ucol_open(const char* loc, UErrorCode* status) {
@@ -217,6 +225,27 @@ UCollationResult ucol_strcollIter(const UCollator* coll, UCharIterator* sIter, U
   return ptr(coll, sIter, tIter, status);
 }
 
+int32_t ucol_getSortKey(const UCollator* coll, const UChar* source, int32_t sourceLength, uint8_t* result, int32_t resultLength) {
+  pthread_once(&once_control, &init_icudata_version);
+  int32_t (*ptr)(const UCollator*, const UChar*, int32_t, uint8_t*, int32_t);
+  if (syms[11] == NULL) {
+    return (int32_t)0;
+  }
+  ptr = (int32_t(*)(const UCollator*, const UChar*, int32_t, uint8_t*, int32_t))syms[11];
+  return ptr(coll, source, sourceLength, result, resultLength);
+}
+
+void ucol_getVersion(const UCollator* coll, UVersionInfo info) {
+  pthread_once(&once_control, &init_icudata_version);
+  void (*ptr)(const UCollator*, UVersionInfo);
+  if (syms[12] == NULL) {
+    memset(info, 0, sizeof(UVersionInfo));
+    return;
+  }
+  ptr = (void(*)(const UCollator*, UVersionInfo))syms[12];
+  ptr(coll, info);
+}
+
 /* unicode/uiter.h */
 void uiter_setUTF8(UCharIterator* iter, const char* s, int32_t length) {
   pthread_once(&once_control, &init_icudata_version);
@@ -40,6 +40,11 @@ namespace c4Internal {
     static const slice kMaxRevTreeDepthKey = "maxRevTreeDepth"_sl;
     static uint32_t kDefaultMaxRevTreeDepth = 20;
 
+    // Info records of an unfinished pruneRevTrees job:
+    static const slice kPruneEndSequenceKey = "pruneEndSequence"_sl;  // Last sequence to check
+    static const slice kPruneCheckpointKey = "pruneCheckpoint"_sl;    // Last sequence checked
+    static const uint64_t kDefaultPruneBytes = 1024 * 1024;
+
     const slice Database::kPublicUUIDKey = "publicUUID"_sl;
     const slice Database::kPrivateUUIDKey = "privateUUID"_sl;
 
@@ -300,6 +305,78 @@ namespace c4Internal {
     }
 
 
+    // Each call handles one chunk of documents in its own transaction, so the database isn't
+    // locked for long, and records its position so the next call (or the next launch) resumes.
+    void Database::pruneRevTrees(uint64_t maxBytes, C4PruneProgress &progress) {
+        mustNotBeInTransaction();
+        if (maxBytes == 0)
+            maxBytes = kDefaultPruneBytes;
+        unsigned maxDepth = maxRevTreeDepth();
+        KeyStore &info = _db->getKeyStore(DataFile::kInfoKeyStoreName);
+        progress = { };
+
+        beginTransaction();
+        try {
+            // If no job is in progress, start one that covers all the existing docs:
+            Record endRec = info.get(kPruneEndSequenceKey);
+            sequence_t endSeq = endRec.exists() ? endRec.bodyAsUInt() : lastSequence();
+            sequence_t seq = info.get(kPruneCheckpointKey).bodyAsUInt();
+
+            // Read the chunk first, since records shouldn't be updated while enumerating them:
+            vector<Record> docs;
+            uint64_t bytes = 0;
+            bool complete = true;
+            RecordEnumerator::Options options;
+            options.includeDeleted = true;
+            RecordEnumerator e(defaultKeyStore(), seq, options);
+            while (e.next() && e->sequence() <= endSeq) {
+                if (bytes >= maxBytes) {
+                    complete = false;
+                    break;
+                }
+                bytes += e->bodySize();
+                docs.push_back(e.record());
+            }
+            e.close();
+
+            for (auto &rec : docs) {
+                if (_documentFactory->pruneDocument(rec, maxDepth))
+                    ++progress.docsPruned;
+                seq = rec.sequence();
+            }
+            progress.docsChecked = docs.size();
+
+            if (complete) {
+                info.del(kPruneEndSequenceKey, transaction());
+                info.del(kPruneCheckpointKey, transaction());
+                seq = endSeq;
+            } else {
+                Record checkpoint(kPruneCheckpointKey);
+                checkpoint.setBodyAsUInt(seq);
+                info.write(checkpoint, transaction());
+                if (!endRec.exists()) {
+                    Record end(kPruneEndSequenceKey);
+                    end.setBodyAsUInt(endSeq);
+                    info.write(end, transaction());
+                }
+            }
+            progress.lastSequence = seq;
+            progress.endSequence = endSeq;
+            progress.complete = complete;
+        } catch (...) {
+            endTransaction(false);
+            throw;
+        }
+        endTransaction(true);
+
+        LogVerbose(DBLog, "Pruned %llu of %llu docs; checked through sequence %llu of %llu",
+                   (unsigned long long)progress.docsPruned,
+                   (unsigned long long)progress.docsChecked,
+                   (unsigned long long)progress.lastSequence,
+                   (unsigned long long)progress.endSequence);
+    }
+
+
     void Database::rekey(const C4EncryptionKey *newKey) {
         LogTo(DBLog, "Rekeying database...");
         C4EncryptionKey keyBuf {kC4EncryptionNone, {}};
@@ -360,9 +437,18 @@ namespace c4Internal {
         KeyStore &info = _db->getKeyStore(DataFile::kInfoKeyStoreName);
         Record rec = info.get(kMaxRevTreeDepthKey);
         if (depth != rec.bodyAsUInt()) {
+            bool lowered = depth < maxRevTreeDepth();
             rec.setBodyAsUInt(depth);
             Transaction t(*_db);
             info.write(rec, t);
+            if (lowered) {
+                // Existing docs aren't pruned until they're saved, so (re)start a pruneRevTrees
+                // job that will go over all of them:
+                Record end(kPruneEndSequenceKey);
+                end.setBodyAsUInt(lastSequence());
+                info.write(end, t);
+                info.del(kPruneCheckpointKey, t);
+            }
             t.commit();
         }
         _maxRevTreeDepth = depth;
@@ -539,7 +625,12 @@ namespace c4Internal {
 
     
     bool Database::purgeDocument(slice docID) {
-        return defaultKeyStore().del(docID, transaction());
+        return documentFactory().purgeDocument(docID);
+    }
+
+
+    bool DocumentFactory::purgeDocument(slice docID) {
+        return _db->defaultKeyStore().del(docID, _db->transaction());
     }
 
 
@@ -27,6 +27,7 @@
 #include <memory>
 #include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace fleece {
     class Encoder;
@@ -73,6 +74,10 @@ namespace c4Internal {
 
         void compact();
 
+        /** Checks about `maxBytes` of documents in sequence order, resuming where the last call
+            left off, pruning their rev trees and removing obsolete bodies. */
+        void pruneRevTrees(uint64_t maxBytes, C4PruneProgress &progress);
+
         const C4DatabaseConfig config;
 
         Transaction& transaction() const;
@@ -162,6 +167,18 @@ namespace c4Internal {
         virtual Document* newDocumentInstance(const Record&) =0;
         virtual alloc_slice revIDFromVersion(slice version) =0;
         virtual bool isFirstGenRevID(slice revID)               {return false;}
+        virtual bool purgeDocument(slice docID);
+
+        /** Generates the revision IDs that putNewRevision would assign for a batch of
+            requests, given documents that have the requests' parent revisions selected.
+            Returns an empty vector if this isn't supported. */
+        virtual std::vector<alloc_slice> generateRevIDs(Document* const docs[],
+                                                        const C4DocPutRequest* const rqs[],
+                                                        size_t count)   {return { };}
+
+        /** Prunes a stored document's revision history to the given depth and removes obsolete
+            revision bodies, without giving it a new sequence. Returns true if it was changed. */
+        virtual bool pruneDocument(const Record&, unsigned maxRevTreeDepth)   {return false;}
 
     private:
         Database* const _db;
@@ -176,6 +193,11 @@ namespace c4Internal {
         Document* newDocumentInstance(const Record&) override;
         alloc_slice revIDFromVersion(slice version) override;
         bool isFirstGenRevID(slice revID) override;
+        bool purgeDocument(slice docID) override;
+        bool pruneDocument(const Record&, unsigned maxRevTreeDepth) override;
+        std::vector<alloc_slice> generateRevIDs(Document* const docs[],
+                                                const C4DocPutRequest* const rqs[],
+                                                size_t count) override;
         static DataFile::FleeceAccessor fleeceAccessor();
     };
 
@@ -135,6 +135,12 @@ namespace c4Internal {
         virtual int32_t putExistingRevision(const C4DocPutRequest&) =0;
         virtual bool putNewRevision(const C4DocPutRequest&) =0;
 
+        /** Same as putNewRevision, but with a new revision ID that was already generated by
+            DocumentFactory::generateRevIDs. */
+        virtual bool putNewRevision(const C4DocPutRequest &rq, slice newRevID) {
+            return putNewRevision(rq);
+        }
+
         virtual void resolveConflict(C4String winningRevID,
                                      C4String losingRevID,
                                      C4Slice mergedBody,
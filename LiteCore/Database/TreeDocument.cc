@@ -63,6 +63,8 @@ namespace c4Internal {
         {
             if (other._selectedRev)
                 _selectedRev = _versionedDoc[other._selectedRev->revID];
+            else if (other._currentRevSelectedLazily)
+                _selectedRev = _versionedDoc.currentRevision();
         }
 
 
@@ -102,23 +104,31 @@ namespace c4Internal {
         void loadRevisions() override {
             if (!_versionedDoc.revsAvailable()) {
                 _versionedDoc.read();
-                selectRevision(_versionedDoc.currentRevision());
+                selectCurrentRevision();
             }
         }
 
         bool hasRevisionBody() noexcept override {
             if (!revisionsLoaded())
                 Warn("c4doc_hasRevisionBody called on doc loaded without kC4IncludeBodies");
-            return _selectedRev && _selectedRev->isBodyAvailable();
+            if (_currentRevSelectedLazily)
+                return selectedRev.body.buf != nullptr;
+            return _selectedRev && _versionedDoc.isBodyOfRevisionAvailable(_selectedRev);
         }
 
         bool loadSelectedRevBody() override {
             loadRevisions();
+            if (!selectedRev.body.buf && _selectedRev && _selectedRev->hasExternalBody()) {
+                // Body is stored outside the rev tree, so read it now:
+                _loadedBody = _versionedDoc.readBodyOfRevision(_selectedRev);
+                selectedRev.body = _loadedBody;
+            }
             return selectedRev.body.buf != nullptr;
         }
 
         bool selectRevision(const Rev *rev) noexcept {   // doesn't throw
             _selectedRev = rev;
+            _currentRevSelectedLazily = false;
             _loadedBody = nullslice;
             if (rev) {
                 _selectedRevIDBuf = rev->revID.expanded();
@@ -147,12 +157,37 @@ namespace c4Internal {
             return true;
         }
 
+        // Selects the current revision without decoding the rev tree, if it hasn't been yet.
+        // The selected Rev is looked up later, by selectedRevision(), if it's needed.
+        void selectCurrentRevisionLazily() noexcept {
+            _selectedRev = nullptr;
+            _currentRevSelectedLazily = true;
+            _loadedBody = nullslice;
+            _selectedRevIDBuf = _revIDBuf;
+            selectedRev.revID = _selectedRevIDBuf;
+            selectedRev.flags = (C4RevisionFlags)_versionedDoc.currentRevFlags();
+            selectedRev.sequence = _versionedDoc.currentRevSequence();
+            selectedRev.body = _versionedDoc.currentRevBody();
+        }
+
+        const Rev* selectedRevision() {
+            if (_currentRevSelectedLazily) {
+                _selectedRev = _versionedDoc.currentRevision();
+                _currentRevSelectedLazily = false;
+            }
+            return _selectedRev;
+        }
+
         bool selectCurrentRevision() noexcept override { // doesn't throw
             if (_versionedDoc.revsAvailable()) {
-                selectRevision(_versionedDoc.currentRevision());
+                if (!_versionedDoc.isDecoded() && _revIDBuf)
+                    selectCurrentRevisionLazily();
+                else
+                    selectRevision(_versionedDoc.currentRevision());
                 return true;
             } else {
                 _selectedRev = nullptr;
+                _currentRevSelectedLazily = false;
                 Document::selectCurrentRevision();
                 return false;
             }
@@ -161,7 +196,7 @@ namespace c4Internal {
         bool selectParentRevision() noexcept override {
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
-            if (_selectedRev)
+            if (selectedRevision())
                 selectRevision(_selectedRev->parent);
             return _selectedRev != nullptr;
         }
@@ -169,7 +204,7 @@ namespace c4Internal {
         bool selectNextRevision() noexcept override {    // does not throw
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
-            if (_selectedRev)
+            if (selectedRevision())
                 selectRevision(_selectedRev->next());
             return _selectedRev != nullptr;
         }
@@ -177,7 +212,7 @@ namespace c4Internal {
         bool selectNextLeafRevision(bool includeDeleted) noexcept override {
             if (!revisionsLoaded())
                 Warn("Trying to access revision tree of doc loaded without kC4IncludeBodies");
-            auto rev = _selectedRev;
+            auto rev = selectedRevision();
             if (!rev)
                 return false;
             do {
@@ -213,7 +248,7 @@ namespace c4Internal {
         }
 
         void setRemoteAncestorRevID(C4RemoteID remote) override {
-            _versionedDoc.setLatestRevisionOnRemote(remote, _selectedRev);
+            _versionedDoc.setLatestRevisionOnRemote(remote, selectedRevision());
         }
 
         void updateFlags() {
@@ -222,7 +257,7 @@ namespace c4Internal {
         }
 
         bool removeSelectedRevBody() noexcept override {
-            if (!_selectedRev)
+            if (!selectedRevision())
                 return false;
             _versionedDoc.removeBody(_selectedRev);
             return true;
@@ -333,7 +368,13 @@ namespace c4Internal {
 
         bool putNewRevision(const C4DocPutRequest &rq) override {
             bool deletion = (rq.revFlags & kRevDeleted) != 0;
-            revidBuffer encodedNewRevID = generateDocRevID(rq.body, selectedRev.revID, deletion);
+            revidBuffer newRevID = generateDocRevID(rq.body, selectedRev.revID, deletion);
+            return putNewRevision(rq, newRevID);
+        }
+
+
+        bool putNewRevision(const C4DocPutRequest &rq, slice newRevID) override {
+            revid encodedNewRevID(newRevID);
             slice body = rq.body;
             if (!body)
                 body = slice{fleece::Dict::kEmpty, 2};
@@ -341,7 +382,7 @@ namespace c4Internal {
             auto newRev = _versionedDoc.insert(encodedNewRevID,
                                                body,
                                                (Rev::Flags)rq.revFlags,
-                                               _selectedRev,
+                                               selectedRevision(),
                                                rq.allowConflict,
                                                httpStatus);
             if (newRev) {
@@ -388,7 +429,14 @@ namespace c4Internal {
             sha1_add(&ctx, body.buf, body.size);
             sha1_end(&ctx, digestBuf);
             digest = slice(digestBuf, 20);
+            return revIDFromDigest(digest, parentRevID);
+        #else
+            error::_throw(error::Unimplemented);
+        #endif
+        }
 
+
+        static revidBuffer revIDFromDigest(slice digest, C4Slice parentRevID) {
             // Derive new rev's generation #:
             unsigned generation = 1;
             if (parentRevID.buf) {
@@ -396,15 +444,13 @@ namespace c4Internal {
                 generation = parentID.generation() + 1;
             }
             return revidBuffer(generation, digest, kDigestType);
-        #else
-            error::_throw(error::Unimplemented);
-        #endif
         }
 
 
     private:
         VersionedDocument _versionedDoc;
         const Rev *_selectedRev;
+        bool _currentRevSelectedLazily {false};     // Current rev selected, but _selectedRev unset
     };
 
 
@@ -419,6 +465,43 @@ namespace c4Internal {
         return new TreeDocument(database(), doc);
     }
 
+    // Digests the same data as TreeDocument::generateDocRevID, but for all the revisions at once,
+    // which lets SHA1Digester hash several of them in parallel.
+    vector<alloc_slice> TreeDocumentFactory::generateRevIDs(Document* const docs[],
+                                                            const C4DocPutRequest* const rqs[],
+                                                            size_t count)
+    {
+    #if SECURE_DIGEST_AVAILABLE
+        vector<uint8_t> prefixes(2 * count);        // Each rev's parent revID length & deletion flag
+        vector<slice> pieces;
+        pieces.reserve(4 * count);
+        for (size_t i = 0; i < count; ++i) {
+            C4Slice parentRevID = docs[i]->selectedRev.revID;
+            uint8_t &revLen = prefixes[2*i], &delByte = prefixes[2*i + 1];
+            revLen = (uint8_t)min((unsigned long)parentRevID.size, 255ul);
+            delByte = (rqs[i]->revFlags & kRevDeleted) != 0;
+            pieces.push_back(slice(&revLen, 1));
+            pieces.push_back(slice(parentRevID.buf, revLen));
+            pieces.push_back(slice(&delByte, 1));
+            pieces.push_back(rqs[i]->body);
+        }
+
+        vector<uint8_t> digests(20 * count);
+        SHA1Digester::digestMany(pieces.data(), 4, count, digests.data());
+
+        vector<alloc_slice> revIDs;
+        revIDs.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            revidBuffer revID = TreeDocument::revIDFromDigest(slice(&digests[20*i], 20),
+                                                              docs[i]->selectedRev.revID);
+            revIDs.push_back(alloc_slice(revID));
+        }
+        return revIDs;
+    #else
+        error::_throw(error::Unimplemented);
+    #endif
+    }
+
     DataFile::FleeceAccessor TreeDocumentFactory::fleeceAccessor() {
         return RawRevision::getCurrentRevBody;
     }
@@ -431,6 +514,25 @@ namespace c4Internal {
         return revID.hasPrefix(slice("1-", 2));
     }
 
+    // Purging has to go through the rev tree, to delete bodies stored outside it.
+    bool TreeDocumentFactory::purgeDocument(slice docID) {
+        VersionedDocument doc(database()->defaultKeyStore(), docID);
+        if (!doc.exists())
+            return false;
+        doc.purgeAll();
+        return doc.save(database()->transaction()) != VersionedDocument::kConflict;
+    }
+
+    bool TreeDocumentFactory::pruneDocument(const Record &rec, unsigned maxRevTreeDepth) {
+        VersionedDocument doc(database()->defaultKeyStore(), rec);
+        doc.prune(maxRevTreeDepth);
+        doc.removeNonLeafBodies();
+        if (!doc.changed())
+            return false;
+        // (This doesn't add a revision, so the document keeps its sequence.)
+        return doc.save(database()->transaction()) != VersionedDocument::kConflict;
+    }
+
 } // end namespace c4Internal
 
 
@@ -447,8 +549,10 @@ bool c4doc_save(C4Document *doc,
     if (!idoc->mustBeInTransaction(outError))
         return false;
     try {
-        ((TreeDocument*)idoc)->save(maxRevTreeDepth ? maxRevTreeDepth : kDefaultMaxRevTreeDepth);
-        return true;
+        auto depth = maxRevTreeDepth ? maxRevTreeDepth : kDefaultMaxRevTreeDepth;
+        if (((TreeDocument*)idoc)->save(depth))
+            return true;
+        c4error_return(LiteCoreDomain, kC4ErrorConflict, C4STR("C4Document is out of date"), outError);
     } catchError(outError)
     return false;
 }
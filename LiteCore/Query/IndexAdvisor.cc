@@ -0,0 +1,200 @@
+//
+// IndexAdvisor.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "IndexAdvisor.hh"
+#include "Fleece.hh"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore {
+
+    // Max number of distinct query patterns remembered; after this, new ones are ignored.
+    static const size_t kMaxPatterns = 100;
+
+    // Default value of Options::minRuns
+    static const unsigned kDefaultMinRuns = 3;
+
+
+    IndexAdvisor::IndexAdvisor(const Options &options)
+    :_options(options)
+    {
+        if (_options.minRuns == 0)
+            _options.minRuns = kDefaultMinRuns;
+    }
+
+
+    void IndexAdvisor::recordRun(const vector<string> &whereProperties,
+                                 const vector<string> &orderByProperties,
+                                 bool fullScan, bool tempBTree,
+                                 double seconds)
+    {
+        if (!fullScan && !tempBTree)
+            return;
+        // The index covers the WHERE properties first, then the ORDER BY ones:
+        vector<string> properties = whereProperties;
+        for (auto &prop : orderByProperties) {
+            if (find(properties.begin(), properties.end(), prop) == properties.end())
+                properties.push_back(prop);
+        }
+        if (properties.empty())
+            return;
+
+        string key = expressionsJSON(properties);
+        lock_guard<mutex> lock(_mutex);
+        auto i = _patterns.find(key);
+        if (i == _patterns.end()) {
+            if (_patterns.size() >= kMaxPatterns)
+                return;
+            Pattern pattern;
+            pattern.rec = {indexName(properties, key), key, 0, 0.0, false, false, false};
+            pattern.settled = false;
+            i = _patterns.emplace(key, pattern).first;
+        }
+        Recommendation &rec = i->second.rec;
+        ++rec.runs;
+        rec.seconds += seconds;
+        rec.fullScan |= fullScan;
+        rec.tempBTree |= tempBTree;
+    }
+
+
+    vector<IndexAdvisor::Recommendation> IndexAdvisor::recommendations() const {
+        vector<Recommendation> result;
+        {
+            lock_guard<mutex> lock(_mutex);
+            for (auto &entry : _patterns)
+                result.push_back(entry.second.rec);
+        }
+        sortByCost(result);
+        return result;
+    }
+
+
+    vector<IndexAdvisor::Recommendation> IndexAdvisor::autoCreateCandidates() const {
+        vector<Recommendation> result;
+        {
+            lock_guard<mutex> lock(_mutex);
+            for (auto &entry : _patterns) {
+                const Pattern &pattern = entry.second;
+                if (!pattern.settled && pattern.rec.runs >= _options.minRuns
+                                     && pattern.rec.seconds * 1000.0 >= _options.minTotalMS) {
+                    result.push_back(pattern.rec);
+                }
+            }
+        }
+        sortByCost(result);
+        return result;
+    }
+
+
+    void IndexAdvisor::markAutoCreated(const string &expressionsJSON) {
+        lock_guard<mutex> lock(_mutex);
+        auto i = _patterns.find(expressionsJSON);
+        if (i != _patterns.end()) {
+            i->second.rec.autoCreated = true;
+            i->second.settled = true;
+        }
+    }
+
+
+    void IndexAdvisor::markRejected(const string &expressionsJSON) {
+        lock_guard<mutex> lock(_mutex);
+        auto i = _patterns.find(expressionsJSON);
+        if (i != _patterns.end())
+            i->second.settled = true;
+    }
+
+
+    /*static*/ alloc_slice IndexAdvisor::encodeRecommendations(const vector<Recommendation> &recs) {
+        Encoder enc;
+        enc.beginArray();
+        for (auto &rec : recs) {
+            enc.beginDictionary();
+            enc.writeKey("name"_sl);
+            enc.writeString(rec.name);
+            enc.writeKey("expressions"_sl);
+            enc.writeString(rec.expressionsJSON);
+            enc.writeKey("runs"_sl);
+            enc.writeUInt(rec.runs);
+            enc.writeKey("ms"_sl);
+            enc.writeDouble(rec.seconds * 1000.0);
+            enc.writeKey("fullScan"_sl);
+            enc.writeBool(rec.fullScan);
+            enc.writeKey("tempBTree"_sl);
+            enc.writeBool(rec.tempBTree);
+            enc.writeKey("autoCreated"_sl);
+            enc.writeBool(rec.autoCreated);
+            enc.endDictionary();
+        }
+        enc.endArray();
+        return enc.extractOutput();
+    }
+
+
+    // Index name from the property paths, e.g. "advisor_name_first_age_1f3a96c2". Since
+    // different paths can map to the same readable part ("a.b" and "a_b" both become "a_b"),
+    // it ends with a hash of the index expressions.
+    string IndexAdvisor::indexName(const vector<string> &properties,
+                                   const string &expressionsJSON)
+    {
+        string name = kAutoIndexPrefix;
+        for (size_t i = 0; i < properties.size(); ++i) {
+            if (i > 0)
+                name += '_';
+            for (char c : properties[i])
+                name += isalnum((unsigned char)c) ? c : '_';
+        }
+        uint32_t hash = 2166136261u;                    // 32-bit FNV-1a
+        for (char c : expressionsJSON)
+            hash = (hash ^ (uint8_t)c) * 16777619u;
+        char suffix[10];
+        sprintf(suffix, "_%08x", hash);
+        return name + suffix;
+    }
+
+
+    // JSON index expressions for the property paths, e.g. `[[".name.first"],[".age"]]`
+    string IndexAdvisor::expressionsJSON(const vector<string> &properties) {
+        string json = "[";
+        for (size_t i = 0; i < properties.size(); ++i) {
+            if (i > 0)
+                json += ',';
+            json += "[\".";
+            for (char c : properties[i]) {
+                if (c == '"' || c == '\\')
+                    json += '\\';
+                json += c;
+            }
+            json += "\"]";
+        }
+        json += "]";
+        return json;
+    }
+
+
+    void IndexAdvisor::sortByCost(vector<Recommendation> &recs) {
+        stable_sort(recs.begin(), recs.end(), [](const Recommendation &a, const Recommendation &b) {
+            return a.seconds > b.seconds;
+        });
+    }
+
+}
@@ -0,0 +1,102 @@
+//
+// IndexAdvisor.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace litecore {
+
+    /** Watches the queries run on a KeyStore -- the properties they filter and sort on, whether
+        their plans scan the whole table or sort in a temporary B-tree, and how long they take --
+        and recommends value indexes that would speed up the most expensive ones.
+        Thread-safe. */
+    class IndexAdvisor {
+    public:
+        struct Options {
+            bool autoCreate;            ///< Create recommended indexes automatically
+            unsigned maxAutoIndexes;    ///< Max number of automatically-created indexes
+            uint64_t maxAutoIndexBytes; ///< Max size of an automatic index; 0 means no limit
+            unsigned minRuns;           ///< Runs of a query before its index is auto-created
+            unsigned minTotalMS;        ///< Total time of those runs before auto-creating
+        };
+
+        /** A recommended value index. */
+        struct Recommendation {
+            std::string name;               ///< Suggested index name
+            std::string expressionsJSON;    ///< Index expressions, as for KeyStore::createIndex
+            uint64_t runs;                  ///< Number of query runs that would have used it
+            double seconds;                 ///< Total time taken by those runs
+            bool fullScan;                  ///< Those queries scanned the entire table
+            bool tempBTree;                 ///< Those queries sorted in a temporary B-tree
+            bool autoCreated;               ///< The index was created automatically
+        };
+
+        /** Names of automatically-created indexes start with this. */
+        static constexpr const char* kAutoIndexPrefix = "advisor_";
+
+        explicit IndexAdvisor(const Options&);
+
+        const Options& options() const                      {return _options;}
+
+        /** Records a run of a query that took `seconds`. The properties come from the
+            QueryParser; `fullScan` and `tempBTree` describe the query plan. Runs whose plan
+            does neither aren't recorded, since an index wouldn't help them. */
+        void recordRun(const std::vector<std::string> &whereProperties,
+                       const std::vector<std::string> &orderByProperties,
+                       bool fullScan, bool tempBTree,
+                       double seconds);
+
+        /** All recommendations, most expensive first. */
+        std::vector<Recommendation> recommendations() const;
+
+        /** The recommendations used often enough to meet the auto-create thresholds, whose
+            indexes haven't yet been created or rejected, most expensive first. */
+        std::vector<Recommendation> autoCreateCandidates() const;
+
+        /** Marks a recommendation's index as having been created. */
+        void markAutoCreated(const std::string &expressionsJSON);
+
+        /** Marks a recommendation's index as rejected (e.g. too big), so it won't be a
+            candidate again. */
+        void markRejected(const std::string &expressionsJSON);
+
+        /** Encodes recommendations as a Fleece array of dicts with keys "name",
+            "expressions", "runs", "ms", "fullScan", "tempBTree" and "autoCreated". */
+        static alloc_slice encodeRecommendations(const std::vector<Recommendation>&);
+
+    private:
+        static std::string indexName(const std::vector<std::string> &properties,
+                                     const std::string &expressionsJSON);
+        static std::string expressionsJSON(const std::vector<std::string> &properties);
+        static void sortByCost(std::vector<Recommendation>&);
+
+        struct Pattern {
+            Recommendation rec;
+            bool settled;                   // Index was auto-created or rejected
+        };
+
+        mutable std::mutex _mutex;
+        Options _options;
+        std::map<std::string, Pattern> _patterns;     // Keyed by expressionsJSON
+    };
+
+}
@@ -49,11 +49,59 @@ namespace litecore {
         virtual std::string explain() =0;
 
         struct Options {
-            alloc_slice paramBindings;
+            alloc_slice paramBindings;              ///< Dict of parameter values, as JSON or Fleece
+            bool paramBindingsAreFleece {false};    ///< True if paramBindings is Fleece data
+            unsigned timeLimitMS {0};               ///< Max time to run (ms), or 0 for no limit
+            uint64_t stepLimit {0};                 ///< Max SQLite VM steps, or 0 for no limit
+            unsigned parallelism {0};               ///< Max threads for an aggregate query's scan
+            uint64_t maxRecordingBytes {0};         ///< Max bytes of results in memory, or 0
+            bool spillToDisk {false};               ///< Write results past the limit to a file?
         };
 
+        /** Process-wide statistics of the memory used by recorded query results. */
+        struct RecordingStats {
+            uint64_t bytesInMemory;                 ///< Bytes of results currently in memory
+            uint64_t peakBytesInMemory;             ///< Highest value of bytesInMemory so far
+            uint64_t largestRecording;              ///< Largest single query result, in bytes
+            uint64_t bytesSpilled;                  ///< Total bytes ever written to temp files
+        };
+
+        /** Runs the query and returns an enumerator of its results. If the query is cancelled, or
+            exceeds the time or step limit given in the options, throws error::QueryInterrupted.
+            If `parallelism` is greater than 1, a large enough aggregate query may scan the table
+            on that many threads at once, each over a range of rows; the time and step limits
+            then apply to each thread. */
         virtual QueryEnumerator* createEnumerator(const Options* =nullptr) =0;
 
+        /** A query's results are recorded when it runs, and live in memory until its enumerator
+            is freed. If recording the results would use more than the options'
+            `maxRecordingBytes`, or take the memory used by all recordings past the process-wide
+            limit set by `setRecordingMemoryLimit`, the rest of the results are written to a
+            temporary file that's memory-mapped for reading if `spillToDisk` is set (and the
+            database isn't encrypted, since the file wouldn't be); otherwise the query fails with
+            error::QueryResultTooLarge. */
+        static void setRecordingMemoryLimit(uint64_t maxBytes);
+
+        static RecordingStats recordingStats();
+
+        /** Runs several queries of the same DataFile within one read-only transaction, so that
+            their results are consistent with each other, and returns their enumerators in the
+            same order. `options` has an item for each query. If `parallelism` is greater than 1,
+            up to that many of the queries run at once, on separate connections. */
+        static std::vector<std::unique_ptr<QueryEnumerator>>
+                createEnumerators(const std::vector<Query*> &queries,
+                                  const std::vector<Options> &options,
+                                  unsigned parallelism =0);
+
+        /** Runs the query, discarding the results, and returns a report of how it executed:
+            rows visited by each loop of the query plan, full-scan steps, sorts, automatic index
+            rows, VM steps, and the number of calls to and time spent in each Fleece function. */
+        virtual std::string profile(const Options* =nullptr) =0;
+
+        /** Interrupts any createEnumerator() call on this query that's in progress on another
+            thread, making it throw error::QueryInterrupted. Has no effect on later calls. */
+        virtual void cancel() noexcept =0;
+
     protected:
         Query(KeyStore &keyStore) noexcept
         :_keyStore(keyStore)
@@ -83,6 +131,10 @@ namespace litecore {
         virtual int64_t getRowCount() const         {return -1;}
         virtual void seek(uint64_t rowIndex)        {error::_throw(error::UnsupportedOperation);}
 
+        /** The number of threads the query's table scan was split across (see
+            Query::Options::parallelism), or 1 if it ran serially. */
+        virtual unsigned partitionCount() const     {return 1;}
+
         virtual bool hasFullText() const                        {return false;}
         virtual const FullTextTerms& fullTextTerms()            {return _fullTextTerms;}
 
@@ -49,8 +49,17 @@ namespace litecore {
     // Existing SQLite FTS rank function:
     static constexpr slice kRankFnName  = "rank"_sl;
 
+    // FTS5's built-in ranking function:
+    static constexpr slice kBM25FnName  = "bm25"_sl;
+
+    // R*Tree query function for geo indexes, in SQLiteN1QLFunctions.cc:
+    static constexpr slice kGeoRadiusFnName = "geo_radius"_sl;
+
     static constexpr slice kArrayCountFnName = "array_count"_sl;
 
+    // Unicode collation sort-key function, in UnicodeCollator_ICU.cc:
+    static constexpr slice kSortKeyFnName = "unicode_sortkey"_sl;
+
 
 #pragma mark - UTILITY FUNCTIONS:
 
@@ -136,6 +145,11 @@ namespace litecore {
     
     static string propertyFromOperands(Array::iterator &operands);
     static string propertyFromNode(const Value *node);
+    static vector<string> likeFragments(slice pattern);
+    static vector<string> regexFragments(slice pattern);
+
+    // Thrown while parsing a query against an aggregate view that can't answer it.
+    struct AggregateViewMismatch { };
 
 
 #pragma mark - QUERY PARSER TOP LEVEL:
@@ -147,24 +161,40 @@ namespace litecore {
         _parameters.clear();
         _variables.clear();
         _ftsTables.clear();
+        _clause = kOtherClause;
+        _whereProperties.clear();
+        _orderByProperties.clear();
+        _aggregateViewUsed.clear();
         _1stCustomResultCol = 0;
         _isAggregateQuery = _aggregatesOK = false;
     }
 
 
-    void QueryParser::parseJSON(slice expressionJSON) {
-        alloc_slice expressionFleece;
+    static alloc_slice convertQueryJSON(slice expressionJSON) {
         try {
-            expressionFleece = JSONConverter::convertJSON(expressionJSON);
+            return JSONConverter::convertJSON(expressionJSON);
         } catch (FleeceException x) {
             fail("JSON parse error: %s", x.what());
         }
+    }
+
+
+    void QueryParser::parseJSON(slice expressionJSON) {
+        alloc_slice expressionFleece = convertQueryJSON(expressionJSON);
         return parse(Value::fromTrustedData(expressionFleece));
     }
     
     
     void QueryParser::parse(const Value *expression) {
         reset();
+        parseQuery(expression);
+        if (_isAggregateQuery && _aggregateViews && _aliases.empty() && _ftsTables.empty()
+                              && _baseResultColumns.empty())
+            useAggregateView(expression);
+    }
+
+
+    void QueryParser::parseQuery(const Value *expression) {
         if (expression->asDict()) {
             // Given a dict; assume it's the operands of a SELECT:
             writeSelect(expression->asDict());
@@ -181,6 +211,70 @@ namespace litecore {
     }
 
 
+    // Parses an aggregate query again, reading from each aggregate view in turn instead of the
+    // table, until one of them has every grouping expression and aggregate the query needs.
+    // If none does, the query is parsed normally again.
+    void QueryParser::useAggregateView(const Value *expression) {
+        auto views = _aggregateViews();
+        for (auto &view : views) {
+            _aggregateView = &view;
+            _sql.str("");
+            reset();
+            try {
+                parseQuery(expression);
+                _aggregateView = nullptr;
+                _aggregateViewUsed = view.tableName;
+                return;
+            } catch (const AggregateViewMismatch&) { }
+        }
+        _aggregateView = nullptr;
+        _sql.str("");
+        reset();
+        parseQuery(expression);
+    }
+
+
+    // The partial aggregates are found by parsing the query as though a view of them existed,
+    // which has every column asked for. Those columns are then computed from the table.
+    bool QueryParser::parsePartitionedJSON(slice expressionJSON, const string &partialsTable) {
+        alloc_slice expressionFleece = convertQueryJSON(expressionJSON);
+        const Value *expression = Value::fromTrustedData(expressionFleece);
+        reset();
+        parseQuery(expression);
+        if (!_isAggregateQuery || !_aliases.empty() || !_ftsTables.empty()
+                               || !_baseResultColumns.empty())
+            return false;
+
+        // Combining query, which also collects the partial aggregates' columns:
+        AggregateView partials {partialsTable, {}};
+        _aggregateView = &partials;
+        _collectingPartials = true;
+        _partialColumns = {aggregateViewColumn("count"_sl, "")};
+        _sql.str("");
+        reset();
+        bool ok = true;
+        try {
+            parseQuery(expression);
+        } catch (const AggregateViewMismatch&) {
+            ok = false;
+        }
+        _aggregateView = nullptr;
+        _collectingPartials = false;
+        if (!ok)
+            return false;
+        string combiningSQL = _sql.str();
+
+        // Query of the partial aggregates:
+        _sql.str("");
+        reset();
+        writePartialAggregatesQuery(expression);
+        _partialAggregatesSQL = _sql.str();
+
+        _sql.str(combiningSQL);
+        return true;
+    }
+
+
     void QueryParser::parseJustExpression(const Value *expression) {
         reset();
         parseNode(expression);
@@ -241,6 +335,8 @@ namespace litecore {
 
         if (nCustomCol == 0) {
             // If no return columns are specified, add the docID and sequence as defaults
+            if (_aggregateView)
+                throw AggregateViewMismatch();
             if (nCol > 0)
                 _sql << ", ";
             _sql << defaultTablePrefix << "key, " << defaultTablePrefix << "sequence";
@@ -250,7 +346,9 @@ namespace litecore {
         writeFromClause(from);
 
         // WHERE clause:
+        _clause = kWhereClause;
         writeWhereClause(where);
+        _clause = kOtherClause;
 
         // GROUP_BY clause:
         bool grouped = (writeSelectListClause(operands, "GROUP_BY"_sl, " GROUP BY ") > 0);
@@ -268,7 +366,9 @@ namespace litecore {
         }
 
         // ORDER_BY clause:
+        _clause = kOrderByClause;
         writeSelectListClause(operands, "ORDER_BY"_sl, " ORDER BY ", true);
+        _clause = kOtherClause;
 
         // LIMIT, OFFSET clauses:
         writeOrderOrLimitClause(operands, "LIMIT"_sl,  "LIMIT");
@@ -303,7 +403,9 @@ namespace litecore {
 
 
     void QueryParser::writeWhereClause(const Value *where) {
-        if (_includeDeleted) {
+        if (_collectingPartials)
+            return;                                 // (the partial aggregates are pre-filtered)
+        if (_includeDeleted || _aggregateView) {    // (aggregate views omit deleted docs)
             if (where) {
                 _sql << " WHERE ";
                 parseNode(where);
@@ -331,12 +433,21 @@ namespace litecore {
     }
 
 
-    void QueryParser::writeCreateIndex(const string &name, const Array *expressions) {
+    void QueryParser::writeCreateIndex(const string &name,
+                                       const Array *expressions,
+                                       const Value *where)
+    {
         reset();
         _sql << "CREATE INDEX \"" << name << "\" ON " << _tableName << " ";
         Array::iterator iter(expressions);
         writeColumnList(iter);
-        // TODO: Add 'WHERE' clause for use with SQLite 3.15+
+        if (where) {
+            // A partial index. Its WHERE clause is written exactly like a query's (including the
+            // not-deleted test), because SQLite will only use the index for a query whose WHERE
+            // clause contains each of its terms verbatim.
+            writeWhereClause(where);
+        }
+        require(_parameters.empty(), "Index expressions may not contain query parameters");
     }
 
 
@@ -367,6 +478,10 @@ namespace litecore {
 
 
     void QueryParser::writeFromClause(const Value *from) {
+        if (_aggregateView) {
+            _sql << " FROM \"" << _aggregateView->tableName << "\"";
+            return;
+        }
         _sql << " FROM " << _tableName;
         unsigned i = 0;
         if (from) {
@@ -420,7 +535,8 @@ namespace litecore {
             if (i > 1)
                 _sql << ",";
             _sql << " JOIN \"" << ftsTable << "\" AS FTS" << ftsTableNo
-                 << " ON FTS" << ftsTableNo << ".docid = kv_default.rowid";
+                 << " ON FTS" << ftsTableNo << (isFTS5Table(ftsTable) ? ".rowid" : ".docid")
+                 << " = kv_default.rowid";
         }
     }
 
@@ -485,6 +601,8 @@ namespace litecore {
 
 
     void QueryParser::parseOpNode(const Array *node) {
+        if (_aggregateView && writeAggregateViewColumn(node))
+            return;
         Array::iterator array(node);
         require(array.count() > 0, "Empty JSON array");
         slice op = requiredString(array[0], "operation");
@@ -559,8 +677,39 @@ namespace litecore {
     }
 
     
+    // Returns the operator that's equivalent to `op` with its operands swapped, or nullslice if
+    // `op` isn't a comparison that can be swapped. (IS and IS NOT can't: with a null on the right
+    // they become = and != (#410), which treat a missing value differently.)
+    static slice commutedComparison(slice op) {
+        static const slice kCommuted[][2] = {
+            {"="_sl, "="_sl}, {"!="_sl, "!="_sl},
+            {"<"_sl, ">"_sl}, {"<="_sl, ">="_sl}, {">"_sl, "<"_sl}, {">="_sl, "<="_sl},
+        };
+        for (auto &c : kCommuted)
+            if (op.caseEquivalent(c[0]))
+                return c[1];
+        return nullslice;
+    }
+
+
     // Handles infix operators
     void QueryParser::infixOp(slice op, Array::iterator& operands) {
+        if (operands.count() == 2 && operands[0]->type() != kArray
+                                  && operands[1]->type() == kArray) {
+            slice commuted = commutedComparison(op);
+            if (commuted) {
+                // Write a comparison with a literal on the left as the equivalent one with the
+                // literal on the right. Then equivalent WHERE clauses produce identical SQL,
+                // which SQLite needs in order to match a query against a partial index.
+                const Value *lhs = operands[1], *rhs = operands[0];
+                op = commuted;
+                parseCollatableNode(lhs);
+                _sql << ' ' << op << ' ';
+                parseCollatableNode(rhs);
+                return;
+            }
+        }
+
         if (operands.count() >= 2 && operands[1]->type() == kNull) {
             // Ugly special case where SQLite's semantics for 'IS [NOT]' don't match N1QL's (#410)
             if (op.caseEquivalent("IS"_sl))
@@ -642,13 +791,26 @@ namespace litecore {
         auto curContext = _context.back();
         _context.pop_back();
 
-        // Parse the expression:
-        parseNode(operands[1]);
+        string sortKey;
+        if (isSortKeyCandidate(operands[1])) {
+            // An index or ORDER BY term can use the binary sort key instead of the collation, if
+            // we're creating such an index or the query can use one:
+            sortKey = sortKeySQL(operands[1]);
+            if (!_unicodeSortKeys && !(_indexedExpression && _indexedExpression(sortKey)))
+                sortKey.clear();
+        }
 
-        // If nothing in the expression (like a comparison operator) used the collation to generate
-        // a SQL 'COLLATE', generate one now for the entire expression:
-        if (!_collationUsed)
-            writeCollation();
+        if (!sortKey.empty()) {
+            _sql << sortKey;
+        } else {
+            // Parse the expression:
+            parseNode(operands[1]);
+
+            // If nothing in the expression (like a comparison operator) used the collation to
+            // generate a SQL 'COLLATE', generate one now for the entire expression:
+            if (!_collationUsed)
+                writeCollation();
+        }
 
         _context.push_back(curContext);
 
@@ -700,14 +862,34 @@ namespace litecore {
     }
 
 
-    // Handles "fts_index MATCH pattern" expressions (FTS)
-    void QueryParser::matchOp(slice op, Array::iterator& operands) {
-        // Is a MATCH legal here? Look at the parent operation(s):
+    // Handles "x LIKE pattern" expressions
+    void QueryParser::likeOp(slice op, Array::iterator& operands) {
+        bool prefiltered = false;
+        if (operands[1]->type() == kString) {
+            prefiltered = writeTrigramPrefilter(operands[0],
+                                                likeFragments(operands[1]->asString()));
+        }
+        infixOp(op, operands);
+        if (prefiltered)
+            _sql << ")";
+    }
+
+
+    // Returns true if the operation being written is the entire WHERE clause or a term of a
+    // top-level AND in it, i.e. if no row for which it isn't true can be in the results.
+    bool QueryParser::isTopLevelCondition() const {
         auto parentCtx = _context.rbegin() + 1;
         auto parentOp = (*parentCtx)->op;
         while (parentOp == "AND"_sl)
             parentOp = (*++parentCtx)->op;
-        require(parentOp == "SELECT"_sl || parentOp == nullslice,
+        return parentOp == "SELECT"_sl || parentOp == nullslice;
+    }
+
+
+    // Handles "fts_index MATCH pattern" expressions (FTS)
+    void QueryParser::matchOp(slice op, Array::iterator& operands) {
+        // Is a MATCH legal here? Look at the parent operation(s):
+        require(isTopLevelCondition(),
                 "MATCH can only appear at top-level, or in a top-level AND");
 
         // Write the expression:
@@ -718,6 +900,39 @@ namespace litecore {
     }
 
 
+    // Handles geo index searches:
+    // ["GEO_WITHIN", indexName, west, south, east, north] matches docs whose GeoJSON value lies
+    // within the bounding box; ["GEO_NEAR", indexName, lon, lat, meters] matches docs whose
+    // GeoJSON value lies within that distance of the point.
+    void QueryParser::geoOp(slice op, Array::iterator& operands) {
+        if (_aggregateView)
+            throw AggregateViewMismatch();
+        string geoTable = geoTableName(requiredString(operands[0], "geo index name").asString());
+        if (_tableExists && !_tableExists(geoTable))
+            error::_throw(error::NoSuchIndex, "'%.*s' test requires a geo index", SPLAT(op));
+
+        if (_aliases.empty())
+            _sql << _tableName << ".";
+        else
+            _sql << '"' << _aliases[0] << "\".";
+        _sql << "rowid IN (SELECT id FROM \"" << geoTable << "\" WHERE ";
+        ++operands;
+        if (op.caseEquivalent("GEO_WITHIN"_sl)) {
+            static const char* const kBoundsTests[4] = {"minLon >= ", " AND minLat >= ",
+                                                        " AND maxLon <= ", " AND maxLat <= "};
+            for (auto test : kBoundsTests) {
+                _sql << test;
+                parseNode(operands.value());
+                ++operands;
+            }
+        } else {
+            _sql << "id MATCH " << kGeoRadiusFnName;
+            writeArgList(operands);
+        }
+        _sql << ")";
+    }
+
+
     // Handles "ANY var IN array SATISFIES expr" (and EVERY, and ANY AND EVERY)
     void QueryParser::anyEveryOp(slice op, Array::iterator& operands) {
         auto var = (string)requiredString(operands[0], "ANY/EVERY first parameter");
@@ -732,6 +947,11 @@ namespace litecore {
         bool every = !op.caseEquivalent("ANY"_sl);
         bool anyAndEvery = op.caseEquivalent("ANY AND EVERY"_sl);
 
+        if (!every && writeArrayIndexLookup(var, property, operands[2])) {
+            _variables.erase(var);
+            return;
+        }
+
         //OPT: If expr is `var = value`, can generate `fl_contains(array, value)` instead 
 
         if (anyAndEvery) {
@@ -758,6 +978,71 @@ namespace litecore {
     }
 
 
+    // Returns true if `node` is a reference to the variable itself, e.g. ["?", "X"] or ["?X"].
+    static bool isVariableNode(const Value *node, const string &var) {
+        Array::iterator i(node->asArray());
+        if (i.count() == 0)
+            return false;
+        slice op = i[0]->asString();
+        if (op == "?"_sl)
+            return i.count() == 2 && i[1]->asString() == slice(var);
+        return i.count() == 1 && op == slice("?" + var);
+    }
+
+
+    // Returns true if `node` is a literal scalar or a query parameter.
+    static bool isLiteralOrParameter(const Value *node) {
+        switch (node->type()) {
+            case kBoolean:
+            case kNumber:
+            case kString:
+                return true;
+            case kArray: {
+                Array::iterator i(node->asArray());
+                slice op = i.count() > 0 ? i[0]->asString() : nullslice;
+                return op.size > 0 && op[0] == '$';
+            }
+            default:
+                return false;
+        }
+    }
+
+
+    // If an ANY predicate is of the form `var = value`, and the array property has an array index,
+    // writes a lookup in the index's table and returns true. Else returns false.
+    bool QueryParser::writeArrayIndexLookup(const string &var,
+                                            string property,
+                                            const Value *predicate)
+    {
+        if (!_tableExists || !_collationUsed)
+            return false;               // the index only supports binary collation
+        Array::iterator i(predicate->asArray());
+        if (i.count() != 3 || i[0]->asString() != "="_sl)
+            return false;
+        const Value *value;
+        if (isVariableNode(i[1], var))
+            value = i[2];
+        else if (isVariableNode(i[2], var))
+            value = i[1];
+        else
+            return false;
+        if (!isLiteralOrParameter(value))
+            return false;
+
+        string tableName = extractTableAlias(property);
+        string unnestTable = unnestedTableName(property);
+        if (!_tableExists(unnestTable))
+            return false;
+
+        if (tableName.empty())
+            tableName = _tableName + ".";
+        _sql << tableName << "rowid IN (SELECT docid FROM \"" << unnestTable << "\" WHERE value = ";
+        parseNode(value);
+        _sql << ")";
+        return true;
+    }
+
+
     // Handles doc property accessors, e.g. [".", "prop"] or [".prop"] --> fl_value(body, "prop")
     void QueryParser::propertyOp(slice op, Array::iterator& operands) {
         writePropertyGetter(kValueFnName, propertyFromOperands(operands));
@@ -861,8 +1146,11 @@ namespace litecore {
             // Outer SELECT
             writeSelect(dict);
         } else {
+            if (_aggregateView)
+                throw AggregateViewMismatch();
             // Nested SELECT; use a fresh parser
             QueryParser nested(_tableName, _bodyColumnName);
+            nested.setTableExistsCallback(_tableExists);
             nested.parse(dict);
             _sql << nested.SQL();
         }
@@ -922,17 +1210,38 @@ namespace litecore {
         if (op.caseEquivalent(kArrayCountFnName) && writeNestedPropertyOpIfAny(kCountFnName, operands))
             return;
 
-        // Special case: in "rank(ftsName)" the param has to be a matchinfo() call:
+        // Special case: in "rank(ftsName)" the param has to be a matchinfo() call, or with FTS5
+        // the native bm25() function (negated, since it returns lower values for better matches):
         if (op.caseEquivalent(kRankFnName)) {
             string fts = FTSTableName(operands[0]);
             if (find(_ftsTables.begin(), _ftsTables.end(), fts) == _ftsTables.end())
                 fail("rank() can only be called on FTS indexes");
-            _sql << "rank(matchinfo(\"" << fts << "\"))";
+            if (isFTS5Table(fts))
+                _sql << "(-" << kBM25FnName << "(\"" << fts << "\"))";
+            else
+                _sql << "rank(matchinfo(\"" << fts << "\"))";
             return;
         }
 
+        // Special case: a substring or regex search with a literal pattern can use a trigram index
+        // to narrow down the records to search:
+        bool prefiltered = false;
+        if ((op.caseEquivalent("contains"_sl) || op.caseEquivalent("regexp_contains"_sl)
+                                              || op.caseEquivalent("regexp_like"_sl))
+                && operands[1]->type() == kString) {
+            slice pattern = operands[1]->asString();
+            vector<string> fragments;
+            if (op.caseEquivalent("contains"_sl))
+                fragments.push_back(pattern.asString());
+            else
+                fragments = regexFragments(pattern);
+            prefiltered = writeTrigramPrefilter(operands[0], fragments);
+        }
+
         _sql << op;
         writeArgList(operands);
+        if (prefiltered)
+            _sql << ")";
     }
 
 
@@ -1007,8 +1316,9 @@ namespace litecore {
     }
 
 
-    // Writes a call to a Fleece SQL function, including the closing ")".
-    void QueryParser::writePropertyGetter(slice fn, string property) {
+    // If the query has database aliases, removes the alias from the start of `property` and
+    // returns it in the form of a SQL table qualifier (quoted, with a trailing '.').
+    string QueryParser::extractTableAlias(string &property) {
         string tableName;
         if (!_aliases.empty()) {
             // Interpret the first component of the property as a db alias:
@@ -1031,7 +1341,28 @@ namespace litecore {
             tableName = "\"" + first + "\".";
             property = rest;
         }
+        return tableName;
+    }
+
 
+    // Writes a call to a Fleece SQL function, including the closing ")".
+    void QueryParser::writePropertyGetter(slice fn, string property) {
+        string tableName = extractTableAlias(property);
+        if (_aggregateView) {
+            // Reading from an aggregate view, a property can only be one of its groups:
+            if (property == "_id" || property == "_sequence" || fn == kEachFnName)
+                throw AggregateViewMismatch();
+            stringstream expr;
+            expr << (property.empty() && fn == kValueFnName ? kRootFnName : fn)
+                 << "(" << _bodyColumnName;
+            if (!property.empty()) {
+                expr << ", ";
+                writeSQLString(expr, slice(property));
+            }
+            expr << ")";
+            writeAggregateViewGroup(expr.str());
+            return;
+        }
         if (property == "_id") {
             require(fn == kValueFnName, "can't use '_id' in this context");
             _sql << tableName << "key";
@@ -1043,6 +1374,9 @@ namespace litecore {
             if (property == "" && fn == kValueFnName)
                 fn = kRootFnName;
 
+            if (fn == kValueFnName && !property.empty())
+                addIndexCandidate(property);
+
             // Write the function call:
             _sql << fn << "(" << tableName << _bodyColumnName;
             if(!property.empty()) {
@@ -1054,6 +1388,35 @@ namespace litecore {
     }
 
 
+    // Notes a property that an index might help with: one compared in the WHERE clause, or
+    // sorted on in the ORDER BY clause.
+    void QueryParser::addIndexCandidate(const string &property) {
+        if (_clause == kOtherClause || _aliases.size() > 1)
+            return;
+        // Find the operation the property is an operand of. (A bare string in a column list
+        // has no operation of its own.)
+        auto op = _context.rbegin();
+        if (*op != &kColumnListOperation)
+            ++op;
+        vector<string> *properties;
+        if (_clause == kWhereClause) {
+            static const slice kComparisons[] = {"="_sl, "<"_sl, "<="_sl, ">"_sl, ">="_sl,
+                                                 "IS"_sl, "IN"_sl, "BETWEEN"_sl};
+            if (find(begin(kComparisons), end(kComparisons), (*op)->op) == end(kComparisons))
+                return;
+            properties = &_whereProperties;
+        } else {
+            if (*op != &kColumnListOperation && (*op)->op == "DESC"_sl)
+                ++op;
+            if (*op != &kColumnListOperation)
+                return;
+            properties = &_orderByProperties;
+        }
+        if (find(properties->begin(), properties->end(), property) == properties->end())
+            properties->push_back(property);
+    }
+
+
     /*static*/ std::string QueryParser::expressionSQL(const fleece::Value* expr,
                                                       const char *bodyColumnName)
     {
@@ -1063,6 +1426,164 @@ namespace litecore {
     }
 
 
+#pragma mark - AGGREGATE VIEWS:
+
+
+    /*static*/ string QueryParser::aggregateViewColumn(slice fn, const string &exprSQL) {
+        return fn.asString() + ":" + exprSQL;
+    }
+
+
+    // In a query being answered from an aggregate view, writes an aggregate function call, or a
+    // grouping expression, in terms of the view's columns and returns true. Returns false for any
+    // other expression, whose operands then get the same treatment.
+    bool QueryParser::writeAggregateViewColumn(const Array *node) {
+        slice op = node->get(0)->asString();
+        if (op.size > 2 && op[op.size-2] == '(' && op[op.size-1] == ')') {
+            slice fn(op.buf, op.size - 2);
+            static const slice kAggregates[] = {"count"_sl, "sum"_sl, "avg"_sl, "min"_sl, "max"_sl};
+            auto agg = find_if(begin(kAggregates), end(kAggregates),
+                               [&](slice name) {return fn.caseEquivalent(name);});
+            if (agg != end(kAggregates)) {
+                require(_aggregatesOK,
+                        "Cannot use aggregate function %.*s() in this context", SPLAT(fn));
+                _isAggregateQuery = true;
+                if (node->count() > 2)
+                    throw AggregateViewMismatch();  // (e.g. SQL's scalar 2-argument min())
+                string argSQL;
+                if (node->count() > 1) {
+                    try {
+                        argSQL = expressionSQL(node->get(1), _bodyColumnName.c_str());
+                    } catch (const error&) {
+                        throw AggregateViewMismatch();
+                    }
+                }
+                // Each view row is a group, so a query's aggregate is an aggregate of those
+                // of its groups:
+                string count = aggregateViewColumn("count"_sl, argSQL);
+                if (!hasAggregateViewColumn(count))
+                    throw AggregateViewMismatch();
+                if (*agg == "count"_sl) {
+                    _sql << "coalesce(sum(";
+                    writeAggregateViewColumnName(count);
+                    _sql << "), 0)";
+                    return true;
+                }
+                string column = aggregateViewColumn((*agg == "avg"_sl) ? "sum"_sl : *agg, argSQL);
+                if (argSQL.empty() || !hasAggregateViewColumn(column))
+                    throw AggregateViewMismatch();
+                if (*agg == "sum"_sl) {
+                    // (SQL's sum() of no non-null values is NULL)
+                    _sql << "(CASE WHEN sum(";
+                    writeAggregateViewColumnName(count);
+                    _sql << ") > 0 THEN sum(";
+                    writeAggregateViewColumnName(column);
+                    _sql << ") END)";
+                } else if (*agg == "avg"_sl) {
+                    _sql << "(sum(";
+                    writeAggregateViewColumnName(column);
+                    _sql << ") * 1.0 / nullif(sum(";
+                    writeAggregateViewColumnName(count);
+                    _sql << "), 0))";
+                } else {
+                    _sql << *agg << "(";
+                    writeAggregateViewColumnName(column);
+                    _sql << ")";
+                }
+                return true;
+            }
+        }
+
+        if (_collectingPartials)
+            return false;   // (Partial aggregates are only grouped by properties)
+        string exprSQL;
+        try {
+            exprSQL = expressionSQL(node, _bodyColumnName.c_str());
+        } catch (const error&) {
+            return false;   // (e.g. it contains an aggregate; its operands will be handled)
+        }
+        if (!hasAggregateViewColumn(aggregateViewColumn("group"_sl, exprSQL)))
+            return false;
+        writeAggregateViewGroup(exprSQL);
+        return true;
+    }
+
+
+    // Writes a reference to an aggregate view's grouping column; if it has none with the given
+    // expression, the view can't answer the query.
+    void QueryParser::writeAggregateViewGroup(const string &exprSQL) {
+        string column = aggregateViewColumn("group"_sl, exprSQL);
+        if (!hasAggregateViewColumn(column))
+            throw AggregateViewMismatch();
+        writeAggregateViewColumnName(column);
+    }
+
+
+    bool QueryParser::hasAggregateViewColumn(const string &column) {
+        if (_collectingPartials) {
+            if (find(_partialColumns.begin(), _partialColumns.end(), column)
+                    == _partialColumns.end())
+                _partialColumns.push_back(column);
+            return true;
+        }
+        auto &columns = _aggregateView->columns;
+        return find(columns.begin(), columns.end(), column) != columns.end();
+    }
+
+
+    void QueryParser::writeAggregateViewColumnName(const string &column) {
+        _sql << '"';
+        for (char c : column) {
+            if (c == '"')
+                _sql << '"';
+            _sql << c;
+        }
+        _sql << '"';
+    }
+
+
+    // Writes a query of the table computing the columns in _partialColumns, for the rows in a
+    // range of rowids. It groups by every property the combining query reads, which makes groups
+    // at least as fine as the query's own, so the combining query can regroup them.
+    void QueryParser::writePartialAggregatesQuery(const Value *expression) {
+        const Value *where;
+        const Dict *operands = expression->asDict();
+        if (!operands) {
+            const Array *a = expression->asArray();
+            if (a && a->count() > 0 && a->get(0)->asString() == "SELECT"_sl)
+                operands = requiredDict(a->get(1), "Argument to SELECT");
+        }
+        if (operands)
+            where = getCaseInsensitive(operands, "WHERE"_sl);
+        else
+            where = expression;
+
+        _sql << "SELECT ";
+        stringstream groupBy;
+        unsigned n = 0;
+        for (auto &column : _partialColumns) {
+            auto colon = column.find(':');
+            string fn = column.substr(0, colon), exprSQL = column.substr(colon + 1);
+            if (n++ > 0)
+                _sql << ", ";
+            if (fn == "group") {
+                _sql << exprSQL;
+                groupBy << (groupBy.tellp() > 0 ? ", " : " GROUP BY ") << n;
+            } else if (exprSQL.empty()) {
+                _sql << fn << "(*)";
+            } else {
+                _sql << fn << "(" << exprSQL << ")";
+            }
+        }
+        writeFromClause(nullptr);
+        _clause = kWhereClause;
+        writeWhereClause(where);
+        _clause = kOtherClause;
+        _sql << " AND " << _tableName << ".rowid >= :rowid_start AND "
+             << _tableName << ".rowid < :rowid_end" << groupBy.str();
+    }
+
+
 #pragma mark - FULL-TEXT-SEARCH MATCH:
 
 
@@ -1099,6 +1620,18 @@ namespace litecore {
         return _tableName + "::" + indexName;
     }
 
+    string QueryParser::aggregateViewTableName(const string &indexName) const {
+        require(!indexName.empty() && indexName.find('"') == string::npos,
+                "Aggregate index name may not contain double-quotes nor be empty");
+        return _tableName + "::" + indexName;
+    }
+
+    // An FTS5 table has a "_config" shadow table, which FTS4 doesn't. If the parser can't check,
+    // it assumes FTS4.
+    bool QueryParser::isFTS5Table(const string &ftsTableName) const {
+        return _tableExists && _tableExists(ftsTableName + "_config");
+    }
+
     size_t QueryParser::FTSPropertyIndex(const Value *matchLHS, bool canAdd) {
         string key = FTSTableName(matchLHS);
         auto i = find(_ftsTables.begin(), _ftsTables.end(), key);
@@ -1122,4 +1655,281 @@ namespace litecore {
         return property;
     }
 
+
+
+#pragma mark - UNICODE SORT KEYS:
+
+
+    // Returns true if the expression being collated with a Unicode collation is a property, and
+    // is an item of an index or ORDER BY (optionally DESC.) Such an expression's values can be
+    // replaced by their sort keys, which compare bytewise in the same order.
+    bool QueryParser::isSortKeyCandidate(const Value *collatedExpr) const {
+        if (!_collation.unicodeAware)
+            return false;
+        auto parent = _context.rbegin();        // (collateOp has already popped itself)
+        if ((*parent)->op == "DESC"_sl)
+            ++parent;
+        if (parent == _context.rend() || *parent != &kColumnListOperation)
+            return false;
+        slice op = collatedExpr->asString();
+        if (!op) {
+            const Array *array = collatedExpr->asArray();
+            if (!array || array->count() == 0)
+                return false;
+            op = array->get(0)->asString();
+        }
+        return op.size > 1 && op[0] == '.';
+    }
+
+
+    // Returns the SQL for the collated expression's sort key, without writing it to _sql.
+    string QueryParser::sortKeySQL(const Value *collatedExpr) {
+        string outerSQL = _sql.str();
+        _sql.str("");
+        parseNode(collatedExpr);
+        stringstream sortKey;
+        sortKey << kSortKeyFnName << "(" << _sql.str() << ", ";
+        writeSQLString(sortKey, slice(_collation.sqliteName()));
+        sortKey << ")";
+        _sql.str(outerSQL);
+        _sql.seekp(0, ios_base::end);
+        return sortKey.str();
+    }
+
+
+#pragma mark - GEO INDEXES:
+
+
+    // Name of the R*Tree table in which a geo index stores the bounds of the documents.
+    string QueryParser::geoTableName(const string &indexName) const {
+        require(!indexName.empty() && indexName.find('"') == string::npos,
+                "Geo index name may not contain double-quotes nor be empty");
+        return _tableName + "::" + indexName;
+    }
+
+
+#pragma mark - ARRAY INDEXES:
+
+
+    // Name of the side table in which an array index stores the items of an array property.
+    string QueryParser::unnestedTableName(const string &property) const {
+        require(!property.empty() && property.find('"') == string::npos,
+                "Array index property may not contain double-quotes nor be empty");
+        return _tableName + ":unnest:" + property;
+    }
+
+
+    string QueryParser::arrayIndexProperty(const Value *expression) {
+        string property = propertyFromNode(expression);
+        require(!property.empty(), "Array index expression must be a property");
+        return property;
+    }
+
+
+#pragma mark - TRIGRAM INDEXES:
+
+
+    // Max number of trigrams looked up in a trigram index to find the candidates for a match.
+    // (Any subset of a pattern's trigrams finds all the matches; more just narrows them down.)
+    static const size_t kMaxTrigramLookups = 8;
+
+
+    // Name of the side table in which a trigram index stores the trigrams of a property.
+    string QueryParser::trigramTableName(const string &property) const {
+        require(!property.empty() && property.find('"') == string::npos,
+                "Trigram index property may not contain double-quotes nor be empty");
+        return _tableName + ":trigram:" + property;
+    }
+
+
+    string QueryParser::trigramIndexProperty(const Value *expression) {
+        string property = propertyFromNode(expression);
+        require(!property.empty(), "Trigram index expression must be a property");
+        return property;
+    }
+
+
+    /*static*/ vector<uint32_t> QueryParser::trigrams(slice str) {
+        vector<uint32_t> result;
+        if (str.size < 3)
+            return result;
+        result.reserve(str.size - 2);
+        auto s = (const uint8_t*)str.buf;
+        for (size_t i = 0; i + 2 < str.size; ++i)
+            result.push_back((uint32_t(s[i]) << 16) | (uint32_t(s[i+1]) << 8) | s[i+2]);
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+
+    // The literal substrings that every string matching a LIKE pattern contains.
+    static vector<string> likeFragments(slice pattern) {
+        vector<string> fragments;
+        string fragment;
+        for (size_t i = 0; i < pattern.size; ++i) {
+            char c = pattern[i];
+            if (c == '%' || c == '_') {
+                if (!fragment.empty())
+                    fragments.push_back(fragment);
+                fragment.clear();
+            } else {
+                fragment += c;
+            }
+        }
+        if (!fragment.empty())
+            fragments.push_back(fragment);
+        return fragments;
+    }
+
+
+    // The literal substrings that every string containing a match of a regex contains. This errs
+    // on the side of finding fewer: anything in parentheses is skipped, and alternation at the
+    // top level means there are none.
+    static vector<string> regexFragments(slice pattern) {
+        vector<string> fragments;
+        string fragment;
+        auto endFragment = [&]() {
+            if (!fragment.empty())
+                fragments.push_back(fragment);
+            fragment.clear();
+        };
+        // Removes the last character (which may be a multi-byte UTF-8 sequence) from `fragment`:
+        auto dropLastChar = [&]() {
+            while (!fragment.empty() && (fragment.back() & 0xC0) == 0x80)
+                fragment.pop_back();
+            if (!fragment.empty())
+                fragment.pop_back();
+        };
+        int depth = 0;
+        for (size_t i = 0; i < pattern.size; ++i) {
+            char c = pattern[i];
+            switch (c) {
+                case '|':
+                    if (depth == 0)
+                        return {};
+                    break;
+                case '(':
+                    endFragment();
+                    ++depth;
+                    break;
+                case ')':
+                    endFragment();
+                    --depth;
+                    break;
+                case '[':
+                    // Skip the character class:
+                    endFragment();
+                    ++i;
+                    if (i < pattern.size && pattern[i] == '^')
+                        ++i;
+                    if (i < pattern.size && pattern[i] == ']')
+                        ++i;
+                    for (; i < pattern.size && pattern[i] != ']'; ++i) {
+                        if (pattern[i] == '\\')
+                            ++i;
+                    }
+                    break;
+                case '*':
+                case '?':
+                case '{':
+                    // The preceding character is optional:
+                    dropLastChar();
+                    endFragment();
+                    if (c == '{') {
+                        while (i < pattern.size && pattern[i] != '}')
+                            ++i;
+                    }
+                    break;
+                case '+':
+                case '.':
+                case '^':
+                case '$':
+                    endFragment();
+                    break;
+                case '\\':
+                    if (++i >= pattern.size)
+                        break;
+                    c = pattern[i];
+                    if (isalnum((unsigned char)c)) {
+                        // A character class, anchor, backreference or escaped character. Skip
+                        // its operands, so they aren't mistaken for literal characters:
+                        endFragment();
+                        size_t nOperands = 0;
+                        switch (c) {
+                            case 'x': nOperands = 2; break;     // \xHH
+                            case 'u': nOperands = 4; break;     // \uHHHH
+                            case 'c': nOperands = 1; break;     // \cX
+                            case 'k':                           // \k<name>
+                                while (i + 1 < pattern.size && pattern[i] != '>')
+                                    ++i;
+                                break;
+                            default:
+                                if (isdigit((unsigned char)c)) {  // \1, \12...
+                                    while (i + 1 < pattern.size
+                                                && isdigit((unsigned char)pattern[i + 1]))
+                                        ++i;
+                                }
+                                break;
+                        }
+                        i = min(i + nOperands, pattern.size - 1);
+                    } else if (depth == 0) {
+                        fragment += c;
+                    }
+                    break;
+                default:
+                    if (depth == 0)
+                        fragment += c;
+                    break;
+            }
+        }
+        endFragment();
+        return fragments;
+    }
+
+
+    // If `stringExpr` is a property with a trigram index, and this is a top-level condition of the
+    // WHERE clause, writes the start of a parenthesized test that the record has the trigrams of
+    // every fragment (with a trailing AND), and returns true; then the caller writes the actual
+    // test and the ")". Otherwise returns false.
+    bool QueryParser::writeTrigramPrefilter(const Value *stringExpr,
+                                            const vector<string> &fragments)
+    {
+        if (!_tableExists || !_collationUsed || _aggregateView || _clause != kWhereClause
+                          || fragments.empty() || !isTopLevelCondition())
+            return false;
+        string property = propertyFromNode(stringExpr);
+        if (property.empty())
+            return false;
+        string tableName = extractTableAlias(property);
+        if (property.empty() || property.find('"') != string::npos)
+            return false;
+        string trigramTable = trigramTableName(property);
+        if (!_tableExists(trigramTable))
+            return false;
+
+        vector<uint32_t> lookups;
+        for (auto &fragment : fragments) {
+            for (auto trigram : trigrams(slice(fragment))) {
+                if (find(lookups.begin(), lookups.end(), trigram) == lookups.end())
+                    lookups.push_back(trigram);
+            }
+        }
+        if (lookups.empty())
+            return false;               // no fragment is long enough to have a trigram
+        if (lookups.size() > kMaxTrigramLookups)
+            lookups.resize(kMaxTrigramLookups);
+
+        if (tableName.empty())
+            tableName = _tableName + ".";
+        _sql << "(" << tableName << "rowid IN (";
+        for (size_t i = 0; i < lookups.size(); ++i) {
+            if (i > 0)
+                _sql << " INTERSECT ";
+            _sql << "SELECT docid FROM \"" << trigramTable << "\" WHERE trigram = " << lookups[i];
+        }
+        _sql << ") AND ";
+        return true;
+    }
+
 }
@@ -20,6 +20,7 @@
 #include "Base.hh"
 #include "UnicodeCollator.hh"
 #include "Array.hh"
+#include <functional>
 #include <memory>
 #include <set>
 #include <sstream>
@@ -42,14 +43,66 @@ namespace litecore {
         ,_bodyColumnName(bodyColumnName)
         { }
 
+        /** Callback that returns true if a table exists in the database. */
+        using TableExistsCallback = std::function<bool(const std::string &tableName)>;
+
         void setBaseResultColumns(const std::vector<std::string>& c){_baseResultColumns = c;}
 
+        /** Lets the parser check for side tables like array indexes, which it will then use
+            to speed up queries. If not set, those indexes are ignored. */
+        void setTableExistsCallback(const TableExistsCallback &cb)  {_tableExists = cb;}
+
+        /** Callback that returns true if a value index on a SQL expression exists. */
+        using IndexedExpressionCallback = std::function<bool(const std::string &expressionSQL)>;
+
+        /** Lets the parser check whether a Unicode-collated ORDER BY term has a matching index of
+            sort keys, in which case it sorts by sort key to use that index. */
+        void setIndexedExpressionCallback(const IndexedExpressionCallback &cb) {_indexedExpression = cb;}
+
+        /** A materialized aggregate view (see KeyStore::kAggregateIndex): a table with a row per
+            group, whose columns are named after the expressions they hold. */
+        struct AggregateView {
+            std::string tableName;
+            std::vector<std::string> columns;
+        };
+
+        /** Callback that returns the aggregate views of the table. */
+        using AggregateViewsCallback = std::function<std::vector<AggregateView>()>;
+
+        /** Lets the parser answer aggregate queries from an aggregate view that has all the
+            groups and aggregates the query needs. */
+        void setAggregateViewsCallback(const AggregateViewsCallback &cb) {_aggregateViews = cb;}
+
+        /** Name of an aggregate view's column holding the aggregate `fn` ("group", "count",
+            "sum", "min" or "max") of the SQL expression `exprSQL`. The column counting the
+            group's rows has function "count" and an empty expression. */
+        static std::string aggregateViewColumn(slice fn, const std::string &exprSQL);
+
+        /** Prepares an aggregate query to be run in parallel over ranges of rowids. Afterwards,
+            partialAggregatesSQL() is a query of the partial aggregates of each group within the
+            range of rowids bound to `:rowid_start` and `:rowid_end`, and SQL() is a query that
+            combines those partial aggregates, once stored in the table `partialsTable`, into
+            the query's results. Returns false if the query can't be run this way. */
+        bool parsePartitionedJSON(slice, const std::string &partialsTable);
+
+        /** The query of partial aggregates, after parsePartitionedJSON(). */
+        const std::string& partialAggregatesSQL() const             {return _partialAggregatesSQL;}
+
+        /** The columns of the partial aggregates (and of the table storing them), named like
+            those of an aggregate view. */
+        const std::vector<std::string>& partialAggregateColumns() const {return _partialColumns;}
+
+        /** Makes Unicode-collated expressions in an index (or ORDER BY) use sort keys. */
+        void setUnicodeSortKeys(bool sortKeys)                      {_unicodeSortKeys = sortKeys;}
+
         void parse(const fleece::Value*);
         void parseJSON(slice);
 
         void parseJustExpression(const fleece::Value *expression);
 
-        void writeCreateIndex(const std::string &name, const fleece::Array *expressions);
+        void writeCreateIndex(const std::string &name,
+                              const fleece::Array *expressions,
+                              const fleece::Value *where =nullptr);
 
         static void writeSQLString(std::ostream &out, slice str);
 
@@ -61,10 +114,29 @@ namespace litecore {
 
         bool isAggregateQuery() const                               {return _isAggregateQuery;}
 
+        /** The aggregate view the query reads from instead of the table, or empty if none. */
+        const std::string& aggregateViewUsed() const                {return _aggregateViewUsed;}
+
+        /** Properties of the queried table that the WHERE clause compares, and that the
+            ORDER_BY clause sorts on; the raw material for index recommendations.
+            (Not collected for queries with joins.) */
+        const std::vector<std::string>& whereProperties() const     {return _whereProperties;}
+        const std::vector<std::string>& orderByProperties() const   {return _orderByProperties;}
+
         static std::string expressionSQL(const fleece::Value*, const char *bodyColumnName = "body");
         std::string FTSTableName(const fleece::Value *key) const;
         std::string FTSTableName(const std::string &property) const;
         static std::string FTSColumnName(const fleece::Value *expression);
+        std::string geoTableName(const std::string &indexName) const;
+        std::string aggregateViewTableName(const std::string &indexName) const;
+        std::string unnestedTableName(const std::string &property) const;
+        static std::string arrayIndexProperty(const fleece::Value *expression);
+        std::string trigramTableName(const std::string &property) const;
+        static std::string trigramIndexProperty(const fleece::Value *expression);
+
+        /** The distinct trigrams (3-byte substrings) of a string, each packed into an integer,
+            in ascending order. A trigram index stores these for each record. */
+        static std::vector<uint32_t> trigrams(slice str);
 
     private:
         struct Operation;
@@ -84,6 +156,14 @@ namespace litecore {
         void handleOperation(const Operation*, slice actualOperator, fleece::Array::iterator& operands);
         void parseStringLiteral(slice str);
 
+        void parseQuery(const fleece::Value*);
+        void useAggregateView(const fleece::Value*);
+        bool writeAggregateViewColumn(const fleece::Array*);
+        void writeAggregateViewGroup(const std::string &exprSQL);
+        bool hasAggregateViewColumn(const std::string &column);
+        void writePartialAggregatesQuery(const fleece::Value*);
+        void writeAggregateViewColumnName(const std::string &column);
+
         void writeSelect(const fleece::Dict *dict);
         void writeSelect(const fleece::Value *where, const fleece::Dict *operands);
         unsigned writeSelectListClause(const fleece::Dict *operands, slice key, const char *sql, bool aggregatesOK =false);
@@ -107,7 +187,9 @@ namespace litecore {
         void existsOp(slice, fleece::Array::iterator&);
         void collateOp(slice, fleece::Array::iterator&);
         void inOp(slice, fleece::Array::iterator&);
+        void likeOp(slice, fleece::Array::iterator&);
         void matchOp(slice, fleece::Array::iterator&);
+        void geoOp(slice, fleece::Array::iterator&);
         void anyEveryOp(slice, fleece::Array::iterator&);
         void parameterOp(slice, fleece::Array::iterator&);
         void propertyOp(slice, fleece::Array::iterator&);
@@ -120,7 +202,15 @@ namespace litecore {
         void functionOp(slice, fleece::Array::iterator&);
 
         bool writeNestedPropertyOpIfAny(fleece::slice fnName, fleece::Array::iterator &operands);
+        std::string extractTableAlias(std::string &property);
         void writePropertyGetter(slice fn, std::string property);
+        void addIndexCandidate(const std::string &property);
+        bool writeArrayIndexLookup(const std::string &var,
+                                   std::string property,
+                                   const fleece::Value *predicate);
+        bool isTopLevelCondition() const;
+        bool writeTrigramPrefilter(const fleece::Value *stringExpr,
+                                   const std::vector<std::string> &fragments);
         void writeSQLString(slice str)              {writeSQLString(_sql, str);}
         void writeArgList(fleece::Array::iterator& operands);
         void writeColumnList(fleece::Array::iterator& operands);
@@ -132,6 +222,9 @@ namespace litecore {
 
         unsigned findFTSProperties(const fleece::Value *node);
         size_t FTSPropertyIndex(const fleece::Value *matchLHS, bool canAdd =false);
+        bool isFTS5Table(const std::string &ftsTableName) const;
+        bool isSortKeyCandidate(const fleece::Value *collatedExpr) const;
+        std::string sortKeySQL(const fleece::Value *collatedExpr);
 
         std::string _tableName;
         std::string _bodyColumnName;
@@ -142,12 +235,24 @@ namespace litecore {
         std::set<std::string> _parameters;
         std::set<std::string> _variables;
         std::vector<std::string> _ftsTables;
+        enum Clause {kOtherClause, kWhereClause, kOrderByClause};
+        Clause _clause {kOtherClause};          // Clause being written, for index candidates
+        std::vector<std::string> _whereProperties, _orderByProperties;
+        TableExistsCallback _tableExists;
+        IndexedExpressionCallback _indexedExpression;
+        AggregateViewsCallback _aggregateViews;
+        const AggregateView* _aggregateView {nullptr};  // View being tried, while parsing
+        std::string _aggregateViewUsed;
+        bool _collectingPartials {false};       // Treating every view column as existing
+        std::vector<std::string> _partialColumns;
+        std::string _partialAggregatesSQL;
         unsigned _1stCustomResultCol {0};
         bool _aggregatesOK {false};
         bool _isAggregateQuery {false};
         static constexpr bool _includeDeleted {false};  // In future add an accessor to set this
         Collation _collation;
         bool _collationUsed {true};
+        bool _unicodeSortKeys {false};
     };
 
 }
@@ -61,8 +61,10 @@ namespace litecore {
         {"IS NOT"_sl,  2, 2,  3,  &QueryParser::infixOp},
         {"IN"_sl,      2, 9,  3,  &QueryParser::inOp},
         {"NOT IN"_sl,  2, 9,  3,  &QueryParser::inOp},
-        {"LIKE"_sl,    2, 2,  3,  &QueryParser::infixOp},
+        {"LIKE"_sl,    2, 2,  3,  &QueryParser::likeOp},
         {"MATCH"_sl,   2, 2,  3,  &QueryParser::matchOp},
+        {"GEO_WITHIN"_sl, 5, 5,  3,  &QueryParser::geoOp},
+        {"GEO_NEAR"_sl, 4, 4,  3,  &QueryParser::geoOp},
         {"BETWEEN"_sl, 3, 3,  3,  &QueryParser::betweenOp},
         {"EXISTS"_sl,  1, 1,  8,  &QueryParser::existsOp},
 
@@ -183,6 +185,9 @@ namespace litecore {
         // FTS (not standard N1QL):
         {"rank"_sl,             1, 1},
 
+        // Geospatial (not standard N1QL):
+        {"geo_distance"_sl,     4, 4},
+
         // Aggregate functions:
         {"avg"_sl,              1, 1, nullslice, true},
         {"count"_sl,            0, 1, nullslice, true},
@@ -0,0 +1,245 @@
+//
+// SQLiteFTS5Extensions.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Makes FTS5 tables work like LiteCore's FTS4 ones: registers the 'unicodesn' tokenizer with
+// FTS5 (by adapting the FTS3 tokenizer module), and an FTS5 version of the offsets() function.
+
+#include "SQLite_Internal.hh"
+#include <sqlite3.h>
+#include <algorithm>
+#include <new>
+#include <sstream>
+#include <string.h>
+#include <vector>
+
+extern "C" {
+    #include "fts3_tokenizer.h"
+}
+
+using namespace std;
+
+namespace litecore {
+
+
+#pragma mark - TOKENIZER:
+
+
+    // An FTS5 tokenizer instance, wrapping an FTS3 tokenizer.
+    struct FTS3TokenizerAdapter {
+        const sqlite3_tokenizer_module *module;
+        sqlite3_tokenizer *tokenizer;
+    };
+
+
+    static int adapterCreate(void *moduleContext,
+                             const char **argv, int argc,
+                             Fts5Tokenizer **outTokenizer)
+    {
+        auto module = (const sqlite3_tokenizer_module*)moduleContext;
+        sqlite3_tokenizer *tokenizer = nullptr;
+        int rc = module->xCreate(argc, argv, &tokenizer);
+        if (rc != SQLITE_OK)
+            return rc;
+        tokenizer->pModule = module;    // FTS3 callers are responsible for setting this
+        auto adapter = new (nothrow) FTS3TokenizerAdapter {module, tokenizer};
+        if (!adapter) {
+            module->xDestroy(tokenizer);
+            return SQLITE_NOMEM;
+        }
+        *outTokenizer = (Fts5Tokenizer*)adapter;
+        return SQLITE_OK;
+    }
+
+
+    static void adapterDelete(Fts5Tokenizer *fts5Tokenizer) {
+        auto adapter = (FTS3TokenizerAdapter*)fts5Tokenizer;
+        adapter->module->xDestroy(adapter->tokenizer);
+        delete adapter;
+    }
+
+
+    static int adapterTokenize(Fts5Tokenizer *fts5Tokenizer,
+                               void *context,
+                               int flags,
+                               const char *text, int textLen,
+                               int (*tokenCallback)(void *context, int tflags,
+                                                    const char *token, int tokenLen,
+                                                    int start, int end))
+    {
+        auto adapter = (FTS3TokenizerAdapter*)fts5Tokenizer;
+        sqlite3_tokenizer_cursor *cursor;
+        int rc = adapter->module->xOpen(adapter->tokenizer, text, textLen, &cursor);
+        if (rc != SQLITE_OK)
+            return rc;
+        cursor->pTokenizer = adapter->tokenizer;
+
+        const char *token;
+        int tokenLen, start, end, position;
+        while (SQLITE_OK == (rc = adapter->module->xNext(cursor, &token, &tokenLen,
+                                                          &start, &end, &position))) {
+            rc = tokenCallback(context, 0, token, tokenLen, start, end);
+            if (rc != SQLITE_OK)
+                break;
+        }
+        adapter->module->xClose(cursor);
+        return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+    }
+
+
+    // Looks up a registered FTS3 tokenizer module.
+    // (This form of fts3_tokenizer() requires SQLITE_ENABLE_FTS3_TOKENIZER.)
+    static const sqlite3_tokenizer_module* getFTS3Tokenizer(sqlite3 *db, const char *name) {
+        const sqlite3_tokenizer_module *module = nullptr;
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT fts3_tokenizer(?)", -1, &stmt, nullptr) != SQLITE_OK)
+            return nullptr;
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_bytes(stmt, 0) == sizeof(module))
+            memcpy(&module, sqlite3_column_blob(stmt, 0), sizeof(module));
+        sqlite3_finalize(stmt);
+        return module;
+    }
+
+
+    // https://www.sqlite.org/fts5.html#extending_fts5
+    static fts5_api* getFTS5API(sqlite3 *db) {
+        fts5_api *api = nullptr;
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "SELECT fts5(?1)", -1, &stmt, nullptr) != SQLITE_OK)
+            return nullptr;
+        sqlite3_bind_pointer(stmt, 1, &api, "fts5_api_ptr", nullptr);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return api;
+    }
+
+
+#pragma mark - OFFSETS:
+
+
+    // One matched token: its column, query term number, and position in the column.
+    struct FTS5Hit {
+        int column, term, position;
+
+        bool operator< (const FTS5Hit &other) const {
+            if (column != other.column)
+                return column < other.column;
+            if (position != other.position)
+                return position < other.position;
+            return term < other.term;
+        }
+    };
+
+
+    // State of the tokenizer callback that maps a column's hit positions to byte offsets.
+    struct FTS5OffsetsWriter {
+        vector<FTS5Hit>::const_iterator hit, end;
+        int column;
+        int position;
+        stringstream &out;
+        bool first;
+    };
+
+
+    static int writeOffsetsOfToken(void *context, int tflags,
+                                   const char *token, int tokenLen,
+                                   int start, int end)
+    {
+        auto w = (FTS5OffsetsWriter*)context;
+        if (tflags & FTS5_TOKEN_COLOCATED)
+            return SQLITE_OK;
+        for (; w->hit != w->end && w->hit->column == w->column
+                                && w->hit->position == w->position; ++w->hit) {
+            if (!w->first)
+                w->out << ' ';
+            w->first = false;
+            w->out << w->column << ' ' << w->hit->term << ' ' << start << ' ' << (end - start);
+        }
+        ++w->position;
+        return SQLITE_OK;
+    }
+
+
+    // FTS5 auxiliary function `offsets(fts)`, returning the same string as FTS4's offsets():
+    // groups of 4 integers giving the column, query term number, byte offset and byte length
+    // of each matched token. <https://www.sqlite.org/fts3.html#offsets>
+    static void fts5Offsets(const Fts5ExtensionApi *api, Fts5Context *fts,
+                            sqlite3_context *ctx, int argc, sqlite3_value **argv)
+    {
+        // A phrase's tokens are numbered as consecutive terms, as in FTS4:
+        int nPhrases = api->xPhraseCount(fts);
+        vector<int> firstTerm(nPhrases);
+        for (int p = 0, term = 0; p < nPhrases; ++p) {
+            firstTerm[p] = term;
+            term += api->xPhraseSize(fts, p);
+        }
+
+        int nInst;
+        int rc = api->xInstCount(fts, &nInst);
+        vector<FTS5Hit> hits;
+        for (int i = 0; i < nInst && rc == SQLITE_OK; ++i) {
+            int phrase, column, offset;
+            rc = api->xInst(fts, i, &phrase, &column, &offset);
+            if (rc != SQLITE_OK)
+                break;
+            for (int t = 0; t < api->xPhraseSize(fts, phrase); ++t)
+                hits.push_back({column, firstTerm[phrase] + t, offset + t});
+        }
+        sort(hits.begin(), hits.end());
+
+        // Re-tokenize each column with hits, to find the byte ranges of the hit tokens:
+        stringstream out;
+        bool first = true;
+        for (auto hit = hits.cbegin(); hit != hits.cend() && rc == SQLITE_OK; ) {
+            const char *text;
+            int textLen;
+            rc = api->xColumnText(fts, hit->column, &text, &textLen);
+            if (rc != SQLITE_OK)
+                break;
+            FTS5OffsetsWriter writer {hit, hits.cend(), hit->column, 0, out, first};
+            rc = api->xTokenize(fts, text, textLen, &writer, writeOffsetsOfToken);
+            first = writer.first;
+            // Skip any hits the tokenizer didn't reach, and go on to the next column:
+            for (hit = writer.hit; hit != hits.cend() && hit->column == writer.column; ++hit)
+                ;
+        }
+
+        if (rc != SQLITE_OK) {
+            sqlite3_result_error_code(ctx, rc);
+            return;
+        }
+        string result = out.str();
+        sqlite3_result_text(ctx, result.data(), (int)result.size(), SQLITE_TRANSIENT);
+    }
+
+
+#pragma mark - REGISTRATION:
+
+
+    int RegisterFTS5Extensions(sqlite3 *db) {
+        auto module = getFTS3Tokenizer(db, "unicodesn");
+        auto api = getFTS5API(db);
+        if (!module || !api)
+            return SQLITE_ERROR;
+        fts5_tokenizer tokenizer = {adapterCreate, adapterDelete, adapterTokenize};
+        int rc = api->xCreateTokenizer(api, "unicodesn", (void*)module, &tokenizer, nullptr);
+        if (rc == SQLITE_OK)
+            rc = api->xCreateFunction(api, "offsets", nullptr, fts5Offsets, nullptr);
+        return rc;
+    }
+
+}
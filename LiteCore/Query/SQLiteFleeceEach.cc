@@ -343,10 +343,15 @@ private:
 #pragma mark - SQLITE3 HOOK FUNCTIONS:
 
 
+    // (Each scan counts as one call of fl_each when profiling; the time spent iterating it and
+    // reading its columns is added to that.)
+
     static int cursorNext(sqlite3_vtab_cursor *cur) noexcept {
+        ProfiledCall call(((FleeceCursor*)cur)->_vtab->context, false);
         return ((FleeceCursor*)cur)->next();
     }
     static int cursorColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) noexcept {
+        ProfiledCall call(((FleeceCursor*)cur)->_vtab->context, false);
         return ((FleeceCursor*)cur)->column(ctx, i);
     }
     static int cursorRowid(sqlite3_vtab_cursor *cur, long long *outRowid) noexcept {
@@ -359,6 +364,7 @@ private:
                             int idxNum, const char *idxStr,
                             int argc, sqlite3_value **argv) noexcept
     {
+        ProfiledCall call(((FleeceCursor*)cur)->_vtab->context);
         return ((FleeceCursor*)cur)->filter(idxNum, idxStr, argc, argv);
     }
 
@@ -397,12 +403,13 @@ constexpr sqlite3_module FleeceCursor::kEachModule;
 
 int RegisterFleeceEachFunctions(sqlite3 *db,
                                 DataFile::FleeceAccessor accessor,
-                                SharedKeys *sharedKeys)
+                                SharedKeys *sharedKeys,
+                                SQLiteFunctionProfile* const *profile)
 {
     return sqlite3_create_module_v2(db,
                                     "fl_each",
                                     &FleeceCursor::kEachModule,
-                                    new fleeceFuncContext{accessor, sharedKeys},
+                                    new fleeceFuncContext{accessor, sharedKeys, "fl_each", profile},
                                     [](void *param){delete (fleeceFuncContext*)param;});
 }
 
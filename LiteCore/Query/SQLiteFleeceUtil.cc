@@ -202,20 +202,52 @@ namespace litecore {
     }
 
 
+    // On a connection whose queries can be profiled, registered functions are called through
+    // these, which look up the real callback in the spec and time it (if a profile is active):
+
+    static void profiledFunction(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        auto fc = (const fleeceFuncContext*)sqlite3_user_data(ctx);
+        ProfiledCall call(*fc);
+        fc->spec->function(ctx, argc, argv);
+    }
+
+    static void profiledStep(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        auto fc = (const fleeceFuncContext*)sqlite3_user_data(ctx);
+        ProfiledCall call(*fc);
+        fc->spec->stepCallback(ctx, argc, argv);
+    }
+
+    static void profiledFinal(sqlite3_context *ctx) noexcept {
+        auto fc = (const fleeceFuncContext*)sqlite3_user_data(ctx);
+        ProfiledCall call(*fc, false);      // the steps already counted as calls
+        fc->spec->finalCallback(ctx);
+    }
+
+
     static void registerFunctionSpecs(sqlite3 *db,
                                       DataFile::FleeceAccessor accessor,
                                       fleece::SharedKeys *sharedKeys,
+                                      SQLiteFunctionProfile* const *profile,
                                       const SQLiteFunctionSpec functions[])
     {
         if (!accessor)
             accessor = [](slice data) {return data;};
         for (auto fn = functions; fn->name; ++fn) {
+            auto function = fn->function;
+            auto stepCallback = fn->stepCallback;
+            auto finalCallback = fn->finalCallback;
+            if (profile) {
+                if (function)       function = &profiledFunction;
+                if (stepCallback)   stepCallback = &profiledStep;
+                if (finalCallback)  finalCallback = &profiledFinal;
+            }
             int rc = sqlite3_create_function_v2(db,
                                                 fn->name,
                                                 fn->argCount,
                                                 SQLITE_UTF8 | SQLITE_DETERMINISTIC,
-                                                new fleeceFuncContext{accessor, sharedKeys},
-                                                fn->function, fn->stepCallback, fn->finalCallback,
+                                                new fleeceFuncContext{accessor, sharedKeys,
+                                                                      fn->name, profile, fn},
+                                                function, stepCallback, finalCallback,
                                                 [](void *param) {delete (fleeceFuncContext*)param;});
             if (rc != SQLITE_OK)
                 throw SQLite::Exception(db, rc);
@@ -225,12 +257,18 @@ namespace litecore {
 
     void RegisterSQLiteFunctions(sqlite3 *db,
                                  DataFile::FleeceAccessor accessor,
-                                 fleece::SharedKeys *sharedKeys)
+                                 fleece::SharedKeys *sharedKeys,
+                                 SQLiteFunctionProfile* const *profile)
     {
-        registerFunctionSpecs(db, accessor, sharedKeys, kFleeceFunctionsSpec);
-        registerFunctionSpecs(db, accessor, sharedKeys, kRankFunctionsSpec);
-        registerFunctionSpecs(db, accessor, sharedKeys, kN1QLFunctionsSpec);
-        RegisterFleeceEachFunctions(db, accessor, sharedKeys);
+        registerFunctionSpecs(db, accessor, sharedKeys, profile, kFleeceFunctionsSpec);
+        registerFunctionSpecs(db, accessor, sharedKeys, profile, kRankFunctionsSpec);
+        registerFunctionSpecs(db, accessor, sharedKeys, profile, kN1QLFunctionsSpec);
+        RegisterFleeceEachFunctions(db, accessor, sharedKeys, profile);
+        int rc = RegisterGeoQueryFunctions(db, profile);
+        if (rc == SQLITE_OK)
+            rc = RegisterTrigramFunctions(db);
+        if (rc != SQLITE_OK)
+            throw SQLite::Exception(db, rc);
     }
 
 }
@@ -19,7 +19,9 @@
 #pragma once
 #include "Base.hh"
 #include "Fleece.hh"
+#include "SQLite_Internal.hh"
 #include <sqlite3.h>
+#include <chrono>
 
 
 namespace litecore {
@@ -33,10 +35,15 @@ namespace litecore {
         kFleeceIntUnsigned,             // Integer is unsigned
     };
 
+    struct SQLiteFunctionSpec;
+
     // What the user_data of a registered function points to
     struct fleeceFuncContext {
         DataFile::FleeceAccessor accessor;
         fleece::SharedKeys *sharedKeys;
+        const char *name;                           // Registered name of the function
+        SQLiteFunctionProfile* const *profile;      // Points to the profile being recorded, if any
+        const SQLiteFunctionSpec *spec;             // The function's spec, if it's profiled
     };
 
 
@@ -97,11 +104,46 @@ namespace litecore {
         void (*finalCallback)(sqlite3_context*);
     };
 
+    // Counts and times a call of a SQL function (or virtual table, or R*Tree callback) while a
+    // query is being profiled, adding the time until it's destructed. Does nothing otherwise.
+    class ProfiledCall {
+    public:
+        explicit ProfiledCall(const fleeceFuncContext &fc, bool isNewCall =true) noexcept
+        :_profile(fc.profile ? *fc.profile : nullptr)
+        ,_name(fc.name)
+        ,_isNewCall(isNewCall)
+        {
+            if (_profile)
+                _start = std::chrono::steady_clock::now();
+        }
+
+        ~ProfiledCall() {
+            if (_profile) {
+                auto &stats = _profile->functions[_name];
+                if (_isNewCall)
+                    ++stats.calls;
+                stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                               - _start).count();
+            }
+        }
+
+    private:
+        SQLiteFunctionProfile* const _profile;
+        const char* const _name;
+        bool const _isNewCall;
+        std::chrono::steady_clock::time_point _start;
+    };
+
     extern const SQLiteFunctionSpec kFleeceFunctionsSpec[];
     extern const SQLiteFunctionSpec kRankFunctionsSpec[];
     extern const SQLiteFunctionSpec kN1QLFunctionsSpec[];
 
     int RegisterFleeceEachFunctions(sqlite3 *db, DataFile::FleeceAccessor,
-                                    fleece::SharedKeys*);
+                                    fleece::SharedKeys*,
+                                    SQLiteFunctionProfile* const *profile);
+
+    int RegisterGeoQueryFunctions(sqlite3 *db, SQLiteFunctionProfile* const *profile);
+
+    int RegisterTrigramFunctions(sqlite3 *db);
 
 }
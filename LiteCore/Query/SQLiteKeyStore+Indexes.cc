@@ -21,11 +21,14 @@
 #include "SQLiteDataFile.hh"
 #include "SQLite_Internal.hh"
 #include "QueryParser.hh"
+#include "IndexAdvisor.hh"
 #include "Record.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "Fleece.hh"
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 extern "C" {
@@ -37,6 +40,11 @@ using namespace fleece;
 
 namespace litecore {
 
+    // FTS5 'automerge' setting: number of segments at one level that triggers a merge.
+    // (SQLite's default is 4.)
+    static const int kFTS5AutoMerge = 8;
+
+
     static void validateIndexName(slice name) {
         if(name.size == 0) {
             error::_throw(error::LiteCoreError::InvalidParameter, "Index name must not be empty");
@@ -67,6 +75,18 @@ namespace litecore {
     }
 
 
+    // Parses the JSON WHERE expression of a partial index:
+    static alloc_slice parseIndexWhere(const char *whereJSON) {
+        alloc_slice whereFleece;
+        try {
+            whereFleece = JSONConverter::convertJSON(slice(whereJSON));
+        } catch (const FleeceException &) { }
+        if (!whereFleece || !Value::fromTrustedData(whereFleece)->asArray())
+            error::_throw(error::InvalidQuery);
+        return whereFleece;
+    }
+
+
     void SQLiteKeyStore::createIndex(slice indexName,
                                      slice expression,
                                      IndexType type,
@@ -76,14 +96,21 @@ namespace litecore {
         alloc_slice expressionFleece;
         const Array *params;
         tie(expressionFleece, params) = parseIndexExpr(expression, type);
+        if (options && options->where && type != kValueIndex)
+            error::_throw(error::InvalidParameter, "Only value indexes can have a WHERE clause");
 
         Transaction t(db());
         switch (type) {
             case kValueIndex:    createValueIndex(indexNameStr, params, options); break;
             case kFullTextIndex: createFTSIndex(indexNameStr, params, options); break;
+            case kGeoIndex:      createGeoIndex(indexNameStr, params, options); break;
+            case kArrayIndex:    createArrayIndex(indexNameStr, params, options); break;
+            case kAggregateIndex:createAggregateIndex(indexNameStr, params, options); break;
+            case kTrigramIndex:  createTrigramIndex(indexNameStr, params, options); break;
             default:             error::_throw(error::Unimplemented);
         }
         t.commit();
+        db().schemaChanged();
     }
 
 
@@ -112,15 +139,87 @@ namespace litecore {
                                           const Array *params,
                                           const IndexOptions *options)
     {
+        alloc_slice whereFleece;
+        const Value *where = nullptr;
+        if (options && options->where) {
+            whereFleece = parseIndexWhere(options->where);
+            where = Value::fromTrustedData(whereFleece);
+        }
         QueryParser qp(tableName());
-        qp.writeCreateIndex(indexName, params);
-        _createIndex(kValueIndex, indexName, indexName, qp.SQL());
+        if (options && options->unicodeSortKeys) {
+            if (!db().supportsUnicodeSortKeys())
+                error::_throw(error::UnsupportedOperation,
+                              "Unicode sort keys are not available on this platform");
+            qp.setUnicodeSortKeys(true);
+        }
+        qp.writeCreateIndex(indexName, params, where);
+        if (_createIndex(kValueIndex, indexName, indexName, qp.SQL())
+                && options && options->unicodeSortKeys)
+            db().setUnicodeSortKeyVersion();
+    }
+
+
+    // Splits the column list of a `CREATE INDEX ... ON table (col, col...)` statement into its
+    // column expressions, minus any ASC/DESC suffix.
+    static vector<string> indexColumnExpressions(const string &sql, const string &tableName) {
+        vector<string> columns;
+        auto start = sql.find(" ON " + tableName + " (");
+        if (start == string::npos)
+            return columns;
+        int depth = 0;
+        char quote = 0;
+        string column;
+        for (auto i = start + tableName.size() + 6; i < sql.size(); ++i) {
+            char c = sql[i];
+            if (quote) {
+                if (c == quote)
+                    quote = 0;
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (c == '(') {
+                ++depth;
+            } else if ((c == ',' || c == ')') && depth == 0) {
+                for (const char *suffix : {" ASC", " DESC"}) {
+                    if (hasSuffix(column, suffix))
+                        column.resize(column.size() - strlen(suffix));
+                }
+                columns.push_back(column);
+                column.clear();
+                if (c == ')')
+                    break;
+                while (i + 1 < sql.size() && sql[i + 1] == ' ')
+                    ++i;
+                continue;
+            } else if (c == ')') {
+                --depth;
+            }
+            column += c;
+        }
+        return columns;
     }
 
 
-    static void writeTokenizerOptions(stringstream &sql, const KeyStore::IndexOptions *options) {
+    // Returns true if this table has a value index one of whose expressions is `expressionSQL`.
+    bool SQLiteKeyStore::hasIndexOnExpression(const string &expressionSQL) const {
+        // (instr() is just a quick filter; the expressions have to match exactly.)
+        SQLite::Statement check(db(), "SELECT sql FROM sqlite_master WHERE type='index' "
+                                      "AND tbl_name=? AND instr(sql, ?) > 0");
+        check.bind(1, tableName());
+        check.bind(2, expressionSQL);
+        while (check.executeStep()) {
+            auto columns = indexColumnExpressions(check.getColumn(0).getString(), tableName());
+            if (find(columns.begin(), columns.end(), expressionSQL) != columns.end())
+                return true;
+        }
+        return false;
+    }
+
+
+    // Returns the tokenizer name and arguments for a FTS table.
+    static string tokenizerOptions(const KeyStore::IndexOptions *options) {
         // See https://www.sqlite.org/fts3.html#tokenizer . 'unicodesn' is our custom tokenizer.
-        sql << "tokenize=unicodesn";
+        stringstream sql;
+        sql << "unicodesn";
         if (options) {
             // Get the language code (options->language might have a country too, like "en_US")
             string languageCode;
@@ -150,6 +249,7 @@ namespace litecore {
                 sql << " \"remove_diacritics=1\"";
             }
         }
+        return sql.str();
     }
 
 
@@ -158,6 +258,7 @@ namespace litecore {
                                         const Array *params,
                                         const IndexOptions *options)
     {
+        bool fts5 = options && options->useFTS5;
         auto ftsTableName = QueryParser(tableName()).FTSTableName(indexName);
         // Collect the name of each FTS column and the SQL expression that populates it:
         vector<string> colNames, colExprs;
@@ -168,29 +269,47 @@ namespace litecore {
         string columns = join(colNames, ", ");
         string exprs = join(colExprs, ", ");
 
-        // Build the SQL that creates an FTS table, including the tokenizer options:
+        // Build the SQL that creates an FTS table, including the tokenizer options.
+        // (FTS5 takes them as a single string; FTS4 as separate arguments.)
         stringstream sql;
-        sql << "CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING fts4(" << columns << ", ";
-        writeTokenizerOptions(sql, options);
+        sql << "CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING "
+            << (fts5 ? "fts5(" : "fts4(") << columns << ", tokenize=";
+        if (fts5)
+            QueryParser::writeSQLString(sql, slice(tokenizerOptions(options)));
+        else
+            sql << tokenizerOptions(options);
         sql << ")";
 
-        // Create the FTS table, but if an identical one already exists, return:
+        // Create the FTS table, but if an identical one already exists, return.
+        // (If an FTS4 index is being re-created as FTS5, this replaces it.)
         if (!_createIndex(kFullTextIndex, ftsTableName, indexName, sql.str()))
             return;
 
+        if (fts5) {
+            // Let more segments accumulate before merging them, which cuts the write cost of
+            // keeping the index up to date; SQLiteDataFile merges them incrementally instead.
+            db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" "
+                             "(\"" << ftsTableName << "\", rank) "
+                             "VALUES ('automerge', " << kFTS5AutoMerge << ")"));
+        }
+
         // Index the existing records:
-        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+        const char *idCol = fts5 ? "rowid" : "docid";
+        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" "
+                         "(" << idCol << ", " << columns << ") "
                          "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new"));
 
         // Set up triggers to keep the FTS table up to date
         // ...on insertion:
         createTrigger(ftsTableName, "ins", "INSERT",
-                      CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
+                      CONCAT("INSERT INTO \"" << ftsTableName << "\" "
+                             "(" << idCol << ", " << columns << ") "
                              "VALUES (new.rowid, " << exprs << ")"));
 
         // ...on delete:
         createTrigger(ftsTableName, "del", "DELETE",
-                      CONCAT("DELETE FROM \"" << ftsTableName << "\" WHERE docid = old.rowid"));
+                      CONCAT("DELETE FROM \"" << ftsTableName << "\" "
+                             "WHERE " << idCol << " = old.rowid"));
 
         // ...on update:
         stringstream upd;
@@ -200,18 +319,416 @@ namespace litecore {
                 upd << ", ";
             upd << colNames[i] << " = " << colExprs[i];
         }
-        upd << " WHERE docid = new.rowid";
+        upd << " WHERE " << idCol << " = new.rowid";
         createTrigger(ftsTableName, "upd", "UPDATE", upd.str());
     }
 
 
+    // Creates a geo index. The bounding box of each record's GeoJSON value is stored in an
+    // R*Tree table, which is kept up to date by triggers.
+    void SQLiteKeyStore::createGeoIndex(string indexName,
+                                        const Array *params,
+                                        const IndexOptions *options)
+    {
+        if (params->count() != 1)
+            error::_throw(error::InvalidQuery, "Geo index must have exactly one expression");
+        auto geoTableName = QueryParser(tableName()).geoTableName(indexName);
+        string sql = CONCAT("CREATE VIRTUAL TABLE \"" << geoTableName << "\" "
+                            "USING rtree(id, minLon, maxLon, minLat, maxLat)");
+
+        // Create the R*Tree table, but if an identical one already exists, return:
+        if (!_createIndex(kGeoIndex, geoTableName, indexName, sql))
+            return;
+
+        // The INSERT of the bounds of `new.body`, skipping non-GeoJSON values. The GeoJSON is
+        // parsed once per record, by geo_bounds() in a subquery; the OFFSET keeps SQLite from
+        // flattening that subquery, which would call geo_bounds() once per column.
+        string geoJSON = QueryParser::expressionSQL(params->get(0), "new.body");
+        auto insertBounds = [&](const string &from) {
+            return CONCAT("INSERT INTO \"" << geoTableName << "\" "
+                          "(id, minLon, maxLon, minLat, maxLat) "
+                          "SELECT id, geo_bound(b, 0), geo_bound(b, 1), geo_bound(b, 2), "
+                                 "geo_bound(b, 3) "
+                          "FROM (SELECT new.rowid AS id, geo_bounds(" << geoJSON << ") AS b"
+                                 << from << " LIMIT -1 OFFSET 0) "
+                          "WHERE b NOT NULL");
+        };
+        string insertSQL = insertBounds("");
+        string deleteSQL = CONCAT("DELETE FROM \"" << geoTableName << "\" WHERE id = old.rowid");
+
+        // Index the existing records:
+        db().exec(insertBounds(" FROM kv_" + name() + " AS new"));
+
+        // Set up triggers to keep the R*Tree table up to date:
+        createTrigger(geoTableName, "ins", "INSERT", insertSQL);
+        createTrigger(geoTableName, "del", "DELETE", deleteSQL);
+        createTrigger(geoTableName, "upd", "UPDATE OF body", deleteSQL + "; " + insertSQL);
+    }
+
+
+    // Creates an array index. The items of the array property are stored in a side table, one
+    // row per item, which is kept up to date by triggers, and the SQL index is on that table.
+    // The side table has its own index on docid, "<table>::docid", for the triggers' deletes.
+    void SQLiteKeyStore::createArrayIndex(string indexName,
+                                          const Array *params,
+                                          const IndexOptions *options)
+    {
+        if (params->count() != 1)
+            error::_throw(error::InvalidQuery, "Array index must have exactly one expression");
+        string property = QueryParser::arrayIndexProperty(params->get(0));
+        string unnestTableName = QueryParser(tableName()).unnestedTableName(property);
+        string sql = CONCAT("CREATE INDEX \"" << indexName << "\" ON \""
+                            << unnestTableName << "\" (value)");
+        {
+            // If an identical index already exists, return:
+            SQLite::Statement check(db(), "SELECT sql FROM sqlite_master "
+                                          "WHERE name = ? AND tbl_name = ? AND type = 'index'");
+            check.bind(1, indexName);
+            check.bind(2, unnestTableName);
+            if (check.executeStep() && check.getColumn(0).getString() == sql)
+                return;
+        }
+        _deleteIndex(indexName);
+
+        if (!db().tableExists(unnestTableName)) {
+            stringstream eachSQL;
+            eachSQL << "fl_each(new.body, ";
+            QueryParser::writeSQLString(eachSQL, slice(property));
+            eachSQL << ") AS _each";
+            string insertInto = CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, value) "
+                                       "SELECT new.rowid, _each.value FROM ");
+            string insertSQL = insertInto + eachSQL.str();
+            string deleteSQL = CONCAT("DELETE FROM \"" << unnestTableName << "\" "
+                                      "WHERE docid = old.rowid");
+
+            db().exec(CONCAT("CREATE TABLE \"" << unnestTableName << "\" "
+                             "(docid INTEGER NOT NULL, value)"));
+            db().exec(CONCAT("CREATE INDEX \"" << unnestTableName << "::docid\" "
+                             "ON \"" << unnestTableName << "\" (docid)"));
+            // Index the existing records:
+            db().exec(CONCAT(insertInto << "kv_" << name() << " AS new, " << eachSQL.str()));
+            // Set up triggers to keep the table up to date:
+            createTrigger(unnestTableName, "ins", "INSERT", insertSQL);
+            createTrigger(unnestTableName, "del", "DELETE", deleteSQL);
+            createTrigger(unnestTableName, "upd", "UPDATE OF body", deleteSQL + "; " + insertSQL);
+        }
+        db().exec(sql, LogLevel::Info);
+    }
+
+
+    // Creates a trigram index. The distinct trigrams of the string property are stored in a side
+    // table, one row per trigram, which is kept up to date by triggers, and the SQL index is on
+    // that table. QueryParser looks up a pattern's trigrams in it to narrow down the records that
+    // a LIKE, contains() or regexp_contains() test has to be evaluated on.
+    void SQLiteKeyStore::createTrigramIndex(string indexName,
+                                            const Array *params,
+                                            const IndexOptions *options)
+    {
+        if (params->count() != 1)
+            error::_throw(error::InvalidQuery, "Trigram index must have exactly one expression");
+        string property = QueryParser::trigramIndexProperty(params->get(0));
+        string trigramTableName = QueryParser(tableName()).trigramTableName(property);
+        string sql = CONCAT("CREATE INDEX \"" << indexName << "\" ON \""
+                            << trigramTableName << "\" (trigram, docid)");
+        {
+            // If an identical index already exists, return:
+            SQLite::Statement check(db(), "SELECT sql FROM sqlite_master "
+                                          "WHERE name = ? AND tbl_name = ? AND type = 'index'");
+            check.bind(1, indexName);
+            check.bind(2, trigramTableName);
+            if (check.executeStep() && check.getColumn(0).getString() == sql)
+                return;
+        }
+        _deleteIndex(indexName);
+
+        if (!db().tableExists(trigramTableName)) {
+            string trigramsSQL = CONCAT("trigrams(" << QueryParser::expressionSQL(params->get(0),
+                                                                                   "new.body")
+                                        << ")");
+            string insertInto = CONCAT("INSERT INTO \"" << trigramTableName << "\" "
+                                       "(docid, trigram) SELECT new.rowid, trigram FROM ");
+            string insertSQL = insertInto + trigramsSQL;
+            string deleteSQL = CONCAT("DELETE FROM \"" << trigramTableName << "\" "
+                                      "WHERE docid = old.rowid");
+
+            // (Keyed by docid, since that's how the triggers delete a record's trigrams. A
+            // record's trigrams are distinct.)
+            db().exec(CONCAT("CREATE TABLE \"" << trigramTableName << "\" "
+                             "(docid INTEGER NOT NULL, trigram INTEGER NOT NULL, "
+                             "PRIMARY KEY (docid, trigram)) WITHOUT ROWID"));
+            // Index the existing records:
+            db().exec(CONCAT(insertInto << "kv_" << name() << " AS new, " << trigramsSQL));
+            // Set up triggers to keep the table up to date:
+            createTrigger(trigramTableName, "ins", "INSERT", insertSQL);
+            createTrigger(trigramTableName, "del", "DELETE", deleteSQL);
+            createTrigger(trigramTableName, "upd", "UPDATE OF body", deleteSQL + "; " + insertSQL);
+        }
+        db().exec(sql, LogLevel::Info);
+    }
+
+
+    string sqlIdentifier(const string &name) {
+        string quoted = "\"";
+        for (char c : name) {
+            if (c == '"')
+                quoted += '"';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+
+    // Creates an aggregate index: a materialized view with a row per group, holding the number of
+    // records in the group and the requested aggregates of each aggregated expression. It's kept
+    // up to date by triggers. Its columns are named after their expressions, which lets
+    // QueryParser match aggregate queries to it.
+    void SQLiteKeyStore::createAggregateIndex(string indexName,
+                                              const Array *params,
+                                              const IndexOptions *options)
+    {
+        // An aggregated expression, and which aggregates of it to keep (its count is always kept)
+        struct Aggregated {
+            const Value *expr;
+            string sql;
+            bool sum, min, max;
+        };
+        vector<const Value*> groups;
+        vector<Aggregated> aggregated;
+        for (Array::iterator i(params); i; ++i) {
+            const Array *call = i.value()->asArray();
+            slice fn = (call && call->count() > 0) ? call->get(0)->asString() : nullslice;
+            bool isAggregate = false;
+            if (fn.size > 2 && fn[fn.size-2] == '(' && fn[fn.size-1] == ')') {
+                fn.shorten(fn.size - 2);
+                for (slice name : {"count"_sl, "sum"_sl, "avg"_sl, "min"_sl, "max"_sl})
+                    isAggregate = isAggregate || fn.caseEquivalent(name);
+            }
+            if (!isAggregate) {
+                groups.push_back(i.value());
+                continue;
+            }
+            if (call->count() > 2 || (call->count() == 1 && !fn.caseEquivalent("count"_sl)))
+                error::_throw(error::InvalidQuery, "Wrong number of arguments to aggregate");
+            if (call->count() == 1)
+                continue;                   // count() is the number of records in the group
+            string sql = QueryParser::expressionSQL(call->get(1));
+            auto agg = find_if(aggregated.begin(), aggregated.end(),
+                               [&](const Aggregated &a) {return a.sql == sql;});
+            if (agg == aggregated.end()) {
+                aggregated.push_back({call->get(1), sql, false, false, false});
+                agg = aggregated.end() - 1;
+            }
+            agg->sum |= fn.caseEquivalent("sum"_sl) || fn.caseEquivalent("avg"_sl);
+            agg->min |= fn.caseEquivalent("min"_sl);
+            agg->max |= fn.caseEquivalent("max"_sl);
+        }
+
+        // Column names, and the SQL to get each column's value from a record named `table`:
+        string rowsCol = sqlIdentifier(QueryParser::aggregateViewColumn("count"_sl, ""));
+        auto groupCol = [&](size_t i) {
+            return sqlIdentifier(QueryParser::aggregateViewColumn("group"_sl,
+                                                QueryParser::expressionSQL(groups[i])));
+        };
+        auto aggCol = [&](slice fn, const Aggregated &a) {
+            return sqlIdentifier(QueryParser::aggregateViewColumn(fn, a.sql));
+        };
+        auto valueOf = [&](const Value *expr, const char *table) {
+            return QueryParser::expressionSQL(expr, (string(table) + ".body").c_str());
+        };
+        auto isLive = [&](const char *table) {
+            return CONCAT("(" << table << ".flags & " << (unsigned)DocumentFlags::kDeleted
+                              << ") = 0");
+        };
+        // The WHERE condition matching the view row of a record's group:
+        auto inGroupOf = [&](const char *table) -> string {
+            stringstream where;
+            where << "1";
+            for (size_t i = 0; i < groups.size(); ++i)
+                where << " AND " << groupCol(i) << " IS " << valueOf(groups[i], table);
+            return where.str();
+        };
+
+        // Create the table, but if an identical one already exists, return:
+        string viewTableName = QueryParser(tableName()).aggregateViewTableName(indexName);
+        string viewTable = sqlIdentifier(viewTableName);
+        stringstream create;
+        create << "CREATE TABLE " << viewTable << " (" << rowsCol << " INTEGER NOT NULL DEFAULT 0";
+        for (size_t i = 0; i < groups.size(); ++i)
+            create << ", " << groupCol(i);
+        for (auto &a : aggregated) {
+            create << ", " << aggCol("count"_sl, a) << " INTEGER NOT NULL DEFAULT 0";
+            if (a.sum)
+                create << ", " << aggCol("sum"_sl, a) << " NOT NULL DEFAULT 0";
+            if (a.min)
+                create << ", " << aggCol("min"_sl, a);
+            if (a.max)
+                create << ", " << aggCol("max"_sl, a);
+        }
+        create << ")";
+        if (!_createIndex(kAggregateIndex, viewTableName, indexName, create.str()))
+            return;
+        if (!groups.empty()) {
+            stringstream index;
+            index << "CREATE INDEX " << sqlIdentifier(viewTableName + "::groups")
+                  << " ON " << viewTable << " (";
+            for (size_t i = 0; i < groups.size(); ++i)
+                index << (i ? ", " : "") << groupCol(i);
+            index << ")";
+            db().exec(index.str());
+        }
+
+        // Aggregate the existing records:
+        stringstream populate, columns, values, groupBy;
+        columns << rowsCol;
+        values << "count(*)";
+        for (size_t i = 0; i < groups.size(); ++i) {
+            columns << ", " << groupCol(i);
+            values << ", " << valueOf(groups[i], "doc");
+            groupBy << (i ? ", " : " GROUP BY ") << valueOf(groups[i], "doc");
+        }
+        for (auto &a : aggregated) {
+            string value = valueOf(a.expr, "doc");
+            columns << ", " << aggCol("count"_sl, a);
+            values << ", count(" << value << ")";
+            if (a.sum) {
+                columns << ", " << aggCol("sum"_sl, a);
+                values << ", coalesce(sum(" << value << "), 0)";
+            }
+            if (a.min) {
+                columns << ", " << aggCol("min"_sl, a);
+                values << ", min(" << value << ")";
+            }
+            if (a.max) {
+                columns << ", " << aggCol("max"_sl, a);
+                values << ", max(" << value << ")";
+            }
+        }
+        db().exec(CONCAT("INSERT INTO " << viewTable << " (" << columns.str() << ") "
+                         "SELECT " << values.str() << " FROM kv_" << name() << " AS doc "
+                         "WHERE " << isLive("doc") << groupBy.str()
+                         << " HAVING count(*) > 0"));
+
+        // SQL that adds the `new` record to its group, creating the group if necessary:
+        stringstream add;
+        add << "INSERT INTO " << viewTable << " (" << rowsCol;
+        for (size_t i = 0; i < groups.size(); ++i)
+            add << ", " << groupCol(i);
+        add << ") SELECT 0";
+        for (size_t i = 0; i < groups.size(); ++i)
+            add << ", " << valueOf(groups[i], "new");
+        add << " WHERE " << isLive("new") << " AND NOT EXISTS (SELECT 1 FROM " << viewTable
+            << " WHERE " << inGroupOf("new") << "); "
+            << "UPDATE " << viewTable << " SET " << rowsCol << " = " << rowsCol << " + 1";
+        for (auto &a : aggregated) {
+            string value = valueOf(a.expr, "new");
+            string count = aggCol("count"_sl, a);
+            add << ", " << count << " = " << count << " + (" << value << " IS NOT NULL)";
+            if (a.sum) {
+                string sum = aggCol("sum"_sl, a);
+                add << ", " << sum << " = " << sum << " + coalesce(" << value << ", 0)";
+            }
+            if (a.min) {
+                string min = aggCol("min"_sl, a);
+                add << ", " << min << " = CASE WHEN " << value << " IS NULL THEN " << min
+                    << " WHEN " << min << " IS NULL OR " << value << " < " << min
+                    << " THEN " << value << " ELSE " << min << " END";
+            }
+            if (a.max) {
+                string max = aggCol("max"_sl, a);
+                add << ", " << max << " = CASE WHEN " << value << " IS NULL THEN " << max
+                    << " WHEN " << max << " IS NULL OR " << value << " > " << max
+                    << " THEN " << value << " ELSE " << max << " END";
+            }
+        }
+        add << " WHERE " << isLive("new") << " AND " << inGroupOf("new");
+
+        // SQL that removes the `old` record from its group, deleting the group if it's empty.
+        // If the record held its group's min or max, that has to be recomputed from the group.
+        stringstream remove;
+        remove << "UPDATE " << viewTable << " SET " << rowsCol << " = " << rowsCol << " - 1";
+        for (auto &a : aggregated) {
+            string value = valueOf(a.expr, "old");
+            string count = aggCol("count"_sl, a);
+            remove << ", " << count << " = " << count << " - (" << value << " IS NOT NULL)";
+            if (a.sum) {
+                string sum = aggCol("sum"_sl, a);
+                remove << ", " << sum << " = " << sum << " - coalesce(" << value << ", 0)";
+            }
+            for (int isMax = 0; isMax <= 1; ++isMax) {
+                if (!(isMax ? a.max : a.min))
+                    continue;
+                string col = aggCol(isMax ? "max"_sl : "min"_sl, a);
+                remove << ", " << col << " = CASE WHEN " << value << " IS NULL OR " << value
+                       << (isMax ? " < " : " > ") << col << " THEN " << col
+                       << " ELSE (SELECT " << (isMax ? "max(" : "min(") << valueOf(a.expr, "doc")
+                       << ") FROM kv_" << name() << " AS doc WHERE " << isLive("doc");
+                for (auto group : groups)
+                    remove << " AND " << valueOf(group, "doc") << " IS " << valueOf(group, "old");
+                remove << ") END";
+            }
+        }
+        remove << " WHERE " << isLive("old") << " AND " << inGroupOf("old") << "; "
+               << "DELETE FROM " << viewTable << " WHERE " << rowsCol << " <= 0 AND "
+               << inGroupOf("old");
+
+        // Set up triggers to keep the view up to date:
+        createTrigger(viewTableName, "ins", "INSERT", add.str());
+        createTrigger(viewTableName, "del", "DELETE", remove.str());
+        createTrigger(viewTableName, "upd", "UPDATE OF body, flags",
+                      remove.str() + "; " + add.str());
+    }
+
+
+    // Returns the names of the tables of this KeyStore's aggregate indexes.
+    vector<string> SQLiteKeyStore::aggregateViewTables() const {
+        vector<string> tables;
+        SQLite::Statement getViews(db(), "SELECT name FROM sqlite_master WHERE type='table' "
+                                         "AND name LIKE ? || '::%' "
+                                         "AND sql LIKE 'CREATE TABLE % (\"count:\" %'");
+        getViews.bind(1, tableName());
+        while (getViews.executeStep())
+            tables.push_back(getViews.getColumn(0).getString());
+        return tables;
+    }
+
+
     void SQLiteKeyStore::_deleteIndex(slice name) {
-        // Delete any expression index:
         validateIndexName(name);
         string indexName = (string)name;
+
+        // If this is an array or trigram index, find its side table:
+        string sideTableName;
+        {
+            SQLite::Statement getTable(db(), "SELECT tbl_name FROM sqlite_master "
+                                             "WHERE type = 'index' AND name = ?1 "
+                                             "AND (tbl_name LIKE ?2 || ':unnest:%' "
+                                                  "OR tbl_name LIKE ?2 || ':trigram:%')");
+            getTable.bind(1, indexName);
+            getTable.bind(2, tableName());
+            if (getTable.executeStep())
+                sideTableName = getTable.getColumn(0).getString();
+        }
+
+        // Delete any expression index:
         db().exec(CONCAT("DROP INDEX IF EXISTS \"" << indexName << "\""), LogLevel::Info);
 
-        // Delete any FTS index:
+        // Delete an array or trigram index's table, unless another index still uses it (other
+        // than an array index table's own docid index):
+        if (!sideTableName.empty()) {
+            SQLite::Statement check(db(), "SELECT 1 FROM sqlite_master "
+                                          "WHERE type = 'index' AND tbl_name = ? "
+                                          "AND name != tbl_name || '::docid'");
+            check.bind(1, sideTableName);
+            if (!check.executeStep()) {
+                db().exec(CONCAT("DROP TABLE IF EXISTS \"" << sideTableName << "\""),
+                          LogLevel::Info);
+                dropTrigger(sideTableName, "ins");
+                dropTrigger(sideTableName, "upd");
+                dropTrigger(sideTableName, "del");
+            }
+        }
+
+        // Delete any FTS or geo index:
         QueryParser qp(tableName());
         auto ftsTableName = qp.FTSTableName(indexName);
         db().exec(CONCAT("DROP TABLE IF EXISTS \"" << ftsTableName << "\""), LogLevel::Info);
@@ -225,6 +742,7 @@ namespace litecore {
         Transaction t(db());
         _deleteIndex(name);
         t.commit();
+        db().schemaChanged();
     }
 
 
@@ -240,9 +758,21 @@ namespace litecore {
             enc.writeString(getIndex.getColumn(0).getString());
         }
 
+        SQLite::Statement getArray(db(), "SELECT name FROM sqlite_master WHERE type='index' "
+                                            "AND (tbl_name LIKE ?1 || ':unnest:%' "
+                                                 "OR tbl_name LIKE ?1 || ':trigram:%') "
+                                            "AND name != tbl_name || '::docid' "
+                                            "AND sql NOT NULL");
+        getArray.bind(1, tableNameStr);
+        while(getArray.executeStep()) {
+            enc.writeString(getArray.getColumn(0).getString());
+        }
+
         SQLite::Statement getFTS(db(), "SELECT name FROM sqlite_master WHERE type='table' "
                                             "AND name like ? || '::%' "
-                                            "AND sql LIKE 'CREATE VIRTUAL TABLE % USING fts%'");
+                                            "AND (sql LIKE 'CREATE VIRTUAL TABLE % USING fts%' "
+                                                 "OR sql LIKE 'CREATE VIRTUAL TABLE % USING rtree%' "
+                                                 "OR sql LIKE 'CREATE TABLE % (\"count:\" %')");
         getFTS.bind(1, tableNameStr);
         while(getFTS.executeStep()) {
             string ftsName = getFTS.getColumn(0).getString();
@@ -255,6 +785,77 @@ namespace litecore {
     }
 
 
+#pragma mark - INDEX ADVISOR:
+
+
+    void SQLiteKeyStore::setIndexAdvisor(shared_ptr<IndexAdvisor> advisor) {
+        lock_guard<mutex> lock(_indexAdvisorMutex);
+        _indexAdvisor = advisor;
+    }
+
+
+    shared_ptr<IndexAdvisor> SQLiteKeyStore::indexAdvisor() const {
+        lock_guard<mutex> lock(_indexAdvisorMutex);
+        return _indexAdvisor;
+    }
+
+
+    unsigned SQLiteKeyStore::createAdvisedIndexes() {
+        auto advisor = indexAdvisor();
+        if (!advisor || !advisor->options().autoCreate)
+            return 0;
+        auto &options = advisor->options();
+        // A candidate whose index isn't created (because of the limit, or an error) stays a
+        // candidate for the next call.
+        unsigned created = 0;
+        for (auto &rec : advisor->autoCreateCandidates()) {
+            if (autoIndexCount() >= options.maxAutoIndexes) {
+                LogTo(QueryLog, "Index advisor: not creating %s; already at limit of %u indexes",
+                      rec.name.c_str(), options.maxAutoIndexes);
+                break;
+            }
+            try {
+                int64_t sizeBefore = usedBytes();
+                createIndex(slice(rec.name), slice(rec.expressionsJSON));
+                int64_t indexSize = usedBytes() - sizeBefore;
+                if (options.maxAutoIndexBytes > 0 && indexSize > (int64_t)options.maxAutoIndexBytes) {
+                    Warn("Index advisor: dropping index %s; its size %lld exceeds the limit",
+                         rec.name.c_str(), (long long)indexSize);
+                    deleteIndex(slice(rec.name));
+                    advisor->markRejected(rec.expressionsJSON);
+                    continue;
+                }
+                LogTo(QueryLog, "Index advisor: created index %s on %s (%lld bytes)",
+                      rec.name.c_str(), rec.expressionsJSON.c_str(), (long long)indexSize);
+                advisor->markAutoCreated(rec.expressionsJSON);
+                ++created;
+            } catch (const exception &x) {
+                Warn("Index advisor: couldn't create index %s: %s", rec.name.c_str(), x.what());
+            }
+        }
+        return created;
+    }
+
+
+    // The number of automatically-created indexes on this KeyStore's table.
+    unsigned SQLiteKeyStore::autoIndexCount() const {
+        SQLite::Statement count(db(), "SELECT count(*) FROM sqlite_master WHERE type='index' "
+                                      "AND tbl_name=? AND substr(name, 1, ?)=?");
+        string prefix = IndexAdvisor::kAutoIndexPrefix;
+        count.bind(1, tableName());
+        count.bind(2, (int)prefix.size());
+        count.bind(3, prefix);
+        return count.executeStep() ? count.getColumn(0).getInt() : 0;
+    }
+
+
+    // The number of bytes of the database file in use (not free.)
+    int64_t SQLiteKeyStore::usedBytes() const {
+        return (db().intQuery("PRAGMA page_count") - db().intQuery("PRAGMA freelist_count"))
+                    * db().intQuery("PRAGMA page_size");
+    }
+
+
     void SQLiteKeyStore::createSequenceIndex() {
         if (!_createdSeqIndex) {
             if (!_capabilities.sequences)
@@ -265,4 +866,15 @@ namespace litecore {
         }
     }
 
+
+    // A partial index of the keys of conflicted records, so they can be found without scanning
+    // the whole table. SQLite keeps it up to date as the records' flags change.
+    void SQLiteKeyStore::createConflictIndex() {
+        if (!_createdConflictIndex) {
+            db().execWithLock(CONCAT("CREATE INDEX IF NOT EXISTS kv_" << name() << "_conflicts"
+                                     " ON kv_" << name() << " (key) WHERE (flags & 2) != 0"));
+            _createdConflictIndex = true;
+        }
+    }
+
 }
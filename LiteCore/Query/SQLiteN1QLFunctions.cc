@@ -25,7 +25,10 @@
 #include "StringUtil.hh"
 #include "function_ref.hh"
 #include <regex>
+#include <algorithm>
+#include <bitset>
 #include <cmath>
+#include <memory>
 #include <string>
 
 #ifdef _MSC_VER
@@ -637,55 +640,360 @@ namespace litecore {
 #pragma mark - REGULAR EXPRESSIONS:
 
 
+    // A compiled regular expression, as cached by the regexp_ functions through SQLite's auxdata.
+    // Most patterns used in queries are literals, prefixes/suffixes, or sequences of single
+    // characters and character classes with `*`, `+` or `?` quantifiers. Those are matched by a
+    // bit-parallel NFA simulation that runs in linear time and can't backtrack; any other pattern
+    // (groups, alternation, counted repetition, backreferences...) falls back to std::regex,
+    // which is also used for regexp_replace's formatting.
+    class QueryRegex {
+    public:
+        explicit QueryRegex(slice pattern)
+        :_pattern(pattern.asString())
+        {
+            _simple = parse();
+            if (!_simple)
+                _regex.reset(new regex(_pattern));      // throws regex_error if invalid
+        }
+
+        // Returns the byte offset of the leftmost match in `text`, or -1 if there is none.
+        int64_t search(slice text) const {
+            if (_isLiteral)
+                return searchLiteral(text);
+            else if (_simple)
+                return searchAtoms(text);
+            cmatch match;
+            if (!regex_search((const char*)text.buf, (const char*)text.end(), match, *_regex))
+                return -1;
+            return match.prefix().length();
+        }
+
+        const regex& stdRegex() const {
+            if (!_regex)
+                _regex.reset(new regex(_pattern));
+            return *_regex;
+        }
+
+    private:
+        static constexpr size_t kMaxAtoms = 63;     // plus the accepting state, fits in 64 bits
+        static constexpr size_t kNoMatch = SIZE_MAX;
+
+        typedef bitset<256> CharSet;
+
+        enum Quantifier : uint8_t {kOne, kOptional, kStar};
+
+        struct Atom {
+            CharSet chars;
+            Quantifier quantifier;
+        };
+
+        static void addRange(CharSet &chars, uint8_t first, uint8_t last) {
+            for (unsigned c = first; c <= last; ++c)
+                chars.set(c);
+        }
+
+        // Parses the character after a backslash. Returns false if unsupported.
+        static bool parseEscape(uint8_t c, CharSet &chars) {
+            CharSet cls;
+            switch (c) {
+                case 'd': case 'D':
+                    addRange(cls, '0', '9');
+                    break;
+                case 'w': case 'W':
+                    addRange(cls, '0', '9');
+                    addRange(cls, 'A', 'Z');
+                    addRange(cls, 'a', 'z');
+                    cls.set('_');
+                    break;
+                case 's': case 'S':
+                    for (char ws : {' ', '\t', '\n', '\v', '\f', '\r'})
+                        cls.set((uint8_t)ws);
+                    break;
+                case 'n': cls.set('\n'); break;
+                case 'r': cls.set('\r'); break;
+                case 't': cls.set('\t'); break;
+                case 'f': cls.set('\f'); break;
+                case 'v': cls.set('\v'); break;
+                default:
+                    // Escaped punctuation is literal; letters & digits have special meanings
+                    if (c >= 0x80 || isalnum(c) || c == '_')
+                        return false;
+                    cls.set(c);
+                    break;
+            }
+            if (c == 'D' || c == 'W' || c == 'S')
+                cls.flip();
+            chars |= cls;
+            return true;
+        }
+
+        // Parses a bracketed character class; `p` points just past the '['.
+        static bool parseClass(const uint8_t* &p, const uint8_t *end, CharSet &chars) {
+            bool negated = (p < end && *p == '^');
+            if (negated)
+                ++p;
+            if (p < end && *p == ']')
+                return false;       // ECMAScript "[]" / "[^]"; leave those to std::regex
+            while (p < end && *p != ']') {
+                uint8_t c = *p++;
+                if (c == '[') {
+                    return false;   // possible [:class:], [.coll.] or [=equiv=]
+                } else if (c == '\\') {
+                    if (p == end || *p == 'b' || !parseEscape(*p++, chars))
+                        return false;
+                    if (p < end && *p == '-' && p + 1 < end && p[1] != ']')
+                        return false;   // range starting with an escape
+                } else if (p + 1 < end && *p == '-' && p[1] != ']') {
+                    uint8_t last = p[1];
+                    if (last == '\\' || last == '[' || last < c)
+                        return false;
+                    addRange(chars, c, last);
+                    p += 2;
+                } else {
+                    chars.set(c);
+                }
+            }
+            if (p == end)
+                return false;       // unterminated
+            ++p;
+            if (negated)
+                chars.flip();
+            return true;
+        }
+
+        // Tries to parse the pattern into a sequence of quantified atoms. Returns false if the
+        // pattern uses syntax that needs std::regex.
+        bool parse() {
+            auto p = (const uint8_t*)_pattern.data(), end = p + _pattern.size();
+            if (p < end && *p == '^') {
+                _anchorStart = true;
+                ++p;
+            }
+            bool literal = true;
+            while (p < end) {
+                uint8_t c = *p++;
+                Atom atom {};
+                switch (c) {
+                    case '$':
+                        if (p != end)
+                            return false;
+                        _anchorEnd = true;
+                        continue;
+                    case '.':
+                        atom.chars.set();
+                        atom.chars.reset('\n');
+                        atom.chars.reset('\r');
+                        literal = false;
+                        break;
+                    case '[':
+                        if (!parseClass(p, end, atom.chars))
+                            return false;
+                        literal = false;
+                        break;
+                    case '\\':
+                        if (p == end || !parseEscape(*p, atom.chars))
+                            return false;
+                        if (isalpha(*p))
+                            literal = false;
+                        else
+                            c = *p;         // escaped punctuation
+                        ++p;
+                        break;
+                    case '(': case ')': case '|': case '{': case '}': case ']': case '^':
+                    case '*': case '+': case '?':
+                        return false;
+                    default:
+                        atom.chars.set(c);
+                        break;
+                }
+
+                // Optional quantifier, optionally followed by '?' to make it lazy (which doesn't
+                // affect whether or where a match starts):
+                bool plus = false;
+                if (p < end && (*p == '*' || *p == '+' || *p == '?')) {
+                    if (*p == '*')
+                        atom.quantifier = kStar;
+                    else if (*p == '?')
+                        atom.quantifier = kOptional;
+                    else
+                        plus = true;
+                    if (++p < end && *p == '?')
+                        ++p;
+                    if (p < end && (*p == '*' || *p == '+' || *p == '?' || *p == '{'))
+                        return false;
+                    literal = false;
+                }
+                if (literal)
+                    _literal.push_back((char)c);
+                _atoms.push_back(atom);
+                if (plus) {
+                    // "x+" is equivalent to "xx*":
+                    atom.quantifier = kStar;
+                    _atoms.push_back(atom);
+                }
+                if (_atoms.size() > kMaxAtoms)
+                    return false;
+            }
+            _isLiteral = literal;
+            return true;
+        }
+
+        int64_t searchLiteral(slice text) const {
+            auto begin = (const char*)text.buf, end = begin + text.size;
+            if (_literal.size() > text.size)
+                return -1;
+            else if (_anchorStart && _anchorEnd)
+                return (_literal.size() == text.size && equal(begin, end, _literal.begin())) ? 0 : -1;
+            else if (_anchorStart)
+                return equal(_literal.begin(), _literal.end(), begin) ? 0 : -1;
+            else if (_anchorEnd) {
+                size_t pos = text.size - _literal.size();
+                return equal(_literal.begin(), _literal.end(), begin + pos) ? int64_t(pos) : -1;
+            }
+            auto found = std::search(begin, end, _literal.begin(), _literal.end());
+            return (found != end || _literal.empty()) ? int64_t(found - begin) : -1;
+        }
+
+
+        // Adds NFA state `k` (the number of atoms matched so far) to `states`, along with the
+        // states reachable from it without consuming input, tagging each with the offset `start`
+        // where its match began. Where two threads reach the same state, the leftmost one wins.
+        void addState(uint64_t &states, size_t startOf[], size_t k, size_t start) const {
+            for (;;) {
+                uint64_t bit = 1ull << k;
+                if ((states & bit) && startOf[k] <= start)
+                    return;
+                states |= bit;
+                startOf[k] = start;
+                if (k == _atoms.size() || _atoms[k].quantifier == kOne)
+                    return;
+                ++k;
+            }
+        }
+
+        int64_t searchAtoms(slice text) const {
+            const size_t nAtoms = _atoms.size();
+            const uint64_t acceptBit = 1ull << nAtoms;
+            auto bytes = (const uint8_t*)text.buf;
+            size_t startBuf[2][kMaxAtoms + 1];
+            size_t *startOf = startBuf[0], *nextStartOf = startBuf[1];
+            uint64_t states = 0;
+            size_t best = kNoMatch;
+            for (size_t i = 0; i <= text.size; ++i) {
+                if (i < best && (i == 0 || !_anchorStart))
+                    addState(states, startOf, 0, i);
+                else if (states == 0)
+                    break;
+                if ((states & acceptBit) && (!_anchorEnd || i == text.size))
+                    best = min(best, startOf[nAtoms]);
+                if (i == text.size)
+                    break;
+
+                uint8_t c = bytes[i];
+                uint64_t next = 0;
+                for (size_t k = 0; k < nAtoms; ++k) {
+                    if ((states & (1ull << k)) && startOf[k] < best && _atoms[k].chars.test(c))
+                        addState(next, nextStartOf, (_atoms[k].quantifier == kStar) ? k : k + 1,
+                                 startOf[k]);
+                }
+                states = next;
+                swap(startOf, nextStartOf);
+            }
+            return (best == kNoMatch) ? -1 : int64_t(best);
+        }
+
+        string _pattern;
+        vector<Atom> _atoms;
+        string _literal;
+        bool _simple {false}, _isLiteral {false}, _anchorStart {false}, _anchorEnd {false};
+        mutable unique_ptr<regex> _regex;
+    };
+
+
+    // Calls `fn` with the compiled form of the pattern in argv[1], which is cached in SQLite's
+    // auxdata so it's only compiled once per statement (as long as the pattern is constant.)
+    static void withRegex(sqlite3_context *ctx, sqlite3_value **argv,
+                          function_ref<void(const QueryRegex&)> fn) noexcept
+    {
+        try {
+            auto re = (const QueryRegex*)sqlite3_get_auxdata(ctx, 1);
+            if (re) {
+                fn(*re);
+            } else {
+                auto pattern = stringArgument(argv[1]);
+                if (!pattern.buf) {
+                    sqlite3_result_null(ctx);
+                    return;
+                }
+                unique_ptr<QueryRegex> newRe(new QueryRegex(pattern));
+                fn(*newRe);
+                sqlite3_set_auxdata(ctx, 1, newRe.release(), [](void *auxdata) {
+                    delete (QueryRegex*)auxdata;
+                });
+            }
+        } catch (const regex_error &) {
+            sqlite3_result_error(ctx, "invalid regular expression", -1);
+        } catch (const bad_alloc&) {
+            sqlite3_result_error_nomem(ctx);
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "regular expression function caught an exception!", -1);
+        }
+    }
+
+
     static void regexp_like(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        auto arg0 = stringArgument(argv[0]);
-        auto arg1 = stringArgument(argv[1]);
-        regex r((char *)arg1.buf);
-        int result = regex_search((char *)arg0.buf, r) ? 1 : 0;
-        sqlite3_result_int(ctx, result);
+        withRegex(ctx, argv, [&](const QueryRegex &re) {
+            auto text = stringArgument(argv[0]);
+            if (!text.buf)
+                sqlite3_result_null(ctx);
+            else
+                sqlite3_result_int(ctx, re.search(text) >= 0);
+        });
     }
 
     static void regexp_position(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        auto arg0 = stringArgument(argv[0]);
-        auto arg1 = stringArgument(argv[1]);
-        regex r((char *)arg1.buf);
-        cmatch pattern_match;
-        if(!regex_search((char *)arg0.buf, pattern_match, r)) {
-            sqlite3_result_int64(ctx, -1);
-            return;
-        }
-
-        sqlite3_result_int64(ctx, pattern_match.prefix().length());
+        withRegex(ctx, argv, [&](const QueryRegex &re) {
+            auto text = stringArgument(argv[0]);
+            if (!text.buf)
+                sqlite3_result_null(ctx);
+            else
+                sqlite3_result_int64(ctx, re.search(text));
+        });
     }
 
     static void regexp_replace(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        auto expression = stringArgument(argv[0]).asString();
-        auto pattern = stringArgument(argv[1]);
-        auto repl = stringArgument(argv[2]).asString();
-        string result;
-        auto out = back_inserter(result);
-        int n = -1;
-        if(argc == 4) {
-            n = sqlite3_value_int(argv[3]);
-        }
+        withRegex(ctx, argv, [&](const QueryRegex &re) {
+            auto text = stringArgument(argv[0]);
+            if (!text.buf) {
+                sqlite3_result_null(ctx);
+                return;
+            }
+            int n = -1;
+            if(argc == 4) {
+                n = sqlite3_value_int(argv[3]);
+            }
+            if (n == 0 || re.search(text) < 0) {
+                // Nothing to replace, so skip std::regex entirely:
+                sqlite3_result_value(ctx, argv[0]);
+                return;
+            }
 
-        regex r((char *)pattern.buf);
-        auto iter = sregex_iterator(expression.begin(), expression.end(), r);
-        auto last_iter = iter;
-        auto stop = sregex_iterator();
-        if(iter == stop) {
-            result = expression;
-        } else {
+            auto expression = text.asString();
+            auto repl = stringArgument(argv[2]).asString();
+            string result;
+            auto out = back_inserter(result);
+            auto iter = sregex_iterator(expression.begin(), expression.end(), re.stdRegex());
+            auto last_iter = iter;
+            auto stop = sregex_iterator();
             for(; n-- && iter != stop; ++iter) {
                 out = copy(iter->prefix().first, iter->prefix().second, out);
                 out = iter->format(out, repl);
                 last_iter = iter;
             }
+            out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
 
-			out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
-        }
-
-        sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
+            sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
+        });
     }
 
 
@@ -791,6 +1099,173 @@ namespace litecore {
     }
 
 
+#pragma mark - GEOSPATIAL:
+
+
+    static constexpr double kEarthRadius = 6371008.8;   // mean radius, in meters
+
+    static inline double toRadians(double deg)  {return deg * M_PI / 180;}
+    static inline double toDegrees(double rad)  {return rad * 180 / M_PI;}
+
+    // Great-circle distance in meters between two points, using the haversine formula.
+    static double geoDistance(double lon1, double lat1, double lon2, double lat2) {
+        double sinDLat = sin(toRadians(lat2 - lat1) / 2);
+        double sinDLon = sin(toRadians(lon2 - lon1) / 2);
+        double a = sinDLat * sinDLat
+                 + cos(toRadians(lat1)) * cos(toRadians(lat2)) * sinDLon * sinDLon;
+        return 2 * kEarthRadius * asin(min(1.0, sqrt(a)));
+    }
+
+
+    // geo_distance(lon1, lat1, lon2, lat2) returns the distance in meters between two points.
+    static void fl_geo_distance(sqlite3_context* ctx, int argc, sqlite3_value **argv) {
+        double coord[4];
+        for (int i = 0; i < 4; ++i) {
+            if (!isNumeric(ctx, argv[i]))
+                return;
+            coord[i] = sqlite3_value_double(argv[i]);
+        }
+        sqlite3_result_double(ctx, geoDistance(coord[0], coord[1], coord[2], coord[3]));
+    }
+
+
+    // Bounding box of a GeoJSON value, in the column order of a geo index's R*Tree table.
+    struct GeoBounds {
+        double minLon {INFINITY}, maxLon {-INFINITY}, minLat {INFINITY}, maxLat {-INFINITY};
+
+        bool valid() const          {return minLon <= maxLon && minLat <= maxLat;}
+
+        void add(double lon, double lat) {
+            minLon = min(minLon, lon);  maxLon = max(maxLon, lon);
+            minLat = min(minLat, lat);  maxLat = max(maxLat, lat);
+        }
+
+        // Adds a GeoJSON position ([lon, lat, ...]) or a nested array of positions.
+        void addCoordinates(const Array *coords) {
+            if (!coords || coords->count() == 0)
+                return;
+            if (coords->get(0)->type() == kNumber) {
+                if (coords->count() >= 2 && coords->get(1)->type() == kNumber)
+                    add(coords->get(0)->asDouble(), coords->get(1)->asDouble());
+            } else {
+                for (Array::iterator i(coords); i; ++i)
+                    addCoordinates(i->asArray());
+            }
+        }
+
+        // Adds a GeoJSON object: its "bbox" if present, else its geometry's coordinates.
+        void addGeoJSON(const Value *geo, SharedKeys *sk) {
+            auto dict = geo->asDict();
+            if (!dict) {
+                addCoordinates(geo->asArray());     // a bare position, or array of positions
+                return;
+            }
+            auto bbox = dict->get("bbox"_sl, sk);
+            if (bbox && bbox->asArray()) {
+                // bbox is [west, south, east, north], or [w, s, minAlt, e, n, maxAlt] in 3D
+                auto b = bbox->asArray();
+                auto n = b->count();
+                if (n == 4 || n == 6) {
+                    add(b->get(0)->asDouble(), b->get(1)->asDouble());
+                    add(b->get(n/2)->asDouble(), b->get(n/2 + 1)->asDouble());
+                    return;
+                }
+            }
+            auto geometry = dict->get("geometry"_sl, sk);               // Feature
+            if (geometry) {
+                addGeoJSON(geometry, sk);
+                return;
+            }
+            auto geometries = dict->get("geometries"_sl, sk);           // GeometryCollection
+            if (geometries) {
+                for (Array::iterator i(geometries->asArray()); i; ++i)
+                    addGeoJSON(i.value(), sk);
+                return;
+            }
+            auto coordinates = dict->get("coordinates"_sl, sk);
+            if (coordinates)
+                addCoordinates(coordinates->asArray());
+        }
+    };
+
+
+    // geo_bounds(geojson) returns the bounding box of a GeoJSON value as a blob of four doubles,
+    // in the column order of a geo index's R*Tree table; or null if the value isn't GeoJSON.
+    // Used to populate geo indexes.
+    static void fl_geo_bounds(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        auto subtype = sqlite3_value_subtype(argv[0]);
+        if (sqlite3_value_type(argv[0]) != SQLITE_BLOB
+                || (subtype != kFleeceDataSubtype && subtype != kFleecePointerSubtype)) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        const Value *geo = fleeceParam(ctx, argv[0]);
+        if (!geo)
+            return;
+        GeoBounds bounds;
+        bounds.addGeoJSON(geo, ((fleeceFuncContext*)sqlite3_user_data(ctx))->sharedKeys);
+        if (!bounds.valid()) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        double box[4] = {bounds.minLon, bounds.maxLon, bounds.minLat, bounds.maxLat};
+        sqlite3_result_blob(ctx, box, sizeof(box), SQLITE_TRANSIENT);
+    }
+
+
+    // geo_bound(bounds, n) returns one coordinate of a bounding box returned by geo_bounds():
+    // n = 0, 1, 2, 3 for min longitude, max longitude, min latitude, max latitude.
+    static void fl_geo_bound(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        double box[4];
+        const void *blob = sqlite3_value_blob(argv[0]);
+        int n = sqlite3_value_int(argv[1]);
+        if (!blob || sqlite3_value_bytes(argv[0]) != sizeof(box) || n < 0 || n > 3) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        memcpy(box, blob, sizeof(box));
+        sqlite3_result_double(ctx, box[n]);
+    }
+
+
+    // R*Tree query callback for `id MATCH geo_radius(lon, lat, meters)`: accepts index entries
+    // whose bounding box comes within the given distance of the point.
+    static int geo_radius(sqlite3_rtree_query_info *info) {
+        ProfiledCall call(*(const fleeceFuncContext*)info->pContext);
+        if (info->nParam != 3 || info->nCoord != 4)
+            return SQLITE_ERROR;
+        double lon = info->aParam[0], lat = info->aParam[1], radius = info->aParam[2];
+        auto c = info->aCoord;      // minLon, maxLon, minLat, maxLat
+        bool within;
+        if (info->iLevel > 0) {
+            // Interior node: cheap conservative test against the radius's lat/lon bounding box.
+            double dLat = toDegrees(radius / kEarthRadius);
+            double maxLat = fabs(lat) + dLat;
+            within = c[3] >= lat - dLat && c[2] <= lat + dLat;
+            if (within && maxLat < 90) {
+                double dLon = dLat / cos(toRadians(maxLat));
+                if (lon - dLon >= -180 && lon + dLon <= 180)    // else it wraps around
+                    within = c[1] >= lon - dLon && c[0] <= lon + dLon;
+            }
+        } else {
+            // Leaf entry: exact distance to the nearest point of its bounds.
+            double nearLon = max(c[0], min(lon, c[1]));
+            double nearLat = max(c[2], min(lat, c[3]));
+            within = geoDistance(lon, lat, nearLon, nearLat) <= radius;
+        }
+        info->eWithin = within ? PARTLY_WITHIN : NOT_WITHIN;
+        return SQLITE_OK;
+    }
+
+
+    int RegisterGeoQueryFunctions(sqlite3 *db, SQLiteFunctionProfile* const *profile) {
+        return sqlite3_rtree_query_callback(db, "geo_radius", geo_radius,
+                                            new fleeceFuncContext{nullptr, nullptr,
+                                                                  "geo_radius", profile},
+                                            [](void *param){delete (fleeceFuncContext*)param;});
+    }
+
+
 #pragma mark - TYPE TESTS & CONVERSIONS:
 
 
@@ -1217,6 +1692,10 @@ namespace litecore {
         { "tan",               1, fl_tan },
         { "trunc",             1, fl_trunc },
         { "trunc",             2, fl_trunc },
+
+        { "geo_bounds",        1, fl_geo_bounds },
+        { "geo_bound",         2, fl_geo_bound },
+        { "geo_distance",      4, fl_geo_distance },
         { }
     };
 
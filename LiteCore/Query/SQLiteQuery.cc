@@ -22,15 +22,32 @@
 #include "Logging.hh"
 #include "Query.hh"
 #include "QueryParser.hh"
+#include "IndexAdvisor.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "Fleece.hh"
 #include "Path.hh"
 #include "Stopwatch.hh"
+#include "FilePath.hh"
+#include "PlatformIO.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
 #include <sstream>
+#include <iomanip>
 #include <iostream>
+#include <thread>
+
+#ifdef _MSC_VER
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <sys/mman.h>
+#endif
 
 using namespace std;
 using namespace fleece;
@@ -47,6 +64,74 @@ namespace litecore {
     };
 
 
+    // Temporary table holding the partial aggregates of a query run in parallel:
+    static const char* const kPartialsTable = "partial_aggregates";
+
+    // Fewest rowids a thread running a query in parallel should scan:
+    static const int64_t kMinRowsPerPartition = 1000;
+
+    // Size at which a query's recorded results are broken into a new chunk:
+    static const size_t kRecordingChunkSize = 256 * 1024;
+
+
+    // A range of rowids whose partial aggregates one thread computes, and the results.
+    struct QueryPartition {
+        int64_t start, end;                                     // Rowids in [start, end)
+        unique_ptr<SQLiteDataFile::ReadConnection> connection;
+        vector<sqlite3_value*> values;                          // The partial aggregates
+        bool noSnapshot {false};                                // Couldn't open the snapshot
+        exception_ptr error;
+
+        ~QueryPartition() {
+            for (auto value : values)
+                sqlite3_value_free(value);
+        }
+    };
+
+
+    // Primitives of SQLiteQuery::bindParameters, for SQLiteCpp statements and for the raw SQLite
+    // ones of a query run in parallel. Strings and data are bound without copying.
+    static int parameterIndex(SQLite::Statement &stmt, const string &name) {
+        return stmt.getIndex(name.c_str());
+    }
+
+    static int parameterIndex(sqlite3_stmt *stmt, const string &name) {
+        return sqlite3_bind_parameter_index(stmt, name.c_str());
+    }
+
+    static void bindInt(SQLite::Statement &stmt, int index, int64_t i) {
+        stmt.bind(index, (long long)i);
+    }
+
+    static void bindInt(sqlite3_stmt *stmt, int index, int64_t i) {
+        sqlite3_bind_int64(stmt, index, i);
+    }
+
+    static void bindDouble(SQLite::Statement &stmt, int index, double d) {
+        stmt.bind(index, d);
+    }
+
+    static void bindDouble(sqlite3_stmt *stmt, int index, double d) {
+        sqlite3_bind_double(stmt, index, d);
+    }
+
+    static void bindString(SQLite::Statement &stmt, int index, slice str) {
+        stmt.bindNoCopy(index, (const char*)str.buf, (int)str.size);
+    }
+
+    static void bindString(sqlite3_stmt *stmt, int index, slice str) {
+        sqlite3_bind_text(stmt, index, (const char*)str.buf, (int)str.size, SQLITE_STATIC);
+    }
+
+    static void bindData(SQLite::Statement &stmt, int index, slice data) {
+        stmt.bindNoCopy(index, data.buf, (int)data.size);
+    }
+
+    static void bindData(sqlite3_stmt *stmt, int index, slice data) {
+        sqlite3_bind_blob(stmt, index, data.buf, (int)data.size, SQLITE_STATIC);
+    }
+
+
     class SQLiteQuery : public Query, Logging {
     public:
         SQLiteQuery(SQLiteKeyStore &keyStore, slice selectorExpression)
@@ -55,16 +140,20 @@ namespace litecore {
         {
             log("Compiling JSON query: %.*s", SPLAT(selectorExpression));
             QueryParser qp(keyStore.tableName());
+            qp.setTableExistsCallback([&](const string &tableName) {
+                return keyStore.db().tableExists(tableName);
+            });
+            qp.setIndexedExpressionCallback([&](const string &expressionSQL) {
+                return keyStore.hasIndexOnExpression(expressionSQL);
+            });
+            qp.setAggregateViewsCallback([&]() -> vector<QueryParser::AggregateView> {
+                vector<QueryParser::AggregateView> views;
+                for (auto &table : keyStore.aggregateViewTables())
+                    views.push_back({table, keyStore.db().tableColumns(table)});
+                return views;
+            });
             qp.parseJSON(selectorExpression);
 
-            _parameters = qp.parameters();
-            for (auto p = _parameters.begin(); p != _parameters.end();) {
-                if (hasPrefix(*p, "opt_"))
-                    p = _parameters.erase(p);       // Optional param, don't warn if it's unbound
-                else
-                    ++p;
-            }
-
             _ftsTables = qp.ftsTablesUsed();
             for (auto ftsTable : _ftsTables) {
                 if (!keyStore.db().tableExists(ftsTable))
@@ -73,10 +162,44 @@ namespace litecore {
 
             string sql = qp.SQL();
             LogTo(SQL, "Compiled {Query#%u}: %s", _objectRef, sql.c_str());
+            if (!qp.aggregateViewUsed().empty())
+                log("Answering query from aggregate index %s", qp.aggregateViewUsed().c_str());
             _statement.reset(keyStore.compile(sql));
-            
+
+            // Look up the SQLite index of each parameter now, so binding doesn't have to:
+            for (const string &name : qp.parameters()) {        // (std::set is sorted)
+                int index = _statement->getIndex(("$_" + name).c_str());
+                bool optional = hasPrefix(name, "opt_");    // Optional: don't warn if unbound
+                _parameters.push_back({name, index, optional});
+                if (!optional)
+                    ++_nRequiredParameters;
+            }
+
             _1stCustomResultColumn = qp.firstCustomResultColumn();
             _isAggregate = qp.isAggregateQuery();
+            _whereProperties = qp.whereProperties();
+            _orderByProperties = qp.orderByProperties();
+
+            // An aggregate query that reads the table may also be run in parallel:
+            if (_isAggregate && qp.aggregateViewUsed().empty()) {
+                QueryParser pp(keyStore.tableName());
+                pp.setTableExistsCallback([&](const string &tableName) {
+                    return keyStore.db().tableExists(tableName);
+                });
+                try {
+                    if (pp.parsePartitionedJSON(selectorExpression, kPartialsTable)) {
+                        string partialsSQL = pp.partialAggregatesSQL();
+                        unique_ptr<SQLite::Statement> check(keyStore.compile(partialsSQL));
+                        _partialsSQL = partialsSQL;
+                        _partialColumns = pp.partialAggregateColumns();
+                        _combiningSQL = pp.SQL();
+                        LogTo(SQL, "Partial aggregates of {Query#%u}: %s",
+                              _objectRef, _partialsSQL.c_str());
+                    }
+                } catch (const exception &x) {
+                    Warn("{Query#%u} can't run in parallel: %s", _objectRef, x.what());
+                }
+            }
         }
 
 
@@ -93,7 +216,7 @@ namespace litecore {
 
             if (!_matchedTextStatement) {
                 auto &df = (SQLiteDataFile&) keyStore().dataFile();
-                string sql = "SELECT * FROM \"" + expr + "\" WHERE docid=?";
+                string sql = "SELECT * FROM \"" + expr + "\" WHERE rowid=?";
                 _matchedTextStatement.reset(new SQLite::Statement(df, sql));
             }
 
@@ -130,15 +253,154 @@ namespace litecore {
             return result.str();
         }
 
+        // Tells the KeyStore's IndexAdvisor (if any) about a run of this query.
+        void adviseIndexes(double seconds) noexcept {
+            if (_whereProperties.empty() && _orderByProperties.empty())
+                return;
+            auto &ks = (SQLiteKeyStore&)keyStore();
+            auto advisor = ks.indexAdvisor();
+            if (!advisor)
+                return;
+            try {
+                checkPlan();
+                advisor->recordRun(_whereProperties, _orderByProperties,
+                                   _planFullScan, _planTempBTree, seconds);
+            } catch (const exception &x) {
+                Warn("Index advisor failed on {Query#%u}: %s", _objectRef, x.what());
+            }
+        }
+
+        // Finds whether the query plan scans the entire table, or sorts in a temporary B-tree.
+        // The result is cached until an index is created or deleted, since that can change the plan.
+        void checkPlan() {
+            auto &df = (SQLiteDataFile&) keyStore().dataFile();
+            uint64_t generation = df.schemaGeneration();
+            if (_planChecked && generation == _planSchemaGeneration)
+                return;
+            _planChecked = true;
+            _planSchemaGeneration = generation;
+            _planFullScan = _planTempBTree = false;
+
+            string table = ((SQLiteKeyStore&)keyStore()).tableName();
+            SQLite::Statement x(df, "EXPLAIN QUERY PLAN " + _statement->getQuery());
+            while (x.executeStep()) {
+                string detail = x.getColumn(3).getText();
+                // Older SQLite says "SCAN TABLE kv_default", newer just "SCAN kv_default":
+                for (const string &scan : {"SCAN TABLE " + table, "SCAN " + table}) {
+                    if (hasPrefix(detail, scan) && (detail.size() == scan.size()
+                                                    || detail[scan.size()] == ' ')
+                                                && detail.find(" INDEX ") == string::npos)
+                        _planFullScan = true;
+                }
+                if (hasPrefix(detail, "USE TEMP B-TREE FOR ")
+                        && detail.find("ORDER BY") != string::npos)
+                    _planTempBTree = true;
+            }
+        }
+
         virtual QueryEnumerator* createEnumerator(const Options *options) override;
         SQLiteQueryEnumerator* createEnumerator(const Options *options, sequence_t lastSeq);
+        SQLiteQueryEnumerator* run(const Options *options, sequence_t curSeq);
+        SQLiteQueryEnumerator* run(const Options *options, sequence_t curSeq,
+                                   SQLiteDataFile::ReadConnection&);
+        SQLiteQueryEnumerator* createParallelEnumerator(const Options &options, sequence_t curSeq);
+        void runPartition(QueryPartition&, const Dict *params, const Options&, sqlite3_snapshot*);
+        SQLiteQueryEnumerator* combinePartitions(vector<QueryPartition>&,
+                                                 const Options&, sequence_t curSeq);
+
+        virtual string profile(const Options *options) override;
+
+        void cancel() noexcept override {
+            ++_cancelCount;
+        }
 
         unsigned objectRef() const                  {return _objectRef;}
 
-        set<string> _parameters;
+        sqlite3* sqliteHandle() const {
+            SQLite::Database &sqlDb = (SQLiteDataFile&)keyStore().dataFile();
+            return sqlDb.getHandle();
+        }
+
+        // A query parameter, and its index in the SQLite statement.
+        struct Parameter {
+            string name;        // Name as used in the query (without SQL's "$_" prefix)
+            int index;          // SQLite parameter index, or 0 if unknown
+            bool optional;      // Name starts with "opt_"
+        };
+
+        // Looks up a parameter by name, without allocating. Returns nullptr if not found.
+        const Parameter* findParameter(slice name) const {
+            auto i = lower_bound(_parameters.begin(), _parameters.end(), name,
+                                 [](const Parameter &param, slice n) {
+                                     return slice(param.name).compare(n) < 0;
+                                 });
+            if (i == _parameters.end() || slice(i->name) != name || i->index == 0)
+                return nullptr;
+            return &*i;
+        }
+
+        // Binds parameter values from a Fleece dict to a statement compiled from this query, or
+        // (if `byName` is true) to one compiled from other SQL that uses the same "$_" names.
+        // Strings and data are bound without copying, so `params` must outlive the statement run.
+        // Returns the number of required (non-optional) parameters that were bound.
+        template <class STMT>
+        unsigned bindParameters(STMT &stmt, const Dict *params, bool byName) const {
+            unsigned nBound = 0;
+            if (!params)
+                return nBound;
+            for (Dict::iterator it(params); it; ++it) {
+                slice key = it.key()->asString();
+                const Value *val = it.value();
+                auto param = findParameter(key);
+                if (!param) {
+                    if (val->type() == kNull)
+                        continue;
+                    error::_throw(error::InvalidQueryParam,
+                                  "Unknown query property '%.*s'", SPLAT(key));
+                }
+                if (!param->optional)
+                    ++nBound;
+                int index = param->index;
+                if (byName) {
+                    index = parameterIndex(stmt, "$_" + param->name);
+                    if (index == 0)
+                        continue;
+                }
+                switch (val->type()) {
+                    case kNull:
+                        break;
+                    case kBoolean:
+                    case kNumber:
+                        if (val->isInteger() && !val->isUnsigned())
+                            bindInt(stmt, index, val->asInt());
+                        else
+                            bindDouble(stmt, index, val->asDouble());
+                        break;
+                    case kString:
+                        bindString(stmt, index, val->asString());
+                        break;
+                    case kData:
+                        bindData(stmt, index, val->asData());
+                        break;
+                    default:
+                        error::_throw(error::InvalidParameter);
+                }
+            }
+            return nBound;
+        }
+
+        vector<Parameter> _parameters;          // Sorted by name
+        unsigned _nRequiredParameters {0};
         vector<string> _ftsTables;
         unsigned _1stCustomResultColumn;
         bool _isAggregate;
+        atomic<unsigned> _cancelCount {0};      // Incremented by cancel()
+        vector<string> _whereProperties, _orderByProperties;   // Index candidates
+        uint64_t _planSchemaGeneration {0};     // Schema generation when plan was last checked
+        bool _planChecked {false};
+        bool _planFullScan {false}, _planTempBTree {false};
+        string _partialsSQL, _combiningSQL;     // For parallel runs; empty if not possible
+        vector<string> _partialColumns;
 
         shared_ptr<SQLite::Statement> statement() {return _statement;}
 
@@ -164,8 +426,14 @@ namespace litecore {
         :_query(query)
         ,_lastSequence(lastSequence)
         {
-            if (options)
+            if (options) {
                 _options = *options;
+                if (_options.paramBindings.buf && !_options.paramBindingsAreFleece) {
+                    // Convert JSON parameters once, instead of every time the query is refreshed:
+                    _options.paramBindings = JSONConverter::convertJSON(_options.paramBindings);
+                    _options.paramBindingsAreFleece = true;
+                }
+            }
         }
 
     protected:
@@ -176,24 +444,230 @@ namespace litecore {
 
 
 
+    // Process-wide accounting of the memory used by recordings (see QueryRecording, below):
+    static atomic<uint64_t> sRecordingMemoryLimit {0};
+    static atomic<uint64_t> sRecordingBytesInMemory {0};
+    static atomic<uint64_t> sPeakRecordingBytes {0};
+    static atomic<uint64_t> sLargestRecording {0};
+    static atomic<uint64_t> sRecordingBytesSpilled {0};
+
+    static void raiseTo(atomic<uint64_t> &value, uint64_t n) {
+        uint64_t cur = value;
+        while (n > cur && !value.compare_exchange_weak(cur, n))
+            ;
+    }
+
+    void Query::setRecordingMemoryLimit(uint64_t maxBytes) {
+        sRecordingMemoryLimit = maxBytes;
+    }
+
+    Query::RecordingStats Query::recordingStats() {
+        RecordingStats stats;
+        stats.bytesInMemory = sRecordingBytesInMemory;
+        stats.peakBytesInMemory = sPeakRecordingBytes;
+        stats.largestRecording = sLargestRecording;
+        stats.bytesSpilled = sRecordingBytesSpilled;
+        return stats;
+    }
+
+
+    // The recorded results of a query, as a series of Fleece arrays ("chunks") that each hold a
+    // run of rows. Chunks stay in memory as long as they fit in the query's and the process's
+    // memory limits; after that they're appended to a temporary file (if the options allow it,
+    // and the database isn't encrypted, since the file isn't), which finish() memory-maps.
+    // Each row takes two array items; see SQLiteQueryEnumerator.
+    class QueryRecording {
+    public:
+        QueryRecording(const Query::Options &options, bool encrypted)
+        :_memoryLimit(options.maxRecordingBytes)
+        ,_spillToDisk(options.spillToDisk && !encrypted)
+        ,_encrypted(encrypted)
+        { }
+
+        ~QueryRecording() {
+            sRecordingBytesInMemory -= _bytesInMemory;
+            if (_file) {
+                unmap();
+                fclose(_file);
+                try {
+                    _filePath.del();
+                } catch (...) { }
+            }
+        }
+
+        uint64_t rowCount() const                   {return _rowCount;}
+        uint64_t size() const                       {return _size;}
+        uint64_t bytesSpilled() const               {return _fileSize;}
+
+        size_t chunkCount() const                   {return _chunks.size();}
+        uint64_t firstRowOfChunk(size_t i) const    {return _chunks[i].firstRow;}
+
+        const Array* chunkRows(size_t i) const {
+            return Value::fromTrustedData(_chunks[i].data)->asArray();
+        }
+
+        // Returns the index of the chunk containing a row, which must exist.
+        size_t chunkContaining(uint64_t row) const {
+            auto i = upper_bound(_chunks.begin(), _chunks.end(), row,
+                                 [](uint64_t r, const Chunk &chunk) {return r < chunk.firstRow;});
+            return (i - _chunks.begin()) - 1;
+        }
+
+        void addChunk(alloc_slice data, uint32_t nRows) {
+            Chunk chunk;
+            chunk.firstRow = _rowCount;
+            chunk.size = data.size;
+            if (!_file && reserveMemory(data.size)) {
+                chunk.memory = data;
+                chunk.data = data;
+            } else if (_spillToDisk) {
+                chunk.fileOffset = spill(data);
+            } else {
+                error::_throw(error::QueryResultTooLarge,
+                              "Query results exceeded the memory limit after %llu rows%s",
+                              (unsigned long long)_rowCount,
+                              (_encrypted ? "; results of an encrypted database can't spill to disk"
+                                          : ""));
+            }
+            _chunks.push_back(chunk);
+            _rowCount += nRows;
+            _size += data.size;
+        }
+
+        // Call after the last chunk is added.
+        void finish() {
+            if (_file) {
+                if (fflush(_file) != 0)
+                    error::_throwErrno();
+                map();
+                for (auto &chunk : _chunks) {
+                    if (!chunk.memory)
+                        chunk.data = slice((const uint8_t*)_mapped + chunk.fileOffset, chunk.size);
+                }
+            }
+            raiseTo(sLargestRecording, _size);
+        }
+
+        bool operator== (const QueryRecording &other) const {
+            if (_rowCount != other._rowCount || _chunks.size() != other._chunks.size())
+                return false;
+            for (size_t i = 0; i < _chunks.size(); ++i) {
+                if (_chunks[i].data != other._chunks[i].data)
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        struct Chunk {
+            alloc_slice memory;             // The chunk's data, if it's kept in memory
+            slice data;                     // The chunk's data, in memory or in the mapped file
+            size_t size {0};
+            uint64_t fileOffset {0};        // Offset of the data in the file, if spilled
+            uint64_t firstRow {0};          // Index of the chunk's first row in the recording
+        };
+
+        // Accounts for `size` more bytes in memory, unless that would exceed a limit.
+        bool reserveMemory(size_t size) {
+            if (_memoryLimit > 0 && _bytesInMemory + size > _memoryLimit)
+                return false;
+            uint64_t total = (sRecordingBytesInMemory += size);
+            uint64_t globalLimit = sRecordingMemoryLimit;
+            if (globalLimit > 0 && total > globalLimit) {
+                sRecordingBytesInMemory -= size;
+                return false;
+            }
+            _bytesInMemory += size;
+            raiseTo(sPeakRecordingBytes, total);
+            return true;
+        }
+
+        // Appends data to the temporary file, returning its offset.
+        uint64_t spill(slice data) {
+            if (!_file)
+                _filePath = FilePath::tempDirectory()["LiteCore_query_"].mkTempFile(&_file);
+            uint64_t offset = _fileSize;
+            // Pad each chunk to a multiple of 8 bytes, to keep the Fleece data aligned:
+            static const uint8_t kPadding[8] = { };
+            size_t padding = (8 - data.size % 8) % 8;
+            if (fwrite(data.buf, 1, data.size, _file) != data.size
+                    || fwrite(kPadding, 1, padding, _file) != padding)
+                error::_throwErrno();
+            _fileSize += data.size + padding;
+            sRecordingBytesSpilled += data.size;
+            return offset;
+        }
+
+        void map() {
+#ifdef _MSC_VER
+            auto fileHandle = (HANDLE)_get_osfhandle(_fileno(_file));
+            _mapping = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (_mapping)
+                _mapped = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!_mapped)
+                error::_throw(error::IOError);
+#else
+            void *mapped = mmap(nullptr, (size_t)_fileSize, PROT_READ, MAP_SHARED,
+                                fileno(_file), 0);
+            if (mapped == MAP_FAILED)
+                error::_throwErrno();
+            _mapped = mapped;
+#endif
+        }
+
+        void unmap() {
+#ifdef _MSC_VER
+            if (_mapped)
+                UnmapViewOfFile(_mapped);
+            if (_mapping)
+                CloseHandle(_mapping);
+#else
+            if (_mapped)
+                munmap(_mapped, (size_t)_fileSize);
+#endif
+        }
+
+        QueryRecording(const QueryRecording&) =delete;
+        QueryRecording& operator=(const QueryRecording&) =delete;
+
+        const uint64_t _memoryLimit;        // Max bytes in memory, or 0 for no limit
+        const bool _spillToDisk;
+        const bool _encrypted;              // Database is encrypted, so results mustn't spill
+        vector<Chunk> _chunks;
+        uint64_t _rowCount {0};
+        uint64_t _size {0};                 // Total bytes of Fleece data
+        uint64_t _bytesInMemory {0};        // Bytes of chunks kept in memory
+        FilePath _filePath;                 // Temporary file holding spilled chunks
+        FILE *_file {nullptr};
+        uint64_t _fileSize {0};
+        void *_mapped {nullptr};            // Address the file is mapped at, after finish()
+#ifdef _MSC_VER
+        HANDLE _mapping {nullptr};
+#endif
+    };
+
+
+
     // Query enumerator that reads from prerecorded Fleece data (generated by fastForward(), below)
-    // Each array item is a row, which is itself an array of column values.
+    // Each row takes two array items: an array of column values, then a bitmap of the columns
+    // that are missing. The rows may be split across the chunks of a QueryRecording.
     class SQLiteQueryEnumerator : public QueryEnumerator, SQLiteQueryEnumBase, Logging {
     public:
         SQLiteQueryEnumerator(SQLiteQuery *query,
                               const Query::Options *options,
                               sequence_t lastSequence,
-                              alloc_slice recording,
-                              unsigned long long rowCount,
+                              unique_ptr<QueryRecording> recording,
                               double elapsedTime)
         :SQLiteQueryEnumBase(query, options, lastSequence)
         ,Logging(QueryLog)
-        ,_recording(recording)
-        ,_rows(Value::fromTrustedData(_recording)->asArray())
+        ,_recording(move(recording))
+        ,_rows(_recording->chunkRows(0))
         ,_iter(_rows)
         {
-            log("Created on {Query#%u} with %llu rows (%zu bytes) in %.3fms",
-                query->objectRef(), rowCount, recording.size, elapsedTime*1000);
+            log("Created on {Query#%u} with %llu rows (%llu bytes, %llu spilled to disk) in %.3fms",
+                query->objectRef(), (unsigned long long)_recording->rowCount(),
+                (unsigned long long)_recording->size(),
+                (unsigned long long)_recording->bytesSpilled(), elapsedTime*1000);
         }
 
         ~SQLiteQueryEnumerator() {
@@ -201,19 +675,21 @@ namespace litecore {
         }
 
         bool hasEqualContents(const SQLiteQueryEnumerator* other) const {
-            return _recording == other->_recording;
+            return *_recording == *other->_recording;
         }
 
         virtual int64_t getRowCount() const override {
-            return _rows->count() / 2;  // (every other row is a column bitmap)
+            return _recording->rowCount();
         }
 
+        unsigned partitionCount() const override        {return _partitionCount;}
+        void setPartitionCount(unsigned n)              {_partitionCount = n;}
+
         virtual void seek(uint64_t rowIndex) override {
-            rowIndex *= 2;
-            if (rowIndex >= _rows->count())
+            if (rowIndex >= _recording->rowCount())
                 error::_throw(error::InvalidParameter);
-            _iter = Array::iterator(_rows);
-            _iter += (uint32_t)rowIndex;
+            setChunk(_recording->chunkContaining(rowIndex));
+            _iter += (uint32_t)(2 * (rowIndex - _recording->firstRowOfChunk(_chunk)));
             _first = false;
         }
 
@@ -222,6 +698,8 @@ namespace litecore {
                 _first = false;
             else
                 _iter += 2;
+            while (!_iter && _chunk + 1 < _recording->chunkCount())
+                setChunk(_chunk + 1);
             if (!_iter) {
                 logVerbose("END");
                 return false;
@@ -286,33 +764,102 @@ namespace litecore {
         string loggingClassName() const override    {return "QueryEnum";}
 
     private:
-        alloc_slice _recording;
+        void setChunk(size_t chunk) {
+            _chunk = chunk;
+            _rows = _recording->chunkRows(chunk);
+            _iter = Array::iterator(_rows);
+        }
+
+        unique_ptr<QueryRecording> _recording;
+        size_t _chunk {0};
         const Array* _rows;
         Array::iterator _iter;
         bool _first {true};
+        unsigned _partitionCount {1};
+    };
+
+
+
+    // Installs a SQLite progress handler for the duration of a query run, which stops the
+    // statement if the query is cancelled or runs past its time or VM-step budget.
+    // (The handler belongs to the connection, so only one of these may exist at a time.)
+    class QueryInterrupter {
+    public:
+        static constexpr int kCheckInterval = 1000;     // VM steps between calls to the handler
+
+        QueryInterrupter(sqlite3 *sqlite,
+                         const atomic<unsigned> &cancelCount,
+                         const Query::Options &options)
+        :_sqlite(sqlite)
+        ,_cancelCount(cancelCount)
+        ,_initialCancelCount(cancelCount)
+        ,_timeLimit(options.timeLimitMS / 1000.0)
+        ,_stepLimit(options.stepLimit)
+        {
+            sqlite3_progress_handler(_sqlite, kCheckInterval, &progressCallback, this);
+        }
+
+        ~QueryInterrupter() {
+            sqlite3_progress_handler(_sqlite, 0, nullptr, nullptr);
+        }
+
+        // If the interrupter stopped the query, returns a description of why; else nullptr.
+        const char* reason() const                  {return _reason;}
+
+    private:
+        static int progressCallback(void *context) {
+            return ((QueryInterrupter*)context)->check();
+        }
+
+        // Returns nonzero to make SQLite abort the statement with SQLITE_INTERRUPT.
+        int check() {
+            _steps += kCheckInterval;
+            if (_cancelCount != _initialCancelCount)
+                _reason = "was cancelled";
+            else if (_stepLimit > 0 && _steps > _stepLimit)
+                _reason = "exceeded its step limit";
+            else if (_timeLimit > 0 && _stopwatch.elapsed() > _timeLimit)
+                _reason = "exceeded its time limit";
+            return _reason != nullptr;
+        }
+
+        sqlite3* const _sqlite;
+        const atomic<unsigned> &_cancelCount;
+        const unsigned _initialCancelCount;
+        const double _timeLimit;            // seconds
+        const uint64_t _stepLimit;
+        uint64_t _steps {0};
+        Stopwatch _stopwatch;
+        const char *_reason {nullptr};
     };
 
 
 
     // Reads from 'live' SQLite statement and records the results into a Fleece array,
     // which is then used as the data source of a SQLiteQueryEnum.
+    // By default it runs the query's own statement; given another statement of the same query
+    // (possibly compiled on another connection, `sqlite`), it binds the parameters by name
+    // instead of by the statement's precomputed indexes.
     class SQLiteQueryRunner : public SQLiteQueryEnumBase {
     public:
-        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence)
+        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence,
+                          shared_ptr<SQLite::Statement> statement =nullptr,
+                          sqlite3 *sqlite =nullptr)
         :SQLiteQueryEnumBase(query, options, lastSequence)
-        ,_statement(query->statement())
+        ,_statement(statement ? statement : query->statement())
+        ,_bindByName(statement != nullptr)
+        ,_interrupter(sqlite ? sqlite : query->sqliteHandle(), query->_cancelCount, _options)
         {
             _statement->clearBindings();
-            _unboundParameters = _query->_parameters;
-            if (options && options->paramBindings.buf)
-                bindParameters(options->paramBindings);
-            if (!_unboundParameters.empty()) {
-                stringstream msg;
-                for (const string &param : _unboundParameters)
-                    msg << " $" << param;
-                Warn("Some query parameters were left unbound and will have value `MISSING`:%s",
-                     msg.str().c_str());
+            const Dict *params = nullptr;
+            if (_options.paramBindings.buf) {
+                params = Value::fromData(_options.paramBindings)->asDict();
+                if (!params)
+                    error::_throw(error::InvalidParameter);
             }
+            if (_query->bindParameters(*_statement, params, _bindByName)
+                    < _query->_nRequiredParameters)
+                warnUnboundParameters(params);
 
             LogStatement(*_statement);
         }
@@ -320,50 +867,18 @@ namespace litecore {
         ~SQLiteQueryRunner() {
             try {
                 _statement->reset();
+                _statement->clearBindings();    // strings & data were bound without copying
             } catch (...) { }
         }
 
-        void bindParameters(slice json) {
-            alloc_slice fleeceData;
-            fleeceData = JSONConverter::convertJSON(json);
-            const Dict *root = Value::fromData(fleeceData)->asDict();
-            if (!root)
-                error::_throw(error::InvalidParameter);
-            for (Dict::iterator it(root); it; ++it) {
-                auto key = (string)it.key()->asString();
-                _unboundParameters.erase(key);
-                auto sqlKey = string("$_") + key;
-                const Value *val = it.value();
-                try {
-                    switch (val->type()) {
-                        case kNull:
-                            break;
-                        case kBoolean:
-                        case kNumber:
-                            if (val->isInteger() && !val->isUnsigned())
-                                _statement->bind(sqlKey, (long long)val->asInt());
-                            else
-                                _statement->bind(sqlKey, val->asDouble());
-                            break;
-                        case kString:
-                            _statement->bind(sqlKey, (string)val->asString());
-                            break;
-                        case kData: {
-                            slice str = val->asString();
-                            _statement->bind(sqlKey, str.buf, (int)str.size);
-                            break;
-                        }
-                        default:
-                            error::_throw(error::InvalidParameter);
-                    }
-                } catch (const SQLite::Exception &x) {
-                    if (x.getErrorCode() == SQLITE_RANGE)
-                        error::_throw(error::InvalidQueryParam,
-                                      "Unknown query property '%s'", key.c_str());
-                    else
-                        throw;
-                }
+        void warnUnboundParameters(const Dict *params) {
+            stringstream msg;
+            for (auto &param : _query->_parameters) {
+                if (!param.optional && !(params && params->get(slice(param.name))))
+                    msg << " $" << param.name;
             }
+            Warn("Some query parameters were left unbound and will have value `MISSING`:%s",
+                 msg.str().c_str());
         }
 
         bool encodeColumn(Encoder &enc, int i) {
@@ -396,35 +911,151 @@ namespace litecore {
             return true;
         }
 
-        // Collects all the (remaining) rows into a Fleece array of arrays,
+        // Collects all the (remaining) rows into a recording made of Fleece arrays of arrays,
         // and returns an enumerator impl that will replay them.
         SQLiteQueryEnumerator* fastForward() {
             Stopwatch st;
             int nCols = _statement->getColumnCount();
-            uint64_t rowCount = 0;
+            bool encrypted = _query->keyStore().dataFile().options().encryptionAlgorithm
+                                                                            != kNoEncryption;
+            unique_ptr<QueryRecording> recording(new QueryRecording(_options, encrypted));
+            uint32_t chunkRows = 0;
             Encoder enc;
             enc.beginArray();
-            while (_statement->executeStep()) {
-                uint64_t missingCols = 0;
-                enc.beginArray(nCols);
-                for (int i = 0; i < nCols; ++i) {
-                    if (!encodeColumn(enc, i) && i < 64)
-                        missingCols |= (1 << i);
+            try {
+                while (_statement->executeStep()) {
+                    uint64_t missingCols = 0;
+                    enc.beginArray(nCols);
+                    for (int i = 0; i < nCols; ++i) {
+                        if (!encodeColumn(enc, i) && i < 64)
+                            missingCols |= (1 << i);
+                    }
+                    enc.endArray();
+                    // Add an integer containing a bit-map of which columns are missing/undefined:
+                    enc.writeUInt(missingCols);
+                    ++chunkRows;
+                    if (enc.bytesWritten() >= kRecordingChunkSize) {
+                        enc.endArray();
+                        recording->addChunk(enc.extractOutput(), chunkRows);
+                        enc.reset();
+                        enc.beginArray();
+                        chunkRows = 0;
+                    }
                 }
-                enc.endArray();
-                // Add an integer containing a bit-map of which columns are missing/undefined:
-                enc.writeUInt(missingCols);
-                ++rowCount;
+            } catch (const SQLite::Exception&) {
+                if (_interrupter.reason())
+                    error::_throw(error::QueryInterrupted, "Query %s after %.3fms",
+                                  _interrupter.reason(), st.elapsed() * 1000);
+                throw;
             }
             enc.endArray();
-            alloc_slice recording = enc.extractOutput();
-            return new SQLiteQueryEnumerator(_query, &_options, _lastSequence, recording,
-                                             rowCount, st.elapsed());
+            if (chunkRows > 0 || recording->chunkCount() == 0)
+                recording->addChunk(enc.extractOutput(), chunkRows);
+            recording->finish();
+            return new SQLiteQueryEnumerator(_query, &_options, _lastSequence, move(recording),
+                                             st.elapsed());
+        }
+
+        // Runs the query to completion like fastForward(), while collecting statistics, and
+        // returns a report of them.
+        string profile() {
+            auto &df = (SQLiteDataFile&)_query->keyStore().dataFile();
+            SQLite::Database &sqlDb = df;
+            vector<sqlite3_stmt*> candidates = resetStatementCounters(sqlDb.getHandle());
+
+            SQLiteFunctionProfile functions;
+            unique_ptr<SQLiteQueryEnumerator> e;
+            Stopwatch st;
+            df.setFunctionProfile(&functions);
+            try {
+                e.reset(fastForward());
+            } catch (...) {
+                df.setFunctionProfile(nullptr);
+                throw;
+            }
+            df.setFunctionProfile(nullptr);
+            double elapsed = st.elapsed();
+
+            // Of the statements with our SQL, the one that just ran is the one with VM steps:
+            sqlite3_stmt *stmt = nullptr;
+            for (auto candidate : candidates) {
+                if (sqlite3_stmt_status(candidate, SQLITE_STMTSTATUS_VM_STEP, false) > 0) {
+                    stmt = candidate;
+                    break;
+                }
+            }
+
+            stringstream out;
+            out << _statement->getQuery() << "\n";
+            out << fixed << setprecision(3);
+            out << "rows: " << e->getRowCount() << ", time: " << elapsed * 1000 << " ms\n";
+            if (stmt) {
+                out << "VM steps: "
+                    << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, false) << "\n"
+                    << "full-scan steps: "
+                    << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, false) << "\n"
+                    << "sorts: "
+                    << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, false) << "\n"
+                    << "auto-index rows: "
+                    << sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, false) << "\n";
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+                // https://www.sqlite.org/c3ref/stmt_scanstatus.html
+                for (int i = 0; ; ++i) {
+                    sqlite3_int64 nLoop, nVisit;
+                    double estimate;
+                    const char *explain;
+                    if (sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NLOOP, &nLoop) != 0)
+                        break;
+                    sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NVISIT, &nVisit);
+                    sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_EST, &estimate);
+                    sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_EXPLAIN, &explain);
+                    out << "loop " << i << ": " << explain << " -- " << nLoop << " loops, "
+                        << nVisit << " rows visited (estimated " << estimate << " per loop)\n";
+                }
+#endif
+            }
+
+            // List the SQL functions in descending order of time spent:
+            using FunctionStats = pair<const char*, SQLiteFunctionProfile::Stats>;
+            vector<FunctionStats> fnStats(functions.functions.begin(),
+                                          functions.functions.end());
+            sort(fnStats.begin(), fnStats.end(), [](const FunctionStats &a,
+                                                    const FunctionStats &b) {
+                return a.second.seconds > b.second.seconds;
+            });
+            for (auto &fn : fnStats) {
+                out << fn.first << ": " << fn.second.calls << " calls, "
+                    << fn.second.seconds * 1000 << " ms\n";
+            }
+            return out.str();
+        }
+
+        // Returns the connection's statements whose SQL is the same as _statement's (one of
+        // which is _statement; SQLiteCpp doesn't expose its sqlite3_stmt), after resetting their
+        // counters so they'll reflect only the upcoming run.
+        vector<sqlite3_stmt*> resetStatementCounters(sqlite3 *db) {
+            string sql = _statement->getQuery();
+            vector<sqlite3_stmt*> stmts;
+            for (auto stmt = sqlite3_next_stmt(db, nullptr); stmt;
+                      stmt = sqlite3_next_stmt(db, stmt)) {
+                const char *stmtSQL = sqlite3_sql(stmt);
+                if (!stmtSQL || sql != stmtSQL)
+                    continue;
+                for (int op : {SQLITE_STMTSTATUS_VM_STEP, SQLITE_STMTSTATUS_FULLSCAN_STEP,
+                               SQLITE_STMTSTATUS_SORT, SQLITE_STMTSTATUS_AUTOINDEX})
+                    sqlite3_stmt_status(stmt, op, true);
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+                sqlite3_stmt_scanstatus_reset(stmt);
+#endif
+                stmts.push_back(stmt);
+            }
+            return stmts;
         }
 
     private:
         shared_ptr<SQLite::Statement> _statement;
-        set<string> _unboundParameters;
+        bool _bindByName;
+        QueryInterrupter _interrupter;
     };
 
 
@@ -440,19 +1071,334 @@ namespace litecore {
     SQLiteQueryEnumerator* SQLiteQuery::createEnumerator(const Options *options,
                                                          sequence_t lastSeq)
     {
-        // Start a read-only transaction, to ensure that the result of lastSequence() will be
-        // consistent with the query results.
-        ReadOnlyTransaction t(keyStore().dataFile());
+        Stopwatch st;
+        unique_ptr<SQLiteQueryEnumerator> e;
+        {
+            // Start a read-only transaction, to ensure that the result of lastSequence() will be
+            // consistent with the query results.
+            ReadOnlyTransaction t(keyStore().dataFile());
+
+            sequence_t curSeq = lastSequence();
+            if (lastSeq > 0 && lastSeq == curSeq)
+                return nullptr;
+            e.reset(run(options, curSeq));
+        }
+        adviseIndexes(st.elapsed());
+        return e.release();
+    }
 
-        sequence_t curSeq = lastSequence();
-        if (lastSeq > 0 && lastSeq == curSeq)
-            return nullptr;
+    // Runs the query within the current read-only transaction, whose lastSequence is `curSeq`.
+    SQLiteQueryEnumerator* SQLiteQuery::run(const Options *options, sequence_t curSeq) {
+        if (options && options->parallelism > 1 && !_partialsSQL.empty()
+                    && !keyStore().dataFile().inTransaction()) {
+            auto e = createParallelEnumerator(*options, curSeq);
+            if (e)
+                return e;
+        }
         SQLiteQueryRunner recorder(this, options, curSeq);
         return recorder.fastForward();
     }
 
+    // Runs the query on a read connection, within its snapshot, on the current thread.
+    SQLiteQueryEnumerator* SQLiteQuery::run(const Options *options, sequence_t curSeq,
+                                            SQLiteDataFile::ReadConnection &conn)
+    {
+        shared_ptr<SQLite::Statement> statement(new SQLite::Statement(conn,
+                                                                      _statement->getQuery()));
+        SQLiteQueryRunner recorder(this, options, curSeq, statement, conn.handle());
+        return recorder.fastForward();
+    }
+
     QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options) {
         return createEnumerator(options, 0);
     }
 
+    string SQLiteQuery::profile(const Options *options) {
+        ReadOnlyTransaction t(keyStore().dataFile());
+        SQLiteQueryRunner runner(this, options, lastSequence());
+        return runner.profile();
+    }
+
+
+#pragma mark - PARALLEL EXECUTION:
+
+
+    // Runs an aggregate query by splitting the table into ranges of rowids, computing the partial
+    // aggregates of each range on its own thread and read connection, then combining those into
+    // the results on the main connection. Returns nullptr if the query should be run serially
+    // instead: the table is too small, the database is encrypted, or the threads can't all read
+    // the snapshot that the main connection is reading (and that `curSeq` belongs to.)
+    SQLiteQueryEnumerator* SQLiteQuery::createParallelEnumerator(const Options &options,
+                                                                 sequence_t curSeq)
+    {
+        auto &df = (SQLiteDataFile&)keyStore().dataFile();
+        string table = ((SQLiteKeyStore&)keyStore()).tableName();
+        SQLite::Statement range(df, "SELECT min(rowid), max(rowid) FROM " + table);
+        if (!range.executeStep() || range.getColumn(0).isNull())
+            return nullptr;
+        int64_t minRowid = range.getColumn(0).getInt64(), maxRowid = range.getColumn(1).getInt64();
+        int64_t nRowids = maxRowid - minRowid + 1;
+        auto n = (unsigned)min<int64_t>(options.parallelism, nRowids / kMinRowsPerPartition);
+        if (n < 2)
+            return nullptr;
+        SQLiteDataFile::Snapshot snapshot = df.currentSnapshot();
+        if (!snapshot)
+            return nullptr;
+
+        vector<QueryPartition> partitions(n);
+        for (unsigned i = 0; i < n; ++i) {
+            auto &part = partitions[i];
+            part.start = minRowid + (nRowids / n) * i;
+            part.end = (i == n - 1) ? maxRowid + 1 : part.start + nRowids / n;
+            part.connection = df.borrowReadConnection();
+            if (!part.connection)
+                return nullptr;
+        }
+
+        alloc_slice paramBindings = options.paramBindings;
+        if (paramBindings.buf && !options.paramBindingsAreFleece)
+            paramBindings = JSONConverter::convertJSON(paramBindings);
+        const Dict *params = nullptr;
+        if (paramBindings.buf) {
+            params = Value::fromData(paramBindings)->asDict();
+            if (!params)
+                error::_throw(error::InvalidParameter);
+        }
+
+        logVerbose("Running in parallel on %u threads", n);
+        {
+            vector<thread> threads;
+            for (unsigned i = 1; i < n; ++i) {
+                threads.emplace_back([&, i] {
+                    runPartition(partitions[i], params, options, snapshot.get());
+                });
+            }
+            runPartition(partitions[0], params, options, snapshot.get());
+            for (auto &t : threads)
+                t.join();
+        }
+
+        bool noSnapshot = false;
+        for (auto &part : partitions) {
+            df.returnReadConnection(move(part.connection));
+            noSnapshot = noSnapshot || part.noSnapshot;
+        }
+        for (auto &part : partitions) {
+            if (part.error)
+                rethrow_exception(part.error);
+        }
+        if (noSnapshot) {
+            log("Couldn't read the database snapshot in parallel; running serially instead");
+            return nullptr;
+        }
+        unique_ptr<SQLiteQueryEnumerator> e(combinePartitions(partitions, options, curSeq));
+        e->setPartitionCount(n);
+        return e.release();
+    }
+
+
+    // Computes the partial aggregates of one partition, reading `snapshot`. Called on the
+    // partition's own thread, so it only uses the partition's read connection.
+    void SQLiteQuery::runPartition(QueryPartition &part, const Dict *params,
+                                   const Options &options, sqlite3_snapshot *snapshot)
+    {
+        auto &conn = *part.connection;
+        try {
+            if (!conn.beginSnapshot(snapshot)) {
+                part.noSnapshot = true;
+                return;
+            }
+            QueryInterrupter interrupter(conn.handle(), _cancelCount, options);
+            sqlite3_stmt *stmt;
+            int rc = sqlite3_prepare_v2(conn.handle(), _partialsSQL.c_str(), -1, &stmt, nullptr);
+            if (rc != SQLITE_OK)
+                error::_throw(error::SQLite, rc);
+            unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> statement(stmt, &sqlite3_finalize);
+
+            // Bind the parameters (strings and data stay valid for the whole run):
+            bindParameters(stmt, params, true);
+            sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":rowid_start"),
+                               part.start);
+            sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":rowid_end"),
+                               part.end);
+
+            int nCols = sqlite3_column_count(stmt);
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                for (int i = 0; i < nCols; ++i) {
+                    sqlite3_value *value = sqlite3_value_dup(sqlite3_column_value(stmt, i));
+                    if (!value)
+                        throw bad_alloc();
+                    part.values.push_back(value);
+                }
+            }
+            if (rc != SQLITE_DONE) {
+                if (interrupter.reason())
+                    error::_throw(error::QueryInterrupted, "Query %s", interrupter.reason());
+                error::_throw(error::SQLite, rc);
+            }
+            statement.reset();
+            conn.endSnapshot();
+        } catch (...) {
+            part.error = current_exception();
+            try {
+                conn.endSnapshot();
+            } catch (...) { }
+        }
+    }
+
+
+    // Stores the partitions' partial aggregates in a temporary table, then runs the query that
+    // combines them into the results.
+    SQLiteQueryEnumerator* SQLiteQuery::combinePartitions(vector<QueryPartition> &partitions,
+                                                          const Options &options,
+                                                          sequence_t curSeq)
+    {
+        SQLite::Database &sqlDb = (SQLiteDataFile&)keyStore().dataFile();
+        string table = sqlIdentifier(kPartialsTable);
+        stringstream create, insert;
+        create << "CREATE TEMP TABLE " << table << " (";
+        insert << "INSERT INTO " << table << " VALUES (";
+        for (size_t i = 0; i < _partialColumns.size(); ++i) {
+            create << (i ? ", " : "") << sqlIdentifier(_partialColumns[i]);
+            insert << (i ? ", ?" : "?");
+        }
+        create << ")";
+        insert << ")";
+        sqlDb.exec(create.str());
+
+        unique_ptr<SQLiteQueryEnumerator> e;
+        try {
+            // (SQLiteCpp can't bind a sqlite3_value, so this uses the SQLite API directly)
+            sqlite3_stmt *stmt;
+            int rc = sqlite3_prepare_v2(sqliteHandle(), insert.str().c_str(), -1, &stmt, nullptr);
+            if (rc != SQLITE_OK)
+                error::_throw(error::SQLite, rc);
+            unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> store(stmt, &sqlite3_finalize);
+            auto nCols = _partialColumns.size();
+            for (auto &part : partitions) {
+                for (size_t row = 0; row < part.values.size(); row += nCols) {
+                    for (size_t i = 0; i < nCols; ++i)
+                        sqlite3_bind_value(stmt, (int)i + 1, part.values[row + i]);
+                    rc = sqlite3_step(stmt);
+                    sqlite3_reset(stmt);
+                    if (rc != SQLITE_DONE)
+                        error::_throw(error::SQLite, rc);
+                }
+            }
+            store.reset();
+
+            shared_ptr<SQLite::Statement> combining(new SQLite::Statement(sqlDb, _combiningSQL));
+            SQLiteQueryRunner recorder(this, &options, curSeq, combining);
+            e.reset(recorder.fastForward());
+        } catch (...) {
+            sqlDb.exec("DROP TABLE temp." + table);
+            throw;
+        }
+        sqlDb.exec("DROP TABLE temp." + table);
+        return e.release();
+    }
+
+
+#pragma mark - BATCHES:
+
+
+    // (The SQLite implementation is the only one, so this static method lives here.)
+    /*static*/ vector<unique_ptr<QueryEnumerator>> Query::createEnumerators(
+                                                            const vector<Query*> &queries,
+                                                            const vector<Options> &options,
+                                                            unsigned parallelism)
+    {
+        Assert(options.size() == queries.size());
+        size_t n = queries.size();
+        vector<unique_ptr<QueryEnumerator>> result(n);
+        if (n == 0)
+            return result;
+        auto &df = (SQLiteDataFile&)queries[0]->keyStore().dataFile();
+        for (auto query : queries) {
+            if (&query->keyStore().dataFile() != &df)
+                error::_throw(error::InvalidParameter,
+                              "Batched queries must be on the same database");
+        }
+
+        vector<double> elapsed(n);
+        {
+            ReadOnlyTransaction t(df);
+            vector<sequence_t> curSeqs(n);
+            for (size_t i = 0; i < n; ++i)
+                curSeqs[i] = ((SQLiteQuery*)queries[i])->lastSequence();
+
+            // Run the queries in parallel, each thread taking the next one not yet run, all
+            // reading the snapshot of this transaction:
+            bool ran = false;
+            auto nThreads = (unsigned)min<size_t>(parallelism, n);
+            SQLiteDataFile::Snapshot snapshot;
+            if (nThreads > 1 && !df.inTransaction())
+                snapshot = df.currentSnapshot();
+            if (snapshot) {
+                vector<unique_ptr<SQLiteDataFile::ReadConnection>> connections;
+                for (unsigned i = 0; i < nThreads; ++i) {
+                    auto conn = df.borrowReadConnection();
+                    if (!conn)
+                        break;
+                    connections.push_back(move(conn));
+                }
+                if (connections.size() == nThreads) {
+                    atomic<size_t> next {0};
+                    atomic<bool> noSnapshot {false};
+                    vector<exception_ptr> errors(nThreads);
+                    auto work = [&](unsigned worker) {
+                        auto &conn = *connections[worker];
+                        try {
+                            if (!conn.beginSnapshot(snapshot.get())) {
+                                noSnapshot = true;
+                                return;
+                            }
+                            for (size_t i = next++; i < n && !noSnapshot; i = next++) {
+                                auto query = (SQLiteQuery*)queries[i];
+                                Stopwatch st;
+                                result[i].reset(query->run(&options[i], curSeqs[i], conn));
+                                elapsed[i] = st.elapsed();
+                            }
+                            conn.endSnapshot();
+                        } catch (...) {
+                            errors[worker] = current_exception();
+                            try {
+                                conn.endSnapshot();
+                            } catch (...) { }
+                        }
+                    };
+                    {
+                        vector<thread> threads;
+                        for (unsigned i = 1; i < nThreads; ++i)
+                            threads.emplace_back(work, i);
+                        work(0);
+                        for (auto &th : threads)
+                            th.join();
+                    }
+                    for (auto &conn : connections)
+                        df.returnReadConnection(move(conn));
+                    for (auto &error : errors) {
+                        if (error)
+                            rethrow_exception(error);
+                    }
+                    ran = !noSnapshot;
+                    if (noSnapshot)
+                        LogTo(QueryLog, "Couldn't read the database snapshot in parallel; "
+                                        "running batch serially");
+                }
+            }
+
+            if (!ran) {
+                for (size_t i = 0; i < n; ++i) {
+                    Stopwatch st;
+                    result[i].reset(((SQLiteQuery*)queries[i])->run(&options[i], curSeqs[i]));
+                    elapsed[i] = st.elapsed();
+                }
+            }
+        }
+        for (size_t i = 0; i < n; ++i)
+            ((SQLiteQuery*)queries[i])->adviseIndexes(elapsed[i]);
+        return result;
+    }
+
 }
@@ -0,0 +1,216 @@
+//
+// SQLiteTrigrams.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+//  'trigrams' is a table-valued function, modeled on 'fl_each', whose rows are the distinct
+//  trigrams of its string argument. Trigram indexes use it to fill their side tables.
+//  Documentation on table-valued functions: http://www.sqlite.org/vtab.html#tabfunc2
+
+#include "SQLite_Internal.hh"
+#include "SQLiteFleeceUtil.hh"
+#include "QueryParser.hh"
+
+#include <sqlite3.h>
+
+using namespace std;
+using namespace fleece;
+
+
+namespace litecore {
+
+
+// Column numbers; these correspond to the CREATE TABLE statement below
+enum {
+    kTrigramColumn = 0,     // 'trigram': A trigram, packed into an integer
+    kInputColumn,           // 'input':   The string whose trigrams are returned [hidden]
+};
+
+
+// Index used; stored in 'idxNum'
+enum {
+    kNoIndex = 0,
+    kInputIndex,
+};
+
+
+// TrigramCursor is a subclass of sqlite3_vtab_cursor that scans over the trigrams of a string.
+class TrigramCursor : public sqlite3_vtab_cursor {
+private:
+    vector<uint32_t> _trigrams;         // The distinct trigrams of the input
+    size_t _rowid {0};                  // The current row number, starting at 0
+
+
+#pragma mark - STATIC METHODS (DIRECT CALLBACKS):
+
+
+    // Creates a new sqlite3_vtab that describes the virtual table.
+    static int connect(sqlite3 *db,
+                       void *aux,
+                       int argc, const char *const*argv,
+                       sqlite3_vtab **outVtab,
+                       char **outErr) noexcept
+    {
+        int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(trigram, input HIDDEN)");
+        if( rc!=SQLITE_OK )
+            return rc;
+        auto vtab = (sqlite3_vtab*) calloc(1, sizeof(sqlite3_vtab));
+        if (!vtab)
+            return SQLITE_NOMEM;
+        *outVtab = vtab;
+        return SQLITE_OK;
+    }
+
+
+    // Destructor for sqlite3_vtab
+    static int disconnect(sqlite3_vtab *vtab) noexcept {
+        free(vtab);
+        return SQLITE_OK;
+    }
+
+
+    // Creates a new TrigramCursor object.
+    static int open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **outCursor) noexcept {
+        try {
+            *outCursor = new TrigramCursor;
+            return SQLITE_OK;
+        } catch (const bad_alloc&) {
+            return SQLITE_NOMEM;
+        }
+    }
+
+
+    // Frees a TrigramCursor.
+    static int close(sqlite3_vtab_cursor *cursor) noexcept {
+        delete (TrigramCursor*)cursor;
+        return SQLITE_OK;
+    }
+
+
+    // The table can only be scanned given an equality constraint on the hidden 'input' column,
+    // i.e. when called as a table-valued function.
+    static int bestIndex(sqlite3_vtab *vtab, sqlite3_index_info *info) noexcept {
+        int inputIdx = -1;
+        auto constraint = info->aConstraint;
+        for (int i = 0; i < info->nConstraint; i++, constraint++){
+            if (constraint->usable && constraint->op == SQLITE_INDEX_CONSTRAINT_EQ
+                                   && constraint->iColumn == kInputColumn)
+                inputIdx = i;
+        }
+        if (inputIdx < 0) {
+            info->idxNum = kNoIndex;
+            info->estimatedCost = 1e99;
+        } else {
+            info->idxNum = kInputIndex;
+            info->estimatedCost = 1.0;
+            info->aConstraintUsage[inputIdx].argvIndex = 1;
+            info->aConstraintUsage[inputIdx].omit = 1;
+        }
+        return SQLITE_OK;
+    }
+
+
+#pragma mark - INSTANCE METHODS:
+
+
+    // Computes the trigrams of the input. Any non-null value is converted to text the same way
+    // LIKE converts it, so that a value LIKE matches always has the pattern's trigrams.
+    int filter(int idxNum, const char *idxStr, int argc, sqlite3_value **argv) noexcept {
+        _trigrams.clear();
+        _rowid = 0;
+        if (idxNum == kNoIndex || sqlite3_value_type(argv[0]) == SQLITE_NULL)
+            return SQLITE_OK;
+        try {
+            _trigrams = QueryParser::trigrams(valueAsStringSlice(argv[0]));
+            return SQLITE_OK;
+        } catch (const bad_alloc&) {
+            return SQLITE_NOMEM;
+        }
+    }
+
+
+    int column(sqlite3_context *ctx, int column) noexcept {
+        if (_rowid >= _trigrams.size() || column != kTrigramColumn)
+            return SQLITE_ERROR;
+        sqlite3_result_int64(ctx, _trigrams[_rowid]);
+        return SQLITE_OK;
+    }
+
+
+#pragma mark - SQLITE3 HOOK FUNCTIONS:
+
+
+    static int cursorNext(sqlite3_vtab_cursor *cur) noexcept {
+        ++((TrigramCursor*)cur)->_rowid;
+        return SQLITE_OK;
+    }
+    static int cursorColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) noexcept {
+        return ((TrigramCursor*)cur)->column(ctx, i);
+    }
+    static int cursorRowid(sqlite3_vtab_cursor *cur, long long *outRowid) noexcept {
+        *outRowid = ((TrigramCursor*)cur)->_rowid;
+        return SQLITE_OK;
+    }
+    static int cursorEof(sqlite3_vtab_cursor *cur) noexcept {
+        auto self = (TrigramCursor*)cur;
+        return self->_rowid >= self->_trigrams.size();
+    }
+    static int cursorFilter(sqlite3_vtab_cursor *cur,
+                            int idxNum, const char *idxStr,
+                            int argc, sqlite3_value **argv) noexcept
+    {
+        return ((TrigramCursor*)cur)->filter(idxNum, idxStr, argc, argv);
+    }
+
+
+public:
+
+    // Module definition of 'trigrams' function
+    constexpr static sqlite3_module kTrigramsModule = {
+        0,                         /* iVersion */
+        0,                         /* xCreate */
+        connect,                   /* xConnect */
+        bestIndex,                 /* xBestIndex */
+        disconnect,                /* xDisconnect */
+        0,                         /* xDestroy */
+        open,                      /* xOpen - open a cursor */
+        close,                     /* xClose - close a cursor */
+        cursorFilter,              /* xFilter - configure scan constraints */
+        cursorNext,                /* xNext - advance a cursor */
+        cursorEof,                 /* xEof - check for end of scan */
+        cursorColumn,              /* xColumn - read data */
+        cursorRowid,               /* xRowid - read data */
+        0,                         /* xUpdate */
+        0,                         /* xBegin */
+        0,                         /* xSync */
+        0,                         /* xCommit */
+        0,                         /* xRollback */
+        0,                         /* xFindMethod */
+        0,                         /* xRename */
+    };
+
+}; // end class definition
+
+
+constexpr sqlite3_module TrigramCursor::kTrigramsModule;
+
+
+int RegisterTrigramFunctions(sqlite3 *db) {
+    return sqlite3_create_module(db, "trigrams", &TrigramCursor::kTrigramsModule, nullptr);
+}
+
+
+}
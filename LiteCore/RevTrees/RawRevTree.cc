@@ -35,43 +35,57 @@ namespace litecore {
 #pragma pack()
 
 
-    std::deque<Rev> RawRevision::decodeTree(slice raw_tree,
-                                            RevTree::RemoteRevMap &remoteMap,
-                                            RevTree* owner,
-                                            sequence_t curSeq)
+    // Extra room left in a decoded tree's arena and revs vector, so that a typical update
+    // (inserting a revision or two) doesn't have to allocate more:
+    static const unsigned kSpareRevs = 2;
+    static const size_t kSpareArenaBytes = 128;
+
+
+    void RawRevision::decodeTree(slice raw_tree,
+                                 RevTree* owner,
+                                 sequence_t curSeq)
     {
         const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
         unsigned count = rawRev->count();
         if (count > UINT16_MAX)
             error::_throw(error::CorruptRevisionData);
-        deque<Rev> revs(count);
-        auto rev = revs.begin();
+
+        // Size the arena from the tree, so decoding it takes a single allocation. (The decoded
+        // revs point into raw_tree for their revIDs and bodies, so those aren't copied.)
+        owner->_arena.reserve((count + kSpareRevs) * (sizeof(Rev) + sizeof(Rev*))
+                              + kSpareArenaBytes);
+        Rev *revs = owner->_arena.alloc<Rev>(count);
+        owner->_revs.reserve(count + kSpareRevs);
+        Rev *rev = revs;
         for (; rawRev->isValid(); rawRev = rawRev->next()) {
-            rawRev->copyTo(*rev, revs);
+            new (rev) Rev;
+            rawRev->copyTo(*rev, revs, count);
             if (rev->sequence == 0)
                 rev->sequence = curSeq;
             rev->owner = owner;
+            owner->_revs.push_back(rev);
             rev++;
         }
 
         auto entry = (const RemoteEntry*)offsetby(rawRev, sizeof(uint32_t));
+        auto &remoteMap = owner->_remoteRevs;
+        remoteMap.reserve(((uint8_t*)raw_tree.end() - (uint8_t*)entry) / sizeof(RemoteEntry));
         while (entry < raw_tree.end()) {
             RevTree::RemoteID remoteID = _dec16(entry->remoteDBID_BE);
             auto revIndex = _dec16(entry->revIndex_BE);
             if (remoteID == 0 || revIndex >= count)
                 error::_throw(error::CorruptRevisionData);
-            remoteMap[remoteID] = &revs[revIndex];
+            remoteMap.emplace_back(remoteID, &revs[revIndex]);
             ++entry;
         }
 
         if ((uint8_t*)entry != (uint8_t*)raw_tree.end()) {
             error::_throw(error::CorruptRevisionData);
         }
-        return revs;
     }
 
 
-    alloc_slice RawRevision::encodeTree(const vector<Rev*> &revs,
+    alloc_slice RawRevision::encodeTree(const RevTree::RevVector &revs,
                                         const RevTree::RemoteRevMap &remoteMap)
     {
         // Allocate output buffer:
@@ -118,6 +132,8 @@ namespace litecore {
         uint8_t dstFlags = rev.flags & ~kNonPersistentFlags;
         if (rev._body)
             dstFlags |= RawRevision::kHasData;
+        if (rev._externalBody)
+            dstFlags |= RawRevision::kHasExternalBody;
         this->flags = (Rev::Flags)dstFlags;
 
         void *dstData = offsetby(&this->revID[0], rev.revID.size);
@@ -127,15 +143,17 @@ namespace litecore {
         return (RawRevision*)offsetby(this, revSize);
     }
 
-    void RawRevision::copyTo(Rev &dst, const deque<Rev> &revs) const {
+    void RawRevision::copyTo(Rev &dst, const Rev revs[], unsigned count) const {
         const void* end = this->next();
         dst.revID = {this->revID, this->revIDLen};
         dst.flags = (Rev::Flags)(this->flags & ~kPersistentOnlyFlags);
         auto parentIndex = _dec16(this->parentIndex_BE);
         if (parentIndex == kNoParent)
             dst.parent = nullptr;
-        else
+        else if (parentIndex < count)
             dst.parent = &revs[parentIndex];
+        else
+            error::_throw(error::CorruptRevisionData);
         const void *data = offsetby(&this->revID, this->revIDLen);
         ptrdiff_t len = (uint8_t*)end-(uint8_t*)data;
         data = offsetby(data, GetUVarInt(slice(data, len), &dst.sequence));
@@ -143,6 +161,17 @@ namespace litecore {
             dst._body = slice(data, end);
         else
             dst._body = nullslice;
+        dst._externalBody = (this->flags & RawRevision::kHasExternalBody) != 0;
+    }
+
+
+    sequence_t RawRevision::getCurrentRevSequence(slice raw_tree) noexcept {
+        const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+        const void* end = rawRev->next();
+        const void *data = offsetby(&rawRev->revID, rawRev->revIDLen);
+        sequence_t sequence = 0;
+        GetUVarInt(slice(data, end), &sequence);
+        return sequence;
     }
 
 
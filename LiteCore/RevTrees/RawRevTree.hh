@@ -21,8 +21,6 @@
 #include "RevTree.hh"
 #include "KeyStore.hh"
 #include "Endian.hh"
-#include <deque>
-#include <vector>
 
 
 namespace litecore {
@@ -36,12 +34,12 @@ namespace litecore {
     // revision is the current one for every remote database.
     class RawRevision {
     public:
-        static std::deque<Rev> decodeTree(slice raw_tree,
-                                          RevTree::RemoteRevMap &remoteMap,
-                                          RevTree *owner NONNULL,
-                                          sequence_t curSeq);
+        // Decodes the tree into the owner's (empty) revs and remotes, allocating from its arena.
+        static void decodeTree(slice raw_tree,
+                               RevTree *owner NONNULL,
+                               sequence_t curSeq);
 
-        static alloc_slice encodeTree(const std::vector<Rev*> &revs,
+        static alloc_slice encodeTree(const RevTree::RevVector &revs,
                                       const RevTree::RemoteRevMap &remoteMap);
 
         static inline slice getCurrentRevBody(slice raw_tree) noexcept {
@@ -49,14 +47,25 @@ namespace litecore {
             return rawRev->body();
         }
 
+        static inline Rev::Flags getCurrentRevFlags(slice raw_tree) noexcept {
+            const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+            return (Rev::Flags)(rawRev->flags & ~kPersistentOnlyFlags);
+        }
+
+        // Returns the current revision's sequence, or 0 if it's the record's sequence.
+        static sequence_t getCurrentRevSequence(slice raw_tree) noexcept;
+
     private:
         static const uint16_t kNoParent = UINT16_MAX;
 
         // Private RevisionFlags bits used in encoded form:
         enum : uint8_t {
             kHasData = 0x80,  /**< Does this raw rev contain JSON/Fleece data? */
+            kHasExternalBody = 0x40, /**< Is the rev's body stored outside the tree? (Trees
+                                          with this flag are only written to files that have
+                                          been upgraded by DataFile::requireNewFormat.) */
             kNonPersistentFlags  = (Rev::kNew),         // Not saved to disk
-            kPersistentOnlyFlags = (kHasData),          // Only used on disk, not in memory
+            kPersistentOnlyFlags = (kHasData | kHasExternalBody), // Only used on disk
         };
 
         uint32_t        size_BE;        // Total size of this tree rev (big-endian)
@@ -87,7 +96,7 @@ namespace litecore {
         }
 
         static size_t sizeToWrite(const Rev&);
-        void copyTo(Rev &dst, const std::deque<Rev>&) const;
+        void copyTo(Rev &dst, const Rev revs[], unsigned count) const;
         RawRevision* copyFrom(const Rev &rev);
     };
 
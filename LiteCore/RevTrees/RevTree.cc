@@ -36,23 +36,31 @@ namespace litecore {
 
     static bool compareRevs(const Rev *rev1, const Rev *rev2);
 
+    // Trees with at least this many revs use hash tables to look up revs by revID or sequence,
+    // instead of a linear search. (Below this size a scan is as fast, and saves memory.)
+    static const size_t kMinRevsToIndex = 32;
+
     RevTree::RevTree(slice raw_tree, sequence_t seq) {
         decode(raw_tree, seq);
     }
 
     RevTree::RevTree(const RevTree &other)
-    :_insertedData(other._insertedData)
-    ,_sorted(other._sorted)
-    ,_changed(other._changed)
+    :_changed(other._changed)
     ,_unknown(other._unknown)
+    ,_sorted(other._sorted)
     {
-        // It's important to have _revs in the same order as other._revs.
-        // That means we can't just copy other._revsStorage to _revsStorage;
-        // we have to copy _revs in order:
+        other.decodeIfNeeded();
+        // It's important to have _revs in the same order as other._revs, so copy them in order.
+        // RevIDs and bodies living in other's arena have to be copied into mine; the ones that
+        // point into the raw tree data are shared.
         _revs.reserve(other._revs.size());
         for (const Rev *otherRev : other._revs) {
-            _revsStorage.emplace_back(*otherRev);
-            _revs.push_back(&_revsStorage.back());
+            Rev *rev = new (_arena.alloc<Rev>()) Rev(*otherRev);
+            if (other._arena.contains(rev->revID.buf))
+                rev->revID = revid(_arena.copy(rev->revID));
+            if (other._arena.contains(rev->_body.buf))
+                rev->_body = _arena.copy(rev->_body);
+            _revs.push_back(rev);
         }
         // Fix up the newly copied Revs so they point to me (and my other Revs), not other:
         for (Rev *rev : _revs) {
@@ -61,23 +69,31 @@ namespace litecore {
             rev->owner = this;
         }
         // Copy _remoteRevs:
+        _remoteRevs.reserve(other._remoteRevs.size());
         for (auto &i : other._remoteRevs) {
-            _remoteRevs[i.first] = _revs[i.second->index()];
+            _remoteRevs.emplace_back(i.first, _revs[i.second->index()]);
         }
     }
 
     void RevTree::decode(litecore::slice raw_tree, sequence_t seq) {
-        _revsStorage = RawRevision::decodeTree(raw_tree, _remoteRevs, this, seq);
-        initRevs();
+        _lazyTree = nullslice;
+        clearRevs();
+        RawRevision::decodeTree(raw_tree, this, seq);
     }
 
-    void RevTree::initRevs() {
-        _revs.resize(_revsStorage.size());
-        auto i = _revs.begin();
-        for (Rev &rev : _revsStorage) {
-            *i = &rev;
-            ++i;
-        }
+    void RevTree::decodeLazily(slice raw_tree, sequence_t seq) {
+        clearRevs();
+        _lazyTree = raw_tree;
+        _lazySequence = seq;
+    }
+
+    // Forgets all the revs and frees the arena. The vectors have to be replaced, not just
+    // cleared, since their buffers live in the arena too.
+    void RevTree::clearRevs() {
+        clearIndexes();
+        RevVector(RevVector::allocator_type(&_arena)).swap(_revs);
+        RemoteRevMap(RemoteRevMap::allocator_type(&_arena)).swap(_remoteRevs);
+        _arena.reset();
     }
 
     alloc_slice RevTree::encode() {
@@ -103,35 +119,70 @@ namespace litecore {
 
     const Rev* RevTree::currentRevision() {
         Assert(!_unknown);
+        decodeIfNeeded();
         sort();
         return _revs.size() == 0 ? nullptr : _revs[0];
     }
 
     const Rev* RevTree::get(unsigned index) const {
         Assert(!_unknown);
+        decodeIfNeeded();
         Assert(index < _revs.size());
         return _revs[index];
     }
 
     const Rev* RevTree::get(revid revID) const {
-        for (Rev *rev : _revs) {
-            if (rev->revID == revID)
-                return rev;
+        decodeIfNeeded();
+        if (_revs.size() >= kMinRevsToIndex || !_revIDIndex.empty()) {
+            if (_revIDIndex.empty()) {
+                // Once built, this index is kept up to date by _insert() and compact():
+                _revIDIndex.reserve(_revs.size());
+                for (Rev *rev : _revs)
+                    _revIDIndex.emplace(rev->revID, rev);
+            }
+            auto i = _revIDIndex.find(revID);
+            if (i != _revIDIndex.end())
+                return i->second;
+        } else {
+            for (Rev *rev : _revs) {
+                if (rev->revID == revID)
+                    return rev;
+            }
         }
         Assert(!_unknown);
         return nullptr;
     }
 
     const Rev* RevTree::getBySequence(sequence_t seq) const {
-        for (Rev *rev : _revs) {
-            if (rev->sequence == seq)
-                return rev;
+        decodeIfNeeded();
+        if (_revs.size() >= kMinRevsToIndex) {
+            if (_sequenceIndex.empty()) {
+                // Several revs may share a sequence; like the linear search, the index maps it
+                // to the first one in _revs. So it's cleared whenever _revs is reordered.
+                _sequenceIndex.reserve(_revs.size());
+                for (Rev *rev : _revs)
+                    _sequenceIndex.emplace(rev->sequence, rev);
+            }
+            auto i = _sequenceIndex.find(seq);
+            if (i != _sequenceIndex.end())
+                return i->second;
+        } else {
+            for (Rev *rev : _revs) {
+                if (rev->sequence == seq)
+                    return rev;
+            }
         }
         Assert(!_unknown);
         return nullptr;
     }
 
+    void RevTree::clearIndexes() const {
+        _revIDIndex.clear();
+        _sequenceIndex.clear();
+    }
+
     bool RevTree::hasConflict() const {
+        decodeIfNeeded();
         if (_revs.size() < 2) {
             Assert(!_unknown);
             return false;
@@ -169,7 +220,7 @@ namespace litecore {
     }
 
     bool RevTree::isBodyOfRevisionAvailable(const Rev* rev) const {
-        return rev->_body.buf != nullptr; // VersionedDocument overrides this
+        return rev->_body.buf != nullptr; // VersionedDocument overrides this for external bodies
     }
 
     alloc_slice RevTree::readBodyOfRevision(const Rev* rev) const {
@@ -198,16 +249,13 @@ namespace litecore {
         revFlags = Rev::Flags(revFlags & (Rev::kDeleted | Rev::kHasAttachments | Rev::kKeepBody));
 
         Assert(!_unknown);
+        decodeIfNeeded();
         // Allocate copies of the revID and data so they'll stay around:
-        _insertedData.emplace_back(unownedRevID);
-        revid revID = revid(_insertedData.back());
-        if (body.size > 0) {
-            _insertedData.emplace_back(body);
-            body = _insertedData.back();
-        }
+        revid revID = revid(_arena.copy(unownedRevID));
+        if (body.size > 0)
+            body = _arena.copy(body);
 
-        _revsStorage.emplace_back();
-        Rev *newRev = &_revsStorage.back();
+        Rev *newRev = new (_arena.alloc<Rev>()) Rev;
         newRev->owner = this;
         newRev->revID = revID;
         newRev->_body = body;
@@ -231,6 +279,9 @@ namespace litecore {
         if (!_revs.empty())
             _sorted = false;
         _revs.push_back(newRev);
+        if (!_revIDIndex.empty())
+            _revIDIndex.emplace(newRev->revID, newRev);
+        _sequenceIndex.clear();
         return newRev;
     }
 
@@ -350,7 +401,9 @@ namespace litecore {
     }
 
     void RevTree::removeBody(const Rev* rev) {
-        if (rev->body()) {
+        if (rev->body() || rev->_externalBody) {
+            if (rev->_externalBody)
+                externalBodyRemoved(rev);
             const_cast<Rev*>(rev)->removeBody();
             _changed = true;
         }
@@ -358,16 +411,36 @@ namespace litecore {
 
     // Remove bodies of already-saved revs that are no longer leaves:
     void RevTree::removeNonLeafBodies() {
+        decodeIfNeeded();
         for (Rev *rev : _revs) {
-            if (rev->_body.size > 0 && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
+            if ((rev->_body.size > 0 || rev->_externalBody)
+                    && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
+                if (rev->_externalBody)
+                    externalBodyRemoved(rev);
                 rev->removeBody();
                 _changed = true;
             }
         }
     }
 
+    void RevTree::moveBodyOutOfLine(const Rev *rev_in) {
+        auto rev = const_cast<Rev*>(rev_in);
+        rev->_body = nullslice;
+        rev->_externalBody = true;
+        _changed = true;
+    }
+
+    void RevTree::moveBodyInline(const Rev *rev_in, alloc_slice body) {
+        auto rev = const_cast<Rev*>(rev_in);
+        if (body.size > 0)
+            rev->_body = _arena.copy(body);
+        rev->_externalBody = false;
+        _changed = true;
+    }
+
     unsigned RevTree::prune(unsigned maxDepth) {
         Assert(maxDepth > 0);
+        decodeIfNeeded();
         if (_revs.size() <= maxDepth)
             return 0;
 
@@ -432,8 +505,14 @@ namespace litecore {
     }
 
     int RevTree::purgeAll() {
+        decodeIfNeeded();
         int result = (int)_revs.size();
+        for (Rev *rev : _revs) {
+            if (rev->_externalBody)
+                externalBodyRemoved(rev);
+        }
         _revs.resize(0);
+        clearIndexes();
         _changed = true;
         _sorted = true;
         return result;
@@ -447,16 +526,22 @@ namespace litecore {
                 if (dst != rev)
                     *dst = *rev;
                 dst++;
+            } else {
+                if ((*rev)->_externalBody)
+                    externalBodyRemoved(*rev);
+                if (!_revIDIndex.empty())
+                    _revIDIndex.erase((*rev)->revID);
             }
         }
         _revs.resize(dst - _revs.begin());
+        _sequenceIndex.clear();
 
         // Remove purged revs from _remoteRevs:
-        auto tempRemoteRevs = _remoteRevs;
-        for (auto &e : tempRemoteRevs) {
-            if (e.second->isMarkedForPurge())
-                _remoteRevs.erase(e.first);
-        }
+        _remoteRevs.erase(std::remove_if(_remoteRevs.begin(), _remoteRevs.end(),
+                                         [](const RemoteRev &e) {
+                                             return e.second->isMarkedForPurge();
+                                         }),
+                          _remoteRevs.end());
 
         _changed = true;
     }
@@ -484,9 +569,11 @@ namespace litecore {
     }
 
     void RevTree::sort() {
+        decodeIfNeeded();
         if (_sorted)
             return;
         std::sort(_revs.begin(), _revs.end(), &compareRevs);
+        _sequenceIndex.clear();
         _sorted = true;
         checkForResolvedConflict();
     }
@@ -498,6 +585,7 @@ namespace litecore {
     }
 
     bool RevTree::hasNewRevisions() const {
+        decodeIfNeeded();
         for (Rev *rev : _revs) {
             if (rev->isNew() || rev->sequence == 0)
                 return true;
@@ -506,6 +594,8 @@ namespace litecore {
     }
 
     void RevTree::saved(sequence_t newSequence) {
+        decodeIfNeeded();
+        _sequenceIndex.clear();
         for (Rev *rev : _revs) {
             rev->clearFlag(Rev::kNew);
             if (rev->sequence == 0) {
@@ -519,19 +609,27 @@ namespace litecore {
 
     const Rev* RevTree::latestRevisionOnRemote(RemoteID remote) {
         Assert(remote != kNoRemoteID);
-        auto i = _remoteRevs.find(remote);
-        if (i == _remoteRevs.end())
-            return nullptr;
-        return i->second;
+        decodeIfNeeded();
+        for (auto &e : _remoteRevs) {
+            if (e.first == remote)
+                return e.second;
+        }
+        return nullptr;
     }
 
 
     void RevTree::setLatestRevisionOnRemote(RemoteID remote, const Rev *rev) {
         Assert(remote != kNoRemoteID);
+        decodeIfNeeded();
+        auto i = std::find_if(_remoteRevs.begin(), _remoteRevs.end(),
+                              [=](const RemoteRev &e) {return e.first == remote;});
         if (rev) {
-            _remoteRevs[remote] = rev;
-        } else {
-            _remoteRevs.erase(remote);
+            if (i != _remoteRevs.end())
+                i->second = rev;
+            else
+                _remoteRevs.emplace_back(remote, rev);
+        } else if (i != _remoteRevs.end()) {
+            _remoteRevs.erase(i);
         }
         _changed = true;
     }
@@ -543,6 +641,7 @@ namespace litecore {
     }
 
     void RevTree::dump(std::ostream& out) {
+        decodeIfNeeded();
         int i = 0;
         for (Rev *rev : _revs) {
             out << "\t" << (++i) << ": ";
@@ -20,7 +20,7 @@
 #include "PlatformCompat.hh"
 #include "slice.hh"
 #include "RevID.hh"
-#include <deque>
+#include "Arena.hh"
 #include <unordered_map>
 #include <vector>
 
@@ -39,6 +39,7 @@ namespace litecore {
 
         slice body() const          {return _body;}
         bool isBodyAvailable() const{return _body.buf != nullptr;}
+        bool hasExternalBody() const{return _externalBody;}  /**< Body is stored outside the tree */
 
         bool isLeaf() const         {return (flags & kLeaf) != 0;}
         bool isDeleted() const      {return (flags & kDeleted) != 0;}
@@ -68,11 +69,12 @@ namespace litecore {
 
     private:
         slice       _body;          /**< Revision body (JSON), or empty if not stored in this tree*/
+        bool        _externalBody {false};  /**< Is the body stored by the owner, outside the tree? */
 
         void addFlag(Flags f)           {flags = (Flags)(flags | f);}
         void clearFlag(Flags f)         {flags = (Flags)(flags & ~f);}
         void removeBody()               {clearFlag((Flags)(kKeepBody | kHasAttachments));
-                                         _body = nullslice;}
+                                         _body = nullslice; _externalBody = false;}
         bool isMarkedForPurge() const   {return (flags & kPurge) != 0;}
 #if DEBUG
         void dump(std::ostream&);
@@ -82,9 +84,13 @@ namespace litecore {
     };
 
 
-    /** A serializable tree of Revisions. */
+    /** A serializable tree of Revisions.
+        The Rev objects, and copies of any revIDs and bodies added since decoding, are allocated
+        from a per-tree Arena that's released all at once when the tree is destroyed. */
     class RevTree {
     public:
+        using RevVector = std::vector<Rev*, ArenaAllocator<Rev*>>;
+
         RevTree() { }
         RevTree(slice raw_tree, sequence_t seq);
         RevTree(const RevTree&);
@@ -92,16 +98,23 @@ namespace litecore {
 
         void decode(slice raw_tree, sequence_t seq);
 
+        /** Like decode, but defers the work until the tree is first accessed. The raw data must
+            remain valid until then. */
+        void decodeLazily(slice raw_tree, sequence_t seq);
+
+        /** False after decodeLazily(), until the tree is first accessed. */
+        bool isDecoded() const                          {return _lazyTree.buf == nullptr;}
+
         alloc_slice encode();
 
-        size_t size() const                             {return _revs.size();}
+        size_t size() const                             {decodeIfNeeded(); return _revs.size();}
         const Rev* get(unsigned index) const;
         const Rev* get(revid) const;
         const Rev* operator[](unsigned index) const {return get(index);}
         const Rev* operator[](revid revID) const    {return get(revID);}
         const Rev* getBySequence(sequence_t) const;
 
-        const std::vector<Rev*>& allRevisions() const   {return _revs;}
+        const RevVector& allRevisions() const           {decodeIfNeeded(); return _revs;}
         const Rev* currentRevision();
         bool hasConflict() const;
         bool hasNewRevisions() const;
@@ -146,6 +159,11 @@ namespace litecore {
 
         void saved(sequence_t newSequence);
 
+        /** True if the revision's body is in the tree or stored externally by a subclass. */
+        virtual bool isBodyOfRevisionAvailable(const Rev* r NONNULL) const;
+        /** Returns the revision's body, reading it from external storage if necessary. */
+        virtual alloc_slice readBodyOfRevision(const Rev* r NONNULL) const;
+
         //////// Remotes:
 
         using RemoteID = unsigned;
@@ -160,8 +178,11 @@ namespace litecore {
 #endif
 
     protected:
-        virtual bool isBodyOfRevisionAvailable(const Rev* r NONNULL) const;
-        virtual alloc_slice readBodyOfRevision(const Rev* r NONNULL) const;
+        // Support for subclasses that store some revision bodies outside the tree:
+        void moveBodyOutOfLine(const Rev* NONNULL);
+        void moveBodyInline(const Rev* NONNULL, alloc_slice body);
+        // Called when a rev with an external body is purged, or its body is removed:
+        virtual void externalBodyRemoved(const Rev* NONNULL)    { }
 #if DEBUG
         virtual void dump(std::ostream&);
 #endif
@@ -172,19 +193,29 @@ namespace litecore {
     private:
         friend class Rev;
         friend class RawRevision;
-        void initRevs();
+        void clearRevs();
+        void decodeIfNeeded() const {
+            if (_usuallyFalse(_lazyTree.buf != nullptr))
+                const_cast<RevTree*>(this)->decode(_lazyTree, _lazySequence);
+        }
         Rev* _insert(revid, slice body, Rev *parentRev, Rev::Flags);
         bool confirmLeaf(Rev* testRev NONNULL);
+        void clearIndexes() const;
         void compact();
         void checkForResolvedConflict();
 
-        using RemoteRevMap = std::unordered_map<RemoteID, const Rev*>;
+        using RemoteRev = std::pair<RemoteID, const Rev*>;
+        using RemoteRevMap = std::vector<RemoteRev, ArenaAllocator<RemoteRev>>;
 
         bool                     _sorted {true};        // Is _revs currently sorted?
-        std::vector<Rev*>        _revs;                 // Revs in sorted order
-        std::deque<Rev>          _revsStorage;          // Actual storage of the Rev objects
-        std::vector<alloc_slice> _insertedData;         // Storage for new revids
-        RemoteRevMap             _remoteRevs;           // Tracks current rev for a remote DB URL
+        Arena                    _arena;                // Storage of Revs, new revids & bodies
+        RevVector                _revs {RevVector::allocator_type(&_arena)};  // Revs in sorted order
+        RemoteRevMap             _remoteRevs {RemoteRevMap::allocator_type(&_arena)}; // Current rev for each remote DB
+        // Lookup tables for big trees, built on demand:
+        mutable std::unordered_map<slice, Rev*, fleece::sliceHash> _revIDIndex;
+        mutable std::unordered_map<sequence_t, Rev*> _sequenceIndex;
+        slice                    _lazyTree;             // Raw tree not yet decoded, if any
+        sequence_t               _lazySequence {0};     // Record sequence of _lazyTree
     };
 
 }
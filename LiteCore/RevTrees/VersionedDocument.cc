@@ -17,8 +17,11 @@
 //
 
 #include "VersionedDocument.hh"
+#include "RawRevTree.hh"
 #include "Record.hh"
 #include "KeyStore.hh"
+#include "DataFile.hh"
+#include "Delta.hh"
 #include "Error.hh"
 #include "varint.hh"
 #include <ostream>
@@ -26,6 +29,8 @@
 namespace litecore {
     using namespace fleece;
 
+    const std::string VersionedDocument::kBodiesKeyStoreName {"revbodies"};
+
     VersionedDocument::VersionedDocument(KeyStore& db, slice docID)
     :_db(db), _rec(docID)
     {
@@ -42,6 +47,11 @@ namespace litecore {
     :RevTree(other)
     ,_db(other._db)
     ,_rec(other._rec)
+    ,_obsoleteBodies(other._obsoleteBodies)
+    ,_deltaBaseRevID(other._deltaBaseRevID)
+    ,_deltaBase(other._deltaBase)
+    ,_deltaBaseLoaded(other._deltaBaseLoaded)
+    ,_newDeltaBase(other._newDeltaBase)
     { }
 
     void VersionedDocument::read() {
@@ -51,7 +61,14 @@ namespace litecore {
 
     void VersionedDocument::decode() {
         _unknown = false;
+        _deltaBaseLoaded = false;
         if (_rec.body().buf) {
+            if (!(_rec.flags() & DocumentFlags::kSynced)) {
+                // Most documents are only read for their current revision, which the accessors
+                // below can get from the raw tree, so put off decoding the rest of it:
+                decodeLazily(_rec.body(), _rec.sequence());
+                return;
+            }
             RevTree::decode(_rec.body(), _rec.sequence());
             // The kSynced flag is set when the document's current revision is pushed to a server.
             // This is done instead of updating the doc body, for reasons of speed. So when loading
@@ -68,6 +85,186 @@ namespace litecore {
         }
     }
 
+    Rev::Flags VersionedDocument::currentRevFlags() const {
+        Assert(!isDecoded());
+        return RawRevision::getCurrentRevFlags(_rec.body());
+    }
+
+    sequence_t VersionedDocument::currentRevSequence() const {
+        Assert(!isDecoded());
+        sequence_t seq = RawRevision::getCurrentRevSequence(_rec.body());
+        return seq ? seq : _rec.sequence();
+    }
+
+    slice VersionedDocument::currentRevBody() const {
+        Assert(!isDecoded());
+        return RawRevision::getCurrentRevBody(_rec.body());
+    }
+
+#pragma mark - EXTERNAL BODIES:
+
+    KeyStore& VersionedDocument::bodyStore() const {
+        return _db.dataFile().getKeyStore(kBodiesKeyStoreName);
+    }
+
+    // The key of a revision's body in the body store is the docID, a zero byte, and the revID.
+    alloc_slice VersionedDocument::bodyKey(revid revID) const {
+        slice docID = _rec.key();
+        alloc_slice key(docID.size + 1 + revID.size);
+        memcpy((void*)key.buf, docID.buf, docID.size);
+        ((uint8_t*)key.buf)[docID.size] = 0;
+        if (revID.size > 0)
+            memcpy((uint8_t*)key.buf + docID.size + 1, revID.buf, revID.size);
+        return key;
+    }
+
+    bool VersionedDocument::isBodyOfRevisionAvailable(const Rev *rev) const {
+        return rev->hasExternalBody() || RevTree::isBodyOfRevisionAvailable(rev);
+    }
+
+    // The document's delta base is stored in the body store under the key of an empty revID.
+    // Its version (meta) is the revID whose body it is.
+    alloc_slice VersionedDocument::deltaBaseKey() const {
+        return bodyKey(revid());
+    }
+
+    // Reads the delta base, unless it's already been read, leaving _deltaBaseRevID null if the
+    // document has none.
+    void VersionedDocument::loadDeltaBase() const {
+        if (_deltaBaseLoaded)
+            return;
+        Record base = bodyStore().get(deltaBaseKey());
+        _deltaBaseRevID = base.version();
+        _deltaBase = base.body();
+        _deltaBaseLoaded = true;
+    }
+
+    // An external body with a version (meta) is a delta from the document's delta base, which
+    // is the body of that revision.
+    alloc_slice VersionedDocument::readBodyOfRevision(const Rev *rev) const {
+        if (rev->hasExternalBody()) {
+            Record rec = bodyStore().get(bodyKey(rev->revID));
+            if (rec.version().size == 0)
+                return rec.body();
+            loadDeltaBase();
+            if (rec.version() != _deltaBaseRevID)
+                error::_throw(error::CorruptRevisionData, "Revision body's delta base is missing");
+            return ApplyDelta(_deltaBase, rec.body());
+        }
+        return RevTree::readBodyOfRevision(rev);
+    }
+
+    void VersionedDocument::externalBodyRemoved(const Rev *rev) {
+        _obsoleteBodies.push_back(bodyKey(rev->revID));
+    }
+
+    // Moves the bodies of non-current revisions into the body store, so they don't have to be
+    // read and rewritten with the tree every time the document is loaded and saved. The current
+    // revision's body always stays in the tree, since queries and enumerators read it from there.
+    // Each body is stored as a delta from the document's delta base if that's smaller. The base
+    // is a copy of the current revision's body at the time the first delta was made, and stays
+    // the same as the current revision changes, so stored deltas never have to be re-encoded.
+    // (A new base is only stored if it and the deltas are smaller than the bodies; see
+    // writeBodies.)
+    // Nothing is written to the body store yet: the bodies are left pending until the record
+    // itself has been saved (see writeBodies.)
+    void VersionedDocument::moveBodies() {
+        const Rev *current = currentRevision();
+        if (current->hasExternalBody()) {
+            moveBodyInline(current, readBodyOfRevision(current));
+            _obsoleteBodies.push_back(bodyKey(current->revID));
+        }
+
+        for (auto rev : allRevisions()) {
+            if (rev != current && rev->body().size > 0) {
+                loadDeltaBase();
+                if (!_deltaBaseRevID) {
+                    _deltaBaseRevID = alloc_slice(current->revID);
+                    _deltaBase = alloc_slice(current->body());
+                    _newDeltaBase = true;
+                }
+                PendingBody pending {rev, rev->body()};
+                pending.delta = CreateDelta(_deltaBase, rev->body());
+                _pendingBodies.push_back(pending);
+                moveBodyOutOfLine(rev);
+            }
+        }
+    }
+
+    // Deletes obsolete bodies, and writes the ones moved out of the tree by moveBodies (and the
+    // delta base, if it's new and any of them use it.) Called only once the record has been
+    // saved, so a conflict leaves the body store untouched.
+    void VersionedDocument::writeBodies(Transaction &t) {
+        if (!_obsoleteBodies.empty()) {
+            for (auto &key : _obsoleteBodies)
+                bodyStore().del(key, t);
+            _obsoleteBodies.clear();
+            // If that was the last external body, the delta base isn't needed anymore:
+            bool anyExternal = false;
+            for (auto rev : allRevisions())
+                anyExternal = anyExternal || rev->hasExternalBody();
+            if (!anyExternal) {
+                bodyStore().del(deltaBaseKey(), t);
+                _deltaBaseRevID = _deltaBase = nullslice;
+                _deltaBaseLoaded = true;
+            }
+        }
+
+        // Older versions of LiteCore don't know about external bodies, so they mustn't open the
+        // file once it has any:
+        if (!_pendingBodies.empty())
+            _db.dataFile().requireNewFormat();
+        // A new delta base takes as much space as a body, so only use it if it and the deltas
+        // together are smaller than the bodies would be in full. (That's never true of a single
+        // body, but usually is of several similar ones.)
+        if (_newDeltaBase) {
+            size_t fullSize = 0, deltaSize = _deltaBase.size;
+            for (auto &pending : _pendingBodies) {
+                fullSize += pending.body.size;
+                deltaSize += pending.delta ? pending.delta.size : pending.body.size;
+            }
+            if (deltaSize >= fullSize) {
+                for (auto &pending : _pendingBodies)
+                    pending.delta = nullslice;
+            }
+        }
+
+        bool anyDelta = false;
+        for (auto &pending : _pendingBodies) {
+            alloc_slice key = bodyKey(pending.rev->revID);
+            if (pending.delta) {
+                bodyStore().set(key, _deltaBaseRevID, pending.delta, DocumentFlags::kNone, t);
+                anyDelta = true;
+            } else {
+                bodyStore().set(key, pending.body, t);
+            }
+        }
+        _pendingBodies.clear();
+        if (_newDeltaBase) {
+            if (anyDelta)
+                bodyStore().set(deltaBaseKey(), _deltaBaseRevID, _deltaBase,
+                                DocumentFlags::kNone, t);
+            else
+                _deltaBaseRevID = _deltaBase = nullslice;
+            _newDeltaBase = false;
+        }
+    }
+
+    // After a conflict, puts the bodies that moveBodies took out of the tree back in, since they
+    // were never written to the body store, and forgets a delta base that wasn't either.
+    void VersionedDocument::restoreBodies() {
+        for (auto &pending : _pendingBodies)
+            moveBodyInline(pending.rev, alloc_slice(pending.body));
+        _pendingBodies.clear();
+        if (_newDeltaBase) {
+            _deltaBaseRevID = _deltaBase = nullslice;
+            _newDeltaBase = false;
+        }
+    }
+
+
+#pragma mark - SAVING:
+
     bool VersionedDocument::updateMeta() {
         auto oldFlags = _rec.flags();
         alloc_slice oldRevID = _rec.version();
@@ -104,14 +301,23 @@ namespace litecore {
         bool createSequence;
         if (currentRevision()) {
             removeNonLeafBodies();
-            auto newBody = encode();
+            moveBodies();
             createSequence = seq == 0 || hasNewRevisions();
-            // (Don't call _rec.setBody(), because it'd invalidate all the inner pointers from
-            // Revs into the existing body buffer.)
-            seq = _db.set(_rec.key(), _rec.version(), newBody, _rec.flags(),
-                          transaction, &seq, createSequence);
-            if (!seq)
+            try {
+                auto newBody = encode();
+                // (Don't call _rec.setBody(), because it'd invalidate all the inner pointers from
+                // Revs into the existing body buffer.)
+                seq = _db.set(_rec.key(), _rec.version(), newBody, _rec.flags(),
+                              transaction, &seq, createSequence);
+            } catch (...) {
+                restoreBodies();
+                throw;
+            }
+            if (!seq) {
+                restoreBodies();
                 return kConflict;               // Conflict
+            }
+            writeBodies(transaction);
             _rec.updateSequence(seq);
             _rec.setExists();
             if (createSequence)
@@ -120,6 +326,7 @@ namespace litecore {
             createSequence = false;
             if (seq && !_db.del(_rec.key(), transaction, seq))
                 return kConflict;
+            writeBodies(transaction);
         }
         _changed = false;
         return createSequence ? kNewSequence : kNoNewSequence;
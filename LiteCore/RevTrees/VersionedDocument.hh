@@ -24,9 +24,18 @@ namespace litecore {
     class KeyStore;
     class Transaction;
 
-    /** Manages storage of a serialized RevTree in a Record. */
+    /** Manages storage of a serialized RevTree in a Record.
+        Only the current revision's body is stored in the tree; the kept bodies of other
+        revisions are stored in a separate KeyStore, keyed by docID and revID, and read on
+        demand by readBodyOfRevision(). They're stored as deltas from a delta base (a copy of
+        the body the current revision had when the first one was stored, kept in the same
+        KeyStore), unless that wouldn't save space: a base is only stored if it plus the deltas
+        are smaller than the bodies themselves, and a body is stored whole if its delta isn't
+        smaller than it. */
     class VersionedDocument : public RevTree {
     public:
+        /** Name of the KeyStore holding bodies of non-current revisions. */
+        static const std::string kBodiesKeyStoreName;
 
         VersionedDocument(KeyStore&, slice docID);
         VersionedDocument(KeyStore&, const Record&);
@@ -51,6 +60,13 @@ namespace litecore {
 
         const Record& record() const    {return _rec;}
 
+        /** The current revision's flags, sequence and body, read directly from the record.
+            These may only be called before the rev tree is decoded (i.e. while !isDecoded()),
+            and let a caller that only wants the current revision avoid decoding it at all. */
+        Rev::Flags currentRevFlags() const;
+        sequence_t currentRevSequence() const;
+        slice currentRevBody() const;
+
         bool changed() const        {return _changed;}
 
         enum SaveResult {kConflict, kNoNewSequence, kNewSequence};
@@ -58,18 +74,42 @@ namespace litecore {
 
         bool updateMeta();
 
+        virtual bool isBodyOfRevisionAvailable(const Rev*) const override;
+        virtual alloc_slice readBodyOfRevision(const Rev*) const override;
+
 #if DEBUG
         void dump()          {RevTree::dump();}
 #endif
     protected:
+        virtual void externalBodyRemoved(const Rev*) override;
 #if DEBUG
         virtual void dump(std::ostream&) override;
 #endif
 
     private:
         void decode();
+        KeyStore& bodyStore() const;
+        alloc_slice bodyKey(revid) const;
+        alloc_slice deltaBaseKey() const;
+        void loadDeltaBase() const;
+        void moveBodies();
+        void writeBodies(Transaction&);
+        void restoreBodies();
+
+        // A body that moveBodies() took out of the tree, to be written to the body store:
+        struct PendingBody {
+            const Rev*  rev;
+            slice       body;               // Its full body (owned by the tree)
+            alloc_slice delta;              // Delta from the delta base, if smaller
+        };
 
         KeyStore&       _db;
         Record          _rec;
+        std::vector<PendingBody> _pendingBodies;    // Bodies to write once the record is saved
+        std::vector<alloc_slice> _obsoleteBodies;   // Keys of external bodies to delete on save
+        mutable alloc_slice _deltaBaseRevID;        // RevID of the delta base (if any)
+        mutable alloc_slice _deltaBase;             // Body that stored deltas are relative to
+        mutable bool    _deltaBaseLoaded {false};   // Has the delta base been read?
+        bool            _newDeltaBase {false};      // Is the delta base not yet stored?
     };
 }
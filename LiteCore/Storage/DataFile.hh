@@ -89,6 +89,11 @@ namespace litecore {
 
         void forOtherDataFiles(function_ref<void(DataFile*)> fn);
 
+        /** Marks the file as containing data that older versions of LiteCore would misread
+            (currently, revision bodies stored outside their rev trees), so that they'll refuse
+            to open it. This is a one-way upgrade. Must be called within a transaction. */
+        virtual void requireNewFormat() =0;
+
         /** Private API to run a raw (e.g. SQL) query, for diagnostic purposes only */
         virtual fleece::alloc_slice rawQuery(const std::string &query) =0;
 
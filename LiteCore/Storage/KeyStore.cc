@@ -47,6 +47,11 @@ namespace litecore {
         fn(get(seq));
     }
 
+    void KeyStore::readMany(vector<Record> &recs, ContentOptions options) const {
+        for (auto &rec : recs)
+            read(rec, options);
+    }
+
     void KeyStore::readBody(Record &rec) const {
         if (!rec.body()) {
             Record fullDoc = rec.sequence() ? get(rec.sequence())
@@ -83,6 +88,14 @@ namespace litecore {
         error::_throw(error::Unimplemented);
     }
 
+    void KeyStore::setIndexAdvisor(shared_ptr<IndexAdvisor>) {
+        error::_throw(error::Unimplemented);
+    }
+
+    unsigned KeyStore::createAdvisedIndexes() {
+        error::_throw(error::Unimplemented);
+    }
+
     Retained<Query> KeyStore::compileQuery(slice expressionJSON) {
         error::_throw(error::Unimplemented);
     }
@@ -21,6 +21,8 @@
 #include "RefCounted.hh"
 #include "RecordEnumerator.hh"
 #include "function_ref.hh"
+#include <memory>
+#include <vector>
 
 namespace litecore {
 
@@ -28,6 +30,7 @@ namespace litecore {
     class Record;
     class Transaction;
     class Query;
+    class IndexAdvisor;
 
     /** A sequence number in a KeyStore. */
     typedef uint64_t sequence_t;
@@ -73,6 +76,11 @@ namespace litecore {
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOptions options = kDefaultContent) const =0;
 
+        /** Reads a batch of records whose key()s are already set. Records that don't exist are
+            left unchanged (their exists() remains false.) The default implementation just calls
+            read() on each, but subclasses can look them all up at once. */
+        virtual void readMany(std::vector<Record> &recs, ContentOptions = kDefaultContent) const;
+
         /** Reads the body of a Record that's already been read with kMetaonly.
             Does nothing if the record's body is non-null. */
         virtual void readBody(Record &rec) const;
@@ -110,6 +118,9 @@ namespace litecore {
             kValueIndex,         ///< Regular index of property value
             kFullTextIndex,      ///< Full-text index
             kGeoIndex,           ///< Geo index of GeoJSON values
+            kArrayIndex,         ///< Index of the items of an array property
+            kAggregateIndex,     ///< Materialized view of grouped aggregates
+            kTrigramIndex,       ///< Index of the trigrams of a string property
         };
 
         struct IndexOptions {
@@ -117,6 +128,9 @@ namespace litecore {
             bool ignoreDiacritics;  ///< True to strip diacritical marks/accents from letters
             bool disableStemming;   ///< Disables stemming
             const char *stopWords;  ///< NULL for default, or comma-delimited string, or empty
+            const char *where;      ///< NULL, or JSON expression limiting which docs are indexed
+            bool useFTS5;           ///< Full-text index uses FTS5 instead of FTS4
+            bool unicodeSortKeys;   ///< Value index stores sort keys of Unicode-collated values
         };
 
         virtual bool supportsIndexes(IndexType) const                   {return false;}
@@ -127,6 +141,17 @@ namespace litecore {
         virtual void deleteIndex(slice name);
         virtual alloc_slice getIndexes() const;
 
+        /** Sets (or with nullptr, removes) an IndexAdvisor that watches the queries run on
+            this KeyStore and recommends indexes for them. */
+        virtual void setIndexAdvisor(std::shared_ptr<IndexAdvisor>);
+        virtual std::shared_ptr<IndexAdvisor> indexAdvisor() const      {return nullptr;}
+
+        /** Creates the indexes the IndexAdvisor recommends for automatic creation, within the
+            limits of its options, and returns how many it created. Queries never do this
+            themselves, since building an index can take a long time. Must not be called
+            within a transaction. */
+        virtual unsigned createAdvisedIndexes();
+
         // public for complicated reasons; clients should never call it
         virtual ~KeyStore()                             { }
 
@@ -46,7 +46,9 @@ namespace litecore {
             bool           descending     :1;   ///< Reverse order? (Start must be
             bool           includeDeleted :1;   ///< Include deleted records?
             bool           onlyBlobs      :1;   ///< Only include records which contain linked binary data
+            bool           onlyConflicts  :1;   ///< Only include records which are in conflict
             ContentOptions contentOptions :4;   ///< Load record bodies?
+            slice          startAfter;          ///< Key to start after (by-key only; for paging)
 
             /** Default options have all flags false, and kDefaultContent */
             Options();
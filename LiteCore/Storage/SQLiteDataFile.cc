@@ -56,7 +56,11 @@ namespace litecore {
 
     // Min/max user_version of db files I can read
     static const int kMinUserVersion = 201;
-    static const int kMaxUserVersion = 299;
+    static const int kMaxUserVersion = 399;
+
+    // user_version of a file that has revision bodies stored outside their rev trees, which
+    // older versions (whose kMaxUserVersion is 299) can't read. See requireNewFormat().
+    static const int kNewFormatUserVersion = 300;
 
     // SQLite page size
     static const int64_t kPageSize = 4096;
@@ -79,6 +83,9 @@ namespace litecore {
     // If the database has many bytes of free space, vacuum it
     static const int64_t kVacuumSizeThreshold = 50 * MB;
 
+    // Max number of pages an FTS5 index's incremental merge writes during housekeeping
+    static const int kFTS5MergePages = 500;
+
     // Database busy timeout; generally not needed since we have other arbitration that keeps
     // multiple threads from trying to start transactions at once, but another process might
     // open the database and grab the write lock.
@@ -173,6 +180,13 @@ namespace litecore {
     }
 
 
+    // A counter shared by all the DataFile instances on a file, via DataFile::sharedObject().
+    class SQLiteDataFile::SchemaGeneration : public RefCounted {
+    public:
+        atomic<uint64_t> value {0};
+    };
+
+
     SQLiteDataFile::SQLiteDataFile(const FilePath &path, const Options *options)
     :DataFile(path, options)
     {
@@ -187,6 +201,8 @@ namespace litecore {
 
     void SQLiteDataFile::reopen() {
         DataFile::reopen();
+        _schemaGeneration = (SchemaGeneration*)addSharedObject("SchemaGeneration",
+                                                               new SchemaGeneration).get();
         int sqlFlags = options().writeable ? SQLite::OPEN_READWRITE : SQLite::OPEN_READONLY;
         if (options().create)
             sqlFlags |= SQLite::OPEN_CREATE;
@@ -232,6 +248,7 @@ namespace litecore {
                      "PRAGMA mmap_size=%d; "             // Memory-mapped reads
                      "PRAGMA synchronous=normal; "       // Speeds up commits
                      "PRAGMA journal_size_limit=%lld; "  // Limit WAL disk usage
+                     "PRAGMA recursive_triggers=true; "  // REPLACE fires side-table triggers
                      "PRAGMA case_sensitive_like=true",  // Case sensitive LIKE, for N1QL compat
                      -(int)kCacheSize/1024, kMMapSize, (long long)kJournalSize));
 
@@ -254,10 +271,74 @@ namespace litecore {
 
         // Register collators, custom functions, and the FTS tokenizer:
         RegisterSQLiteUnicodeCollations(sqlite, _collationContexts);
-        RegisterSQLiteFunctions(sqlite, fleeceAccessor(), documentKeys());
+        _supportsUnicodeSortKeys = RegisterSQLiteUnicodeSortKeyFunction(sqlite);
+        RegisterSQLiteFunctions(sqlite, fleeceAccessor(), documentKeys(), &_functionProfile);
         int rc = register_unicodesn_tokenizer(sqlite);
         if (rc != SQLITE_OK)
             Warn("Unable to register FTS tokenizer: SQLite err %d", rc);
+        else if ((rc = RegisterFTS5Extensions(sqlite)) != SQLITE_OK)
+            Warn("Unable to register FTS5 tokenizer: SQLite err %d", rc);
+
+        if (_supportsUnicodeSortKeys && options().writeable)
+            updateUnicodeSortKeys();
+    }
+
+
+    uint64_t SQLiteDataFile::schemaGeneration() const {
+        return _schemaGeneration->value;
+    }
+
+
+    // Called after a transaction that created or deleted an index has been committed.
+    void SQLiteDataFile::schemaChanged() {
+        ++_schemaGeneration->value;
+    }
+
+
+    // Records the version of the collator whose sort keys are stored in indexes.
+    // Called when such an index is created.
+    void SQLiteDataFile::setUnicodeSortKeyVersion() {
+        _exec("CREATE TABLE IF NOT EXISTS sortkeyinfo (version TEXT NOT NULL); "
+              "DELETE FROM sortkeyinfo");
+        SQLite::Statement insert(*_sqlDb, "INSERT INTO sortkeyinfo (version) VALUES (?)");
+        insert.bind(1, UnicodeSortKeyVersion());
+        insert.exec();
+    }
+
+
+    // Rebuilds the indexes of Unicode sort keys if they were made by a different version of the
+    // collator (as after an OS upgrade), since their keys might no longer sort correctly.
+    void SQLiteDataFile::updateUnicodeSortKeys() {
+        if (!tableExists("sortkeyinfo"))
+            return;
+        string version = UnicodeSortKeyVersion();
+        {
+            SQLite::Statement get(*_sqlDb, "SELECT version FROM sortkeyinfo");
+            if (get.executeStep() && get.getColumn(0).getString() == version)
+                return;
+        }
+        withFileLock([&]{
+            _exec("BEGIN");
+            try {
+                vector<string> indexes;
+                {
+                    SQLite::Statement names(*_sqlDb, "SELECT name FROM sqlite_master "
+                                            "WHERE type='index' AND sql LIKE '%unicode_sortkey(%'");
+                    while (names.executeStep())
+                        indexes.push_back(names.getColumn(0).getString());
+                }
+                for (auto &name : indexes) {
+                    LogTo(DBLog, "Collator is now %s; rebuilding index '%s'",
+                          version.c_str(), name.c_str());
+                    _exec(CONCAT("REINDEX \"" << name << "\""));
+                }
+                setUnicodeSortKeyVersion();
+                _exec("END");
+            } catch (...) {
+                _exec("ROLLBACK");
+                throw;
+            }
+        });
     }
 
 
@@ -268,6 +349,10 @@ namespace litecore {
 
     void SQLiteDataFile::close() {
         DataFile::close(); // closes all the KeyStores
+        {
+            lock_guard<mutex> lock(_readConnectionsMutex);
+            _readConnections.clear();
+        }
         _getLastSeqStmt.reset();
         _setLastSeqStmt.reset();
         if (_sqlDb) {
@@ -491,6 +576,129 @@ namespace litecore {
     }
 
 
+#pragma mark - READ CONNECTIONS:
+
+
+    // The document keys of a ReadConnection, read through that connection (so that they're
+    // consistent with its snapshot, and safe to use on its thread.) They're read-only.
+    class SQLiteDataFile::ReadConnection::Keys : public fleece::PersistentSharedKeys {
+    public:
+        explicit Keys(const string &infoTableName)
+        :_infoTableName(infoTableName)
+        { }
+
+        void setDatabase(SQLite::Database *sqlDb)  {_sqlDb = sqlDb;}
+
+    protected:
+        virtual bool read() override {
+            SQLite::Statement get(*_sqlDb, "SELECT body FROM " + _infoTableName
+                                           + " WHERE key='SharedKeys'");
+            slice body;
+            if (get.executeStep()) {
+                SQLite::Column col = get.getColumn(0);
+                body = slice(col.getBlob(), col.getBytes());
+            }
+            return loadFrom(body);
+        }
+        virtual void write(slice) override {
+            error::_throw(error::NotWriteable);
+        }
+
+    private:
+        string _infoTableName;
+        SQLite::Database *_sqlDb {nullptr};
+    };
+
+
+    SQLiteDataFile::ReadConnection::ReadConnection(SQLiteDataFile &df) {
+        if (df.documentKeys())
+            _keys.reset(new Keys("kv_" + DataFile::kInfoKeyStoreName));
+        _sqlDb = make_unique<SQLite::Database>(df.filePath().path().c_str(),
+                                               SQLite::OPEN_READONLY,
+                                               kBusyTimeoutSecs * 1000);
+        if (_keys)
+            _keys->setDatabase(_sqlDb.get());
+        _sqlDb->exec(format("PRAGMA cache_size=%d; "
+                            "PRAGMA mmap_size=%d; "
+                            "PRAGMA case_sensitive_like=true",
+                            -(int)kCacheSize/1024, kMMapSize));
+        auto sqlite = _sqlDb->getHandle();
+        RegisterSQLiteUnicodeCollations(sqlite, _collationContexts);
+        RegisterSQLiteUnicodeSortKeyFunction(sqlite);
+        RegisterSQLiteFunctions(sqlite, df.fleeceAccessor(), _keys.get());
+        if (register_unicodesn_tokenizer(sqlite) == SQLITE_OK)
+            RegisterFTS5Extensions(sqlite);
+        // Read once, to open the WAL, which sqlite3_snapshot_open requires:
+        _sqlDb->execAndGet("SELECT count(*) FROM kvmeta");
+    }
+
+
+    SQLiteDataFile::ReadConnection::~ReadConnection() {
+        _sqlDb.reset();
+    }
+
+
+    sqlite3* SQLiteDataFile::ReadConnection::handle() const {
+        return _sqlDb->getHandle();
+    }
+
+
+    bool SQLiteDataFile::ReadConnection::beginSnapshot(sqlite3_snapshot *snapshot) {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        _sqlDb->exec("BEGIN");
+        int rc = sqlite3_snapshot_open(handle(), "main", snapshot);
+        if (rc != SQLITE_OK) {
+            LogVerbose(SQL, "ReadConnection can't open snapshot (err %d)", rc);
+            _sqlDb->exec("COMMIT");
+            return false;
+        }
+        if (_keys)
+            _keys->refresh();
+        return true;
+#else
+        return false;
+#endif
+    }
+
+
+    void SQLiteDataFile::ReadConnection::endSnapshot() {
+        _sqlDb->exec("COMMIT");
+    }
+
+
+    SQLiteDataFile::Snapshot SQLiteDataFile::currentSnapshot() {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+        sqlite3_snapshot *snapshot;
+        if (sqlite3_snapshot_get(_sqlDb->getHandle(), "main", &snapshot) == SQLITE_OK)
+            return Snapshot(snapshot, &sqlite3_snapshot_free);
+#endif
+        return nullptr;
+    }
+
+
+    unique_ptr<SQLiteDataFile::ReadConnection> SQLiteDataFile::borrowReadConnection() {
+        if (options().encryptionAlgorithm != kNoEncryption)
+            return nullptr;     // (would need its own copy of the key)
+        {
+            lock_guard<mutex> lock(_readConnectionsMutex);
+            if (!_readConnections.empty()) {
+                auto conn = move(_readConnections.back());
+                _readConnections.pop_back();
+                return conn;
+            }
+        }
+        checkOpen();
+        return unique_ptr<ReadConnection>(new ReadConnection(*this));
+    }
+
+
+    void SQLiteDataFile::returnReadConnection(unique_ptr<ReadConnection> conn) {
+        lock_guard<mutex> lock(_readConnectionsMutex);
+        if (isOpen())
+            _readConnections.push_back(move(conn));
+    }
+
+
     int SQLiteDataFile::_exec(const string &sql, LogLevel logLevel) {
         if (_usuallyFalse(SQL.willLog(logLevel)))
             SQL.log(logLevel, "%s", sql.c_str());
@@ -547,6 +755,17 @@ namespace litecore {
         return exists;
     }
 
+
+    vector<string> SQLiteDataFile::tableColumns(const string &name) const {
+        checkOpen();
+        SQLite::Statement st(*_sqlDb, "PRAGMA table_info(\"" + name + "\")");
+        LogStatement(st);
+        vector<string> columns;
+        while (st.executeStep())
+            columns.push_back(st.getColumn(1).getString());
+        return columns;
+    }
+
     
     sequence_t SQLiteDataFile::lastSequence(const string& keyStoreName) const {
         sequence_t seq = 0;
@@ -579,6 +798,21 @@ namespace litecore {
 
             _exec("PRAGMA optimize");
 
+            // FTS5 indexes are created with a high 'automerge' setting, so merge some of their
+            // segments now: <https://www.sqlite.org/fts5.html#the_merge_command>
+            vector<string> fts5Tables;
+            {
+                SQLite::Statement getFTS5(*_sqlDb, "SELECT name FROM sqlite_master "
+                                          "WHERE type='table' "
+                                          "AND sql LIKE 'CREATE VIRTUAL TABLE % USING fts5%'");
+                while (getFTS5.executeStep())
+                    fts5Tables.push_back(getFTS5.getColumn(0).getString());
+            }
+            for (auto &table : fts5Tables) {
+                _exec(format("INSERT INTO \"%s\" (\"%s\", rank) VALUES ('merge', %d)",
+                             table.c_str(), table.c_str(), kFTS5MergePages));
+            }
+
             if ((pageCount > 0 && (float)freePages / pageCount >= kVacuumFractionThreshold)
                     || (freePages * kPageSize >= kVacuumSizeThreshold)) {
                 Log("Vacuuming database '%s'...", filePath().dirName().c_str());
@@ -596,6 +830,18 @@ namespace litecore {
     }
 
 
+    // Files start out at user_version 201, readable by older versions of LiteCore, and are only
+    // upgraded once they contain data those versions would misread.
+    void SQLiteDataFile::requireNewFormat() {
+        Assert(inTransaction());
+        if (intQuery("PRAGMA user_version") < kNewFormatUserVersion) {
+            LogTo(DBLog, "Upgrading %s to format version %d; older versions of LiteCore can't "
+                  "open it", filePath().path().c_str(), kNewFormatUserVersion);
+            _exec(format("PRAGMA user_version=%d", kNewFormatUserVersion));
+        }
+    }
+
+
     alloc_slice SQLiteDataFile::rawQuery(const string &query) {
         SQLite::Statement stmt(*_sqlDb, query);
         int nCols = stmt.getColumnCount();
@@ -20,6 +20,9 @@
 
 #include "DataFile.hh"
 #include "UnicodeCollator.hh"
+#include <mutex>
+
+struct sqlite3_snapshot;
 
 namespace SQLite {
     class Database;
@@ -31,6 +34,7 @@ namespace SQLite {
 namespace litecore {
 
     class SQLiteKeyStore;
+    struct SQLiteFunctionProfile;
 
 
     /** SQLite implementation of Database. */
@@ -53,9 +57,62 @@ namespace litecore {
 #endif
         bool keyStoreExists(const std::string &name);
         bool tableExists(const std::string &name) const;
+        std::vector<std::string> tableColumns(const std::string &name) const;
+
+        /** True if the `unicode_sortkey` SQL function is available on this platform. */
+        bool supportsUnicodeSortKeys() const                {return _supportsUnicodeSortKeys;}
+        void setUnicodeSortKeyVersion();
+
+        /** A number that changes whenever an index is created or deleted in this file, through
+            any DataFile instance, so a query can tell when its plan may have changed. */
+        uint64_t schemaGeneration() const;
+        void schemaChanged();
+
+        /** While a profile is set, calls to the Fleece SQL functions are counted and timed in it.
+            Used while profiling a query. */
+        void setFunctionProfile(SQLiteFunctionProfile *p)   {_functionProfile = p;}
+
+        void requireNewFormat() override;
 
         fleece::alloc_slice rawQuery(const std::string &query) override;
 
+        using Snapshot = std::shared_ptr<sqlite3_snapshot>;
+
+        /** Returns the snapshot of the database seen by this DataFile's connection, which must be
+            in a read-only transaction that has already read from the file; or nullptr if SQLite
+            doesn't support snapshots here (it wasn't built with them, or the file isn't in WAL
+            mode.) ReadConnections can then read that same snapshot. */
+        Snapshot currentSnapshot();
+
+        /** An extra read-only connection to the database file, on which a query (or part of one)
+            can run on another thread, concurrently with this DataFile's own connection. */
+        class ReadConnection {
+        public:
+            explicit ReadConnection(SQLiteDataFile&);
+            ~ReadConnection();
+
+            operator SQLite::Database&()                    {return *_sqlDb;}
+            sqlite3* handle() const;
+
+            /** Begins a read transaction on a snapshot from SQLiteDataFile::currentSnapshot().
+                Returns false, without beginning one, if that snapshot can't be opened. */
+            bool beginSnapshot(sqlite3_snapshot*);
+            void endSnapshot();
+
+        private:
+            class Keys;
+            std::unique_ptr<Keys> _keys;                // (must outlive _sqlDb)
+            CollationContextVector _collationContexts;
+            std::unique_ptr<SQLite::Database> _sqlDb;
+        };
+
+        /** Returns an idle ReadConnection, opening a new one if necessary, or nullptr if the
+            file can't have any (it's encrypted.) Thread-safe. */
+        std::unique_ptr<ReadConnection> borrowReadConnection();
+
+        /** Returns a ReadConnection to the pool of idle ones. Thread-safe. */
+        void returnReadConnection(std::unique_ptr<ReadConnection>);
+
         class Factory : public DataFile::Factory {
         public:
             Factory();
@@ -95,12 +152,20 @@ namespace litecore {
     private:
         friend class SQLiteKeyStore;
 
+        class SchemaGeneration;
+
         bool decrypt();
+        void updateUnicodeSortKeys();
         int _exec(const std::string &sql, LogLevel =LogLevel::Verbose);
 
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
         CollationContextVector _collationContexts;
+        bool _supportsUnicodeSortKeys {false};
+        Retained<SchemaGeneration> _schemaGeneration;   // Shared by DataFiles on this file
+        SQLiteFunctionProfile* _functionProfile {nullptr};
+        std::vector<std::unique_ptr<ReadConnection>> _readConnections;   // Idle ones
+        std::mutex _readConnectionsMutex;
     };
 
 }
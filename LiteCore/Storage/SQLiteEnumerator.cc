@@ -81,6 +81,8 @@ namespace litecore {
     {
         if (bySequence && _db.options().writeable)
             createSequenceIndex();
+        else if (options.onlyConflicts && _db.options().writeable)
+            createConflictIndex();
 
         stringstream sql;
         selectFrom(sql, options);
@@ -89,7 +91,8 @@ namespace litecore {
             sql << " WHERE sequence > ?";
             writeAnd = true;
         } else {
-            if (!options.includeDeleted || options.onlyBlobs)
+            if (!options.includeDeleted || options.onlyBlobs || options.onlyConflicts
+                    || options.startAfter.buf)
                 sql << " WHERE ";
         }
         if (!options.includeDeleted) {
@@ -97,15 +100,28 @@ namespace litecore {
             sql << "(flags & 1) != 1";
         }
         if (options.onlyBlobs) {
-            if(writeAnd) sql << " AND "; // else writeAnd = true;
+            if(writeAnd) sql << " AND "; else writeAnd = true;
             sql << "(flags & 4) != 0";
         }
+        if (options.onlyConflicts) {
+            // (This has to match the WHERE clause of the partial index created by
+            // createConflictIndex, for SQLite to use it.)
+            if(writeAnd) sql << " AND "; else writeAnd = true;
+            sql << "(flags & 2) != 0";
+        }
+        bool afterKey = !bySequence && options.startAfter.buf;
+        if (afterKey) {
+            if(writeAnd) sql << " AND "; // else writeAnd = true;
+            sql << (options.descending ? "key < ?" : "key > ?");
+        }
         sql << (bySequence ? " ORDER BY sequence" : " ORDER BY key");
         writeSQLOptions(sql, options);
 
         auto stmt = new SQLite::Statement(db(), sql.str());        // TODO: Cache a statement
         if (bySequence)
             stmt->bind(1, (long long)since);
+        else if (afterKey)
+            stmt->bind(1, options.startAfter.asString());
         return new SQLiteEnumerator(stmt, options.descending, options.contentOptions);
     }
 
@@ -25,6 +25,7 @@
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "Fleece.hh"
 #include <sstream>
+#include <unordered_map>
 
 using namespace std;
 using namespace fleece;
@@ -76,6 +77,7 @@ namespace litecore {
         _recCountStmt.reset();
         _getByKeyStmt.reset();
         _getMetaByKeyStmt.reset();
+        _getManyStmt.reset();
         _getBySeqStmt.reset();
         _getByOffStmt.reset();
         _getMetaBySeqStmt.reset();
@@ -208,6 +210,50 @@ namespace litecore {
     }
 
 
+    // Max number of keys looked up by one query in readMany (SQLite allows up to 999 params.)
+    static const size_t kKeysPerRead = 100;
+
+    void SQLiteKeyStore::readMany(vector<Record> &recs, ContentOptions options) const {
+        unordered_multimap<slice, Record*, fleece::sliceHash> byKey;
+        for (size_t start = 0; start < recs.size(); start += kKeysPerRead) {
+            size_t n = min(recs.size() - start, kKeysPerRead);
+            stringstream sql;
+            sql << ((options & kMetaOnly) ? "SELECT sequence, flags, key, version, length(body)"
+                                          : "SELECT sequence, flags, key, version, body")
+                << " FROM kv_@ WHERE key IN (?";
+            for (size_t i = 1; i < n; ++i)
+                sql << ",?";
+            sql << ")";
+
+            // Only the common case of a full batch of bodies gets a cached statement:
+            unique_ptr<SQLite::Statement> tempStmt;
+            SQLite::Statement *stmt;
+            if (n == kKeysPerRead && !(options & kMetaOnly)) {
+                stmt = &compile(_getManyStmt, sql.str().c_str());
+            } else {
+                tempStmt.reset(compile(subst(sql.str().c_str())));
+                stmt = tempStmt.get();
+            }
+
+            byKey.clear();
+            for (size_t i = 0; i < n; ++i) {
+                Record &rec = recs[start + i];
+                stmt->bindNoCopy((int)i + 1, (const char*)rec.key().buf, (int)rec.key().size);
+                byKey.emplace(rec.key(), &rec);
+            }
+            UsingStatement u(*stmt);
+            while (stmt->executeStep()) {
+                auto range = byKey.equal_range(columnAsSlice(stmt->getColumn(2)));
+                for (auto i = range.first; i != range.second; ++i) {
+                    Record &rec = *i->second;
+                    rec.updateSequence((int64_t)stmt->getColumn(0));
+                    setRecordMetaAndBody(rec, *stmt, options);
+                }
+            }
+        }
+    }
+
+
     Record SQLiteKeyStore::get(sequence_t seq /*, ContentOptions options*/) const {
         constexpr ContentOptions options = kDefaultContent;  // this used to be a param but not used
         if (!_capabilities.sequences)
@@ -18,6 +18,7 @@
 
 #pragma once
 #include "KeyStore.hh"
+#include <mutex>
 
 namespace fleece {
     class Value;
@@ -42,6 +43,7 @@ namespace litecore {
 
         Record get(sequence_t) const override;
         bool read(Record &rec, ContentOptions options) const override;
+        void readMany(std::vector<Record> &recs, ContentOptions options) const override;
 
         sequence_t set(slice key, slice meta, slice value, DocumentFlags,
                        Transaction&,
@@ -63,7 +65,13 @@ namespace litecore {
         void deleteIndex(slice name) override;
         alloc_slice getIndexes() const override;
 
+        void setIndexAdvisor(std::shared_ptr<IndexAdvisor>) override;
+        std::shared_ptr<IndexAdvisor> indexAdvisor() const override;
+
+        unsigned createAdvisedIndexes() override;
+
         void createSequenceIndex();
+        void createConflictIndex();
 
     protected:
         std::string tableName() const                       {return std::string("kv_") + name();}
@@ -110,15 +118,34 @@ namespace litecore {
         void createFTSIndex(std::string indexName,
                             const fleece::Array *params,
                             const IndexOptions *options);
+        void createGeoIndex(std::string indexName,
+                            const fleece::Array *params,
+                            const IndexOptions *options);
+        void createArrayIndex(std::string indexName,
+                              const fleece::Array *params,
+                              const IndexOptions *options);
+        void createAggregateIndex(std::string indexName,
+                                  const fleece::Array *params,
+                                  const IndexOptions *options);
+        void createTrigramIndex(std::string indexName,
+                                const fleece::Array *params,
+                                const IndexOptions *options);
+        std::vector<std::string> aggregateViewTables() const;
         void _deleteIndex(slice name);
+        bool hasIndexOnExpression(const std::string &expressionSQL) const;
+        unsigned autoIndexCount() const;
+        int64_t usedBytes() const;
 
         std::unique_ptr<SQLite::Statement> _recCountStmt;
-        std::unique_ptr<SQLite::Statement> _getByKeyStmt, _getMetaByKeyStmt, _getByOffStmt;
+        std::unique_ptr<SQLite::Statement> _getByKeyStmt, _getMetaByKeyStmt, _getByOffStmt, _getManyStmt;
         std::unique_ptr<SQLite::Statement> _getBySeqStmt, _getMetaBySeqStmt;
         std::unique_ptr<SQLite::Statement> _setStmt, _insertStmt, _replaceStmt, _updateBodyStmt;
         std::unique_ptr<SQLite::Statement> _backupStmt, _delByKeyStmt, _delBySeqStmt, _delByBothStmt;
         std::unique_ptr<SQLite::Statement> _setFlagStmt;
+        std::shared_ptr<IndexAdvisor> _indexAdvisor;
+        mutable std::mutex _indexAdvisorMutex;
         bool _createdSeqIndex {false};     // Created by-seq index yet?
+        bool _createdConflictIndex {false}; // Created conflicts index yet?
         bool _lastSequenceChanged {false};
         int64_t _lastSequence {-1};
     };
@@ -20,6 +20,7 @@
 #include "DataFile.hh"
 #include "Logging.hh"
 #include <memory>
+#include <unordered_map>
 
 struct sqlite3;
 
@@ -39,6 +40,9 @@ namespace litecore {
 
     void LogStatement(const SQLite::Statement &st);
 
+    // Quotes a table or column name for SQL, inside double-quotes.
+    std::string sqlIdentifier(const std::string &name);
+
 
     // Little helper class that makes sure Statement objects get reset on exit
     class UsingStatement {
@@ -56,7 +60,24 @@ namespace litecore {
     };
 
 
+    // Number of calls to, and total time spent in, each of the Fleece SQL functions (`fl_value`,
+    // etc.), collected while a query is being profiled.
+    struct SQLiteFunctionProfile {
+        struct Stats {
+            uint64_t calls;
+            double seconds;
+        };
+        std::unordered_map<const char*, Stats> functions;     // Keyed by function name
+    };
+
+    // If `profile` is non-null, then whenever *profile is non-null the Fleece functions record
+    // their calls in it.
     void RegisterSQLiteFunctions(sqlite3 *db,
                                  DataFile::FleeceAccessor accessor,
-                                 fleece::SharedKeys *sharedKeys);
+                                 fleece::SharedKeys *sharedKeys,
+                                 SQLiteFunctionProfile* const *profile =nullptr);
+
+    // Registers the 'unicodesn' tokenizer and offsets() function with FTS5. Must be called after
+    // the FTS3 'unicodesn' tokenizer has been registered.
+    int RegisterFTS5Extensions(sqlite3 *db);
 }
@@ -22,6 +22,7 @@
 #include "StringUtil.hh"
 #include <sqlite3.h>
 #include <algorithm>
+#include <string.h>
 
 namespace litecore {
 
@@ -99,9 +100,22 @@ namespace litecore {
           5, 47, 49, 51, 53, 55, 57, 59, 61, 63, 65, 67, 69, 71, 73, 75,
          77, 79, 81, 83, 85, 87, 89, 91, 93, 95, 97, 21, 34, 22, 35,128};
 
+    // Same as kCharPriority, except that each uppercase letter maps to the priority of its
+    // lowercase form; used for case-insensitive ("primary strength") comparisons.
+    static const uint8_t kCharPrimary[128] = {
+         99,100,101,102,103,104,105,106,107,  1,  2,108,109,  3,110,111,
+        112,113,114,115,116,117,118,119,120,121,122,123,124,125,126,127,
+          4, 12, 16, 28, 36, 29, 27, 15, 17, 18, 24, 30,  9,  8, 14, 25,
+         37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 11, 10, 31, 32, 33, 13,
+         23, 47, 49, 51, 53, 55, 57, 59, 61, 63, 65, 67, 69, 71, 73, 75,
+         77, 79, 81, 83, 85, 87, 89, 91, 93, 95, 97, 19, 26, 20,  6,  7,
+          5, 47, 49, 51, 53, 55, 57, 59, 61, 63, 65, 67, 69, 71, 73, 75,
+         77, 79, 81, 83, 85, 87, 89, 91, 93, 95, 97, 21, 34, 22, 35,128};
+
 #if 0
-    // This function outputs the table above. It only needs to be run if we change the definition
-    // of the table and need to regenerate it.
+    // This function outputs the kCharPriority table above. It only needs to be run if we change
+    // the definition of the table and need to regenerate it. (kCharPrimary is derived from it by
+    // giving each uppercase letter the priority of its lowercase form.)
     static void generateCharPriorityMap() {
         uint8_t charPriority[128] = {};
         static const char* const kInverseMap = "\t\n\r `^_-,;:!?.'\"()[]{}@*/\\&#%+<=>|~$"
@@ -132,27 +146,48 @@ namespace litecore {
     }
 
 
+    // Returns the length of the common prefix of two strings that's identical and pure ASCII,
+    // rounded down to a multiple of 8 bytes. Compares and checks a 64-bit word at a time.
+    template <class CHAR>
+    static inline size_t equalASCIIPrefix(const CHAR *chars1, const CHAR *chars2, size_t n) {
+        static constexpr size_t kCharsPerWord = sizeof(uint64_t) / sizeof(CHAR);
+        static constexpr uint64_t kNonASCIIBits = (sizeof(CHAR) == 1) ? 0x8080808080808080ull
+                                                                      : 0xFF80FF80FF80FF80ull;
+        size_t i = 0;
+        for (; i + kCharsPerWord <= n; i += kCharsPerWord) {
+            uint64_t w1, w2;
+            memcpy(&w1, &chars1[i], sizeof(w1));
+            memcpy(&w2, &chars2[i], sizeof(w2));
+            if (w1 != w2 || (w1 & kNonASCIIBits) != 0)
+                break;
+        }
+        return i;
+    }
+
+
     template <class CHAR>
     int CompareASCII(int len1, const CHAR *chars1,
                      int len2, const CHAR *chars2,
                      bool caseSensitive)
     {
+        // Identical characters don't affect the result, so skip any long common prefix quickly:
+        size_t skip = equalASCIIPrefix(chars1, chars2, std::min(len1, len2));
+
         int tieBreaker = 0;
-        auto cp1 = chars1, cp2 = chars2;
-        for (size_t n = std::min(len1, len2); n > 0; --n) {
+        auto cp1 = chars1 + skip, cp2 = chars2 + skip;
+        for (size_t n = std::min(len1, len2) - skip; n > 0; --n) {
             auto c1 = *cp1, c2 = *cp2;
             if (_usuallyFalse((c1 >= 0x80) || (c2 >= 0x80)))
                 return kCompareASCIIGaveUp;
-            auto x = c1 ^ c2;
-            if (_usuallyFalse(x != 0)) {
+            if (_usuallyFalse(c1 != c2)) {
                 // Characters are different:
-                if (x == 0x20 && tolower(c1) == tolower(c2)) {
-                    // Case-equivalent:
-                    if (caseSensitive && tieBreaker == 0)
-                        tieBreaker = cmp(kCharPriority[c1], kCharPriority[c2]);
-                } else {
+                auto p1 = kCharPrimary[c1], p2 = kCharPrimary[c2];
+                if (p1 != p2) {
                     // Not case-equivalent: rank strings by priority of these chars
-                    return cmp(kCharPriority[c1], kCharPriority[c2]);
+                    return cmp(p1, p2);
+                } else if (caseSensitive && tieBreaker == 0) {
+                    // Case-equivalent:
+                    tieBreaker = cmp(kCharPriority[c1], kCharPriority[c2]);
                 }
             }
 
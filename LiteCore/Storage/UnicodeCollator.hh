@@ -84,6 +84,20 @@ namespace litecore {
         The contexts created by the collations will be added to the vector. */
     void RegisterSQLiteUnicodeCollations(sqlite3*, CollationContextVector&);
 
+    /** Registers the SQLite function `unicode_sortkey(string, collationName)`, which returns the
+        string's binary sort key for a Unicode-aware collation ("LCUnicode_..."), such that
+        comparing two keys bytewise orders them the same as comparing the strings with that
+        collation. The key is itself a SQL string (of arbitrary bytes), so it orders against other
+        types the same way the string does. Non-string arguments are returned unchanged.
+        Returns false if the platform's collator can't produce sort keys. */
+    bool RegisterSQLiteUnicodeSortKeyFunction(sqlite3*);
+
+    /** Identifies the version of the platform collator that `unicode_sortkey` uses. Sort keys
+        stored under one version may not order correctly against those made by another, so
+        they have to be recomputed when this changes (as after an OS upgrade.)
+        Returns an empty string if the platform's collator can't produce sort keys. */
+    std::string UnicodeSortKeyVersion();
+
 
     /** Simple comparison of two UTF8- or UTF16-encoded strings. Uses Unicode ordering, but gives
         up and returns kCompareASCIIGaveUp if it finds any non-ASCII characters. */
@@ -134,6 +134,18 @@ namespace litecore {
             throw SQLite::Exception(dbHandle, rc);
         return context;
     }
+
+
+    // CFString has no sort-key API, and CFStringCompare's ordering can't be reproduced by one
+    // built some other way, so indexes of sort keys can't be created on Apple platforms.
+    bool RegisterSQLiteUnicodeSortKeyFunction(sqlite3*) {
+        return false;
+    }
+
+
+    string UnicodeSortKeyVersion() {
+        return "";
+    }
 }
 
 #endif // __APPLE__
@@ -28,6 +28,7 @@
 #include <codecvt>
 #include <locale>
 #include <iostream>
+#include <vector>
 
 #if LITECORE_USES_ICU // See UnicodeCollator_*.cc for other implementations
 
@@ -150,6 +151,82 @@ namespace litecore {
         return context;
     }
 
+
+    // unicode_sortkey(string, collationName) -> string
+    static void unicodeSortKey(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        try {
+            // Cache the collator using SQLite's auxdata API, since the name is usually constant:
+            auto coll = (ICUCollationContext*)sqlite3_get_auxdata(ctx, 1);
+            unique_ptr<ICUCollationContext> newColl;
+            if (!coll) {
+                Collation collation;
+                auto name = (const char*)sqlite3_value_text(argv[1]);
+                if (!name || !collation.readSQLiteName(name)) {
+                    sqlite3_result_error(ctx, "unicode_sortkey: invalid collation name", -1);
+                    return;
+                }
+                newColl.reset(new ICUCollationContext(collation));
+                coll = newColl.get();
+            }
+
+            auto chars = (const UChar*)sqlite3_value_text16(argv[0]);
+            int32_t length = sqlite3_value_bytes16(argv[0]) / sizeof(UChar);
+            uint8_t stackBuf[256];
+            vector<uint8_t> heapBuf;
+            uint8_t *key = stackBuf;
+            int32_t keySize = ucol_getSortKey(coll->ucoll, chars, length, key, sizeof(stackBuf));
+            if (keySize > (int32_t)sizeof(stackBuf)) {
+                heapBuf.resize(keySize);
+                key = heapBuf.data();
+                keySize = ucol_getSortKey(coll->ucoll, chars, length, key, keySize);
+            }
+            if (keySize == 0) {
+                sqlite3_result_error(ctx, "unicode_sortkey: ICU failed to create sort key", -1);
+                return;
+            }
+            // The key is returned as a string, not a blob, so that it sorts against other types
+            // the same way the string would. (SQLite compares strings bytewise, with the default
+            // BINARY collation.) The key's trailing 00 byte is left off.
+            sqlite3_result_text(ctx, (const char*)key, keySize - 1, SQLITE_TRANSIENT);
+
+            if (newColl) {
+                sqlite3_set_auxdata(ctx, 1, newColl.release(), [](void *auxdata) {
+                    delete (ICUCollationContext*)auxdata;
+                });
+            }
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "unicode_sortkey: exception!", -1);
+        }
+    }
+
+
+    bool RegisterSQLiteUnicodeSortKeyFunction(sqlite3 *dbHandle) {
+        int rc = sqlite3_create_function_v2(dbHandle, "unicode_sortkey", 2,
+                                            SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                            nullptr, unicodeSortKey, nullptr, nullptr, nullptr);
+        if (rc != SQLITE_OK)
+            throw SQLite::Exception(dbHandle, rc);
+        return true;
+    }
+
+
+    string UnicodeSortKeyVersion() {
+        // The root collator's version changes whenever ICU's collation data or algorithm does:
+        UErrorCode status = U_ZERO_ERROR;
+        UCollator *root = ucol_open("", &status);
+        if (U_FAILURE(status))
+            error::_throw(error::UnexpectedError, "Failed to open root collator (ICU error %d)",
+                          (int)status);
+        UVersionInfo version;
+        ucol_getVersion(root, version);
+        ucol_close(root);
+        return format("ICU %u.%u.%u.%u", version[0], version[1], version[2], version[3]);
+    }
+
 }
 
 #endif // !__APPLE__
@@ -33,6 +33,14 @@ namespace litecore {
                                                                 const Collation &coll) {
         return nullptr;
     }
+
+    bool RegisterSQLiteUnicodeSortKeyFunction(sqlite3*) {
+        return false;
+    }
+
+    string UnicodeSortKeyVersion() {
+        return "";
+    }
 }
 
 #endif
@@ -151,6 +151,81 @@ namespace litecore {
             throw SQLite::Exception(dbHandle, rc);
         return context;
     }
+
+
+    // unicode_sortkey(string, collationName) -> string
+    static void unicodeSortKey(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        try {
+            // Cache the collator using SQLite's auxdata API, since the name is usually constant:
+            auto coll = (WinApiCollationContext*)sqlite3_get_auxdata(ctx, 1);
+            unique_ptr<WinApiCollationContext> newColl;
+            if (!coll) {
+                Collation collation;
+                auto name = (const char*)sqlite3_value_text(argv[1]);
+                if (!name || !collation.readSQLiteName(name)) {
+                    sqlite3_result_error(ctx, "unicode_sortkey: invalid collation name", -1);
+                    return;
+                }
+                newColl.reset(new WinApiCollationContext(collation));
+                coll = newColl.get();
+            }
+
+            // LCMapStringEx's sort keys compare bytewise the same as CompareStringEx with the
+            // same locale and flags. (For LCMAP_SORTKEY the destination size is in bytes.)
+            // The key is returned as a string, so it sorts against other types like the string.
+            auto chars = (LPCWSTR)sqlite3_value_text16(argv[0]);
+            int length = sqlite3_value_bytes16(argv[0]) / sizeof(WCHAR);
+            DWORD flags = LCMAP_SORTKEY | coll->flags;
+            int keySize = LCMapStringEx(coll->localeName, flags, chars, length,
+                                        nullptr, 0, nullptr, nullptr, 0);
+            if (keySize > 0) {
+                TempArray(key, BYTE, keySize);
+                keySize = LCMapStringEx(coll->localeName, flags, chars, length,
+                                        (LPWSTR)key, keySize, nullptr, nullptr, 0);
+                if (keySize > 0)
+                    sqlite3_result_text(ctx, (const char*)key, keySize, SQLITE_TRANSIENT);
+            }
+            if (keySize <= 0) {
+                Warn("Failed to create sort key (Error %d)", GetLastError());
+                sqlite3_result_error(ctx, "unicode_sortkey: failed to create sort key", -1);
+                return;
+            }
+
+            if (newColl) {
+                sqlite3_set_auxdata(ctx, 1, newColl.release(), [](void *auxdata) {
+                    delete (WinApiCollationContext*)auxdata;
+                });
+            }
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "unicode_sortkey: exception!", -1);
+        }
+    }
+
+
+    bool RegisterSQLiteUnicodeSortKeyFunction(sqlite3 *dbHandle) {
+        int rc = sqlite3_create_function_v2(dbHandle, "unicode_sortkey", 2,
+                                            SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                            nullptr, unicodeSortKey, nullptr, nullptr, nullptr);
+        if (rc != SQLITE_OK)
+            throw SQLite::Exception(dbHandle, rc);
+        return true;
+    }
+
+
+    string UnicodeSortKeyVersion() {
+        // The NLS version changes whenever Windows' sorting data does:
+        NLSVERSIONINFOEX info {};
+        info.dwNLSVersionInfoSize = sizeof(info);
+        if (!GetNLSVersionEx(COMPARE_STRING, LOCALE_NAME_INVARIANT, &info))
+            error::_throw(error::UnexpectedError, "GetNLSVersionEx failed (Error %d)",
+                          (int)GetLastError());
+        return format("NLS %lu.%lu", (unsigned long)info.dwNLSVersion,
+                      (unsigned long)info.dwDefinedVersion);
+    }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+//
+// Arena.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "slice.hh"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+namespace litecore {
+
+    /** A simple bump allocator. Memory is carved sequentially out of malloc'ed chunks and is
+        never freed individually; all of it is released at once by reset() or the destructor.
+        Only use it for objects that are trivially destructible, since no destructors are run. */
+    class Arena {
+    public:
+        explicit Arena(size_t initialCapacity =0)   {if (initialCapacity) reserve(initialCapacity);}
+        ~Arena()                                    {reset();}
+
+        Arena(const Arena&) =delete;
+        Arena& operator= (const Arena&) =delete;
+
+        /** Makes sure at least `capacity` more bytes can be allocated without another malloc. */
+        void reserve(size_t capacity) {
+            if ((size_t)(_end - _next) < capacity)
+                addChunk(capacity);
+        }
+
+        /** Allocates uninitialized memory. */
+        void* alloc(size_t size, size_t alignment =alignof(void*)) {
+            auto start = align(_next, alignment);
+            if (_usuallyFalse(!_chunk || start + size > _end)) {
+                addChunk(size + alignment);
+                start = align(_next, alignment);
+            }
+            _next = start + size;
+            return start;
+        }
+
+        /** Allocates uninitialized memory for `count` objects of type T. */
+        template <class T>
+        T* alloc(size_t count =1) {
+            return (T*)alloc(count * sizeof(T), alignof(T));
+        }
+
+        /** Copies a slice's contents into the arena. */
+        fleece::slice copy(fleece::slice s) {
+            if (s.size == 0)
+                return fleece::slice(s.buf, (size_t)0);
+            void *dst = alloc(s.size, 1);
+            memcpy(dst, s.buf, s.size);
+            return fleece::slice(dst, s.size);
+        }
+
+        /** True if the pointer points into memory allocated by this arena. */
+        bool contains(const void *ptr) const {
+            for (Chunk *chunk = _chunk; chunk; chunk = chunk->prev) {
+                if (ptr >= chunk->data() && ptr < chunk->data() + chunk->capacity)
+                    return true;
+            }
+            return false;
+        }
+
+        /** Total bytes malloc'ed for chunks. */
+        size_t capacity() const {
+            size_t total = 0;
+            for (Chunk *chunk = _chunk; chunk; chunk = chunk->prev)
+                total += chunk->capacity;
+            return total;
+        }
+
+        /** Frees all memory allocated by the arena. */
+        void reset() {
+            while (_chunk) {
+                Chunk *prev = _chunk->prev;
+                ::free(_chunk);
+                _chunk = prev;
+            }
+            _next = _end = nullptr;
+        }
+
+    private:
+        static constexpr size_t kMinChunkSize = 512;
+        static constexpr size_t kMaxChunkGrowth = 64 * 1024;
+
+        struct Chunk {
+            Chunk*  prev;
+            size_t  capacity;
+            uint8_t* data()                 {return (uint8_t*)(this + 1);}
+        };
+
+        static uint8_t* align(uint8_t *p, size_t alignment) {
+            return (uint8_t*)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        }
+
+        void addChunk(size_t minSize) {
+            // Chunks grow geometrically (up to a point) so that a tree that keeps growing
+            // doesn't need a malloc per insertion:
+            size_t size = (minSize > kMinChunkSize) ? minSize : kMinChunkSize;
+            if (_chunk) {
+                size_t grown = 2 * _chunk->capacity;
+                if (grown > kMaxChunkGrowth)
+                    grown = kMaxChunkGrowth;
+                if (grown > size)
+                    size = grown;
+            }
+            auto chunk = (Chunk*) ::malloc(sizeof(Chunk) + size);
+            if (!chunk)
+                throw std::bad_alloc();
+            chunk->prev = _chunk;
+            chunk->capacity = size;
+            _chunk = chunk;
+            _next = chunk->data();
+            _end = _next + size;
+        }
+
+        Chunk*   _chunk {nullptr};          // Most recently allocated chunk (head of list)
+        uint8_t* _next {nullptr};           // Next free byte in _chunk
+        uint8_t* _end {nullptr};            // End of _chunk
+    };
+
+
+    /** STL allocator that allocates from an Arena. Deallocation is a no-op; the memory is
+        reclaimed when the Arena is reset. */
+    template <class T>
+    class ArenaAllocator {
+    public:
+        using value_type = T;
+
+        explicit ArenaAllocator(Arena *arena) noexcept      :_arena(arena) { }
+        template <class U>
+        ArenaAllocator(const ArenaAllocator<U> &other) noexcept :_arena(other._arena) { }
+
+        T* allocate(size_t n)                               {return _arena->alloc<T>(n);}
+        void deallocate(T*, size_t) noexcept                { }
+
+        template <class U>
+        bool operator== (const ArenaAllocator<U> &other) const  {return _arena == other._arena;}
+        template <class U>
+        bool operator!= (const ArenaAllocator<U> &other) const  {return _arena != other._arena;}
+
+    private:
+        template <class U> friend class ArenaAllocator;
+        Arena *_arena;
+    };
+
+}
@@ -0,0 +1,141 @@
+//
+// Delta.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Delta.hh"
+#include "Error.hh"
+#include "varint.hh"
+#include <string>
+#include <string.h>
+#include <unordered_map>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore {
+
+    // Delta format: the target's size as a varint, followed by instructions. Each instruction
+    // starts with a varint whose low bit is 1 for a copy and 0 for an insert, and whose other
+    // bits are the number of bytes. A copy is followed by a varint offset into the base, and
+    // an insert by the bytes themselves.
+
+    // Matches are found by looking up each block of this many bytes of the target in a table of
+    // the base's aligned blocks:
+    static const size_t kBlockSize = 16;
+
+
+    static uint32_t hashBlock(const uint8_t *block) {
+        uint32_t h = 2166136261u;                   // FNV-1a
+        for (size_t i = 0; i < kBlockSize; ++i)
+            h = (h ^ block[i]) * 16777619u;
+        return h;
+    }
+
+
+    static void writeUVarInt(string &out, uint64_t n) {
+        uint8_t buf[kMaxVarintLen64];
+        out.append((const char*)buf, PutUVarInt(buf, n));
+    }
+
+
+    alloc_slice CreateDelta(slice base, slice target) {
+        auto baseBytes = (const uint8_t*)base.buf, targetBytes = (const uint8_t*)target.buf;
+
+        unordered_map<uint32_t, size_t> blocks;
+        blocks.reserve(base.size / kBlockSize);
+        for (size_t pos = 0; pos + kBlockSize <= base.size; pos += kBlockSize)
+            blocks.emplace(hashBlock(&baseBytes[pos]), pos);    // (keeps the first occurrence)
+
+        string out;
+        out.reserve(target.size);
+        writeUVarInt(out, target.size);
+        auto writeInsert = [&](size_t start, size_t end) {
+            if (end > start) {
+                writeUVarInt(out, (end - start) << 1);
+                out.append((const char*)&targetBytes[start], end - start);
+            }
+        };
+
+        size_t literalStart = 0;
+        for (size_t pos = 0; pos + kBlockSize <= target.size; ) {
+            auto found = blocks.find(hashBlock(&targetBytes[pos]));
+            if (found == blocks.end()
+                    || memcmp(&baseBytes[found->second], &targetBytes[pos], kBlockSize) != 0) {
+                ++pos;
+                continue;
+            }
+            // Extend the match backwards (over the pending literal bytes) and forwards:
+            size_t baseStart = found->second, targetStart = pos;
+            while (targetStart > literalStart && baseStart > 0
+                        && baseBytes[baseStart-1] == targetBytes[targetStart-1]) {
+                --baseStart;
+                --targetStart;
+            }
+            size_t len = pos + kBlockSize - targetStart;
+            while (baseStart + len < base.size && targetStart + len < target.size
+                        && baseBytes[baseStart+len] == targetBytes[targetStart+len])
+                ++len;
+
+            writeInsert(literalStart, targetStart);
+            writeUVarInt(out, (len << 1) | 1);
+            writeUVarInt(out, baseStart);
+            pos = literalStart = targetStart + len;
+            if (out.size() >= target.size)
+                return nullslice;
+        }
+        writeInsert(literalStart, target.size);
+
+        if (out.size() >= target.size)
+            return nullslice;
+        return alloc_slice(out.data(), out.size());
+    }
+
+
+    alloc_slice ApplyDelta(slice base, slice delta) {
+        uint64_t size;
+        // (Each byte of the delta can produce at most base.size bytes of output.)
+        if (!ReadUVarInt(&delta, &size) || size > (uint64_t)delta.size * (base.size + 1))
+            error::_throw(error::CorruptData);
+        alloc_slice result((size_t)size);
+        auto dst = (uint8_t*)result.buf;
+        size_t pos = 0;
+        while (delta.size > 0) {
+            uint64_t op, len;
+            if (!ReadUVarInt(&delta, &op))
+                error::_throw(error::CorruptData);
+            len = op >> 1;
+            if (len > size - pos)
+                error::_throw(error::CorruptData);
+            if (op & 1) {
+                uint64_t offset;
+                if (!ReadUVarInt(&delta, &offset) || offset > base.size || len > base.size - offset)
+                    error::_throw(error::CorruptData);
+                memcpy(&dst[pos], (const uint8_t*)base.buf + offset, (size_t)len);
+            } else {
+                if (len > delta.size)
+                    error::_throw(error::CorruptData);
+                memcpy(&dst[pos], delta.buf, (size_t)len);
+                delta.moveStart((size_t)len);
+            }
+            pos += (size_t)len;
+        }
+        if (pos != size)
+            error::_throw(error::CorruptData);
+        return result;
+    }
+
+}
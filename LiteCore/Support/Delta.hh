@@ -0,0 +1,34 @@
+//
+// Delta.hh
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+
+namespace litecore {
+
+    /** Encodes `target` as a delta from `base`: a series of instructions that either copy a
+        range of bytes from `base` or insert literal bytes. This works well on encoded Fleece
+        documents that differ in only a few properties, since most of their data is identical.
+        Returns a null slice if the delta would not be smaller than `target` itself. */
+    alloc_slice CreateDelta(slice base, slice target);
+
+    /** Reconstructs the `target` data passed to CreateDelta, given the same `base`.
+        Throws CorruptData if the delta is invalid or doesn't match the base. */
+    alloc_slice ApplyDelta(slice base, slice delta);
+
+}
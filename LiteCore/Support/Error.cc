@@ -149,6 +149,8 @@ namespace litecore {
             "database is in a newer file format than this software supports",
             "invalid document ID",
             "database cannot be upgraded to the current version", // 39
+            "query was cancelled or exceeded its time/step limit", // 40
+            "query results exceeded the memory limit",
         };
         static_assert(sizeof(kLiteCoreMessages)/sizeof(kLiteCoreMessages[0]) ==
                         error::NumLiteCoreErrorsPlus1, "Incomplete error message table");
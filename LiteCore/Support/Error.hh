@@ -85,6 +85,8 @@ namespace litecore {
             DatabaseTooNew,
             BadDocID,
             CantUpgradeDatabase,
+            QueryInterrupted,
+            QueryResultTooLarge,
 
             // Add new codes here. You MUST add messages to kLiteCoreMessages!
             // You MUST add corresponding kC4Err codes to the enum in C4Base.h!
@@ -0,0 +1,703 @@
+//
+// SecureDigest.cc
+//
+// Copyright (c) 2018 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SecureDigest.hh"
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define SHA1_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define SHA1_X86_TARGET
+    #else
+        #include <cpuid.h>
+        #define SHA1_X86_TARGET __attribute__((target("sha,sse4.1")))
+    #endif
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define SHA1_SSE2_LANES 1
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define SHA1_NEON_LANES 1
+    // The SHA1 instructions are only used if the compiler's target includes them:
+    #if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2)
+        #define SHA1_ARMV8 1
+        #if defined(__linux__)
+            #include <sys/auxv.h>
+            #include <asm/hwcap.h>
+        #endif
+    #endif
+#endif
+
+
+namespace litecore {
+    using namespace fleece;
+
+    // Digests `nBlocks` consecutive 64-byte blocks into `state`.
+    typedef void (*CompressFn)(uint32_t state[5], const uint8_t *data, size_t nBlocks);
+
+    static const uint32_t kInitialState[5] = {
+        0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+    };
+    static const uint32_t kK[4] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+
+
+    static inline uint32_t rol(uint32_t x, int n)     {return (x << n) | (x >> (32 - n));}
+
+    static inline uint32_t loadBE32(const uint8_t *p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    static inline void storeBE32(uint8_t *p, uint32_t n) {
+        p[0] = (uint8_t)(n >> 24); p[1] = (uint8_t)(n >> 16); p[2] = (uint8_t)(n >> 8);
+        p[3] = (uint8_t)n;
+    }
+
+    static inline void storeBE64(uint8_t *p, uint64_t n) {
+        storeBE32(p, (uint32_t)(n >> 32));
+        storeBE32(p + 4, (uint32_t)n);
+    }
+
+
+#pragma mark - PORTABLE:
+
+
+    static void compressPortable(uint32_t state[5], const uint8_t *data, size_t nBlocks) {
+        uint32_t w[16];
+        for (; nBlocks > 0; --nBlocks, data += 64) {
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+            for (int t = 0; t < 80; ++t) {
+                uint32_t wt;
+                if (t < 16) {
+                    wt = w[t] = loadBE32(data + 4 * t);
+                } else {
+                    wt = rol(w[(t-3) & 15] ^ w[(t-8) & 15] ^ w[(t-14) & 15] ^ w[t & 15], 1);
+                    w[t & 15] = wt;
+                }
+                uint32_t f;
+                if (t < 20)
+                    f = (b & c) | (~b & d);
+                else if (t < 40 || t >= 60)
+                    f = b ^ c ^ d;
+                else
+                    f = (b & c) | (b & d) | (c & d);
+                uint32_t temp = rol(a, 5) + f + e + kK[t / 20] + wt;
+                e = d; d = c; c = rol(b, 30); b = a; a = temp;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+        }
+    }
+
+
+#pragma mark - X86 SHA-NI:
+
+
+#ifdef SHA1_X86
+    // Based on Intel's "New Instructions Supporting the Secure Hash Algorithm on Intel
+    // Architecture Processors" (2013).
+    SHA1_X86_TARGET
+    static void compressSHANI(uint32_t state[5], const uint8_t *data, size_t nBlocks) {
+        const __m128i kByteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+        __m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+        __m128i E0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+        __m128i E1, MSG0, MSG1, MSG2, MSG3;
+
+        for (; nBlocks > 0; --nBlocks, data += 64) {
+            __m128i ABCD_SAVE = ABCD, E0_SAVE = E0;
+            // Rounds 0-3:
+            MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), kByteSwap);
+            E0 = _mm_add_epi32(E0, MSG0);
+            E1 = ABCD;
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+            // Rounds 4-7:
+            MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), kByteSwap);
+            E1 = _mm_sha1nexte_epu32(E1, MSG1);
+            E0 = ABCD;
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+            MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+            // Rounds 8-11:
+            MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), kByteSwap);
+            E0 = _mm_sha1nexte_epu32(E0, MSG2);
+            E1 = ABCD;
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+            MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+            MSG0 = _mm_xor_si128(MSG0, MSG2);
+            // Rounds 12-15:
+            MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), kByteSwap);
+            E1 = _mm_sha1nexte_epu32(E1, MSG3);
+            E0 = ABCD;
+            MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+            MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+            MSG1 = _mm_xor_si128(MSG1, MSG3);
+            // Rounds 16-19:
+            E0 = _mm_sha1nexte_epu32(E0, MSG0);
+            E1 = ABCD;
+            MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+            MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+            MSG2 = _mm_xor_si128(MSG2, MSG0);
+            // Rounds 20-23:
+            E1 = _mm_sha1nexte_epu32(E1, MSG1);
+            E0 = ABCD;
+            MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+            MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+            MSG3 = _mm_xor_si128(MSG3, MSG1);
+            // Rounds 24-27:
+            E0 = _mm_sha1nexte_epu32(E0, MSG2);
+            E1 = ABCD;
+            MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+            MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+            MSG0 = _mm_xor_si128(MSG0, MSG2);
+            // Rounds 28-31:
+            E1 = _mm_sha1nexte_epu32(E1, MSG3);
+            E0 = ABCD;
+            MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+            MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+            MSG1 = _mm_xor_si128(MSG1, MSG3);
+            // Rounds 32-35:
+            E0 = _mm_sha1nexte_epu32(E0, MSG0);
+            E1 = ABCD;
+            MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+            MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+            MSG2 = _mm_xor_si128(MSG2, MSG0);
+            // Rounds 36-39:
+            E1 = _mm_sha1nexte_epu32(E1, MSG1);
+            E0 = ABCD;
+            MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+            MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+            MSG3 = _mm_xor_si128(MSG3, MSG1);
+            // Rounds 40-43:
+            E0 = _mm_sha1nexte_epu32(E0, MSG2);
+            E1 = ABCD;
+            MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+            MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+            MSG0 = _mm_xor_si128(MSG0, MSG2);
+            // Rounds 44-47:
+            E1 = _mm_sha1nexte_epu32(E1, MSG3);
+            E0 = ABCD;
+            MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+            MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+            MSG1 = _mm_xor_si128(MSG1, MSG3);
+            // Rounds 48-51:
+            E0 = _mm_sha1nexte_epu32(E0, MSG0);
+            E1 = ABCD;
+            MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+            MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+            MSG2 = _mm_xor_si128(MSG2, MSG0);
+            // Rounds 52-55:
+            E1 = _mm_sha1nexte_epu32(E1, MSG1);
+            E0 = ABCD;
+            MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+            MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+            MSG3 = _mm_xor_si128(MSG3, MSG1);
+            // Rounds 56-59:
+            E0 = _mm_sha1nexte_epu32(E0, MSG2);
+            E1 = ABCD;
+            MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+            MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+            MSG0 = _mm_xor_si128(MSG0, MSG2);
+            // Rounds 60-63:
+            E1 = _mm_sha1nexte_epu32(E1, MSG3);
+            E0 = ABCD;
+            MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+            MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+            MSG1 = _mm_xor_si128(MSG1, MSG3);
+            // Rounds 64-67:
+            E0 = _mm_sha1nexte_epu32(E0, MSG0);
+            E1 = ABCD;
+            MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+            MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+            MSG2 = _mm_xor_si128(MSG2, MSG0);
+            // Rounds 68-71:
+            E1 = _mm_sha1nexte_epu32(E1, MSG1);
+            E0 = ABCD;
+            MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+            MSG3 = _mm_xor_si128(MSG3, MSG1);
+            // Rounds 72-75:
+            E0 = _mm_sha1nexte_epu32(E0, MSG2);
+            E1 = ABCD;
+            MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+            // Rounds 76-79:
+            E1 = _mm_sha1nexte_epu32(E1, MSG3);
+            E0 = ABCD;
+            ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+
+            E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+            ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+        }
+
+        _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(ABCD, 0x1B));
+        state[4] = (uint32_t)_mm_extract_epi32(E0, 3);
+    }
+
+
+    static bool cpuHasSHA() {
+        // Need SSSE3 and SSE4.1 (CPUID leaf 1, ECX bits 9 and 19), and SHA (leaf 7, EBX bit 29).
+    #if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        uint32_t ecx1 = (uint32_t)info[2];
+        __cpuidex(info, 7, 0);
+        uint32_t ebx7 = (uint32_t)info[1];
+    #else
+        if (__get_cpuid_max(0, nullptr) < 7)
+            return false;
+        unsigned eax, ebx, ecx, edx, ecx1, ebx7;
+        __cpuid(1, eax, ebx, ecx1, edx);
+        __cpuid_count(7, 0, eax, ebx7, ecx, edx);
+    #endif
+        return (ecx1 & (1u << 9)) && (ecx1 & (1u << 19)) && (ebx7 & (1u << 29));
+    }
+#endif
+
+
+#pragma mark - ARMV8 SHA1:
+
+
+#ifdef SHA1_ARMV8
+    static void compressARMv8(uint32_t state[5], const uint8_t *data, size_t nBlocks) {
+        uint32x4_t ABCD = vld1q_u32(&state[0]);
+        uint32_t E0 = state[4], E1;
+        uint32x4_t TMP0, TMP1, MSG0, MSG1, MSG2, MSG3;
+
+        for (; nBlocks > 0; --nBlocks, data += 64) {
+            uint32x4_t ABCD_SAVE = ABCD;
+            uint32_t E0_SAVE = E0;
+
+            MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+            MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+            MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+            MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+            TMP0 = vaddq_u32(MSG0, vdupq_n_u32(kK[0]));
+            TMP1 = vaddq_u32(MSG1, vdupq_n_u32(kK[0]));
+
+            // Rounds 0-3:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG2, vdupq_n_u32(kK[0]));
+            MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+            // Rounds 4-7:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG3, vdupq_n_u32(kK[0]));
+            MSG0 = vsha1su1q_u32(MSG0, MSG3);
+            MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+            // Rounds 8-11:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG0, vdupq_n_u32(kK[0]));
+            MSG1 = vsha1su1q_u32(MSG1, MSG0);
+            MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+            // Rounds 12-15:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG1, vdupq_n_u32(kK[1]));
+            MSG2 = vsha1su1q_u32(MSG2, MSG1);
+            MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+            // Rounds 16-19:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG2, vdupq_n_u32(kK[1]));
+            MSG3 = vsha1su1q_u32(MSG3, MSG2);
+            MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+            // Rounds 20-23:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG3, vdupq_n_u32(kK[1]));
+            MSG0 = vsha1su1q_u32(MSG0, MSG3);
+            MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+            // Rounds 24-27:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG0, vdupq_n_u32(kK[1]));
+            MSG1 = vsha1su1q_u32(MSG1, MSG0);
+            MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+            // Rounds 28-31:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG1, vdupq_n_u32(kK[1]));
+            MSG2 = vsha1su1q_u32(MSG2, MSG1);
+            MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+            // Rounds 32-35:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG2, vdupq_n_u32(kK[2]));
+            MSG3 = vsha1su1q_u32(MSG3, MSG2);
+            MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+            // Rounds 36-39:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG3, vdupq_n_u32(kK[2]));
+            MSG0 = vsha1su1q_u32(MSG0, MSG3);
+            MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+            // Rounds 40-43:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG0, vdupq_n_u32(kK[2]));
+            MSG1 = vsha1su1q_u32(MSG1, MSG0);
+            MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+            // Rounds 44-47:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG1, vdupq_n_u32(kK[2]));
+            MSG2 = vsha1su1q_u32(MSG2, MSG1);
+            MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+            // Rounds 48-51:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG2, vdupq_n_u32(kK[2]));
+            MSG3 = vsha1su1q_u32(MSG3, MSG2);
+            MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+            // Rounds 52-55:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG3, vdupq_n_u32(kK[3]));
+            MSG0 = vsha1su1q_u32(MSG0, MSG3);
+            MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+            // Rounds 56-59:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG0, vdupq_n_u32(kK[3]));
+            MSG1 = vsha1su1q_u32(MSG1, MSG0);
+            MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+            // Rounds 60-63:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG1, vdupq_n_u32(kK[3]));
+            MSG2 = vsha1su1q_u32(MSG2, MSG1);
+            MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+            // Rounds 64-67:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+            TMP0 = vaddq_u32(MSG2, vdupq_n_u32(kK[3]));
+            MSG3 = vsha1su1q_u32(MSG3, MSG2);
+            // Rounds 68-71:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+            TMP1 = vaddq_u32(MSG3, vdupq_n_u32(kK[3]));
+            // Rounds 72-75:
+            E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+            // Rounds 76-79:
+            E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+            ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+
+            E0 += E0_SAVE;
+            ABCD = vaddq_u32(ABCD, ABCD_SAVE);
+        }
+
+        vst1q_u32(&state[0], ABCD);
+        state[4] = E0;
+    }
+
+
+    static bool cpuHasSHA() {
+    #if defined(__linux__) && defined(HWCAP_SHA1)
+        return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+    #else
+        return true;        // The compiler was told the target CPU has it
+    #endif
+    }
+#endif
+
+
+#pragma mark - DISPATCH:
+
+
+    static CompressFn hardwareCompressor() {
+    #if defined(SHA1_X86)
+        static const CompressFn fn = cpuHasSHA() ? &compressSHANI : nullptr;
+    #elif defined(SHA1_ARMV8)
+        static const CompressFn fn = cpuHasSHA() ? &compressARMv8 : nullptr;
+    #else
+        static const CompressFn fn = nullptr;
+    #endif
+        return fn;
+    }
+
+    static std::atomic<bool> sHardwareEnabled {true};
+
+    static CompressFn compressor() {
+        CompressFn fn = sHardwareEnabled.load(std::memory_order_relaxed) ? hardwareCompressor()
+                                                                          : nullptr;
+        return fn ? fn : &compressPortable;
+    }
+
+
+    bool SHA1Digester::hardwareAccelerated() {
+        return sHardwareEnabled && hardwareCompressor() != nullptr;
+    }
+
+
+    void SHA1Digester::enableHardware(bool enable) {
+        sHardwareEnabled = enable;
+    }
+
+
+    void SHA1Digester::begin() {
+        memcpy(_state, kInitialState, sizeof(_state));
+        _length = 0;
+    }
+
+
+    void SHA1Digester::add(const void *bytes, size_t length) {
+        auto data = (const uint8_t*)bytes;
+        size_t buffered = _length % 64;
+        _length += length;
+        CompressFn compress = compressor();
+        if (buffered > 0) {
+            size_t n = std::min(length, 64 - buffered);
+            memcpy(_buffer + buffered, data, n);
+            data += n;
+            length -= n;
+            if (buffered + n < 64)
+                return;
+            compress(_state, _buffer, 1);
+        }
+        if (length >= 64) {
+            compress(_state, data, length / 64);
+            data += length & ~(size_t)63;
+            length %= 64;
+        }
+        if (length > 0)
+            memcpy(_buffer, data, length);
+    }
+
+
+    void SHA1Digester::end(void *outDigest) {
+        uint8_t padding[72] = {0x80};
+        size_t buffered = _length % 64;
+        size_t padLength = (buffered < 56 ? 56 : 120) - buffered;
+        storeBE64(&padding[padLength], _length * 8);
+        add(padding, padLength + 8);
+        for (int i = 0; i < 5; ++i)
+            storeBE32((uint8_t*)outDigest + 4 * i, _state[i]);
+    }
+
+
+#pragma mark - MULTI-BUFFER:
+
+
+#if defined(SHA1_SSE2_LANES) || defined(SHA1_NEON_LANES)
+
+    // SIMD operations on 4 lanes of 32-bit words:
+#ifdef SHA1_SSE2_LANES
+    typedef __m128i Lanes;
+    static inline Lanes lanesOf(uint32_t n)             {return _mm_set1_epi32((int)n);}
+    static inline Lanes load(const uint32_t *w)         {return _mm_loadu_si128((const __m128i*)w);}
+    static inline void store(uint32_t *w, Lanes v)      {_mm_storeu_si128((__m128i*)w, v);}
+    static inline Lanes add(Lanes a, Lanes b)           {return _mm_add_epi32(a, b);}
+    static inline Lanes xor_(Lanes a, Lanes b)          {return _mm_xor_si128(a, b);}
+    static inline Lanes and_(Lanes a, Lanes b)          {return _mm_and_si128(a, b);}
+    static inline Lanes or_(Lanes a, Lanes b)           {return _mm_or_si128(a, b);}
+    static inline Lanes andNot(Lanes a, Lanes b)        {return _mm_andnot_si128(a, b);} // ~a & b
+    template <int N>
+    static inline Lanes rol(Lanes a) {
+        return _mm_or_si128(_mm_slli_epi32(a, N), _mm_srli_epi32(a, 32 - N));
+    }
+#else
+    typedef uint32x4_t Lanes;
+    static inline Lanes lanesOf(uint32_t n)             {return vdupq_n_u32(n);}
+    static inline Lanes load(const uint32_t *w)         {return vld1q_u32(w);}
+    static inline void store(uint32_t *w, Lanes v)      {vst1q_u32(w, v);}
+    static inline Lanes add(Lanes a, Lanes b)           {return vaddq_u32(a, b);}
+    static inline Lanes xor_(Lanes a, Lanes b)          {return veorq_u32(a, b);}
+    static inline Lanes and_(Lanes a, Lanes b)          {return vandq_u32(a, b);}
+    static inline Lanes or_(Lanes a, Lanes b)           {return vorrq_u32(a, b);}
+    static inline Lanes andNot(Lanes a, Lanes b)        {return vbicq_u32(b, a);}       // ~a & b
+    template <int N>
+    static inline Lanes rol(Lanes a) {
+        return vorrq_u32(vshlq_n_u32(a, N), vshrq_n_u32(a, 32 - N));
+    }
+#endif
+
+    static const int kLanes = 4;
+
+
+    // Digests one 64-byte block in each lane. state[i][lane] is word i of that lane's state.
+    static void compressLanes(uint32_t state[5][kLanes], const uint8_t* const blocks[kLanes]) {
+        Lanes w[16];
+        for (int t = 0; t < 16; ++t) {
+            uint32_t words[kLanes];
+            for (int lane = 0; lane < kLanes; ++lane)
+                words[lane] = loadBE32(blocks[lane] + 4 * t);
+            w[t] = load(words);
+        }
+        Lanes a = load(state[0]), b = load(state[1]), c = load(state[2]),
+              d = load(state[3]), e = load(state[4]);
+        for (int t = 0; t < 80; ++t) {
+            if (t >= 16)
+                w[t & 15] = rol<1>(xor_(xor_(w[(t-3) & 15], w[(t-8) & 15]),
+                                        xor_(w[(t-14) & 15], w[t & 15])));
+            Lanes f;
+            if (t < 20)
+                f = or_(and_(b, c), andNot(b, d));
+            else if (t < 40 || t >= 60)
+                f = xor_(xor_(b, c), d);
+            else
+                f = or_(or_(and_(b, c), and_(b, d)), and_(c, d));
+            Lanes temp = add(add(rol<5>(a), f), add(add(e, lanesOf(kK[t / 20])), w[t & 15]));
+            e = d; d = c; c = rol<30>(b); b = a; a = temp;
+        }
+        store(state[0], add(a, load(state[0])));
+        store(state[1], add(b, load(state[1])));
+        store(state[2], add(c, load(state[2])));
+        store(state[3], add(d, load(state[3])));
+        store(state[4], add(e, load(state[4])));
+    }
+
+
+    // Produces the padded 64-byte blocks of a message made of several pieces.
+    class BlockReader {
+    public:
+        BlockReader(const slice *pieces, size_t nPieces)
+        :_piece(pieces), _end(pieces + nPieces)
+        { }
+
+        // Copies the next block to `block`; returns false if the message has been consumed.
+        bool next(uint8_t block[64]) {
+            size_t n = 0;
+            if (_phase == kData) {
+                while (n < 64 && _piece < _end) {
+                    size_t count = std::min(_piece->size - _offset, 64 - n);
+                    memcpy(block + n, (const uint8_t*)_piece->buf + _offset, count);
+                    n += count;
+                    _offset += count;
+                    if (_offset == _piece->size) {
+                        ++_piece;
+                        _offset = 0;
+                    }
+                }
+                _length += n;
+                if (n == 64)
+                    return true;
+                block[n++] = 0x80;
+                _phase = kPadding;
+            } else if (_phase == kDone) {
+                return false;
+            }
+            // Padding: zeros, then the message length in bits (in the next block if no room):
+            if (n > 56) {
+                memset(block + n, 0, 64 - n);
+                return true;
+            }
+            memset(block + n, 0, 56 - n);
+            storeBE64(block + 56, _length * 8);
+            _phase = kDone;
+            return true;
+        }
+
+    private:
+        enum Phase {kData, kPadding, kDone};
+
+        const slice *_piece, *_end;
+        size_t _offset {0};
+        uint64_t _length {0};
+        Phase _phase {kData};
+    };
+
+
+    static void digestManyInLanes(const slice pieces[], size_t piecesPerMessage,
+                                  size_t nMessages, uint8_t *outDigests)
+    {
+        uint32_t state[5][kLanes];
+        uint8_t buffers[kLanes][64];
+        const uint8_t* blocks[kLanes];
+        BlockReader readers[kLanes] = {{nullptr, 0}, {nullptr, 0}, {nullptr, 0}, {nullptr, 0}};
+        size_t messageOf[kLanes];
+        bool busy[kLanes] = {};
+        size_t nextMessage = 0;
+
+        for (int lane = 0; lane < kLanes; ++lane)
+            blocks[lane] = buffers[lane];
+        for (;;) {
+            // Get the next block for each lane, starting new messages in lanes that finished:
+            int nBusy = 0;
+            for (int lane = 0; lane < kLanes; ++lane) {
+                while (!(busy[lane] && readers[lane].next(buffers[lane]))) {
+                    if (busy[lane]) {
+                        uint8_t *digest = outDigests + 20 * messageOf[lane];
+                        for (int i = 0; i < 5; ++i)
+                            storeBE32(digest + 4 * i, state[i][lane]);
+                        busy[lane] = false;
+                    }
+                    if (nextMessage >= nMessages)
+                        break;
+                    messageOf[lane] = nextMessage;
+                    readers[lane] = BlockReader(&pieces[nextMessage * piecesPerMessage],
+                                                piecesPerMessage);
+                    for (int i = 0; i < 5; ++i)
+                        state[i][lane] = kInitialState[i];
+                    busy[lane] = true;
+                    ++nextMessage;
+                }
+                if (busy[lane])
+                    ++nBusy;
+            }
+            if (nBusy == 0)
+                break;
+            // (Idle lanes just digest whatever is in their buffer; the result is ignored.)
+            compressLanes(state, blocks);
+        }
+    }
+
+#endif // SHA1_SSE2_LANES || SHA1_NEON_LANES
+
+
+    void SHA1Digester::digestMany(const slice pieces[], size_t piecesPerMessage,
+                                  size_t nMessages, void *outDigests)
+    {
+        auto digests = (uint8_t*)outDigests;
+#if defined(SHA1_SSE2_LANES) || defined(SHA1_NEON_LANES)
+        // The SHA instructions beat SIMD lanes, so only use lanes without them:
+        if (nMessages > 1 && !hardwareAccelerated()) {
+            digestManyInLanes(pieces, piecesPerMessage, nMessages, digests);
+            return;
+        }
+#endif
+        for (size_t m = 0; m < nMessages; ++m) {
+            SHA1Digester digester;
+            digester.begin();
+            for (size_t i = 0; i < piecesPerMessage; ++i, ++pieces)
+                digester.add(pieces->buf, pieces->size);
+            digester.end(digests + 20 * m);
+        }
+    }
+
+}
@@ -17,6 +17,44 @@
 //
 
 #pragma once
+#include "slice.hh"
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace litecore {
+
+    /** LiteCore's own SHA-1 implementation (SecureDigest.cc). It uses the CPU's SHA instructions
+        (x86 SHA-NI or ARMv8 SHA1) when they're available, detected at runtime. It's used as the
+        sha1Context on platforms whose crypto library doesn't already do that. */
+    class SHA1Digester {
+    public:
+        void begin();
+        void add(const void *bytes, size_t length);
+        void end(void *outDigest);
+
+        /** Computes the digests of `nMessages` messages, each of which is the concatenation of
+            `piecesPerMessage` consecutive slices in `pieces`. The 20-byte digests are written
+            consecutively to `outDigests`. This is faster than digesting one at a time: without
+            SHA instructions it hashes several messages at once in parallel SIMD lanes. */
+        static void digestMany(const fleece::slice pieces[],
+                               size_t piecesPerMessage,
+                               size_t nMessages,
+                               void *outDigests);
+
+        /** True if the CPU's SHA-1 instructions are being used. */
+        static bool hardwareAccelerated();
+
+        /** Enables/disables use of the CPU's SHA instructions, for testing the fallbacks. */
+        static void enableHardware(bool);
+
+    private:
+        uint32_t _state[5];
+        uint64_t _length;               // Total number of bytes added
+        uint8_t  _buffer[64];           // Partial block not yet digested
+    };
+
+}
 
 
 #if defined(_CRYPTO_CC)
@@ -118,7 +156,6 @@
     
 #elif defined(_CRYPTO_MBEDTLS)
     #include <mbedtls/md5.h>
-    #include <mbedtls/sha1.h>
     #include <mbedtls/sha256.h>
 
     typedef mbedtls_md5_context md5Context;
@@ -136,18 +173,17 @@
     }
 
 
-    typedef mbedtls_sha1_context sha1Context;
+    // mbedTLS's SHA-1 is plain C, so use LiteCore's, which can use the CPU's SHA instructions:
+    typedef litecore::SHA1Digester sha1Context;
 
     static inline void sha1_begin(sha1Context *ctx) {
-        mbedtls_sha1_init(ctx);
-        mbedtls_sha1_starts(ctx);
+        ctx->begin();
     }
     static inline void sha1_add(sha1Context *ctx, const void *bytes, size_t length) {
-        mbedtls_sha1_update(ctx, (unsigned char*)bytes, length);
+        ctx->add(bytes, length);
     }
     static inline void sha1_end(sha1Context *ctx, void *outDigest) {
-        mbedtls_sha1_finish(ctx, (unsigned char *)outDigest);
-        mbedtls_sha1_free(ctx);
+        ctx->end(outDigest);
     }
 
 
@@ -150,6 +150,38 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile EnumerateDocs", "[DataFil
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile ReadMany", "[DataFile]") {
+    createNumberedDocs(store);
+
+    for (int metaOnly=0; metaOnly <= 1; ++metaOnly) {
+        INFO("Read many docs, metaOnly=" << metaOnly);
+        // More keys than fit in one query; half of them are missing, and one is repeated:
+        vector<Record> recs;
+        for (int i = 0; i < 250; i++)
+            recs.emplace_back(slice(stringWithFormat("rec-%03d", i)));
+        recs.emplace_back("rec-050"_sl);
+        store->readMany(recs, metaOnly ? kMetaOnly : kDefaultContent);
+
+        for (int i = 0; i < 251; i++) {
+            const Record &rec = recs[i];
+            int n = (i < 250) ? i : 50;
+            INFO("Record " << rec.key().asString());
+            if (n >= 1 && n <= 100) {
+                CHECK(rec.exists());
+                CHECK(rec.sequence() == (sequence_t)n);
+                if (metaOnly)
+                    CHECK(rec.body() == nullslice);
+                else
+                    CHECK(rec.body() == rec.key());
+            } else {
+                CHECK(!rec.exists());
+                CHECK(rec.sequence() == 0);
+            }
+        }
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile EnumerateDocsDescending", "[DataFile]") {
     RecordEnumerator::Options opts;
     opts.descending = true;
@@ -286,6 +318,26 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile DeleteDocAndReopen", "[Da
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile RequireNewFormat", "[DataFile]") {
+    auto userVersion = [&]() {
+        alloc_slice result = db->rawQuery("PRAGMA user_version");
+        return Value::fromTrustedData(result)->asArray()->get(0)->asArray()->get(0)->asInt();
+    };
+    CHECK(userVersion() == 201);
+    {
+        Transaction t(db);
+        db->requireNewFormat();
+        db->requireNewFormat();
+        t.commit();
+    }
+    CHECK(userVersion() == 300);
+
+    // This version can still open the file:
+    reopenDatabase();
+    CHECK(userVersion() == 300);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile KeyStoreInfo", "[DataFile]") {
     KeyStore &s = db->getKeyStore("store");
     REQUIRE(s.lastSequence() == 0);
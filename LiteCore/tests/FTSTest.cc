@@ -161,3 +161,32 @@ TEST_CASE_METHOD(FTSTest, "Query Full-Text Custom stop-words", "[Query][FTS]") {
               {4, 2});
 }
 
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text FTS5", "[Query][FTS]") {
+    SECTION("New index") {
+    }
+    SECTION("Migrate FTS4 index") {
+        createIndex({"english", true});
+    }
+    createIndex({"english", true, false, nullptr, nullptr, true});
+    testQuery(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['.sentence']],\
+                        WHAT: [['.sentence']]}]",
+              {0, 1, 4, 2},
+              {1, 3, 1, 3});
+
+    // rank() uses BM25, and better matches still get higher ranks:
+    Retained<Query> query{ store->compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['rank()', 'sentence']]],\
+                        WHAT: [['rank()', 'sentence']]}]")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    unsigned rows = 0;
+    while (e->next()) {
+        CHECK(e->columns()[0]->asDouble() > 0.0);
+        ++rows;
+    }
+    CHECK(rows == 4);
+}
@@ -90,6 +90,32 @@ TEST_CASE("QueryParser basic", "[Query]") {
 }
 
 
+TEST_CASE("QueryParser commuted comparisons", "[Query]") {
+    CHECK(parseWhere("['=', 'Smith', ['.', 'last']]")
+          == "fl_value(body, 'last') = 'Smith'");
+    CHECK(parseWhere("['<', 18, ['.', 'age']]")
+          == "fl_value(body, 'age') > 18");
+    // IS and IS NOT aren't commuted, since a null on the right would change their meaning:
+    CHECK(parseWhere("['IS NOT', null, ['.', 'age']]")
+          == "x'' IS NOT fl_value(body, 'age')");
+    CHECK(parseWhere("['IS', null, ['.', 'age']]")
+          == "x'' IS fl_value(body, 'age')");
+    CHECK(parseWhere("['LIKE', 'S%', ['.', 'last']]")
+          == "'S%' LIKE fl_value(body, 'last')");
+}
+
+
+TEST_CASE("QueryParser partial index", "[Query]") {
+    QueryParser qp("kv_default");
+    alloc_slice exprs = JSONConverter::convertJSON(json5("[['.', 'price']]"));
+    alloc_slice where = JSONConverter::convertJSON(json5("['=', 'product', ['.', 'type']]"));
+    qp.writeCreateIndex("prices", Value::fromTrustedData(exprs)->asArray(),
+                        Value::fromTrustedData(where));
+    CHECK(qp.SQL() == "CREATE INDEX \"prices\" ON kv_default (fl_value(body, 'price')) "
+                      "WHERE (fl_value(body, 'type') = 'product') AND (flags & 1) = 0");
+}
+
+
 TEST_CASE("QueryParser bindings", "[Query]") {
     CHECK(parseWhere("['=', ['$', 'X'], ['$', 7]]")
           == "$_X = $_7");
@@ -133,6 +159,40 @@ TEST_CASE("QueryParser ANY", "[Query]") {
 }
 
 
+TEST_CASE("QueryParser ANY with array index", "[Query]") {
+    auto parseIndexed = [](string json) {
+        QueryParser qp("kv_default");
+        qp.setTableExistsCallback([](const string &table) {
+            return table == "kv_default:unnest:names";
+        });
+        alloc_slice fleece = JSONConverter::convertJSON(json5(json));
+        qp.parseJustExpression(Value::fromTrustedData(fleece));
+        return qp.SQL();
+    };
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['=', ['?', 'X'], 'Smith']]")
+          == "kv_default.rowid IN (SELECT docid FROM \"kv_default:unnest:names\" WHERE value = 'Smith')");
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['=', ['$name'], ['?X']]]")
+          == "kv_default.rowid IN (SELECT docid FROM \"kv_default:unnest:names\" WHERE value = $_name)");
+    // These can't use the index:
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'names'], ['=', ['?', 'X', 'last'], 'Smith']]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE fl_nested_value(_X.pointer, 'last') = 'Smith')");
+    CHECK(parseIndexed("['EVERY', 'X', ['.', 'names'], ['=', ['?', 'X'], 'Smith']]")
+          == "NOT EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE NOT (_X.value = 'Smith'))");
+    CHECK(parseIndexed("['ANY', 'X', ['.', 'aliases'], ['=', ['?', 'X'], 'Smith']]")
+          == "EXISTS (SELECT 1 FROM fl_each(body, 'aliases') AS _X WHERE _X.value = 'Smith')");
+}
+
+
+TEST_CASE("QueryParser geo", "[Query]") {
+    CHECK(parseWhere("['GEO_WITHIN', 'geo', -123, 37, -122, 38]")
+          == "kv_default.rowid IN (SELECT id FROM \"kv_default::geo\" WHERE minLon >= -123 AND minLat >= 37 AND maxLon <= -122 AND maxLat <= 38)");
+    CHECK(parseWhere("['GEO_NEAR', 'geo', ['$lon'], ['$lat'], 500]")
+          == "kv_default.rowid IN (SELECT id FROM \"kv_default::geo\" WHERE id MATCH geo_radius($_lon, $_lat, 500))");
+    CHECK(parseWhere("['<', ['geo_distance()', ['.lon'], ['.lat'], 0, 0], 1000]")
+          == "geo_distance(fl_value(body, 'lon'), fl_value(body, 'lat'), 0, 0) < 1000");
+}
+
+
 TEST_CASE("QueryParser ANY complex", "[Query]") {
     CHECK(parseWhere("['ANY', 'X', ['.', 'names'], ['=', ['?', 'X', 'last'], 'Smith']]")
           == "EXISTS (SELECT 1 FROM fl_each(body, 'names') AS _X WHERE fl_nested_value(_X.pointer, 'last') = 'Smith')");
@@ -233,6 +293,40 @@ TEST_CASE("QueryParser Collate", "[Query][Collation]") {
 }
 
 
+TEST_CASE("QueryParser Collate sort keys", "[Query][Collation]") {
+    // An index of sort keys:
+    QueryParser qp("kv_default");
+    qp.setUnicodeSortKeys(true);
+    alloc_slice exprs = JSONConverter::convertJSON(json5(
+                            "[['COLLATE', {'unicode':true, 'case':false}, ['.name']]]"));
+    qp.writeCreateIndex("names", Value::fromTrustedData(exprs)->asArray());
+    CHECK(qp.SQL() == "CREATE INDEX \"names\" ON kv_default "
+                      "(unicode_sortkey(fl_value(body, 'name'), 'LCUnicode_C__'))");
+
+    // A query sorts by sort key only if there's an index of them:
+    string query = "{WHAT: ['._id'], \
+                 ORDER_BY: [['DESC', ['COLLATE', {'unicode':true, 'case':false}, ['.name']]]]}";
+    CHECK(parse(query) == "SELECT fl_result(key) FROM kv_default WHERE (flags & 1) = 0 "
+                          "ORDER BY fl_value(body, 'name') COLLATE LCUnicode_C__ DESC");
+
+    QueryParser qp2("kv_default");
+    vector<string> checked;
+    qp2.setIndexedExpressionCallback([&](const string &sql) {
+        checked.push_back(sql);
+        return true;
+    });
+    qp2.parseJSON(json5(query));
+    CHECK(qp2.SQL() == "SELECT fl_result(key) FROM kv_default WHERE (flags & 1) = 0 "
+                       "ORDER BY unicode_sortkey(fl_value(body, 'name'), 'LCUnicode_C__') DESC");
+    CHECK(checked == vector<string>{"unicode_sortkey(fl_value(body, 'name'), 'LCUnicode_C__')"});
+
+    // ...and not for a collated comparison:
+    checked.clear();
+    qp2.parseJSON(json5("{WHERE: ['COLLATE', {'unicode':true}, ['<', ['.name'], 'M']]}"));
+    CHECK(checked.empty());
+}
+
+
 TEST_CASE("QueryParser errors", "[Query][!throws]") {
     mustFail("['poop()', 1]");
     mustFail("['power()', 1]");
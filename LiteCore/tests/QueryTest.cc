@@ -17,12 +17,21 @@
 //
 
 #include "DataFile.hh"
+#include "SQLiteDataFile.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
 #include "Query.hh"
+#include "IndexAdvisor.hh"
 #include "Error.hh"
+#include "StringUtil.hh"
 #include "Fleece.hh"
 #include "Benchmark.hh"
 
 #include "LiteCoreTest.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
 
 using namespace litecore;
 using namespace std;
@@ -230,6 +239,317 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query SELECT", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(DataFileTestFixture, "Query partial index", "[Query]") {
+    addNumberedDocs(store);
+    string whereJSON = json5("['<', ['.num'], 50]");
+    KeyStore::IndexOptions options {};
+    options.where = whereJSON.c_str();
+    store->createIndex("lowNums"_sl, "[[\".num\"]]"_sl, KeyStore::kValueIndex, &options);
+
+    auto indexUsed = [&](const char *where) {
+        Retained<Query> query{ store->compileQuery(json5(where)) };
+        return query->explain().find("USING INDEX lowNums") != string::npos;
+    };
+    // Queries whose WHERE clause implies the index's can use it:
+    CHECK(indexUsed("['AND', ['<', ['.num'], 50], ['>', ['.num'], 40]]"));
+    CHECK(indexUsed("['AND', ['>', 50, ['.num']], ['>', ['.num'], 40]]"));
+    // ...others can't:
+    CHECK(!indexUsed("['>', ['.num'], 40]"));
+
+    Retained<Query> query{ store->compileQuery(json5(
+                                    "['AND', ['<', ['.num'], 50], ['>', ['.num'], 40]]")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 9);
+
+    // A WHERE clause is only allowed on value indexes:
+    ExpectException(error::Domain::LiteCore, error::LiteCoreError::InvalidParameter, [&] {
+        store->createIndex("lowNumsFTS"_sl, "[[\".num\"]]"_sl, KeyStore::kFullTextIndex, &options);
+    });
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query array index", "[Query]") {
+    auto writeTaggedDoc = [&](slice docID, vector<string> tags, Transaction &t) {
+        fleece::Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("tags");
+        enc.beginArray();
+        for (auto &tag : tags)
+            enc.writeString(tag);
+        enc.endArray();
+        enc.endDictionary();
+        alloc_slice body = enc.extractOutput();
+        store->set(docID, nullslice, body, DocumentFlags::kNone, t);
+    };
+    {
+        Transaction t(store->dataFile());
+        writeTaggedDoc("a"_sl, {"red", "green"}, t);
+        writeTaggedDoc("b"_sl, {"blue"}, t);
+        t.commit();
+    }
+    store->createIndex("tags"_sl, "[[\".tags\"]]"_sl, KeyStore::kArrayIndex);
+    CHECK(extractIndexes(store->getIndexes()) == vector<string>{"tags"});
+    {
+        Transaction t(store->dataFile());
+        writeTaggedDoc("c"_sl, {"green", "blue"}, t);
+        writeTaggedDoc("b"_sl, {"yellow"}, t);
+        store->del("a"_sl, t);
+        t.commit();
+    }
+
+    Retained<Query> query{ store->compileQuery(json5(
+                    "{WHAT: ['._id'], WHERE: ['ANY', 'T', ['.tags'], ['=', ['?T'], ['$tag']]],"
+                    " ORDER_BY: ['._id']}")) };
+    CHECK(query->explain().find("kv_default:unnest:tags") != string::npos);
+    auto run = [&](const char *tag) {
+        Query::Options options;
+        string params = format("{\"tag\": \"%s\"}", tag);
+        options.paramBindings = alloc_slice(slice(params));
+        unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        vector<string> docIDs;
+        while (e->next())
+            docIDs.push_back(e->columns()[0]->asString().asString());
+        return docIDs;
+    };
+    CHECK(run("green") == vector<string>{"c"});
+    CHECK(run("blue") == vector<string>{"c"});
+    CHECK(run("yellow") == vector<string>{"b"});
+    CHECK(run("red").empty());
+
+    // Replacing a doc's body removes its old items from the index:
+    {
+        Transaction t(store->dataFile());
+        writeTaggedDoc("c"_sl, {"green"}, t);
+        t.commit();
+    }
+    CHECK(run("blue").empty());
+    CHECK(run("green") == vector<string>{"c"});
+
+    store->deleteIndex("tags"_sl);
+    CHECK(extractIndexes(store->getIndexes()).empty());
+    // (The side table's own docid index doesn't keep it alive:)
+    CHECK(!((SQLiteDataFile*)db)->tableExists("kv_default:unnest:tags"));
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query trigram index", "[Query]") {
+    auto writeJSONDoc = [&](slice docID, const char *json, Transaction &t) {
+        alloc_slice body = JSONConverter::convertJSON(json5(json));
+        store->set(docID, nullslice, body, DocumentFlags::kNone, t);
+    };
+    {
+        Transaction t(store->dataFile());
+        writeJSONDoc("a"_sl, "{name: 'banana'}", t);
+        writeJSONDoc("b"_sl, "{name: 'bandana'}", t);
+        writeJSONDoc("c"_sl, "{name: 'cabana'}", t);
+        writeJSONDoc("d"_sl, "{name: 'apple'}", t);
+        t.commit();
+    }
+    store->createIndex("names"_sl, "[[\".name\"]]"_sl, KeyStore::kTrigramIndex);
+    CHECK(extractIndexes(store->getIndexes()) == vector<string>{"names"});
+    {
+        Transaction t(store->dataFile());
+        writeJSONDoc("d"_sl, "{name: 'pineapple'}", t);
+        writeJSONDoc("e"_sl, "{name: 12345}", t);
+        writeJSONDoc("f"_sl, "{name: 'savannah'}", t);
+        store->del("c"_sl, t);
+        t.commit();
+    }
+
+    auto run = [&](const char *where, bool indexed) -> vector<string> {
+        Retained<Query> query{ store->compileQuery(json5(
+                    format("{WHAT: ['._id'], WHERE: %s, ORDER_BY: ['._id']}", where))) };
+        CHECK((query->explain().find("kv_default:trigram:name") != string::npos) == indexed);
+        unique_ptr<QueryEnumerator> e(query->createEnumerator());
+        vector<string> docIDs;
+        while (e->next())
+            docIDs.push_back(e->columns()[0]->asString().asString());
+        return docIDs;
+    };
+    CHECK(run("['LIKE', ['.name'], '%ana%']", true) == (vector<string>{"a", "b"}));
+    CHECK(run("['LIKE', ['.name'], '%and_na']", true) == (vector<string>{"b"}));
+    CHECK(run("['LIKE', ['.name'], '%234%']", true) == (vector<string>{"e"}));
+    CHECK(run("['contains()', ['.name'], 'apple']", true) == (vector<string>{"d"}));
+    CHECK(run("['regexp_contains()', ['.name'], 'sav+an+ah$']", true) == (vector<string>{"f"}));
+    // An escape's operands aren't literal characters; these patterns spell "a" in hex:
+    CHECK(run("['regexp_like()', ['.name'], 'ban\\\\x61n\\\\u0061']", true)
+          == (vector<string>{"a"}));
+    CHECK(run("['regexp_contains()', ['.name'], 'sav\\\\x61nn\\\\x61h']", true)
+          == (vector<string>{"f"}));
+    CHECK(run("['AND', ['LIKE', ['.name'], 'b%'], ['contains()', ['.name'], 'nan']]", true)
+          == (vector<string>{"a"}));
+    // Patterns without a three-byte literal, and negated or OR'd tests, can't use the index:
+    CHECK(run("['LIKE', ['.name'], '%an%']", false) == (vector<string>{"a", "b", "f"}));
+    CHECK(run("['regexp_contains()', ['.name'], 'ban|pine']", false)
+          == (vector<string>{"a", "b", "d"}));
+    CHECK(run("['NOT', ['LIKE', ['.name'], '%ana%']]", false) == (vector<string>{"d", "e", "f"}));
+    CHECK(run("['OR', ['LIKE', ['.name'], '%ana%'], ['=', ['.name'], 'apple']]", false)
+          == (vector<string>{"a", "b"}));
+
+    store->deleteIndex("names"_sl);
+    CHECK(extractIndexes(store->getIndexes()).empty());
+    CHECK(!((SQLiteDataFile*)db)->tableExists("kv_default:trigram:name"));
+    CHECK(run("['LIKE', ['.name'], '%ana%']", false) == (vector<string>{"a", "b"}));
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query geo index", "[Query]") {
+    auto writeJSONDoc = [&](slice docID, const char *json, Transaction &t) {
+        alloc_slice body = JSONConverter::convertJSON(json5(json));
+        store->set(docID, nullslice, body, DocumentFlags::kNone, t);
+    };
+    {
+        Transaction t(store->dataFile());
+        writeJSONDoc("sf"_sl,      "{loc: {type: 'Point', coordinates: [-122.42, 37.77]}}", t);
+        writeJSONDoc("oakland"_sl, "{loc: {type: 'Point', coordinates: [-122.27, 37.80]}}", t);
+        writeJSONDoc("la"_sl,      "{loc: {type: 'Point', coordinates: [-118.24, 34.05]}}", t);
+        writeJSONDoc("none"_sl,    "{loc: 'nowhere'}", t);
+        t.commit();
+    }
+    store->createIndex("geo"_sl, "[[\".loc\"]]"_sl, KeyStore::kGeoIndex);
+    CHECK(extractIndexes(store->getIndexes()) == vector<string>{"geo"});
+    {
+        Transaction t(store->dataFile());
+        writeJSONDoc("marin"_sl, "{loc: {type: 'Feature', bbox: [-122.8, 37.8, -122.4, 38.3],"
+                                 " geometry: {type: 'Polygon', coordinates: []}}}", t);
+        writeJSONDoc("oakland"_sl, "{loc: {type: 'Point', coordinates: [-122.27, 37.80]}}", t);
+        store->del("la"_sl, t);
+        t.commit();
+    }
+
+    auto run = [&](const char *where) {
+        Retained<Query> query{ store->compileQuery(json5(
+                    format("{WHAT: ['._id'], WHERE: %s, ORDER_BY: ['._id']}", where))) };
+        unique_ptr<QueryEnumerator> e(query->createEnumerator());
+        vector<string> docIDs;
+        while (e->next())
+            docIDs.push_back(e->columns()[0]->asString().asString());
+        return docIDs;
+    };
+    CHECK(run("['GEO_WITHIN', 'geo', -123, 37, -122, 38]") == (vector<string>{"oakland", "sf"}));
+    CHECK(run("['GEO_WITHIN', 'geo', -123, 37, -122, 39]")
+          == (vector<string>{"marin", "oakland", "sf"}));
+    CHECK(run("['GEO_WITHIN', 'geo', -120, 30, -110, 40]").empty());
+    CHECK(run("['GEO_NEAR', 'geo', -122.42, 37.77, 1000]") == vector<string>{"sf"});
+    CHECK(run("['GEO_NEAR', 'geo', -122.42, 37.77, 20000]")
+          == (vector<string>{"marin", "oakland", "sf"}));
+    CHECK(run("['AND', ['GEO_NEAR', 'geo', -122.42, 37.77, 20000], ['!=', ['._id'], 'sf']]")
+          == (vector<string>{"marin", "oakland"}));
+
+    // Moving a doc moves its index entry:
+    {
+        Transaction t(store->dataFile());
+        writeJSONDoc("sf"_sl, "{loc: {type: 'Point', coordinates: [-118.24, 34.05]}}", t);
+        t.commit();
+    }
+    CHECK(run("['GEO_WITHIN', 'geo', -123, 37, -122, 38]") == vector<string>{"oakland"});
+    CHECK(run("['GEO_WITHIN', 'geo', -120, 30, -110, 40]") == vector<string>{"sf"});
+
+    Retained<Query> query{ store->compileQuery(json5(
+                "{WHAT: [['geo_distance()', -122.42, 37.77, -118.24, 34.05]]}")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asDouble() == Approx(559000).epsilon(0.01));
+
+    store->deleteIndex("geo"_sl);
+    CHECK(extractIndexes(store->getIndexes()).empty());
+    ExpectException(error::Domain::LiteCore, error::LiteCoreError::NoSuchIndex, [&] {
+        run("['GEO_WITHIN', 'geo', -123, 37, -122, 38]");
+    });
+}
+
+
+#if LITECORE_USES_ICU
+TEST_CASE_METHOD(DataFileTestFixture, "Query Unicode sort key index", "[Query][Collation]") {
+    {
+        Transaction t(store->dataFile());
+        int n = 0;
+        for (const char *name : {"zebra", "Äpple", "apple", "Zoë", "ångström", "Bob"}) {
+            string docID = stringWithFormat("doc%d", ++n);
+            string json = stringWithFormat("{name: '%s'}", name);
+            alloc_slice body = JSONConverter::convertJSON(json5(json));
+            store->set(slice(docID), nullslice, body, DocumentFlags::kNone, t);
+        }
+        t.commit();
+    }
+    auto run = [&](Query *query) {
+        unique_ptr<QueryEnumerator> e(query->createEnumerator());
+        vector<string> names;
+        while (e->next())
+            names.push_back(e->columns()[0]->asString().asString());
+        return names;
+    };
+    const char *queryJSON = "{WHAT: ['.name'], "
+                            "ORDER_BY: [['COLLATE', {unicode: true, case: false, diac: false}, "
+                                        "['.name']], ['.name']]}";
+    Retained<Query> query{ store->compileQuery(json5(queryJSON)) };
+    vector<string> expected = run(query);
+    CHECK(expected.size() == 6);
+
+    KeyStore::IndexOptions options {nullptr, false, false, nullptr, nullptr, false, true};
+    store->createIndex("names"_sl,
+                       json5("[['COLLATE', {unicode: true, case: false, diac: false}, ['.name']]]"),
+                       KeyStore::kValueIndex, &options);
+    query = store->compileQuery(json5(queryJSON));
+    CHECK(query->explain().find("unicode_sortkey") != string::npos);
+    CHECK(query->explain().find("USING INDEX names") != string::npos);
+    CHECK(run(query) == expected);
+
+    // If the collator's version changes, the index is rebuilt when the database is reopened:
+    auto sqlite = [&]() -> SQLite::Database& {return (SQLiteDataFile&)*db;};
+    auto sortKeyVersion = [&] {
+        return sqlite().execAndGet("SELECT version FROM sortkeyinfo").getString();
+    };
+    CHECK(sortKeyVersion() == UnicodeSortKeyVersion());
+    sqlite().exec("UPDATE sortkeyinfo SET version='ICU 0.0.0.0'");
+    query = nullptr;
+    reopenDatabase();
+    CHECK(sortKeyVersion() == UnicodeSortKeyVersion());
+    query = store->compileQuery(json5(queryJSON));
+    CHECK(query->explain().find("USING INDEX names") != string::npos);
+    CHECK(run(query) == expected);
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query sort key index of mixed types", "[Query][Collation]") {
+    {
+        Transaction t(store->dataFile());
+        int n = 0;
+        for (const char *json : {"{name: 'banana'}", "{name: 12}", "{name: null}",
+                                 "{name: ['x']}", "{}", "{name: 'Apple'}"}) {
+            string docID = stringWithFormat("doc%d", ++n);
+            alloc_slice body = JSONConverter::convertJSON(json5(json));
+            store->set(slice(docID), nullslice, body, DocumentFlags::kNone, t);
+        }
+        t.commit();
+    }
+    auto run = [&](Query *query) {
+        unique_ptr<QueryEnumerator> e(query->createEnumerator());
+        vector<string> docIDs;
+        while (e->next())
+            docIDs.push_back(e->columns()[0]->asString().asString());
+        return docIDs;
+    };
+    const char *queryJSON = "{WHAT: ['._id'], "
+                            "ORDER_BY: [['COLLATE', {unicode: true, case: false}, ['.name']], "
+                                        "['._id']]}";
+    // Missing, then numbers, then strings in collated order, then null and arrays (as blobs):
+    const vector<string> expected {"doc5", "doc2", "doc6", "doc1", "doc3", "doc4"};
+    Retained<Query> query{ store->compileQuery(json5(queryJSON)) };
+    CHECK(run(query) == expected);
+
+    // Ordering by sort keys instead doesn't move strings relative to other types:
+    KeyStore::IndexOptions options {nullptr, false, false, nullptr, nullptr, false, true};
+    store->createIndex("names"_sl,
+                       json5("[['COLLATE', {unicode: true, case: false}, ['.name']]]"),
+                       KeyStore::kValueIndex, &options);
+    query = store->compileQuery(json5(queryJSON));
+    CHECK(query->explain().find("unicode_sortkey") != string::npos);
+    CHECK(run(query) == expected);
+}
+#endif
+
+
 TEST_CASE_METHOD(DataFileTestFixture, "Query SELECT WHAT", "[Query]") {
     addNumberedDocs(store);
     Retained<Query> query{ store->compileQuery(json5(
@@ -362,6 +682,269 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query refresh", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(DataFileTestFixture, "Query interruption", "[Query]") {
+    addNumberedDocs(store);
+    // A million-row cross join that takes a good while to count:
+    Retained<Query> query{ store->compileQuery(json5(
+            "{WHAT: [['COUNT()', ['.a.num']]], "
+             "FROM: [{AS: 'a'}, {AS: 'b', JOIN: 'CROSS'}, {AS: 'c', JOIN: 'CROSS'}]}")) };
+    Query::Options options;
+
+    SECTION("Step limit") {
+        options.stepLimit = 10000;
+        ExpectException(error::Domain::LiteCore, error::LiteCoreError::QueryInterrupted, [&] {
+            unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        });
+    }
+    SECTION("Time limit") {
+        options.timeLimitMS = 1;
+        ExpectException(error::Domain::LiteCore, error::LiteCoreError::QueryInterrupted, [&] {
+            unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        });
+    }
+    SECTION("Cancel") {
+        // Cancel repeatedly until the run returns, so that a cancel is sure to arrive while the
+        // query is running (one that arrives before the run starts has no effect):
+        atomic<bool> finished {false};
+        thread canceller([&] {
+            while (!finished) {
+                query->cancel();
+                this_thread::yield();
+            }
+        });
+        ExpectException(error::Domain::LiteCore, error::LiteCoreError::QueryInterrupted, [&] {
+            try {
+                unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+            } catch (...) {
+                finished = true;
+                throw;
+            }
+            finished = true;
+        });
+        canceller.join();
+    }
+
+    // The connection is still usable, and the earlier cancel doesn't affect a new run:
+    Retained<Query> query2{ store->compileQuery(json5(
+            "{WHAT: [['COUNT()', ['.num']]]}")) };
+    options = Query::Options();
+    options.stepLimit = 1000000;
+    unique_ptr<QueryEnumerator> e(query2->createEnumerator(&options));
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asInt() == 100);
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query recording memory limit", "[Query]") {
+    // About 500KB of results, enough to be recorded in several chunks:
+    {
+        string str(500, 'x');
+        Transaction t(store->dataFile());
+        for (int i = 1; i <= 1000; i++)
+            writeNumberedDoc(store, i, slice(str), t);
+        t.commit();
+    }
+    Retained<Query> query{ store->compileQuery(json5(
+            "{WHAT: ['.num', '.str'], ORDER_BY: [['.num']]}")) };
+    Query::Options options;
+    options.maxRecordingBytes = 100000;
+
+    SECTION("Fail") {
+        ExpectException(error::Domain::LiteCore, error::LiteCoreError::QueryResultTooLarge, [&] {
+            unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        });
+    }
+    SECTION("Spill to disk") {
+        options.spillToDisk = true;
+        auto spilledBefore = Query::recordingStats().bytesSpilled;
+        unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        CHECK(Query::recordingStats().bytesSpilled > spilledBefore);
+        CHECK(Query::recordingStats().largestRecording >= 500000);
+        CHECK(e->getRowCount() == 1000);
+        int64_t n = 0;
+        while (e->next()) {
+            ++n;
+            CHECK(e->columns()[0]->asInt() == n);
+            CHECK(e->columns()[1]->asString().size == 500);
+        }
+        CHECK(n == 1000);
+        e->seek(900);
+        CHECK(e->columns()[0]->asInt() == 901);
+        REQUIRE(e->next());
+        CHECK(e->columns()[0]->asInt() == 902);
+
+        // Unchanged results compare equal, so refresh returns null:
+        unique_ptr<QueryEnumerator> e2(e->refresh());
+        CHECK(!e2);
+    }
+#ifdef COUCHBASE_ENTERPRISE
+    SECTION("Encrypted database doesn't spill to disk") {
+        query = nullptr;
+        DataFile::Options dbOptions = db->options();
+        dbOptions.encryptionAlgorithm = kAES128;
+        dbOptions.encryptionKey = "1234567890123456"_sl;
+        db->rekey(dbOptions.encryptionAlgorithm, dbOptions.encryptionKey);
+        reopenDatabase(&dbOptions);
+        query = store->compileQuery(json5("{WHAT: ['.num', '.str'], ORDER_BY: [['.num']]}"));
+
+        options.spillToDisk = true;
+        auto spilledBefore = Query::recordingStats().bytesSpilled;
+        ExpectException(error::Domain::LiteCore, error::LiteCoreError::QueryResultTooLarge, [&] {
+            unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+        });
+        CHECK(Query::recordingStats().bytesSpilled == spilledBefore);
+    }
+#endif
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query profile", "[Query]") {
+    addNumberedDocs(store);
+    Retained<Query> query{ store->compileQuery(json5(
+                     "{WHAT: ['.num'], WHERE: ['>', ['.num'], 10], ORDER_BY: [['.str']]}")) };
+    string report = query->profile();
+    INFO("Profile: " << report);
+    CHECK(report.find("rows: 90,") != string::npos);
+    CHECK(report.find("VM steps: ") != string::npos);
+    CHECK(report.find("full-scan steps: 0\n") == string::npos);
+    CHECK(report.find("sorts: 1") != string::npos);
+    CHECK(report.find("fl_value: ") != string::npos);
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+    CHECK(report.find("loop 0: SCAN") != string::npos);
+    CHECK(report.find("1 loops, 100 rows visited") != string::npos);
+#endif
+
+    // Profiling leaves the query usable:
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 90);
+
+    // Other SQL functions, and the fl_each table, are profiled too:
+    query = store->compileQuery(json5(
+                     "{WHAT: [['abs()', ['.num']]],"
+                     " WHERE: ['OR', ['ANY', 'X', ['.str'], ['=', ['?X'], 1]], ['>', ['.num'], 90]]}"));
+    report = query->profile();
+    INFO("Profile: " << report);
+    CHECK(report.find("rows: 10,") != string::npos);
+    CHECK(report.find("fl_each: 100 calls") != string::npos);
+    CHECK(report.find("abs: 10 calls") != string::npos);
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query index advisor", "[Query]") {
+    addNumberedDocs(store);
+    IndexAdvisor::Options options {true, 1, 0, 2, 0};   // auto-create 1 index, after 2 runs
+    auto advisor = make_shared<IndexAdvisor>(options);
+    store->setIndexAdvisor(advisor);
+
+    Retained<Query> query{ store->compileQuery(json5(
+                     "{WHAT: ['.num'], WHERE: ['>', ['.num'], 10], ORDER_BY: [['.str']]}")) };
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 90);
+
+    auto recs = advisor->recommendations();
+    REQUIRE(recs.size() == 1);
+    string indexName = recs[0].name;
+    CHECK(hasPrefix(indexName, "advisor_num_str_"));
+    CHECK(recs[0].expressionsJSON == "[[\".num\"],[\".str\"]]");
+    CHECK(recs[0].runs == 1);
+    CHECK(recs[0].fullScan);
+    CHECK(recs[0].tempBTree);
+    CHECK(!recs[0].autoCreated);
+    CHECK(store->createAdvisedIndexes() == 0);
+
+    // The second run reaches minRuns, but running a query doesn't create an index:
+    e.reset(query->createEnumerator());
+    recs = advisor->recommendations();
+    CHECK(recs[0].runs == 2);
+    CHECK(!recs[0].autoCreated);
+    CHECK(extractIndexes(store->getIndexes()).empty());
+
+    CHECK(store->createAdvisedIndexes() == 1);
+    recs = advisor->recommendations();
+    CHECK(recs[0].autoCreated);
+    CHECK(extractIndexes(store->getIndexes()) == vector<string>{indexName});
+    CHECK(query->explain().find(indexName) != string::npos);
+    e.reset(query->createEnumerator());
+    CHECK(e->getRowCount() == 90);
+
+    // Another query pattern is recommended, but not created, due to the maxAutoIndexes limit:
+    Retained<Query> query2{ store->compileQuery(json5(
+                     "{WHAT: ['.num'], WHERE: ['=', ['.str'], 'foo']}")) };
+    for (int i = 0; i < 3; ++i)
+        e.reset(query2->createEnumerator());
+    CHECK(store->createAdvisedIndexes() == 0);
+    recs = advisor->recommendations();
+    REQUIRE(recs.size() == 2);
+    auto rec = find_if(recs.begin(), recs.end(), [](const IndexAdvisor::Recommendation &r) {
+        return hasPrefix(r.name, "advisor_str_");
+    });
+    REQUIRE(rec != recs.end());
+    CHECK(rec->runs == 3);
+    CHECK(!rec->autoCreated);
+    CHECK(extractIndexes(store->getIndexes()).size() == 1);
+    // ...but it stays a candidate, for when there's room for it:
+    REQUIRE(advisor->autoCreateCandidates().size() == 1);
+    CHECK(advisor->autoCreateCandidates()[0].name == rec->name);
+
+    // Creating an index makes the query's plan be re-checked; it no longer scans the table,
+    // so its runs aren't recorded:
+    store->createIndex("str"_sl, "[[\".str\"]]"_sl);
+    e.reset(query2->createEnumerator());
+    recs = advisor->recommendations();
+    rec = find_if(recs.begin(), recs.end(), [](const IndexAdvisor::Recommendation &r) {
+        return hasPrefix(r.name, "advisor_str_");
+    });
+    REQUIRE(rec != recs.end());
+    CHECK(rec->runs == 3);
+
+    // Queries by doc ID, and queries with no predicates, aren't recorded:
+    Retained<Query> query3{ store->compileQuery(json5(
+                     "{WHAT: ['.num'], WHERE: ['=', ['._id'], 'rec-001']}")) };
+    e.reset(query3->createEnumerator());
+    Retained<Query> query4{ store->compileQuery(json5("{WHAT: ['.num']}")) };
+    e.reset(query4->createEnumerator());
+    CHECK(advisor->recommendations().size() == 2);
+
+    store->setIndexAdvisor(nullptr);
+}
+
+
+TEST_CASE("Index advisor candidates", "[Query]") {
+    // A candidate stays one until its index is created or rejected:
+    IndexAdvisor advisor({true, 2, 0, 1, 0});
+    advisor.recordRun({"a"}, {}, true, false, 0.2);
+    advisor.recordRun({"b"}, {}, true, false, 0.1);
+    advisor.recordRun({"c"}, {}, true, false, 0.3);
+    auto recs = advisor.autoCreateCandidates();
+    REQUIRE(recs.size() == 3);
+    CHECK(recs[0].expressionsJSON == "[[\".c\"]]");
+    CHECK(advisor.autoCreateCandidates().size() == 3);
+    advisor.markAutoCreated(recs[0].expressionsJSON);
+    advisor.markRejected(recs[1].expressionsJSON);
+    recs = advisor.autoCreateCandidates();
+    REQUIRE(recs.size() == 1);
+    CHECK(recs[0].expressionsJSON == "[[\".b\"]]");
+    CHECK(!recs[0].autoCreated);
+}
+
+
+TEST_CASE("Index advisor names", "[Query]") {
+    // Paths that look alike once punctuation is replaced still get distinct index names:
+    IndexAdvisor advisor({false, 0, 0, 1, 0});
+    advisor.recordRun({"a.b"}, {}, true, false, 0.1);
+    advisor.recordRun({"a_b"}, {}, true, false, 0.1);
+    advisor.recordRun({"a", "b"}, {}, true, false, 0.1);
+    auto recs = advisor.recommendations();
+    REQUIRE(recs.size() == 3);
+    set<string> names;
+    for (auto &rec : recs) {
+        CHECK(hasPrefix(rec.name, "advisor_a_b_"));
+        names.insert(rec.name);
+    }
+    CHECK(names.size() == 3);
+}
+
+
 TEST_CASE_METHOD(DataFileTestFixture, "Query boolean", "[Query]") {
     {
         Transaction t(store->dataFile());
@@ -797,6 +1380,156 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query HAVING", "[Query]") {
     CHECK(e->columns()[1]->asInt() == 5);
 }
 
+static void writeSale(KeyStore *store, Transaction &t, const char *docID,
+                      const char *type, int amount)
+{
+    fleece::Encoder enc;
+    enc.beginDictionary(2);
+    enc.writeKey("type");
+    enc.writeString(type);
+    enc.writeKey("amount");
+    enc.writeInt(amount);
+    enc.endDictionary();
+    alloc_slice body = enc.extractOutput();
+    store->set(slice(docID), nullslice, body, DocumentFlags::kNone, t);
+}
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query aggregate index", "[Query]") {
+    {
+        Transaction t(store->dataFile());
+        char docID[6];
+        for (int i = 0; i < 20; i++) {
+            sprintf(docID, "doc%02d", i);
+            writeSale(store, t, docID, (i % 2) ? "odd" : "even", i);
+        }
+        t.commit();
+    }
+    store->createIndex("sales"_sl,
+                       json5("[['.type'], ['count()'], ['sum()', ['.amount']],"
+                             " ['min()', ['.amount']], ['max()', ['.amount']]]"),
+                       KeyStore::kAggregateIndex);
+    CHECK(extractIndexes(store->getIndexes()) == vector<string>{"sales"});
+
+    Retained<Query> query{ store->compileQuery(json5(
+        "{WHAT: ['.type', ['count()'], ['sum()', ['.amount']], ['avg()', ['.amount']],"
+        "        ['min()', ['.amount']], ['max()', ['.amount']]],"
+        " GROUP_BY: ['.type'], ORDER_BY: ['.type']}")) };
+    CHECK(query->explain().find("kv_default::sales") != string::npos);
+
+    auto checkGroups = [&](int evenCount, int evenSum, int evenMin, int evenMax,
+                           int oddCount, int oddSum, int oddMin, int oddMax) {
+        unique_ptr<QueryEnumerator> e(query->createEnumerator());
+        REQUIRE(e->getRowCount() == 2);
+        REQUIRE(e->next());
+        CHECK(e->columns()[0]->asString() == "even"_sl);
+        CHECK(e->columns()[1]->asInt() == evenCount);
+        CHECK(e->columns()[2]->asInt() == evenSum);
+        CHECK(e->columns()[3]->asDouble() == (double)evenSum / evenCount);
+        CHECK(e->columns()[4]->asInt() == evenMin);
+        CHECK(e->columns()[5]->asInt() == evenMax);
+        REQUIRE(e->next());
+        CHECK(e->columns()[0]->asString() == "odd"_sl);
+        CHECK(e->columns()[1]->asInt() == oddCount);
+        CHECK(e->columns()[2]->asInt() == oddSum);
+        CHECK(e->columns()[3]->asDouble() == (double)oddSum / oddCount);
+        CHECK(e->columns()[4]->asInt() == oddMin);
+        CHECK(e->columns()[5]->asInt() == oddMax);
+    };
+    checkGroups(10, 90, 0, 18,  10, 100, 1, 19);
+
+    {
+        Transaction t(store->dataFile());
+        writeSale(store, t, "doc20", "odd", 100);           // insert
+        writeSale(store, t, "doc00", "odd", 3);             // move to other group; was even's min
+        store->del("doc19"_sl, t);                          // delete odd's old max
+        store->setDocumentFlag("doc18"_sl, 19, DocumentFlags::kDeleted, t);  // even's max
+        t.commit();
+    }
+    checkGroups(8, 72, 2, 16,  11, 184, 1, 100);
+
+    // A query that only uses the index's groups and aggregates can use it, with a WHERE clause
+    // on the groups:
+    query = store->compileQuery(json5(
+        "{WHAT: [['count()']], WHERE: ['=', ['.type'], 'odd']}"));
+    CHECK(query->explain().find("kv_default::sales") != string::npos);
+    unique_ptr<QueryEnumerator> e(query->createEnumerator());
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asInt() == 11);
+
+    // ...but a query that needs anything else can't:
+    query = store->compileQuery(json5(
+        "{WHAT: [['count()']], WHERE: ['>', ['.amount'], 10]}"));
+    CHECK(query->explain().find("kv_default::sales") == string::npos);
+    e.reset(query->createEnumerator());
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asInt() == 8);
+
+    store->deleteIndex("sales"_sl);
+    CHECK(extractIndexes(store->getIndexes()).empty());
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "Query aggregate in parallel", "[Query]") {
+    {
+        Transaction t(store->dataFile());
+        char docID[10];
+        for (int i = 0; i < 5000; i++) {
+            sprintf(docID, "doc%04d", i);
+            const char *types[3] = {"a", "b", "c"};
+            writeSale(store, t, docID, types[i % 3], i);
+        }
+        for (int i = 0; i < 5000; i += 7) {
+            sprintf(docID, "doc%04d", i);
+            store->setDocumentFlag(slice(docID), i + 1, DocumentFlags::kDeleted, t);
+        }
+        t.commit();
+    }
+
+    // Runs a query serially, then in parallel, and checks that the results are the same:
+    auto checkQuery = [&](const char *json, const char *params) -> string {
+        Retained<Query> query{ store->compileQuery(json5(json)) };
+        Query::Options options;
+        options.paramBindings = alloc_slice(json5(params));
+        string results[2];
+        for (int parallel = 0; parallel < 2; ++parallel) {
+            options.parallelism = parallel ? 4 : 0;
+            unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+            CHECK(e->partitionCount() == (parallel ? 4u : 1u));
+            while (e->next()) {
+                for (Array::iterator col = e->columns(); col; ++col)
+                    results[parallel] += col->toJSONString() + " ";
+                results[parallel] += "| ";
+            }
+        }
+        CHECK(results[1] == results[0]);
+        return results[0];
+    };
+
+    checkQuery("{WHAT: ['.type', ['count()'], ['sum()', ['.amount']], ['avg()', ['.amount']],"
+               "        ['min()', ['.amount']], ['max()', ['.amount']]],"
+               " WHERE: ['>=', ['.amount'], ['$min']],"
+               " GROUP_BY: ['.type'], HAVING: ['>', ['count()'], 1], ORDER_BY: ['.type']}",
+               "{min: 100}");
+    CHECK(checkQuery("{WHAT: [['count()'], ['sum()', ['.amount']]], WHERE: ['<', ['.amount'], 21]}",
+                     "{}") == "18 189 | ");
+    checkQuery("{WHAT: ['.type'], DISTINCT: true, ORDER_BY: [['DESC', ['.type']]]}", "{}");
+    checkQuery("{WHAT: [['max()', ['.amount']]], WHERE: ['<', ['.amount'], 0]}", "{}");
+
+    // Parameters that can't be bound fail the same way as in a serial run:
+    Retained<Query> query{ store->compileQuery(json5(
+                        "{WHAT: [['count()']], WHERE: ['>=', ['.amount'], ['$min']]}")) };
+    Query::Options options;
+    options.parallelism = 4;
+    options.paramBindings = alloc_slice(json5("{min: [100]}"));
+    ExpectException(error::Domain::LiteCore, error::LiteCoreError::InvalidParameter, [&] {
+        unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+    });
+    options.paramBindings = alloc_slice(json5("{max: 100}"));
+    ExpectException(error::Domain::LiteCore, error::LiteCoreError::InvalidQueryParam, [&] {
+        unique_ptr<QueryEnumerator> e(query->createEnumerator(&options));
+    });
+}
+
 TEST_CASE_METHOD(DataFileTestFixture, "Query Functions", "[Query]") {
     {
         Transaction t(store->dataFile());
@@ -1114,6 +1847,13 @@ TEST_CASE_METHOD(DataFileTestFixture, "Query NULL check", "[Query]")
     CHECK(e->columns()[0]->asInt() == 1);
 	CHECK(e->columns()[1]->asString().buf == nullptr);
 
+    // With the null on the left, the missing callsign isn't null, so it matches:
+    query = store->compileQuery(json5(
+        "{'WHAT': [['COUNT()','.']], 'WHERE':['IS NOT', null, ['.callsign']]}"));
+    e.reset(query->createEnumerator());
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asInt() == 2);
+
 	query = store->compileQuery(json5(
         "{'WHAT': [['.callsign']]}"));
 	e.reset(query->createEnumerator());
@@ -17,6 +17,10 @@
 //
 
 #include "RevTree.hh"
+#include "RawRevTree.hh"
+#include "VersionedDocument.hh"
+#include "DataFile.hh"
+#include "RecordEnumerator.hh"
 
 #include "LiteCoreTest.hh"
 
@@ -50,3 +54,207 @@ TEST_CASE("RevID Parsing") {
     CHECK(!r.tryParse("1-aa "_sl));
     CHECK(!r.tryParse(" 1-aa"_sl));
 }
+
+
+TEST_CASE("RevTree lazy decoding") {
+    RevTree tree;
+    int status;
+    revidBuffer rev1("1-aa"_sl), rev2("2-bb"_sl);
+    REQUIRE(tree.insert(rev1, "{\"v\":1}"_sl, Rev::kNoFlags, revid(), false, status));
+    REQUIRE(tree.insert(rev2, "{\"v\":2}"_sl, Rev::kHasAttachments, rev1, false, status));
+    tree.saved(17);
+    alloc_slice raw = tree.encode();
+
+    // The current revision can be read without decoding:
+    CHECK(RawRevision::getCurrentRevBody(raw) == "{\"v\":2}"_sl);
+    CHECK(RawRevision::getCurrentRevFlags(raw) == (Rev::kLeaf | Rev::kHasAttachments));
+    CHECK(RawRevision::getCurrentRevSequence(raw) == 17);
+
+    RevTree lazy;
+    lazy.decodeLazily(raw, 17);
+    CHECK(!lazy.isDecoded());
+    // The first access decodes the tree:
+    CHECK(lazy.size() == 2);
+    CHECK(lazy.isDecoded());
+    auto cur = lazy.currentRevision();
+    REQUIRE(cur);
+    CHECK(cur->revID == revid(rev2));
+    CHECK(cur->parent == lazy[revid(rev1)]);
+
+    // Copying a lazy tree decodes it first:
+    RevTree lazy2;
+    lazy2.decodeLazily(raw, 17);
+    RevTree copy(lazy2);
+    CHECK(copy.size() == 2);
+    CHECK(copy.get(revid(rev1))->body() == "{\"v\":1}"_sl);
+}
+
+
+TEST_CASE("RevTree arena") {
+    Arena arena(100);
+    auto a = arena.alloc<uint64_t>(4);
+    CHECK(((uintptr_t)a % alignof(uint64_t)) == 0);
+    slice s = arena.copy("hello"_sl);
+    CHECK(s == "hello"_sl);
+    CHECK(arena.contains(a));
+    CHECK(arena.contains(s.buf));
+    CHECK(!arena.contains(&arena));
+    // A big allocation gets a new chunk; earlier allocations stay valid:
+    auto big = arena.alloc(10000);
+    CHECK(arena.contains(big));
+    CHECK(s == "hello"_sl);
+    CHECK(arena.capacity() >= 10100);
+    arena.reset();
+    CHECK(arena.capacity() == 0);
+    CHECK(!arena.contains(a));
+}
+
+
+TEST_CASE("RevTree copy owns its inserted data") {
+    int status;
+    revidBuffer rev1("1-aa"_sl), rev2("2-bb"_sl), rev3("3-cc"_sl);
+    unique_ptr<RevTree> tree(new RevTree);
+    REQUIRE(tree->insert(rev1, "{\"v\":1}"_sl, Rev::kNoFlags, revid(), false, status));
+    REQUIRE(tree->insert(rev2, "{\"v\":2}"_sl, Rev::kNoFlags, rev1, false, status));
+    tree->setLatestRevisionOnRemote(RevTree::kDefaultRemoteID, tree->get(revid(rev1)));
+
+    RevTree copy(*tree);
+    tree.reset();
+    REQUIRE(copy.size() == 2);
+    CHECK(copy.currentRevision()->revID == revid(rev2));
+    CHECK(copy.currentRevision()->body() == "{\"v\":2}"_sl);
+    CHECK(copy.get(revid(rev1))->body() == "{\"v\":1}"_sl);
+    CHECK(copy.latestRevisionOnRemote(RevTree::kDefaultRemoteID) == copy.get(revid(rev1)));
+
+    // Round-trip through encode/decode, then keep inserting into the decoded tree:
+    alloc_slice raw = copy.encode();
+    RevTree decoded(raw, 5);
+    REQUIRE(decoded.size() == 2);
+    CHECK(decoded.latestRevisionOnRemote(RevTree::kDefaultRemoteID) == decoded.get(revid(rev1)));
+    REQUIRE(decoded.insert(rev3, "{\"v\":3}"_sl, Rev::kNoFlags, rev2, false, status));
+    CHECK(decoded.currentRevision()->revID == revid(rev3));
+    CHECK(decoded.currentRevision()->parent == decoded.get(revid(rev2)));
+    decoded.setLatestRevisionOnRemote(RevTree::kDefaultRemoteID, nullptr);
+    CHECK(decoded.latestRevisionOnRemote(RevTree::kDefaultRemoteID) == nullptr);
+}
+
+
+TEST_CASE("RevTree indexed lookup") {
+    // Build a tree big enough to be indexed, with a long history plus a short conflicting branch:
+    const int kHistory = 200;
+    vector<revidBuffer> history;
+    for (int gen = kHistory; gen >= 1; --gen) {
+        char str[32];
+        snprintf(str, sizeof(str), "%d-%04x", gen, gen);
+        history.emplace_back(slice(str));
+    }
+    RevTree tree;
+    CHECK(tree.insertHistory(history, "{\"v\":1}"_sl, Rev::kNoFlags) == kHistory);
+    tree.saved(10);
+    revidBuffer branch("101-beef"_sl);
+    int status;
+    REQUIRE(tree.insert(branch, "{\"v\":2}"_sl, Rev::kNoFlags, history[kHistory - 100],
+                        true, status));
+    REQUIRE(tree.size() == kHistory + 1);
+
+    for (auto &revID : history) {
+        auto rev = tree.get(revID);
+        REQUIRE(rev);
+        CHECK(rev->revID == revid(revID));
+    }
+    CHECK(tree.get(revid(branch))->parent == tree.get(revid(history[kHistory - 100])));
+    CHECK(tree.get(revidBuffer("999-0000"_sl)) == nullptr);
+
+    // Sequence lookup goes to the first rev with that sequence, even after sorting:
+    tree.sort();
+    CHECK(tree.getBySequence(10) == tree.get(revid(history[0])));
+    CHECK(tree.getBySequence(0) == tree.get(revid(branch)));
+    tree.saved(11);
+    CHECK(tree.getBySequence(11) == tree.get(revid(branch)));
+    CHECK(tree.getBySequence(12) == nullptr);
+
+    // Purging the branch and pruning history keep the index consistent:
+    CHECK(tree.purge(revid(branch)) == 1);
+    CHECK(tree.get(revid(branch)) == nullptr);
+    CHECK(tree.prune(50) == kHistory - 50);
+    CHECK(tree.size() == 50);
+    CHECK(tree.get(revid(history[49])) != nullptr);
+    CHECK(tree.get(revid(history[50])) == nullptr);
+    CHECK(tree.getBySequence(11) == nullptr);
+    CHECK(tree.getBySequence(10) == tree.get(revid(history[0])));
+}
+
+
+TEST_CASE_METHOD(DataFileTestFixture, "VersionedDocument stored body size", "[RevTree]") {
+    // Similar bodies, which differ in only one property:
+    auto makeBody = [](int n) {
+        string body = "{";
+        for (int i = 0; i < 50; ++i)
+            body += "\"property" + to_string(i) + "\":\"value " + to_string(i) + "\",";
+        body += "\"n\":" + to_string(n) + "}";
+        return alloc_slice(slice(body));
+    };
+    // Total size of the records in the body store:
+    auto storedBodyBytes = [&](unsigned &count) {
+        size_t bytes = 0;
+        count = 0;
+        for (RecordEnumerator e(db->getKeyStore(VersionedDocument::kBodiesKeyStoreName));
+                e.next(); ++count)
+            bytes += e->body().size;
+        return bytes;
+    };
+
+    // Create a document whose current rev has `nConflicts` conflicting leaves:
+    unsigned nConflicts = 0;
+    SECTION("One retained body") {
+        nConflicts = 1;
+    }
+    SECTION("Several retained bodies") {
+        nConflicts = 3;
+    }
+    vector<alloc_slice> bodies;
+    vector<revidBuffer> revIDs;
+    bodies.reserve(nConflicts + 1);
+    revIDs.reserve(nConflicts + 1);
+    {
+        Transaction t(db);
+        VersionedDocument doc(*store, "doc"_sl);
+        int status;
+        revidBuffer rev1("1-aa"_sl);
+        REQUIRE(doc.insert(rev1, makeBody(0), Rev::kNoFlags, revid(), false, status));
+        for (unsigned i = 1; i <= nConflicts + 1; ++i) {
+            bodies.push_back(makeBody(i));
+            revIDs.emplace_back(slice(format("2-%02x", i)));
+            REQUIRE(doc.insert(revIDs.back(), bodies.back(), Rev::kNoFlags, rev1, true, status));
+        }
+        REQUIRE(doc.save(t) == VersionedDocument::kNewSequence);
+        t.commit();
+    }
+
+    VersionedDocument doc(*store, "doc"_sl);
+    const Rev *current = doc.currentRevision();
+    size_t retainedBytes = 0;
+    for (unsigned i = 0; i <= nConflicts; ++i) {
+        const Rev *rev = doc.get(revIDs[i]);
+        REQUIRE(rev);
+        if (rev == current) {
+            CHECK(rev->body() == bodies[i]);
+        } else {
+            CHECK(doc.readBodyOfRevision(rev) == bodies[i]);
+            retainedBytes += bodies[i].size;
+        }
+    }
+
+    unsigned count;
+    size_t bytes = storedBodyBytes(count);
+    if (nConflicts == 1) {
+        // A delta base plus one delta would be bigger than the body, so it's stored whole:
+        CHECK(count == 1);
+        CHECK(bytes == retainedBytes);
+    } else {
+        // The base and the deltas are smaller than the bodies:
+        CHECK(count == nConflicts + 1);
+        CHECK(bytes < retainedBytes);
+        CHECK(bytes < current->body().size + retainedBytes / nConflicts);
+    }
+}
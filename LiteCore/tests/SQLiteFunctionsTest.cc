@@ -268,6 +268,41 @@ N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite numeric ops", "[Query]") {
             == (vector<string>{"4.0", "2.5"}));
 }
 
+N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "SQLite regexp functions", "[Query]") {
+    insert("a", "{\"s\": \"hello world\"}");
+    insert("b", "{\"s\": \"Phone 555-1212\"}");
+    insert("c", "{\"s\": \"mississippi\"}");
+
+    // Literal patterns:
+    CHECK(query("SELECT regexp_contains(fl_value(body, 's'), 'world') FROM kv")
+            == (vector<string>{"1", "0", "0"}));
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), 'ss') FROM kv")
+            == (vector<string>{"-1", "-1", "2"}));
+    CHECK(query("SELECT regexp_like(fl_value(body, 's'), '^hello') FROM kv")
+            == (vector<string>{"1", "0", "0"}));
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), 'pi$') FROM kv")
+            == (vector<string>{"-1", "-1", "9"}));
+    // Character classes & quantifiers:
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), '\\d+-\\d{4}') FROM kv")
+            == (vector<string>{"-1", "6", "-1"}));
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), '[aeiou]s*i') FROM kv")
+            == (vector<string>{"-1", "-1", "1"}));
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), 'o.*o') FROM kv")
+            == (vector<string>{"4", "-1", "-1"}));
+    CHECK(query("SELECT regexp_like(fl_value(body, 's'), '^[a-z ]+$') FROM kv")
+            == (vector<string>{"1", "0", "1"}));
+    // Patterns that need std::regex:
+    CHECK(query("SELECT regexp_position(fl_value(body, 's'), '(ss|pp)i$') FROM kv")
+            == (vector<string>{"-1", "-1", "8"}));
+    CHECK(query("SELECT regexp_replace(fl_value(body, 's'), 's+', 'z') FROM kv")
+            == (vector<string>{"hello world", "Phone 555-1212", "mizizippi"}));
+    CHECK(query("SELECT regexp_replace(fl_value(body, 's'), '(\\w)(\\w*)', '$2$1', 1) FROM kv")
+            == (vector<string>{"elloh world", "honeP 555-1212", "ississippim"}));
+    CHECK(query("SELECT regexp_like(fl_value(body, 's'), NULL) FROM kv")
+            == (vector<string>{"MISSING", "MISSING", "MISSING"}));
+    CHECK_THROWS(query("SELECT regexp_like(fl_value(body, 's'), '(') FROM kv"));
+}
+
 static void testTrim(const char16_t *str, int onSide, int leftTrimmed, int rightTrimmed) {
     auto newStr = str;
     size_t length = 0;
@@ -18,6 +18,8 @@
 
 #include "c4Internal.hh"
 #include "c4Private.h"
+#include "SecureDigest.hh"
+#include "Delta.hh"
 #include "catch.hpp"
 
 
@@ -70,3 +72,79 @@ TEST_CASE("C4Error exceptions") {
     string messageStr = result2string(message);
     CHECK(messageStr == "Oops");
 }
+
+
+static string digestString(const uint8_t *digest) {
+    char hex[41];
+    for (int i = 0; i < 20; i++)
+        sprintf(&hex[2*i], "%02x", digest[i]);
+    return string(hex);
+}
+
+
+static void testSHA1Digests() {
+    uint8_t digest[20];
+    SHA1Digester d;
+    d.begin();
+    d.end(digest);
+    CHECK(digestString(digest) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    d.begin();
+    d.add("ab", 2);
+    d.add("c", 1);
+    d.end(digest);
+    CHECK(digestString(digest) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    string as(1000, 'a');
+    d.begin();
+    d.add(as.data(), as.size());
+    d.end(digest);
+    CHECK(digestString(digest) == "291e9a6c66994949b57ba5e650361e98fc36b1ba");
+
+    // Batch digests of messages of all sizes, each split into two pieces, must match the
+    // one-at-a-time digests:
+    const size_t kNMessages = 200;
+    vector<slice> pieces;
+    for (size_t i = 0; i < kNMessages; i++) {
+        pieces.push_back(slice(as.data(), i / 2));
+        pieces.push_back(slice(as.data(), i - i / 2));
+    }
+    vector<uint8_t> digests(20 * kNMessages);
+    SHA1Digester::digestMany(pieces.data(), 2, kNMessages, digests.data());
+    for (size_t i = 0; i < kNMessages; i++) {
+        d.begin();
+        d.add(as.data(), i);
+        d.end(digest);
+        CHECK(memcmp(&digests[20*i], digest, 20) == 0);
+    }
+}
+
+
+TEST_CASE("SHA-1 digests") {
+    // Test the portable/SIMD-lane code, then the CPU's SHA instructions if it has them:
+    SHA1Digester::enableHardware(false);
+    testSHA1Digests();
+    SHA1Digester::enableHardware(true);
+    INFO("Hardware accelerated: " << SHA1Digester::hardwareAccelerated());
+    testSHA1Digests();
+}
+
+
+TEST_CASE("Binary deltas") {
+    string base;
+    for (int i = 0; i < 100; ++i)
+        base += "\"property" + to_string(i) + "\":" + to_string(i * i) + ",";
+    string target = base;
+    target.replace(500, 10, "CHANGED");
+    target += "\"new\":true";
+
+    alloc_slice delta = CreateDelta(slice(base), slice(target));
+    REQUIRE(delta);
+    CHECK(delta.size < target.size() / 10);
+    CHECK(ApplyDelta(slice(base), delta) == slice(target));
+
+    // Unrelated data has no worthwhile delta:
+    CHECK(!CreateDelta(slice(base), slice("This string has nothing in common with the base.")));
+
+    // A damaged delta is detected:
+    CHECK_THROWS_AS(ApplyDelta(slice(base), slice(delta.buf, delta.size - 1)), litecore::error);
+    CHECK_THROWS_AS(ApplyDelta(slice(base.data(), 100), delta), litecore::error);
+}
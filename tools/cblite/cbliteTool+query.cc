@@ -25,6 +25,7 @@ void CBLiteTool::queryUsage() {
     "  Runs a query against the database."
     "    --offset N : Skip first N rows\n"
     "    --limit N : Stop after N rows\n"
+    "    --profile : Instead of the results, show how the query executed (rows visited, time)\n"
     "    " << it("JSONQUERY") << " : LiteCore JSON (or JSON5) query expression\n"
     ;
 }
@@ -49,8 +50,10 @@ void CBLiteTool::queryDatabase() {
 
     // Set parameters:
     alloc_slice params;
+    C4QueryOptions options = kC4DefaultQueryOptions;
     if (_offset > 0 || _limit >= 0) {
-        JSONEncoder enc;
+        Encoder enc;
+        options.fleeceParameters = true;
         enc.beginDict();
         enc.writeKey("offset"_sl);
         enc.writeInt(_offset);
@@ -60,8 +63,17 @@ void CBLiteTool::queryDatabase() {
         params = enc.finish();
     }
 
+    if (_profile) {
+        // Run query, and show the report instead of the results:
+        alloc_slice report = c4query_profile(query, &options, params, &error);
+        if (!report)
+            fail("running query", error);
+        cout << report.asString();
+        return;
+    }
+
     // Run query:
-    c4::ref<C4QueryEnumerator> e = c4query_run(query, nullptr, params, &error);
+    c4::ref<C4QueryEnumerator> e = c4query_run(query, &options, params, &error);
     if (!e)
         fail("starting query", error);
     if (_offset > 0)
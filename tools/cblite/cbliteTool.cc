@@ -203,6 +203,7 @@ const Tool::FlagSpec CBLiteTool::kInteractiveSubcommands[] = {
 const Tool::FlagSpec CBLiteTool::kQueryFlags[] = {
     {"--offset", (FlagHandler)&CBLiteTool::offsetFlag},
     {"--limit",  (FlagHandler)&CBLiteTool::limitFlag},
+    {"--profile", (FlagHandler)&CBLiteTool::profileFlag},
     {"--help",   (FlagHandler)&CBLiteTool::helpFlag},
     {nullptr, nullptr}
 };
@@ -147,6 +147,7 @@ private:
         _prettyPrint = true;
         _json5 = false;
         _showHelp = false;
+        _profile = false;
     }
 
 
@@ -164,6 +165,7 @@ private:
     void json5Flag()     {_json5 = true; _enumFlags |= kC4IncludeBodies;}
     void rawFlag()       {_prettyPrint = false; _enumFlags |= kC4IncludeBodies;}
     void helpFlag()      {_showHelp = true;}
+    void profileFlag()   {_profile = true;}
     void existingFlag()  {_createDst = false;}
     void carefulFlag()   {_failOnError = true;}
     void jsonIDFlag()    {_jsonIDProperty = nextArg("JSON-id property");}
@@ -194,6 +196,7 @@ private:
     bool _json5 {false};
     bool _showRevID {false};
     bool _showHelp {false};
+    bool _profile {false};
     bool _createDst {true};
     alloc_slice _jsonIDProperty;
 